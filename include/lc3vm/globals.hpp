@@ -9,6 +9,14 @@
 #define SCREEN_WIDTH    2048
 #define SCREEN_HEIGHT   1152
 
+/*
+    The memory bus works on 256-word pages. pageFlags[] holds one byte per page,
+    read_memory()/write_memory() only leave the fast path when the byte is non-zero.
+*/
+#define PAGE_SHIFT      8
+#define PAGE_WORDS      (1 << PAGE_SHIFT)
+#define PAGE_COUNT      (MAX_SIZE >> PAGE_SHIFT)
+
 enum
 {
     OP_BR = 0,
@@ -29,6 +37,66 @@ enum
     OP_TRAP
 };
 
+// LC-3 specific BEGIN ------------------------------------------
+enum
+{
+	R_R0 = 0, R_R1, R_R2, R_R3, R_R4, R_R5, R_R6, R_R7,
+	R_PC, 
+	R_COND, 
+	R_COUNT
+};
+
+// Condition codes are supposed to be in R[COND]'s bit-0/1/2, to be used in BR
+enum
+{
+	FL_POS = 1 << 0,	// P
+	FL_ZRO = 1 << 1,	// Z
+	FL_NEG = 1 << 2		// N
+};
+
+enum
+{
+    MR_KBSR = 0xFE00, /* keyboard status */
+    MR_KBDR = 0xFE02, /* keyboard data */
+    MR_DSR  = 0xFE04, /* display status */
+    MR_DDR  = 0xFE06, /* display data */
+    MR_MCR  = 0xFFFE  /* machine control */
+};
+
+// Clearing it stops the machine, an OS's HALT routine does that
+#define MCR_CLOCK_ENABLE    (1 << 15)
+
+enum
+{
+    KBSR_READY = 1 << 15,   // a key is in KBDR
+    KBSR_IE    = 1 << 14    // set by the guest: a key raises an interrupt instead of waiting to be polled
+};
+
+// The display takes a byte in DDR at any time, DSR always reads ready
+#define DSR_READY   (1 << 15)
+
+/*
+    Processor status register. The condition codes (bits 2-0) live in reg[R_COND], the privilege and
+    the priority in the core's psr, see psr_read()
+*/
+enum
+{
+    PSR_USER           = 1 << 15,  // 0 is supervisor mode
+    PSR_PRIORITY_SHIFT = 8,
+    PSR_PRIORITY       = 0x7 << PSR_PRIORITY_SHIFT
+};
+
+// Interrupt and exception vectors, the handler addresses are in the table at INT_TABLE
+enum
+{
+    INT_TABLE          = 0x0100,
+    INT_PRIVILEGE      = 0x00,     // RTI in user mode
+    INT_KEYBOARD       = 0x80,
+    INT_KEYBOARD_LEVEL = 4         // the keyboard's priority
+};
+
+// LC-3 specific END --------------------------------------------
+
 enum {
 	DEBUG_OFF = 0,
 	DEBUG_ON,
@@ -37,6 +105,22 @@ enum {
 
 extern uint8_t DEBUG_MODE;
 
+enum
+{
+    PAGE_WATCH = 1 << 0,    // at least one watchpoint covers this page
+    PAGE_HEAT  = 1 << 1,    // the heatmap counts accesses to this page
+    PAGE_TRACE = 1 << 2,    // the trace recorder logs writes to this page
+    PAGE_JOURNAL = 1 << 3,  // the undo journal saves the old value of writes to this page
+    PAGE_COW   = 1 << 4,    // the page is still the one machine_clone()/machine_switch() left, see lc3vmwin_machine.hpp
+    PAGE_HANG  = 1 << 5,    // the infinite loop detector hashes writes to this page, see lc3vmwin_hang.hpp
+    PAGE_DEVICE = 1 << 6,   // a device register on this page acts on writes (DDR, MCR)
+
+    // EXPLAIN: The flags that care about loads, the rest only send writes to the slow path
+    PAGE_READ_FLAGS = PAGE_WATCH | PAGE_HEAT
+};
+
+extern uint8_t pageFlags[];
+
 enum Error
 {
     ERROR_LOADFILE = 1,
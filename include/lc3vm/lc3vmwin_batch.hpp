@@ -0,0 +1,64 @@
+#pragma once
+
+/*
+    Lockstep batch engine: runs up to BATCH_LANES copies of the machine at once, one per SIMD lane, each with
+    its own keys, for scripted workloads where many runs of one image differ only in their input.
+
+    Registers are laid out struct-of-arrays (one vector per register, a lane per machine) and memory is
+    interleaved, word w of every lane side by side, so that an access all lanes make to the same address is
+    one vector load or store. Each step picks a group: the lanes at the same PC as the first lane, or when
+    the lanes have split up, the ones at the lowest PC (the lanes behind catch up and the group merges again
+    where the paths meet). The instruction is decoded once and executed on the group's lanes under an active
+    mask, the other lanes keep their registers. Accesses to per-lane addresses (LDR/STR/LDI/STI), the keyboard
+    and display registers and the TRAPs go lane by lane.
+
+    The results are the same as the core's, lc3vm_headless --simd-check compares the two:
+    - the semantics are those of the op_* and trap_* functions in lc3vmwin_core.cpp, including the
+      host versions of OUT/PUTS/PUTSP and what they do with 2048's escape sequences, and the display
+      registers: DSR reads ready and a byte stored through STI/STR to DDR goes to the lane's console
+    - a run stops the way the headless runner stops: HALT or asking for a key after the last one only
+      take effect at the end of the block (the next BR/JSR/JMP/RTI), the instruction limit is checked there too
+    - instructions are always taken from memory, the core runs its decoded blocks. They only differ for
+      code that modifies itself after it ran
+    - the lanes have no interrupts and no privilege: KBSR_IE is only a bit in memory and RTI does nothing,
+      as with a guest that has no vector table. Interrupt driven programs need the core
+    - TRAPs are the built-in native ones, trapTable[] (lc3vmwin_trap.hpp) isn't looked at
+    Console output isn't kept, each lane hashes it (see batch_console_hash()).
+
+    Built with GCC/Clang vector extensions, on x86-64 Linux the engine is compiled twice and picks the
+    AVX2 version at load time when the CPU has it, SSE2 otherwise.
+*/
+
+#include "globals.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#define BATCH_LANES             16
+#define BATCH_CONSOLE_CLEAR     0x100       // hashed in place of a character when the guest clears the screen
+
+enum
+{
+    BATCH_HALT = 0,
+    BATCH_END_OF_KEYS,          // asked for a key after the last one
+    BATCH_INSTRUCTION_LIMIT,
+    BATCH_BAD_ESCAPE            // PUTS met an escape sequence the console can't parse, the core exits on that
+};
+
+struct lc3BatchResult
+{
+    uint64_t instructions;
+    int stop;                   // BATCH_*
+    uint64_t stateHash;         // core_state_hash() of the lane's machine at the end
+    uint64_t consoleHash;
+};
+
+/* FNV-1a step over a console character (or BATCH_CONSOLE_CLEAR), start from BATCH_CONSOLE_HASH_START */
+#define BATCH_CONSOLE_HASH_START    UINT64_C(14695981039346656037)
+uint64_t batch_console_hash(uint64_t hash, int value);
+
+/*
+    Runs keys[0..count-1] (count <= BATCH_LANES), each from the machine in reg[]/memory[] as it is now,
+    until it stops or has run maxInstructions (at most UINT32_MAX). The machine itself isn't changed
+*/
+void batch_run(const std::string* keys, int count, uint64_t maxInstructions, struct lc3BatchResult* results);
@@ -0,0 +1,113 @@
+#pragma once
+
+/*
+    Address breakpoints with optional conditions.
+
+    A condition is typed as text in the disassembly window, e.g.
+        R0 == x0F && mem[xFE02] != 0
+        hits >= 100
+    and is compiled ONCE into a small stack bytecode (bpCondition).
+    The interpreter only evaluates it when breakpointMap[] says the address
+    being executed carries a breakpoint, and evaluation never allocates.
+
+    Grammar (lowest to highest precedence):
+        ||    &&    == != < <= > >=    | ^    &    + -    unary ! ~ -
+    Operands:
+        R0-R7, PC, COND, hits, mem[expr], (expr)
+        numbers as x0F / 0x0F (hex), #12 / 12 (decimal), b0101 (binary)
+
+    Arithmetic wraps at 16 bits like the LC-3 itself, comparisons are unsigned.
+    `hits` is the number of times the address has been reached (this time included).
+*/
+
+#include "globals.hpp"
+#include <cstdint>
+#include <string>
+
+#define BREAKPOINT_MAX      64      // breakpointMap[] stores index + 1 in the low 7 bits
+#define BP_CODE_MAX         64      // bytecode instructions per condition
+#define BP_STACK_MAX        16      // evaluation stack depth, checked at compile time
+#define BP_TEXT_MAX         128
+
+enum bpOpcode
+{
+    BP_PUSH_CONST = 0,
+    BP_PUSH_REG,
+    BP_PUSH_HITS,
+    BP_LOAD,        // pop address, push mem[address]
+    BP_NOT,
+    BP_BITNOT,
+    BP_NEG,
+    BP_ADD,
+    BP_SUB,
+    BP_AND,
+    BP_OR,
+    BP_XOR,
+    BP_EQ,
+    BP_NE,
+    BP_LT,
+    BP_LE,
+    BP_GT,
+    BP_GE,
+    BP_LAND,
+    BP_LOR
+};
+
+struct bpInstr
+{
+    uint8_t op;
+    uint32_t operand;   // constant for BP_PUSH_CONST, register index for BP_PUSH_REG
+};
+
+struct bpCondition
+{
+    struct bpInstr code[BP_CODE_MAX];
+    int length;         // 0 means unconditional
+};
+
+struct lc3Breakpoint
+{
+    uint16_t address;
+    bool enabled;
+    uint32_t hits;
+    struct bpCondition condition;
+    char conditionText[BP_TEXT_MAX];
+};
+
+extern struct lc3Breakpoint breakpoints[];
+extern int breakpointCount;
+/*
+    EXPLAIN: one byte per LC-3 address, 0 if nothing stops there.
+    Low 7 bits: index + 1 of the user breakpoint at that address.
+    BP_MAP_TEMPORARY: the one-shot stop used by step-over and run-to-cursor.
+*/
+#define BP_MAP_INDEX        0x7F
+#define BP_MAP_TEMPORARY    0x80
+extern uint8_t breakpointMap[];
+
+/* Compile text into cond, returns false and fills error if the text does not parse */
+bool bp_compile(const char* text, struct bpCondition* cond, std::string& error);
+uint32_t bp_eval(const struct bpCondition* cond, const uint16_t reg[], const uint16_t memory[], uint32_t hits);
+
+/* Returns the index of the breakpoint, or -1 with error filled */
+int bp_add(uint16_t address, const char* conditionText, std::string& error);
+void bp_remove(int index);
+void bp_clear();
+
+/*
+    One-shot stop at address, removed as soon as it is reached.
+    depth is the callDepth it must be reached at (step-over of a recursive call), -1 for any depth.
+*/
+void bp_set_temporary(uint16_t address, int depth);
+void bp_clear_temporary();
+
+/* Called by the interpreter when breakpointMap[address] != 0, returns true if execution should stop */
+bool bp_check(uint16_t address, const uint16_t reg[], const uint16_t memory[]);
+/*
+    Same test as bp_check() for user breakpoints only, without counting a hit. For reverse execution:
+    laterHits is how many hits bp_check() counted at address from this step on, so the condition sees
+    hits as it was when execution reached this step
+*/
+bool bp_matches(uint16_t address, const uint16_t reg[], const uint16_t memory[], uint32_t laterHits);
+/* True if the condition of an enabled breakpoint reads hits */
+bool bp_uses_hits();
@@ -10,6 +10,8 @@ struct lc3Cache
 	uint16_t 	lc3MemAddress;
 	int 		numInstr;
 	uint16_t* 	codeBlock;
+	uint8_t		idiom;		// lc3IdiomKind of the loop the block ends with, see lc3vmwin_idiom.hpp
+	int			idiomHead;	// index of the loop's first line
 };
 
 /* EXPLAIN: For cache_find(), need to return index of cache and index of code */
@@ -27,6 +29,8 @@ extern struct lc3Cache codeCache[];
 struct lc3Cache cache_create_block(uint16_t memory[], uint16_t lc3Address);
 void cache_clear();
 void cache_add(struct lc3Cache c);
+/* Drops the blocks that have an instruction in [begin, end], returns how many */
+int cache_invalidate(int begin, int end);
 // int cache_find(uint16_t address);
 struct codeLocation cache_find(uint16_t address);
 
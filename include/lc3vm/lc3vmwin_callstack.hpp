@@ -0,0 +1,31 @@
+#pragma once
+
+/*
+    Shadow call stack of the guest.
+
+    LC-3 has no call stack of its own, JSR/JSRR only put the return address in R7.
+    We keep our own by watching the instructions that end a code block (see is_branch()):
+    - JSR/JSRR pushes a frame, so does a TRAP whose service routine runs in guest code (lc3vmwin_trap.hpp)
+    - RET (JMP R7) pops back to the frame whose return address it jumps to
+
+    Natively emulated TRAPs never show up here.
+*/
+
+#include "globals.hpp"
+#include <cstdint>
+
+#define CALLSTACK_MAX   256
+
+struct lc3Frame
+{
+    uint16_t callSite;          // address of the JSR/JSRR
+    uint16_t target;            // first instruction of the subroutine
+    uint16_t returnAddress;     // callSite + 1
+};
+
+extern struct lc3Frame callStack[];
+extern int callDepth;
+
+void callstack_reset();
+/* Call after executing the last instruction of a code block, with the PC already updated */
+void callstack_update(uint16_t instr, uint16_t address, uint16_t newPC);
@@ -0,0 +1,147 @@
+#pragma once
+
+/*
+    The LC-3 machine itself: registers, memory, the memory bus, the instruction/trap functions
+    and the block dispatcher. It knows nothing about SDL or ImGui so that both the GUI
+    (lc3vmimgui.cpp) and the headless runner (lc3vmheadless.cpp) are built on it.
+
+    Whatever the front end has to do for the machine goes through the lc3Host hooks.
+    Any of them may be nullptr.
+
+    Interrupts: the guest enables the keyboard interrupt with KBSR_IE. A pending key is then delivered
+    through INT_TABLE[INT_KEYBOARD] as soon as the running priority is below INT_KEYBOARD_LEVEL, but only
+    between blocks (core_run_block()), so a block never has to check. Entry pushes PSR and PC on the
+    supervisor stack (switching from R6 = USP to the saved SSP in user mode) and RTI pops them again.
+    RTI in user mode raises the privilege exception INT_PRIVILEGE if its table entry isn't 0.
+    Memory access control (ACV) isn't checked.
+*/
+
+#include "globals.hpp"
+#include "lc3vmwin_cache.hpp"
+#include <cstddef>
+#include <cstdint>
+
+struct lc3Host
+{
+    /* Guest console output (OUT/PUTS/PUTSP, DDR), already stripped of the escape sequences 2048 uses. Batched, only display_flush() calls it */
+    void (*console_write)(const char* text, size_t length);
+    /* The guest cleared the screen */
+    void (*console_clear)();
+    /* Called when the guest reads KBSR or GETCs with no key pending, and between blocks while KBSR_IE is set and no key is pending. May call core_key_press() */
+    void (*input_poll)();
+    /*
+        Step-in mode: called before the instruction at index of the block runs.
+        Return true to run it, false to return to the caller without running it.
+        Without this hook nothing waits and step-in mode runs like normal mode.
+    */
+    bool (*step_wait)(const struct lc3Cache& cache, int index);
+    /* A new code block was created at codeCache[cacheIndex] */
+    void (*block_created)(int cacheIndex);
+    /* A watchpoint was hit, watchHit has the details. The machine is already in step-in mode */
+    void (*watch_hit)();
+    /* The guest ran RTI in user mode with no privilege handler, the reserved opcode (other than a native service, lc3vmwin_native.hpp) or a TRAP whose vector has no handler (lc3vmwin_trap.hpp). Without this hook it is printed and skipped */
+    void (*illegal_instruction)(uint16_t instr);
+};
+
+extern struct lc3Host host;
+
+// Registers
+extern uint16_t reg[];
+// RAM
+extern uint16_t memory[];
+
+extern bool keyPressed;
+extern uint8_t lastKeyPressed;
+
+/* PSR_USER and the priority, reg[R_COND] has the rest of the PSR */
+extern uint16_t psr;
+/* The stack pointer of the mode that isn't running, R6 is the running one's */
+extern uint16_t savedSSP;
+extern uint16_t savedUSP;
+
+/* false once the guest HALTs */
+extern bool isRunning;
+/* Step-in "debugging", see cache_run() */
+extern bool isStepIn;
+/* Set when the user continues from an address that has a breakpoint, so that we don't stop on it again right away */
+extern bool breakpointResume;
+/* Step-out stops at the first RET that leaves callDepth below this, -1 when not stepping out */
+extern int stepOutDepth;
+/* Instructions executed since core_reset() */
+extern uint64_t retiredCount;
+/* core_run_block() stops before the instruction that would take retiredCount past this, UINT64_MAX for no limit */
+extern uint64_t retiredLimit;
+/* KBSR reads, GETCs and polls for the keyboard interrupt since core_reset(), times the guest looked at the keyboard */
+extern uint64_t keyboardReads;
+
+extern void (*instr_call_table[])(uint16_t);
+
+/* Clears the registers and every per-run table, PC starts at pc */
+void core_reset(uint16_t pc);
+/* Loads an .obj file, resets the machine at its origin and loads the .sym next to it if there is one */
+bool core_load(const char* path);
+void core_key_press(uint8_t key);
+/* The front end saw the key go up, a key that wasn't read yet is lost */
+void core_key_release();
+/* Installs or removes the per-instruction hook wrappers, call after turning journalEnabled/traceEnabled on or off */
+void core_hooks_update();
+/* Executes exactly one instruction at PC, without breakpoints or the code cache (reverse execution replays with it) */
+void core_step();
+/* Number of the instruction that is running, exact in the middle of a block. Only meaningful during an instruction */
+uint64_t core_current_step();
+/* Hash of the registers, memory[] and the keyboard, equal states hash equal */
+uint64_t core_state_hash();
+/* The whole PSR as the guest sees it, psr with the condition codes */
+uint16_t psr_read();
+/* Interrupt or exception entry: pushes PSR and PC on the supervisor stack and jumps through INT_TABLE[vector] */
+void core_interrupt(uint8_t vector, uint8_t priority);
+/* The keyboard interrupt: hands the pending key to KBSR/KBDR and enters INT_KEYBOARD. Not journaled, see journal_interrupt() */
+void core_keyboard_interrupt();
+
+/* One trip through the dispatcher: find (or create) the block at PC and run it */
+void core_run_block();
+void cache_run(struct lc3Cache cache, int beginIndex);
+
+uint16_t read_memory(uint16_t index);
+/* KBSR/KBDR/DSR update themselves when read, read_memory() calls it for page xFE */
+void read_device(uint16_t index);
+uint16_t read_uint16_t(uint16_t index);
+void write_memory(uint16_t index, uint16_t value);
+void read_memory_slow(uint16_t index);
+void write_memory_slow(uint16_t index, uint16_t value);
+void watch_stop();
+
+// lc-3 instruction functions
+void op_br(uint16_t instr);
+void op_add(uint16_t instr);
+void op_ld(uint16_t instr);
+void op_st(uint16_t instr);
+void op_jsr(uint16_t instr);
+void op_and(uint16_t instr);
+void op_ldr(uint16_t instr);
+void op_str(uint16_t instr);
+void op_rti(uint16_t instr);
+void op_not(uint16_t instr);
+void op_ldi(uint16_t instr);
+void op_sti(uint16_t instr);
+void op_jmp(uint16_t instr);
+void op_res(uint16_t instr);
+void op_lea(uint16_t instr);
+void op_trap(uint16_t instr);
+
+void update_flag(uint16_t value);
+
+/* IN prints this before it waits for the key, then echoes the key and a newline, like the LC-3 OS */
+#define TRAP_IN_PROMPT      "\nInput a character> "
+
+// trap functions
+void trap_0x20();
+void trap_0x21();
+void trap_0x21_host();
+void trap_0x22();
+void trap_0x22_host();
+void trap_0x23();
+void trap_0x24();
+void trap_0x24_host();
+void trap_0x25();
+void parse_escape(uint16_t memory[], uint16_t& index);
@@ -2,6 +2,10 @@
 
 #include "globals.hpp"
 #include "lc3vmwin_disa_be.hpp"
+#include "lc3vmwin_breakpoint.hpp"
+#include "lc3vmwin_watch.hpp"
+#include "lc3vmwin_callstack.hpp"
+#include "lc3vmwin_heatmap.hpp"
 #include <imgui.h>
 #include <string>
 #include <vector>
@@ -37,6 +41,46 @@ public:
     bool initialized;
     bool stepInSignal;
     int stepInLine;
+    /* Consumed by the interpreter loop, same as stepInSignal */
+    bool continueSignal;
+    bool breakSignal;
+    bool stepOverSignal;
+    bool stepOutSignal;
+    bool reverseStepSignal;
+    bool reverseContinueSignal;
+    bool saveStateSignal;
+    bool loadStateSignal;
+    bool recordInputSignal;
+    bool replayInputSignal;
+    bool stopInputSignal;
+    int runToAddress;       // -1 for none
+    int runToDepth;         // callDepth to reach runToAddress at, -1 for any
+
+    /* Breakpoint editor */
+    char bpAddressInput[5];
+    char bpConditionInput[BP_TEXT_MAX];
+    std::string bpError;
+
+    /* Watchpoint editor, watchHitAddress is the instruction that hit one (-1 for none) */
+    char watchBeginInput[5];
+    char watchEndInput[5];
+    bool watchRead;
+    bool watchWrite;
+    bool watchChange;
+    int watchHitAddress;
+
+    /* Trace recorder controls */
+    char tracePathInput[256];
+    int traceMaxMB;
+
+    /* Save state controls, the signals above carry them out between blocks */
+    char statePathInput[256];
+    bool stateWithCache;
+    std::string stateError;
+
+    /* Input log controls, same */
+    char inputLogPathInput[256];
+    std::string inputLogError;
 
     LC3VMdisawindow();
     LC3VMdisawindow(uint16_t instrStream[], uint16_t numInstr, uint16_t address, const WindowConfig& config);
@@ -45,5 +89,11 @@ public:
     void Load_Config(const WindowConfig& config);
     void Load(uint16_t instrStream[], uint16_t numInstr, uint16_t address);
     void Draw(void);
-    
+    void Draw_Breakpoints(void);
+    void Draw_Watchpoints(void);
+    void Draw_Callstack(void);
+    void Draw_Trace(void);
+    void Draw_Savestate(void);
+    void Draw_Input_Log(void);
+
 };
\ No newline at end of file
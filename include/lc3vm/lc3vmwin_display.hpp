@@ -0,0 +1,33 @@
+#pragma once
+
+/*
+    The display device and the console output path.
+
+    Everything the guest puts on the console comes through here: writes to DDR (xFE06) on the memory bus, and the
+    native OUT/PUTS/PUTSP/IN and the PUTSN service, which used to call host.console_write once per character.
+    The bytes go into a ring of DISPLAY_RING_BYTES and reach host.console_write in as few calls as display_flush()
+    can make of them. Whoever runs the core flushes once per slice: the GUI every frame, the headless tools when
+    a run (or a --batch line, a farm job) ends. The core flushes by itself when the ring is full and before a
+    screen clear or anything it prints itself, so the order always stays the same.
+
+    DSR (xFE04) always reads ready, output never has to wait. A guest that polls DSR before each DDR write, like an
+    OS's OUT routine (lc3vmwin_trap.hpp), goes straight through. DDR takes the low byte as it is, without the escape
+    sequence handling of the native PUTS.
+
+    The ring is lock-free, single producer (the core) and single consumer (display_flush()), on positions that only
+    ever grow. Every front end flushes on the core's own thread, which the core flushing a full ring relies on.
+    With host.console_write nullptr (--quiet, a journal replay) nothing is kept.
+*/
+
+#include "globals.hpp"
+#include <cstddef>
+#include <cstdint>
+
+#define DISPLAY_RING_BYTES  (64 * 1024)
+
+/* Queues length bytes of console output */
+void display_write(const char* text, size_t length);
+/* Hands the queued output to host.console_write */
+void display_flush();
+/* Drops the queued output, called by core_reset() */
+void display_reset();
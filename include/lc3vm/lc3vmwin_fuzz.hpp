@@ -0,0 +1,55 @@
+#pragma once
+
+/*
+    Fuzzing engine: runs the loaded program on one keyboard input after another, from the same start state,
+    and tells the caller what each input did. The driver (mutations, corpus, worker processes) is lc3fuzz.cpp.
+
+    Every execution
+    - starts from the machine fuzz_init() captured, machine_reset() puts back only the pages the previous
+      execution wrote (see lc3vmwin_machine.hpp), the code cache stays
+    - hands the guest the input one key each time it polls KBSR or GETCs with none pending, like the
+      headless --keys, and ends normally when the guest HALTs or asks for a key after the last one
+    - records coverage as block edges: each trip through the dispatcher hits the edge from the previous
+      block's address to this one, counted in a 64K map and bucketed (1, 2, 3, 4-7, ... 128+) as AFL does
+    - ends with a fault on RTI in user mode (with no privilege handler), the reserved opcode or an unknown
+      TRAP vector, on a PC outside the program's code (checked per block, by page) and as a hang once it runs
+      more than the instruction limit
+
+    The map of buckets seen so far is passed in as atomics, so that worker processes can share one
+    in shared memory and only report coverage that no worker had yet.
+*/
+
+#include "globals.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#define FUZZ_MAP_SIZE   (1 << 16)
+
+enum
+{
+    FUZZ_OK = 0,        // HALT or out of input
+    FUZZ_ILLEGAL,       // RTI, reserved opcode or unknown TRAP vector
+    FUZZ_BAD_PC,        // dispatched outside the program's code
+    FUZZ_HANG,          // ran into the instruction limit
+    FUZZ_RESULT_COUNT
+};
+
+struct lc3FuzzResult
+{
+    int kind;                   // FUZZ_*
+    uint16_t pc;                // of the faulting instruction, the bad PC, or where the hang was stopped
+    uint64_t instructions;
+    size_t keysUsed;
+    int newBuckets;             // edge/bucket pairs nobody had seen
+    int newEdges;               // of those, edges nobody had seen at all
+};
+
+/*
+    Captures the loaded machine as the start state of every execution and installs the host hooks.
+    virgin holds FUZZ_MAP_SIZE entries, 0xFF for an edge never seen. limit is instructions per execution
+*/
+void fuzz_init(std::atomic<uint8_t>* virgin, uint64_t limit);
+/* Call after fuzz_init(): the PC may only be in from-to, instead of every page that held something when fuzz_init() ran */
+void fuzz_set_code(uint16_t from, uint16_t to);
+void fuzz_run(const uint8_t* keys, size_t length, struct lc3FuzzResult* result);
@@ -0,0 +1,47 @@
+#pragma once
+
+/*
+    Infinite loop detector: stops a run once the machine is back in a state it was in before without having
+    looked at the keyboard since. The LC-3 is deterministic, so from there it can only go round the same
+    loop forever.
+
+    The state is hashed at the end of every code block, at a constant cost:
+    - registers and the keyboard (keyPressed, lastKeyPressed, KBSR/KBDR) are mixed in directly
+    - memory is a sum over every word of mix(address, value), kept up to date by the writes themselves
+      through the pageFlags[] slow path (hang_enable() flags every page with PAGE_HANG). The sum starts at 0
+      on hang_reset(), equal memory gives an equal sum no matter which writes led to it
+    - repeats are found with Brent's algorithm: the hash is remembered at blocks 1, 2, 4, 8... since the last
+      keyboard read and every block is compared with the one remembered. A loop is found within about twice
+      its length plus the time it took to enter it, and no history is kept
+
+    A read of KBSR or a GETC starts over: the program might be waiting for a key, that's no hang.
+    Equal hashes are taken for equal states, two states would have to collide in 64 bits.
+
+    Whatever writes memory[] behind the bus starts it over: machine_forget_base() and the machine switches
+    call hang_reset().
+*/
+
+#include "globals.hpp"
+#include <cstdint>
+
+struct lc3HangReport
+{
+    bool detected;
+    uint16_t pcLow;         // addresses the loop runs, wrap-around ignored
+    uint16_t pcHigh;
+    uint64_t period;        // instructions per trip round the loop
+    uint64_t at;            // retiredCount when it was found
+};
+
+extern bool hangEnabled;
+/* What the last run got stuck in, detected is false while it isn't */
+extern struct lc3HangReport hangReport;
+
+void hang_enable(bool enable);
+/* Forget the history and the report, the run starts over from the machine as it is */
+void hang_reset();
+
+/* End of a code block, count instructions from address were run. Stops the machine (isRunning) on a repeat */
+void hang_block(uint16_t address, int count);
+/* PAGE_HANG slow path, memory[index] is about to go from oldValue to value */
+void hang_on_write(uint16_t index, uint16_t oldValue, uint16_t value);
@@ -0,0 +1,35 @@
+#pragma once
+
+/*
+    Per-address counters for finding guest hotspots and polling loops:
+    executions of each instruction address, and data reads/writes of each memory word.
+
+    Nothing is counted while the heatmap is off, and turning it on doesn't touch the per-instruction loop:
+    - executions are added once per code block for the range that just ran
+    - data accesses go through the pageFlags[] slow path, heatmap_enable() flags every page with PAGE_HEAT
+*/
+
+#include "globals.hpp"
+#include <cstdint>
+
+enum
+{
+    HEAT_EXEC = 0,
+    HEAT_READ,
+    HEAT_WRITE,
+    HEAT_ALL,       // sum of the above, for display only
+    HEAT_COUNT
+};
+
+extern uint32_t heatExec[];
+extern uint32_t heatRead[];
+extern uint32_t heatWrite[];
+extern bool heatmapEnabled;
+
+void heatmap_enable(bool enable);
+void heatmap_clear();
+
+/* count consecutive instructions starting at address have been executed */
+void heatmap_exec(uint16_t address, int count);
+
+uint32_t heatmap_get(uint16_t address, int kind);
@@ -0,0 +1,50 @@
+#pragma once
+
+/*
+    Idiom recognition: counted loops the LC-3 needs for what other machines have an instruction for,
+    run as one native operation instead of trip by trip.
+
+    A loop is the end of a code block that branches back to its own first line with BRp (or BRnp) right
+    after `ADD Rc, Rc, #-1`, Rc being the counter. Whatever comes before the loop head in the same block
+    (the setup that falls into it) doesn't matter. cache_create_block() matches the block's tail against
+    these shapes and stores the result in lc3Cache.idiom and lc3Cache.idiomHead:
+
+        IDIOM_SHIFT     ADD Rd, Rd, Rd                      Rd <<= Rc
+        IDIOM_MULTIPLY  ADD Ra, Ra, Rb  (or Rb, Ra)         Ra += Rb * Rc
+        IDIOM_COPY      LDR Rt, Rs, #a                      Rc words from Rs + a to Rd + b, one at a time
+                        STR Rt, Rd, #b
+                        ADD Rs, Rs, #1   ADD Rd, Rd, #1     (either order)
+
+    followed by the counter and the branch. The registers named in a shape are all different.
+
+    cache_run() calls idiom_run() whenever it enters the block at the loop head, which is every trip but
+    the first. idiom_run() does every trip but the last one natively and leaves that one to cache_run(), so the
+    final COND, PC and the end of block bookkeeping come out of the interpreter itself. It runs nothing
+    (returns 0) whenever something has to see the instructions one by one or the loop isn't the plain case:
+    - the counter isn't above 1 (signed), the count is exactly Rc only then
+    - step-in, a breakpoint in the block, the journal, the trace, ISA stats, the heatmap, an input replay
+      or a retiredLimit inside the loop
+    - for IDIOM_COPY: a source or destination word past xFDFF (the device registers) or on a page with
+      a watchpoint or the heatmap. The copy goes through read_memory()/write_memory(), so copy-on-write
+      pages, the hang detector and overlapping ranges behave as if the loop ran
+*/
+
+#include "globals.hpp"
+#include "lc3vmwin_cache.hpp"
+#include <cstdint>
+
+enum lc3IdiomKind
+{
+    IDIOM_NONE = 0,
+    IDIOM_SHIFT,
+    IDIOM_MULTIPLY,
+    IDIOM_COPY
+};
+
+/* On by default, off to compare against the plain interpreter */
+extern bool idiomEnabled;
+
+/* The idiom the block ends with and the index of its head, IDIOM_NONE if it matches none of the shapes */
+uint8_t idiom_match(const uint16_t block[], int numInstr, uint16_t lc3MemAddress, int* head);
+/* At the loop head: runs all trips but the last, returns the instructions they retired (0 for none) */
+uint64_t idiom_run(const struct lc3Cache& cache);
@@ -0,0 +1,81 @@
+#pragma once
+
+/*
+    Input log: records every key the guest can see, stamped with the instruction it comes in at,
+    and replays it into the same machine so that the run comes out bit for bit the same.
+
+    A key reaches the guest in one of two ways:
+    - between blocks (the GUI's SDL events), it is there before instruction number retiredCount runs
+    - from host.input_poll while an instruction polls KBSR or GETCs (the headless --keys). A GETC gets it right away,
+      the KBSR read that polled still finds no key (READY clear) and the next one does
+    Both are logged with the exact instruction number (core_current_step() for the second kind).
+    The replayer sets retiredLimit so the core stops right at the next between-blocks event, and stands in for
+    host.input_poll to hand out the polled ones. Nothing else slows the replay down, it runs at full speed.
+
+    Recording starts by saving the machine next to the log (LOG.state, see lc3vmwin_savestate.hpp),
+    a replay starts by loading it, so a log doesn't depend on how the program was started.
+    The log ends with the instruction count and core_state_hash() at the end of the recording,
+    a replay that reaches that count with a different hash diverged.
+
+    Log file, text:
+        LC3INPUT 1
+        start STEP
+        press STEP KEY [poll]
+        release STEP
+        end STEP HASH          (HASH is 16 hex digits)
+
+    Reverse execution and the rewind buffer cut the recording back to where they went, and end a replay
+    (the user took over). Loading a state or switching machines during a recording isn't tracked.
+*/
+
+#include "globals.hpp"
+#include "lc3vmwin_savestate.hpp"
+#include <cstddef>
+#include <cstdint>
+
+#define INPUT_LOG_VERSION   1
+
+extern bool inputRecording;
+extern bool inputReplaying;
+
+enum
+{
+    INPUT_REPLAY_NONE = 0,      // no replay since the last start
+    INPUT_REPLAY_RUNNING,
+    INPUT_REPLAY_MATCHED,       // reached the end of the log with the recorded state
+    INPUT_REPLAY_DIVERGED,      // reached it with another state, or a polled key found no poll
+    INPUT_REPLAY_STOPPED        // stopped before the end of the log
+};
+
+struct lc3InputStatus
+{
+    bool recording;
+    bool replaying;
+    size_t events;              // in the recording, or in the log being replayed
+    size_t replayed;            // events handed to the guest so far
+    uint64_t startStep;
+    uint64_t endStep;           // of the log being replayed
+    int result;                 // INPUT_REPLAY_*
+};
+
+/* Saves the machine to path.state and starts logging, call between blocks */
+bool input_record_start(const char* path, const struct lc3SaveHost& hostState);
+/* Writes the log, false if it couldn't */
+bool input_record_stop();
+/* Called by core_key_press()/core_key_release(), polled when the key comes from host.input_poll */
+void input_record_key(uint8_t key, bool released, bool polled);
+
+/* Loads path.state and the log and starts feeding the keys, call between blocks. hostState gets the saved front end state */
+bool input_replay_start(const char* path, struct lc3SaveHost* hostState);
+void input_replay_stop();
+/*
+    Called by core_run_block() while inputReplaying: hands the guest the keys due before this instruction,
+    sets retiredLimit to the next one and checks the state at the end of the log. Front ends also call it
+    once after their loop ends, in case the run halted right at the end of the log
+*/
+void input_replay_due();
+
+/* The machine went back to an earlier retiredCount (reverse execution, rewind) */
+void input_rewound();
+
+void input_status(struct lc3InputStatus* status);
@@ -0,0 +1,73 @@
+#pragma once
+
+/*
+    Undo journal for reverse execution (reverse-step / reverse-continue in the disassembly window).
+
+    While journalEnabled, every executed instruction pushes one entry into a ring of JOURNAL_ENTRIES:
+    the registers before it ran, the keyboard state, the shadow call stack slot a JSR may overwrite,
+    and (through PAGE_JOURNAL on every page) the old value of every memory word it writes.
+    Popping an entry puts the machine back exactly where it was before that instruction.
+
+    Every JOURNAL_CHECKPOINT_INTERVAL instructions a full copy of reg[] and memory[] is taken as well.
+    Going back further than the ring reaches restores the newest checkpoint before the target and replays
+    forward with core_step(), re-injecting the keys that were pressed (they are logged by step) so the guest
+    sees the same input. Keyboard interrupts are logged the same way and taken again at the same step, their
+    stack pushes are undone with the instruction before them. Console output is not repeated during a replay.
+
+    Every breakpoint hit bp_check() counts is logged by step too. Going back takes the later ones off the
+    breakpoint, and reverse-continue evaluates a condition on hits with the count it had at the step it tests.
+    There is at most one hit per instruction, so the log reaches as far back as the ring. Going back further
+    than the log, the counts stay what they were at its oldest hit.
+
+    The cost while running is a 56-byte entry per instruction (registers, write index, call stack slot,
+    keyboard with KBSR/KBDR, PSR and both stack pointers) and a function call per store, plus a 128 KB copy
+    every JOURNAL_CHECKPOINT_INTERVAL instructions. The ring itself takes 3.5 MB, the writes 256 KB and the hits 1 MB.
+*/
+
+#include "globals.hpp"
+#include "lc3vmwin_callstack.hpp"
+#include <cstdint>
+
+#define JOURNAL_ENTRIES                 (1 << 16)       // instructions that can be undone one by one
+#define JOURNAL_WRITES                  (1 << 16)       // memory writes kept for them
+#define JOURNAL_CHECKPOINT_INTERVAL     (1 << 20)
+#define JOURNAL_CHECKPOINTS             16
+#define JOURNAL_KEYS_MAX                4096
+#define JOURNAL_HITS_MAX                (1 << 16)       // breakpoint hits logged for them
+
+extern bool journalEnabled;
+
+/* Turning it on starts the history at the current state */
+void journal_enable(bool enable);
+/* Forgets the history, called by core_reset() */
+void journal_reset();
+
+/* Oldest step that can still be reached, through the ring or a checkpoint. Equal to retiredCount if there's no history */
+uint64_t journal_oldest();
+/* Oldest step the ring alone can reach, i.e. without a replay */
+uint64_t journal_oldest_undo();
+
+/*
+    Moves the machine back to the state right before instruction number step ran.
+    Must be called between blocks (retiredCount is exact there). Returns false if step is out of reach
+*/
+bool journal_seek(uint64_t step);
+bool journal_reverse_step();
+/*
+    Goes back to the last time execution reached an enabled user breakpoint whose condition held.
+    Without one, stops at the oldest reachable step and returns false. While a condition uses hits, the oldest
+    reachable step is also the oldest one whose hits are all still logged
+*/
+bool journal_reverse_continue();
+
+/* Per-instruction hooks, called by the core around every instruction while journalEnabled */
+void journal_before();
+void journal_after();
+/* Called by write_memory_slow() for pages flagged PAGE_JOURNAL, before the write */
+void journal_on_write(uint16_t address, uint16_t oldValue);
+/* Called by core_key_press() and core_key_release() */
+void journal_key(uint8_t key, bool released);
+/* Called by the core right after it took the keyboard interrupt, between two instructions */
+void journal_interrupt();
+/* Called by bp_check() for every hit it counts, before the instruction at address runs */
+void journal_hit(uint16_t address);
@@ -0,0 +1,76 @@
+#pragma once
+
+/*
+    Copy-on-write machine clones, for searches and what-ifs that branch many machines off a common state.
+
+    An lc3Machine is the whole machine (registers, keyboard, memory) with its memory held as 256-word pages
+    shared by reference count. Copying an lc3Machine is a clone: 256 pointer copies, no memory is copied.
+    Pages are never modified once a machine holds them, so any number of clones (and threads) can share them.
+
+    There is still only one machine that runs, the one in reg[]/memory[]. machine_clone() captures it and
+    machine_switch() makes another one current. Both cost the pages touched since the last of them, not 128 KB:
+    - after either, every page is flagged PAGE_COW. The first write to a page takes the slow path once,
+      records the page as dirty and clears the flag, later writes to it are plain stores again
+    - machine_clone() duplicates the dirty pages and shares every other page with the previous capture
+    - machine_switch() copies in the pages whose pointer differs from what memory[] holds, plus the dirty ones
+
+    Decoded blocks are shared the same way: there is one code cache, and switching drops only the blocks that
+    cover words whose contents actually changed, so clones of one program never decode their code twice.
+
+    machine_baseline()/machine_reset() are the same thing with one remembered machine, for running many short
+    scripts from one start: instead of clearing memory[], core_load() and decoding every block again, a reset
+    copies back the pages the run wrote and keeps every block whose code the run left alone.
+
+    Anything that writes memory[] behind the memory bus (loading, reverse execution, rewind, save states,
+    the memory editor) calls machine_forget_base(), the next capture then looks at every page.
+    The keyboard registers are written behind the bus all the time, so their page is always compared.
+
+    The shadow call stack keeps only its depth, as in the rewind buffer.
+*/
+
+#include "globals.hpp"
+#include <cstdint>
+#include <memory>
+
+struct lc3Page
+{
+    uint16_t words[PAGE_WORDS];
+};
+
+struct lc3Machine
+{
+    uint16_t regs[R_COUNT];
+    bool keyPressed;
+    uint8_t lastKeyPressed;
+    uint16_t psr;
+    uint16_t savedSSP;
+    uint16_t savedUSP;
+    bool isRunning;
+    uint64_t retiredCount;
+    int callDepth;
+    std::shared_ptr<const struct lc3Page> pages[PAGE_COUNT];
+};
+
+struct lc3MachineStats
+{
+    uint64_t clones;
+    uint64_t switches;
+    uint64_t pagesDuplicated;   // dirty pages copied out by machine_clone()
+    uint64_t pagesRestored;     // pages copied into memory[] by machine_switch()
+    uint64_t resets;
+};
+
+/* Captures the running machine into machine */
+void machine_clone(struct lc3Machine* machine);
+/* Makes machine the running one. Resets the undo journal, its history belongs to the machine we left */
+void machine_switch(const struct lc3Machine& machine);
+/* Remembers the running machine as the one machine_reset() goes back to */
+void machine_baseline();
+/* Back to the baseline, false if there is none. Costs the pages written since the last reset, like machine_switch() */
+bool machine_reset();
+/* memory[] was written behind the bus, the next capture can't trust what it knows about any page */
+void machine_forget_base();
+/* PAGE_COW slow path, the first write to a page since the last capture/switch */
+void machine_on_write(uint16_t index);
+
+void machine_stats(struct lc3MachineStats* stats);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "globals.hpp"
+#include "lc3vmwin_heatmap.hpp"
 #include <string>
 #include <vector>
 
@@ -25,6 +26,9 @@ public:
     bool memoryEditedIndexLocked; 
     bool quitSignal;
     bool addressInputMode;  // For the inputText under the memory content
+    uint16_t* memorySource; // The VM memory the window was created from, the visible page is refreshed from it each frame
+    int highlightWord;      // LC-3 address drawn in red (e.g. a watchpoint hit), -1 for none
+    int heatKind;           // HEAT_EXEC/READ/WRITE/ALL, which counter colors the cells while the heatmap is on
 
     /* We need a default constructor to write LC3VMMemorywindow window; */
     LC3VMMemoryWindow();
@@ -32,6 +36,12 @@ public:
     ~LC3VMMemoryWindow() = default;
 
     void Draw();
+    void Refresh();
+    /* Jump to the page holding the LC-3 word at address and draw it in red */
+    void Highlight_Word(uint16_t address);
+    /* Background color of the LC-3 word at address, 0 if it has no count. heatMax is the highest count on the page */
+    ImU32 Heat_Color(uint16_t address, uint32_t heatMax);
+    void Draw_Heatmap_Controls();
     void Editor(ImVec2 mousePos, char* c, char original);
     unsigned char Calculate_Char(char buf[], char original);
     /* A hex char array (e.g. 0F3C) to  */
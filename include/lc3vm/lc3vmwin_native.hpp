@@ -0,0 +1,52 @@
+#pragma once
+
+/*
+    Native services through the reserved opcode: with nativeEnabled on, `xD0nn` calls service nn of the
+    registry below instead of being an illegal instruction. Off by default, a strict LC-3 never sees them.
+
+        15 14 13 12 | 11 10 9 8 | 7 6 5 4 3 2 1 0
+        1  1  0  1  | 0  0  0 0 |     service
+
+    Arguments are in R0-R2, results in R0 (and R1), the other registers are left alone. Services that return
+    a value set COND from R0 like an ADD would. Memory goes through read_memory()/write_memory(), so
+    watchpoints, the journal and copy-on-write pages see every word. The call counts as one instruction.
+
+        x01 MEMCPY   R2 words from R1 to R0, overlapping ranges copy as memmove does
+        x02 MEMSET   R2 words at R0 set to R1
+        x03 MUL      R1:R0 = R0 * R1, unsigned 32-bit product, high word in R1
+        x04 DIV      R0 = R0 / R1, R1 = R0 % R1, unsigned. Divided by 0 R0 is xFFFF and R1 the dividend
+        x05 HASH     R0 = hash of R1 words at R0 (32-bit FNV-1a, both halves xored)
+        x06 PUTSN    R1 characters from R0 to the console, one per word like PUTS, no escape sequences
+
+    src/lc3native.asm has a subroutine per service for guest programs. An unknown service, or any of
+    bits 11-8 set, goes to the illegal instruction path like before.
+*/
+
+#include "globals.hpp"
+#include <cstdint>
+
+#define NATIVE_SERVICE_MAX  256
+
+enum lc3NativeService
+{
+    NATIVE_MEMCPY = 0x01,
+    NATIVE_MEMSET = 0x02,
+    NATIVE_MUL = 0x03,
+    NATIVE_DIV = 0x04,
+    NATIVE_HASH = 0x05,
+    NATIVE_PUTSN = 0x06
+};
+
+struct lc3NativeEntry
+{
+    const char* name;
+    void (*call)();     // works on reg[]/memory[] as they are, nullptr for no service
+};
+
+extern bool nativeEnabled;
+extern struct lc3NativeEntry nativeServices[];
+
+/* Adds or replaces service id, e.g. a front end's own. Returns false for an id past NATIVE_SERVICE_MAX */
+bool native_register(int id, const char* name, void (*call)());
+/* Runs the service instr names, false if it names none (the caller treats instr as illegal) */
+bool native_call(uint16_t instr);
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "globals.hpp"
+#include "lc3vmwin_profiler_be.hpp"
+#include <imgui.h>
+#include <string>
+#include <vector>
+
+/*
+    Shows the report of lc3vmwin_profiler_be per subroutine:
+    calls, exclusive and inclusive instruction counts and their share of everything retired since the last reset.
+    Export writes collapsed stacks that flamegraph.pl or speedscope take as-is.
+*/
+
+class LC3VMProfilerWindow
+{
+public:
+    ImVec2 initialWindowSize;
+    ImVec2 minWindowSize;
+    ImVec2 winPos;
+
+    bool disabled;
+    char exportPath[128];
+    std::string exportStatus;
+    std::vector<struct lc3ProfEntry> report;
+
+    LC3VMProfilerWindow();
+    ~LC3VMProfilerWindow() = default;
+
+    void Load_Config(const WindowConfig& config);
+    void Draw();
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+/*
+    Function-level profiler driven by the shadow call stack (lc3vmwin_callstack.hpp).
+
+    Instead of charging every frame on the stack for every instruction, we keep a call tree:
+    one node per distinct call path, and only the node of the innermost frame gets counted.
+    The interpreter calls profiler_count() once per code block with the number of instructions
+    it retired, so the cost does not depend on how deep the guest is.
+
+    Inclusive/exclusive numbers per subroutine are folded out of the tree when the report is built,
+    and the tree itself is what the collapsed-stack export ("a;b;c 123" lines) is made of.
+*/
+
+#include "globals.hpp"
+#include "lc3vmwin_callstack.hpp"
+#include <cstdint>
+#include <vector>
+
+#define PROFILER_NODE_MAX   4096    // distinct call paths, deeper paths are charged to the last node that fit
+
+struct lc3ProfNode
+{
+    uint16_t function;      // target address of the call, the entry point for the root
+    int parent;
+    int firstChild;
+    int nextSibling;
+    uint32_t calls;
+    uint64_t self;          // instructions retired with this node innermost
+};
+
+/* One line of the report, per subroutine */
+struct lc3ProfEntry
+{
+    uint16_t function;
+    uint32_t calls;
+    uint64_t exclusive;
+    uint64_t inclusive;     // recursion is only counted once
+};
+
+extern struct lc3ProfNode profNodes[];
+extern int profNodeCount;
+extern bool profilerEnabled;
+
+/* Drops all counts, the current call stack becomes the first path of the new tree */
+void profiler_reset(uint16_t entry);
+
+/* Charge count instructions to the innermost frame, then follow callDepth if a JSR/RET changed it */
+void profiler_count(uint32_t count);
+void profiler_sync();
+
+uint64_t profiler_total();
+/* Sorted by inclusive count, highest first */
+void profiler_report(std::vector<struct lc3ProfEntry>& report);
+/* Collapsed stacks for flamegraph.pl / speedscope, returns false if the file can't be written */
+bool profiler_export(const char* path);
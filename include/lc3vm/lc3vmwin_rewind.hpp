@@ -0,0 +1,35 @@
+#pragma once
+
+/*
+    Frame rewind buffer for the GUI: hold Backspace to play the last REWIND_SECONDS of the game backwards.
+
+    rewind_capture() is called once per rendered frame. A sample keeps the registers and the keyboard state
+    as they are, and memory[] as the XOR against the previous sample, run-length coded:
+        repeat { varint words that didn't change, varint words that did, their XOR values (uint16 each) }
+    A frame of 2048 changes a few dozen words, so a sample is a few dozen bytes and a minute of history
+    stays far below REWIND_BYTES_MAX. Unchanged 256-word pages are skipped with one memcmp each.
+
+    This is separate from the undo journal (lc3vmwin_journal.hpp): it has frame granularity, is meant for playing
+    and doesn't replay anything. Rewinding restarts the journal's history at the rewound state.
+*/
+
+#include "globals.hpp"
+#include <cstddef>
+#include <cstdint>
+
+#define REWIND_SECONDS      60
+#define REWIND_SAMPLES      (REWIND_SECONDS * FPS)
+#define REWIND_BYTES_MAX    (4 * 1024 * 1024)
+
+extern bool rewindEnabled;
+
+/* Forgets every sample, the next capture starts the history over */
+void rewind_reset();
+/* Samples the machine, does nothing if no instruction ran since the last sample */
+void rewind_capture();
+/* Restores the sample before the newest one and drops the newest, false if there is nothing older */
+bool rewind_step_back();
+
+size_t rewind_count();
+/* Bytes held by the deltas */
+size_t rewind_bytes();
@@ -0,0 +1,65 @@
+#pragma once
+
+/*
+    Save states: the whole machine in a versioned file, so a long run can be checkpointed and restarted later.
+
+    savestate_save() only copies the machine (registers, memory[], the keyboard, the shadow call stack and,
+    if asked, the code cache) into a snapshot, which is one memcpy of memory[] and takes microseconds.
+    A background thread compresses the snapshot and writes it. The file is written next to the target
+    and renamed over it when complete, so a crash mid-save leaves the previous checkpoint intact.
+    One save is in flight at a time, a second savestate_save() waits for the first.
+
+    savestate_load() compares the file's memory with memory[] page by page and drops only the code blocks
+    on pages that differ. Blocks saved in the file are added back where the cache has nothing.
+
+    The front end's own state (what its console shows, how far it got in scripted input) is opaque to the core,
+    it is passed in and handed back in an lc3SaveHost.
+
+    File layout (all numbers little endian):
+        header      "LC3STATE", uint32 SAVESTATE_VERSION, uint32 reserved
+        sections    char tag[4], uint32 payload bytes, payload. Unknown tags are skipped
+        "REGS"      uint16 registers [R_COUNT], uint8 keyPressed, uint8 lastKeyPressed, uint8 isRunning,
+                    uint8 reserved, uint64 retiredCount
+        "PRIV"      uint16 psr, uint16 savedSSP, uint16 savedUSP. Optional, without it the machine is in user mode
+                    at priority 0 as after core_reset()
+        "MEMZ"      memory[], repeat { varint zero words, varint literal words, literal words (uint16 each) }
+        "CALL"      uint32 callDepth, then uint16 callSite, target, returnAddress for the frames still held
+        "HOST"      uint64 input position, then the console text
+        "CACH"      uint32 blocks, per block uint16 address, uint16 instructions, the instruction words
+        "END "      uint64 FNV-1a hash of every byte before this section
+*/
+
+#include "globals.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#define SAVESTATE_VERSION       1
+#define SAVESTATE_HEADER_BYTES  16
+
+struct lc3SaveHost
+{
+    std::string console;        // the guest console as the front end shows it
+    uint64_t inputPosition;     // scripted input consumed so far, 0 for a live keyboard
+};
+
+struct lc3SaveStatus
+{
+    bool busy;                  // a save is being written
+    bool lastOk;                // the last finished save made it to disk
+    uint64_t lastBytes;         // its file size
+    double lastSnapshotMs;      // time the interpreter was stopped for it
+    uint64_t lastStep;          // retiredCount it was taken at
+};
+
+/* Snapshots the machine and writes it to path in the background, savestate_wait() tells how that went */
+void savestate_save(const char* path, const struct lc3SaveHost& hostState, bool withCache);
+/* Waits for the save in flight, returns whether the last save succeeded */
+bool savestate_wait();
+void savestate_status(struct lc3SaveStatus* status);
+
+/*
+    Replaces the machine with the file's. Checks the whole file before touching anything, so a bad file
+    leaves the machine as it was. Resets the undo journal, whose history belongs to the state we left.
+*/
+bool savestate_load(const char* path, struct lc3SaveHost* hostState);
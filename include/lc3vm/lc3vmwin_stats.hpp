@@ -0,0 +1,34 @@
+#pragma once
+
+#include "globals.hpp"
+#include "lc3vmwin_stats_be.hpp"
+#include <imgui.h>
+#include <string>
+#include <vector>
+
+/*
+    Shows the dynamic ISA statistics of lc3vmwin_stats_be: opcode mix, the busiest BR sites
+    with their taken ratio, TRAP counts, block lengths and dispatcher lookups per 1k instructions.
+*/
+
+#define STATS_BRANCH_SITES_SHOWN    16
+
+class LC3VMStatsWindow
+{
+public:
+    ImVec2 initialWindowSize;
+    ImVec2 minWindowSize;
+    ImVec2 winPos;
+
+    bool disabled;
+    char dumpPath[128];
+    std::string dumpStatus;
+    std::vector<uint16_t> branchSites;
+
+    LC3VMStatsWindow();
+    ~LC3VMStatsWindow() = default;
+
+    void Load_Config(const WindowConfig& config);
+    void Draw();
+    void Draw_Branches();
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+/*
+    Dynamic ISA statistics, for deciding which superinstructions and specializations are worth building:
+    - executions per opcode variant (ADD-imm vs ADD-reg, JSR vs JSRR, JMP vs RET...)
+    - taken / not taken per BR site
+    - invocations per TRAP vector, and what they cost: host time of a native one, guest instructions of one
+      that runs in guest code (lc3vmwin_trap.hpp)
+    - how many instructions each trip through cache_run() retired (block length distribution)
+    - dispatcher lookups (cache_find() calls) and block misses
+
+    Like the heatmap, counting is done once per code block over the range that ran,
+    so the per-instruction loop is the same whether stats are on or off.
+*/
+
+#include "globals.hpp"
+#include "lc3vmwin_cache.hpp"
+#include <cstdint>
+
+enum
+{
+    STAT_BR = 0,
+    STAT_ADD_REG,
+    STAT_ADD_IMM,
+    STAT_LD,
+    STAT_ST,
+    STAT_JSR,
+    STAT_JSRR,
+    STAT_AND_REG,
+    STAT_AND_IMM,
+    STAT_LDR,
+    STAT_STR,
+    STAT_RTI,
+    STAT_NOT,
+    STAT_LDI,
+    STAT_STI,
+    STAT_JMP,
+    STAT_RET,
+    STAT_RSV,
+    STAT_LEA,
+    STAT_TRAP,
+    STAT_VARIANT_COUNT
+};
+
+struct lc3Stats
+{
+    uint64_t instructions;
+    uint64_t variants[STAT_VARIANT_COUNT];
+    uint64_t traps[256];
+    uint64_t trapNanoseconds[256];                  // in native handlers
+    uint64_t trapInstructions[256];                 // in guest service routines
+    uint64_t blockLengths[CODE_BLOCK_SIZE + 1];     // index is the number of instructions retired by one cache_run(), the last one also counts longer runs
+    uint64_t dispatches;                            // cache_find() calls
+    uint64_t blockMisses;                           // ...that had to create a block
+    uint64_t branchesTaken;
+    uint64_t branchesNotTaken;
+};
+
+extern struct lc3Stats stats;
+/* Per BR site, indexed by the address of the BR */
+extern uint32_t statBranchTaken[];
+extern uint32_t statBranchNotTaken[];
+extern bool statsEnabled;
+
+void stats_reset();
+
+int stats_variant(uint16_t instr);
+const char* stats_variant_name(int variant);
+const char* stats_trap_name(uint8_t vector);
+
+/*
+    Count code[begin] to code[end - 1], which just ran from address (the address of code[0]).
+    If the block ran to its end and the last instruction is a BR, cond (R_COND) tells whether it was taken.
+*/
+void stats_block(const uint16_t code[], uint16_t address, int begin, int end, bool complete, uint16_t cond);
+
+/* Returns false if the file can't be written */
+bool stats_dump_json(const char* path);
@@ -0,0 +1,27 @@
+#pragma once
+
+/*
+    Symbol table of the loaded program, read from the .sym file the assembler writes next to the .obj.
+
+    Both the lc3as layout
+        //	Symbol Name       Page Address
+        //	----------------  ------------
+        //	DISPLAY_BOARD     3040
+    and plain "NAME x3040" lines are accepted. Lines that don't parse are skipped.
+*/
+
+#include "globals.hpp"
+#include <cstdint>
+
+#define SYMBOL_NAME_MAX     32
+
+/* Replaces the table with the symbols of path. Returns how many, 0 if the file is missing (the table is then empty) */
+int symbols_load(const char* path);
+void symbols_clear();
+
+/* nullptr if no symbol sits exactly at address */
+const char* symbols_find(uint16_t address);
+/* Address of the symbol called name, false if there is none (or it lost its address to another label) */
+bool symbols_lookup(const char* name, uint16_t* address);
+/* Symbol name or "x3040" style text, buffer must hold SYMBOL_NAME_MAX chars */
+const char* symbols_label(uint16_t address, char buffer[]);
@@ -0,0 +1,139 @@
+#pragma once
+
+/*
+    Execution trace recorder.
+
+    While recording, every executed instruction is logged with its PC, instruction word,
+    the registers it changed and the memory words it wrote. Entries are encoded into 256 KB chunks,
+    a ring of chunks is handed to a writer thread that streams them to disk, so the guest never waits on I/O.
+    If the writer falls behind by a whole ring the newest chunk is dropped (counted, and visible to the reader
+    as a gap in the step numbers) rather than stalling the guest.
+
+    Recording turns on the core's per-instruction hooks (core_hooks_update()), and flags every page with PAGE_TRACE
+    to see the writes. When it's off, the dispatch table and the memory bus are exactly the ones without tracing.
+
+    File layout (all numbers little endian):
+        file header     "LC3TRACE", uint32 version, uint32 reserved
+        chunk header    uint32 TRACE_CHUNK_MAGIC, uint32 payload bytes, uint32 entries, uint32 reserved,
+                        uint64 step of the first entry, uint16 registers before the first entry [R_COUNT]
+                        (R_PC is the PC of the first entry)
+        chunk payload   entries, each chunk decodes on its own
+
+    Entry:
+        uint8 flags
+        TRACE_PC_JUMP   varint zigzag(pc - expected PC), the expected PC is the previous PC + 1
+        TRACE_INSTR     uint16 instruction word. Left out when it's the same word as the last time this PC
+                        showed up in the chunk, so loops cost no instruction words at all
+        TRACE_REGS      uint8 mask of R0-R7 changed, then varint zigzag(new - old) for each
+        TRACE_COND      uint8 new R_COND
+        TRACE_WRITES    varint count, then per write varint zigzag(address - previous write address), varint value
+
+    A typical ADD/LD is 3-4 bytes. Registers and writes that change between two instructions (an interrupt
+    entry) are part of the second one's entry. Every write is recorded, however many one instruction makes:
+    a native MEMCPY/MEMSET (lc3vmwin_native.hpp) can write the whole memory. An entry that doesn't fit in
+    TRACE_CHUNK_BYTES gets a chunk of its own, as big as it needs.
+*/
+
+#include "globals.hpp"
+#include <cstddef>
+#include <cstdint>
+
+#define TRACE_VERSION               1
+#define TRACE_FILE_HEADER_BYTES     16
+#define TRACE_CHUNK_MAGIC           0x4B4E4843      // "CHNK"
+#define TRACE_CHUNK_HEADER_BYTES    (24 + 2 * R_COUNT)
+#define TRACE_CHUNK_BYTES           (256 * 1024)
+#define TRACE_RING_CHUNKS           16
+// EXPLAIN: The most an entry with this many writes can take, flags, PC, instruction, registers, COND, count and 6 bytes a write
+#define TRACE_ENTRY_BYTES(writes)   (1 + 3 + 2 + 1 + 8 * 3 + 1 + 3 + (size_t)(writes) * 6)
+
+enum
+{
+    TRACE_PC_JUMP   = 1 << 0,
+    TRACE_INSTR     = 1 << 1,
+    TRACE_REGS      = 1 << 2,
+    TRACE_COND      = 1 << 3,
+    TRACE_WRITES    = 1 << 4
+};
+
+/* Encoding helpers shared by the recorder and the reader */
+inline uint32_t trace_zigzag(uint16_t delta)
+{
+    int16_t value = (int16_t)delta;
+    return (uint32_t)(((uint32_t)value << 1) ^ (uint32_t)(value >> 15)) & 0x1FFFF;
+}
+
+inline uint16_t trace_unzigzag(uint32_t value)
+{
+    return (uint16_t)((value >> 1) ^ (0u - (value & 1)));
+}
+
+inline size_t trace_put_varint(uint8_t* p, uint32_t value)
+{
+    size_t n = 0;
+    while (value >= 0x80)
+    {
+        p[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    p[n++] = (uint8_t)value;
+    return n;
+}
+
+/* Returns the number of bytes read, 0 if the varint runs past end */
+inline size_t trace_get_varint(const uint8_t* p, const uint8_t* end, uint32_t* value)
+{
+    uint32_t result = 0;
+    for (size_t n = 0; n < 5 && p + n < end; n++)
+    {
+        result |= (uint32_t)(p[n] & 0x7F) << (7 * n);
+        if (!(p[n] & 0x80))
+        {
+            *value = result;
+            return n + 1;
+        }
+    }
+    return 0;
+}
+
+inline void trace_put_le(uint8_t* p, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+    {
+        p[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+inline uint64_t trace_get_le(const uint8_t* p, int bytes)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++)
+    {
+        value |= (uint64_t)p[i] << (8 * i);
+    }
+    return value;
+}
+
+/* Recorder */
+struct lc3TraceStatus
+{
+    bool recording;
+    uint64_t entries;
+    uint64_t bytes;             // written to disk so far
+    uint64_t droppedChunks;     // the writer was a whole ring behind, or the size limit was hit
+    bool sizeLimitHit;
+};
+
+extern bool traceEnabled;
+
+/* maxBytes 0 means no limit. Returns false if the file can't be created */
+bool trace_start(const char* path, uint64_t maxBytes);
+/* Flushes everything still in the ring and waits for the writer thread */
+void trace_stop();
+void trace_status(struct lc3TraceStatus* status);
+
+/* Called by write_memory_slow() for pages flagged PAGE_TRACE */
+void trace_on_write(uint16_t address, uint16_t value);
+/* Per-instruction hooks, called by the core around every instruction while traceEnabled */
+void trace_before(uint16_t instr);
+void trace_after();
@@ -0,0 +1,72 @@
+#pragma once
+
+/*
+    Query index over a trace file (see lc3vmwin_trace.hpp), built once in a few passes and kept
+    next to the trace as TRACE.idx. Queries then touch a handful of chunks instead of the whole trace:
+
+    - last write to an address before a step: every address has its own sorted list of the steps
+      that wrote it, a binary search finds the step and one chunk is decoded to get the instruction
+    - first time the PC reached an address: stored directly
+    - values a register had in a PC range: every chunk carries a bitmap of the 256-word code pages
+      it executed, only the chunks that ran code in the range are decoded
+
+    Index layout (little endian, the write lists are read on demand and never held in memory):
+        "LC3TIDX1", uint64 trace file size, uint64 chunk count, uint64 total writes
+        chunk table     uint64 offset, uint64 first step, uint32 entries, uint32 payload bytes, uint8 pages[32]
+        first exec      uint64 [MAX_SIZE], TRACE_INDEX_NONE if never executed
+        write offsets   uint64 [MAX_SIZE + 1], start of each address' list in the write steps
+        write steps     uint64 [total writes]
+*/
+
+#include "globals.hpp"
+#include "lc3vmwin_trace_reader.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#define TRACE_INDEX_NONE            UINT64_MAX
+#define TRACE_INDEX_PAGE_BYTES      (PAGE_COUNT / 8)
+#define TRACE_INDEX_BUILD_WRITES    (32 * 1024 * 1024)      // write steps held in memory per build pass
+
+struct lc3TraceIndexChunk
+{
+    struct lc3TraceChunkInfo info;
+    uint8_t pages[TRACE_INDEX_PAGE_BYTES];
+};
+
+struct lc3TraceIndex
+{
+    struct lc3TraceReader reader;
+    FILE* file;
+    std::vector<struct lc3TraceIndexChunk> chunks;
+    std::vector<uint64_t> firstExec;
+    std::vector<uint64_t> writeOffsets;
+    uint64_t writeStepsOffset;          // file offset of the write steps
+};
+
+/* One distinct value of a register, in order of first appearance */
+struct lc3TraceValue
+{
+    uint16_t value;
+    uint64_t count;
+    uint64_t firstStep;
+    uint16_t firstPC;
+};
+
+/* Builds TRACE.idx, returns false with a message printed on failure */
+bool trace_index_build(const char* tracePath);
+/* Opens the trace and its index, building the index first if it's missing or doesn't match the trace */
+bool trace_index_open(struct lc3TraceIndex* index, const char* tracePath);
+void trace_index_close(struct lc3TraceIndex* index);
+
+/* Decodes the entry at step, false if the step isn't in the trace (never recorded, or dropped) */
+bool trace_index_entry(struct lc3TraceIndex* index, uint64_t step, struct lc3TraceEntry* entry);
+
+/* The last instruction that wrote address at a step < beforeStep */
+bool trace_index_last_write(struct lc3TraceIndex* index, uint16_t address, uint64_t beforeStep, struct lc3TraceEntry* entry);
+/* The first instruction executed at pc */
+bool trace_index_first_exec(struct lc3TraceIndex* index, uint16_t pc, struct lc3TraceEntry* entry);
+/* Every value registerIndex (R0-R7, R_COND) held right after an instruction with from <= PC <= to */
+void trace_index_register_values(
+    struct lc3TraceIndex* index, int registerIndex, uint16_t from, uint16_t to, std::vector<struct lc3TraceValue>& values
+);
@@ -0,0 +1,72 @@
+#pragma once
+
+/*
+    Decoder for the trace files written by lc3vmwin_trace.cpp.
+
+    Entries come back one at a time with the registers as they are AFTER the instruction,
+    chunk by chunk. Chunks decode on their own, so a reader can also seek straight to one
+    (trace_reader_seek()) given the file offset of its header.
+*/
+
+#include "globals.hpp"
+#include "lc3vmwin_trace.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+struct lc3TraceEntry
+{
+    uint64_t step;                  // retired instruction count before this instruction ran
+    uint16_t pc;
+    uint16_t instr;
+    uint16_t regs[R_COUNT];         // after the instruction, except R_PC which is pc
+    uint8_t regMask;                // R0-R7 changed by this instruction
+    size_t writeCount;
+    std::vector<uint16_t> writeAddress;
+    std::vector<uint16_t> writeValue;
+};
+
+struct lc3TraceChunkInfo
+{
+    uint64_t offset;                // of the chunk header in the file
+    uint32_t bytes;                 // payload
+    uint32_t entries;
+    uint64_t firstStep;
+};
+
+struct lc3TraceReader
+{
+    FILE* file;
+    struct lc3TraceChunkInfo chunk;
+    bool chunkLoaded;
+    uint32_t chunkEntry;            // entries decoded from the current chunk
+    std::vector<uint8_t> data;
+    size_t position;
+
+    // EXPLAIN: Decoder state, mirrors the encoder's and starts over with every chunk
+    uint16_t regs[R_COUNT];
+    uint16_t expectedPC;
+    uint16_t prevWrite;
+    std::vector<uint16_t> instrLast;
+    std::vector<uint32_t> instrSeen;
+    uint32_t generation;
+
+    uint64_t nextStep;              // step expected after the last entry, for gap detection
+    bool stepKnown;
+    uint64_t gaps;                  // number of times the step numbering jumped (dropped chunks)
+    uint64_t missingSteps;
+    bool error;
+};
+
+/* Returns false (with a message printed) if the file is missing or not a trace */
+bool trace_reader_open(struct lc3TraceReader* reader, const char* path);
+void trace_reader_close(struct lc3TraceReader* reader);
+
+/* Reads the next entry, returns false at the end of the file or on a corrupt chunk (reader->error set) */
+bool trace_reader_next(struct lc3TraceReader* reader, struct lc3TraceEntry* entry);
+
+/* Reads the next chunk header without decoding its payload, for building indexes. Returns false at the end */
+bool trace_reader_skip_chunk(struct lc3TraceReader* reader, struct lc3TraceChunkInfo* info);
+
+/* Positions the reader at the chunk whose header starts at offset, the next entry is its first one */
+bool trace_reader_seek(struct lc3TraceReader* reader, uint64_t offset);
@@ -0,0 +1,59 @@
+#pragma once
+
+/*
+    TRAP dispatch. Each vector either runs natively, a C++ handler standing in for the service routine
+    (high-level emulation, fast), or in guest code through the trap vector table at x0000-x00FF like on a
+    real LC-3 with its operating system loaded (low-level emulation, exact).
+
+    trapTable[] has an entry per vector. Out of the box x20-x25 have the handlers of lc3vmwin_core.cpp and
+    every other vector has none, which is what op_trap() always did. Then:
+    - trap_register() gives a vector a native handler (new, or in place of the built-in one) and runs it natively
+    - trap_set_guest() switches a vector to its service routine at memory[vector] and back
+    - trap_load_os() loads an OS image (an .obj that covers x0000-x00FF, lc3os.obj of the LC-3 tools is one)
+      and switches every vector its table fills in to guest code. Vectors that should stay fast are switched
+      back afterwards. The image's interrupt table (x0100-x01FF) comes with it, see lc3vmwin_core.hpp
+
+    A guest TRAP is TRAP as the ISA has it: R7 = PC, PC = memory[vector], in the current privilege mode.
+    The routine returns with RET. It jumps, so it ends the code block, which makes the mode part of how
+    blocks are built: trap_set_guest() and trap_load_os() clear the code cache. An OS's HALT clears the clock
+    enable bit of MCR (xFFFE), that stops the machine at the end of the block like the native HALT does.
+    An OS's OUT/PUTS/IN/PUTSP write DDR after polling DSR, which is always ready (lc3vmwin_display.hpp).
+
+    While statsEnabled, each vector also counts where its time goes: host nanoseconds for a native handler,
+    and for a guest routine the instructions from its first one up to the RET back behind the TRAP (nested
+    traps count in both).
+*/
+
+#include "globals.hpp"
+#include <cstdint>
+
+#define TRAP_VECTORS    256
+// EXPLAIN: Guest traps still waiting for their RET, only while statsEnabled. Deeper ones aren't counted
+#define TRAP_NESTING    16
+
+struct lc3TrapEntry
+{
+    const char* name;           // "GETC", nullptr for an unnamed vector
+    void (*call)();             // native handler, reg[R_R7] is already set. nullptr for none
+    bool guest;                 // run memory[vector] instead of call
+};
+
+extern struct lc3TrapEntry trapTable[];
+/* Guest traps that haven't returned yet, cache_run() calls trap_block_end() while there are any */
+extern int trapPending;
+
+/* Adds or replaces the native handler of vector and runs it natively. Returns false for a vector past TRAP_VECTORS */
+bool trap_register(int vector, const char* name, void (*call)());
+/* Runs vector in guest code (guest == true) or natively. Clears the code cache */
+void trap_set_guest(int vector, bool guest);
+/* Loads the OS image at path without resetting the machine, returns the number of vectors switched to guest code, 0 on failure */
+int trap_load_os(const char* path);
+
+/* Runs the TRAP instr, false if its vector has neither a handler nor a guest routine (the caller treats it as illegal) */
+bool trap_call(uint16_t instr);
+/* true for a TRAP to a guest routine, cache_create_block() ends the block there */
+bool trap_ends_block(uint16_t instr);
+/* At the end of every block while trapPending: a guest routine that returned gets its instructions counted */
+void trap_block_end();
+/* Forgets the guest traps in flight, called by core_reset() */
+void trap_reset();
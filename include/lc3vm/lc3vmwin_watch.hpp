@@ -0,0 +1,54 @@
+#pragma once
+
+/*
+    Memory watchpoints on a single LC-3 address or an inclusive range.
+
+    Each watchpoint flags the 256-word pages it covers with PAGE_WATCH in pageFlags[],
+    so read_memory()/write_memory() only call into this module for accesses that land
+    on a watched page. Everything else stays on the fast path.
+*/
+
+#include "globals.hpp"
+#include <cstdint>
+
+#define WATCHPOINT_MAX  32
+
+enum
+{
+    WATCH_READ      = 1 << 0,
+    WATCH_WRITE     = 1 << 1,
+    WATCH_CHANGE    = 1 << 2    // a write that actually changes the value
+};
+
+struct lc3Watchpoint
+{
+    uint16_t begin;
+    uint16_t end;       // inclusive
+    uint8_t kind;
+    bool enabled;
+    uint32_t hits;
+};
+
+/* The last access that triggered a watchpoint, for the UI */
+struct lc3WatchHit
+{
+    bool triggered;
+    uint8_t kind;
+    uint16_t address;
+    uint16_t pc;        // address of the instruction that made the access
+    uint16_t oldValue;
+    uint16_t newValue;
+};
+
+extern struct lc3Watchpoint watchpoints[];
+extern int watchpointCount;
+extern struct lc3WatchHit watchHit;
+
+/* Returns the index of the new watchpoint, -1 if the table is full */
+int watch_add(uint16_t begin, uint16_t end, uint8_t kind);
+void watch_remove(int index);
+void watch_clear();
+
+/* Slow path hooks, return true if a watchpoint was hit (watchHit is filled) */
+bool watch_on_read(uint16_t address, uint16_t value, uint16_t pc);
+bool watch_on_write(uint16_t address, uint16_t oldValue, uint16_t newValue, uint16_t pc);
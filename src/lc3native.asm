@@ -0,0 +1,73 @@
+;--------------------------------------------------------------------------
+;
+; Native services of lc3vm (include/lc3vm/lc3vmwin_native.hpp)
+;
+; The reserved opcode xD0nn calls service nn on the host. LC-3 assemblers have
+; no macros or includes, so each service gets a subroutine here: paste this
+; file in front of your program's .END and JSR to them. A service is one
+; instruction, `.FILL xD0nn` also works inline where the call has to be fast.
+;
+; The VM only runs them with --native (lc3vm_headless, lc3farm). Without it,
+; or on any other LC-3, xD0nn is an illegal instruction.
+;
+; Arguments go in R0-R2, results come back in R0 (and R1). No other register
+; changes, R7 is only used by JSR/RET.
+;
+;--------------------------------------------------------------------------
+
+
+;--------------------------------------------------------------------------
+; NATIVE_MEMCPY
+; Copies R2 words from R1 to R0, the ranges may overlap
+;--------------------------------------------------------------------------
+
+NATIVE_MEMCPY
+      	.FILL xD001                         ; MEMCPY
+      	RET
+
+;--------------------------------------------------------------------------
+; NATIVE_MEMSET
+; Sets R2 words at R0 to R1
+;--------------------------------------------------------------------------
+
+NATIVE_MEMSET
+      	.FILL xD002                         ; MEMSET
+      	RET
+
+;--------------------------------------------------------------------------
+; NATIVE_MUL
+; R1:R0 = R0 * R1, unsigned, high word in R1. Sets the condition codes from R0
+;--------------------------------------------------------------------------
+
+NATIVE_MUL
+      	.FILL xD003                         ; MUL
+      	RET
+
+;--------------------------------------------------------------------------
+; NATIVE_DIV
+; R0 = R0 / R1 and R1 = R0 % R1, unsigned. Sets the condition codes from R0
+; Dividing by 0 gives R0 = xFFFF and leaves the dividend in R1
+;--------------------------------------------------------------------------
+
+NATIVE_DIV
+      	.FILL xD004                         ; DIV
+      	RET
+
+;--------------------------------------------------------------------------
+; NATIVE_HASH
+; R0 = 16-bit hash of the R1 words at R0. Sets the condition codes from R0
+;--------------------------------------------------------------------------
+
+NATIVE_HASH
+      	.FILL xD005                         ; HASH
+      	RET
+
+;--------------------------------------------------------------------------
+; NATIVE_PUTSN
+; Writes the R1 characters at R0 to the console, one per word like PUTS.
+; No terminating x0000 needed
+;--------------------------------------------------------------------------
+
+NATIVE_PUTSN
+      	.FILL xD006                         ; PUTSN
+      	RET
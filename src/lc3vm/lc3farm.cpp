@@ -0,0 +1,1253 @@
+/*
+	Local job farm: runs a list of (program, key script) jobs headless on M worker processes.
+	POSIX only, the workers are forked and everything they share lives in one anonymous shared mapping.
+
+	lc3farm [options] JOBS
+	lc3farm [options] --tests MANIFEST [--junit FILE] [--json FILE]
+	lc3farm [options] --self-test [--junit FILE] [--json FILE]
+		--workers M      worker processes (default the number of CPUs)
+		--max N          instructions per job (default 100000000)
+		--timeout S      seconds per job before its worker is killed (default 60)
+		--retries N      times a job that took its worker down is run again on a new one (default 1)
+		--hang-check     end a job as soon as it is stuck in an infinite loop (lc3vmwin_hang.hpp) instead of
+		                 letting it run into --max or --timeout. It counts as failed
+		--native         let the programs call the native services of the reserved opcode (lc3vmwin_native.hpp)
+		--junit FILE     with --tests, also write the results as a JUnit XML test suite
+		--json FILE      with --tests, also write the results as JSON
+		--self-test      run the built-in tests instead of a manifest (see below)
+
+	JOBS has one job per line: PROGRAM [KEYS]. KEYS is a file with the keys as raw bytes, handed to the program
+	one each time it polls KBSR or GETCs like lc3vm_headless --keys (the fuzzer's inputs are such files).
+	No spaces in the paths. Prints one line per job in the order of JOBS and exits with an error if a job
+	crashed, timed out or was found stuck.
+
+	Test runner (autograder): MANIFEST has one test per line, NAME IMAGE followed by any of
+		keys=FILE        the input as raw bytes
+		input=TEXT       the input inline, with \n \r \t \\ \xHH escapes (a space is \x20)
+		output=FILE      the console output the test expects, byte for byte (a screen clear is a \f)
+		max=N            instruction limit of this test instead of --max
+		timeout=S        seconds of this test instead of --timeout
+		R0..R7=V PC=V COND=V     a register at the end
+		xADDR=V          a memory word at the end
+	Values are LC-3 style, x3000 or #-1 (plain numbers are decimal). A test passes when the program HALTs
+	without running an illegal instruction, before it asks for more input than it has, and the output and
+	every assertion match. Each test starts from a fresh machine with the image just loaded; tests of one
+	image go to the workers back to back so that a worker loads and decodes each image once and starts the
+	next test from machine_reset(). Lines starting with # are comments.
+
+	--self-test checks the runner itself before it grades anything: small programs that read the keyboard
+	by polling KBSR, by GETC and by both in turn echo "abcd\n" and must get it back exactly once. They are
+	written to temporary images and graded like manifest tests, so a key a program sees twice or not at all
+	fails here first.
+
+	How it fits together:
+	- the job list is built before the workers are forked, they read their copy of it. Only the results
+	  and the queue live in shared memory
+	- the parent puts every job index on a ring in shared memory, the workers take them off with a
+	  compare-and-swap on the head. The parent is the only one that adds, so the tail is a plain store
+	- a worker writes the result into the job's slot in shared memory and takes the next one. It keeps its
+	  machine between jobs of the same program and starts them with machine_reset() (lc3vmwin_machine.hpp)
+	- each worker slot says which job it is on and since when. A worker that dies (the core exits on bad input,
+	  or something worse) is replaced, and the job it was on goes back on the ring until it used up its retries.
+	  A job that runs past its timeout is killed along with its worker, the worker is replaced and the job isn't retried
+*/
+
+#include "globals.hpp"
+#include "lc3vmwin_batch.hpp"
+#include "lc3vmwin_core.hpp"
+#include "lc3vmwin_display.hpp"
+#include "lc3vmwin_hang.hpp"
+#include "lc3vmwin_machine.hpp"
+#include "lc3vmwin_native.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <csignal>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+uint8_t DEBUG_MODE = DEBUG_OFF;
+
+#define FARM_LINE_MAX       4096
+#define FARM_MESSAGE_MAX    256
+#define FARM_EXCERPT        24          // characters of each side shown when the output differs
+#define FARM_STOP_LOOP      (BATCH_BAD_ESCAPE + 1)      // job.stop past the batch engine's: the hang detector stopped it
+
+enum
+{
+	JOB_PENDING = 0,
+	JOB_RUNNING,
+	JOB_DONE,
+	JOB_CRASHED,
+	JOB_TIMEOUT,
+	JOB_BAD                 // the program or the keys couldn't be read
+};
+
+/* An assertion of a test, on a register (R_*) or a memory word */
+struct farmCheck
+{
+	bool isRegister;
+	uint16_t where;
+	uint16_t value;
+};
+
+/* What to run, the workers get their own copy when they are forked */
+struct farmSpec
+{
+	std::string name;
+	std::string program;
+	std::string keys;               // a file, or the input itself when inlineInput
+	bool inlineInput;
+	bool hasOutput;
+	std::string output;             // expected console output
+	uint64_t maxInstructions;
+	int64_t timeoutUs;
+	std::vector<struct farmCheck> checks;
+};
+
+/* What came of it, in shared memory */
+struct farmJob
+{
+	std::atomic<int> state;
+	int attempts;
+	int stop;               // BATCH_* of the run
+	int exitStatus;         // of the worker that died on it
+	bool passed;            // tests only
+	uint64_t instructions;
+	uint64_t consoleHash;
+	uint64_t stateHash;
+	uint64_t microseconds;
+	uint16_t loopLow;       // FARM_STOP_LOOP only, from hangReport
+	uint16_t loopHigh;
+	uint64_t loopPeriod;
+	char message[FARM_MESSAGE_MAX];     // why a test failed
+};
+
+struct farmSlot
+{
+	pid_t pid;
+	std::atomic<int> job;               // -1 when idle
+	std::atomic<int64_t> startedUs;
+};
+
+struct farmShared
+{
+	std::atomic<uint32_t> head;
+	std::atomic<uint32_t> tail;
+	std::atomic<int> done;              // jobs in one of the end states
+	std::atomic<bool> finished;
+	uint32_t capacity;
+	int jobCount;
+	int workerCount;
+	struct farmJob* jobs;
+	struct farmSlot* slots;
+	uint32_t* ring;
+};
+
+static struct farmShared* farm = nullptr;
+static std::vector<struct farmSpec> farmSpecs;
+static bool farmTests = false;
+static bool farmHangCheck = false;
+
+static int64_t now_us()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void usage()
+{
+	fprintf(stderr, "Usage: lc3farm [--workers M] [--max N] [--timeout S] [--retries N] [--hang-check] [--native] JOBS\n");
+	fprintf(stderr, "       lc3farm [--workers M] [--max N] [--timeout S] [--retries N] [--hang-check] [--native] --tests MANIFEST [--junit FILE] [--json FILE]\n");
+	fprintf(stderr, "       lc3farm [--workers M] [--max N] [--timeout S] [--retries N] [--hang-check] [--native] --self-test [--junit FILE] [--json FILE]\n");
+}
+
+/* Only the parent calls this */
+static void ring_push(uint32_t job)
+{
+	uint32_t tail = farm->tail.load(std::memory_order_relaxed);
+	farm->ring[tail % farm->capacity] = job;
+	farm->tail.store(tail + 1, std::memory_order_release);
+}
+
+/* false when the ring is empty */
+static bool ring_pop(uint32_t* job)
+{
+	uint32_t head = farm->head.load(std::memory_order_acquire);
+	while (head != farm->tail.load(std::memory_order_acquire))
+	{
+		uint32_t value = farm->ring[head % farm->capacity];
+		if (farm->head.compare_exchange_weak(head, head + 1, std::memory_order_acq_rel))
+		{
+			*job = value;
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Whoever owns the job (the worker on it, or the parent once it took it back) ends it exactly once */
+static void job_finish(struct farmJob& job, int state)
+{
+	job.state = state;
+	farm->done.fetch_add(1, std::memory_order_release);
+}
+
+static bool read_file(const char* path, std::string* contents)
+{
+	contents->clear();
+	FILE* file = fopen(path, "rb");
+	if (!file)
+	{
+		return false;
+	}
+	char chunk[4096];
+	size_t count;
+	while ((count = fread(chunk, 1, sizeof(chunk), file)) > 0)
+	{
+		contents->append(chunk, count);
+	}
+	fclose(file);
+	return true;
+}
+
+/* Worker side */
+
+static std::string workerKeys;
+static size_t workerKeyIndex = 0;
+static bool workerKeysExhausted = false;
+static uint64_t workerConsole = BATCH_CONSOLE_HASH_START;
+static std::string workerOutput;
+static bool workerIllegal = false;
+static uint16_t workerIllegalInstr = 0;
+static uint16_t workerIllegalPC = 0;
+
+static void worker_input_poll()
+{
+	if (workerKeyIndex < workerKeys.size())
+	{
+		core_key_press((uint8_t)workerKeys[workerKeyIndex++]);
+	}
+	else
+	{
+		workerKeysExhausted = true;
+		isRunning = false;
+	}
+}
+
+static void worker_console_write(const char* text, size_t length)
+{
+	for (size_t i = 0; i < length; i++)
+	{
+		workerConsole = batch_console_hash(workerConsole, (uint8_t)text[i]);
+	}
+	if (farmTests)
+	{
+		workerOutput.append(text, length);
+	}
+}
+
+static void worker_console_clear()
+{
+	workerConsole = batch_console_hash(workerConsole, BATCH_CONSOLE_CLEAR);
+	if (farmTests)
+	{
+		workerOutput.push_back('\f');
+	}
+}
+
+static void worker_illegal_instruction(uint16_t instr)
+{
+	// EXPLAIN: The first one is the one to report, isRunning only stops the run at the end of the block
+	if (!workerIllegal)
+	{
+		workerIllegal = true;
+		workerIllegalInstr = instr;
+		workerIllegalPC = (uint16_t)(reg[R_PC] - 1);
+	}
+	isRunning = false;
+}
+
+/* Printable excerpt of text from index on, for failure messages */
+static std::string excerpt(const std::string& text, size_t index)
+{
+	std::string result;
+	for (size_t i = index; i < text.size() && i < index + FARM_EXCERPT; i++)
+	{
+		char ch = text[i];
+		if (ch == '\n')
+		{
+			result += "\\n";
+		}
+		else if (ch == '"' || ch == '\\')
+		{
+			result += '\\';
+			result += ch;
+		}
+		else if ((uint8_t)ch < 0x20 || (uint8_t)ch >= 0x7F)
+		{
+			char hex[8];
+			snprintf(hex, sizeof(hex), "\\x%02X", (uint8_t)ch);
+			result += hex;
+		}
+		else
+		{
+			result += ch;
+		}
+	}
+	if (index + FARM_EXCERPT < text.size())
+	{
+		result += "...";
+	}
+	return result;
+}
+
+static const char* register_name(uint16_t r)
+{
+	static const char* names[R_COUNT] = {"R0", "R1", "R2", "R3", "R4", "R5", "R6", "R7", "PC", "COND"};
+	return names[r];
+}
+
+/* Checks a finished test run, false with the first thing that's wrong in message */
+static bool worker_grade(const struct farmSpec& spec, const struct farmJob& job, char* message, size_t size)
+{
+	if (workerIllegal)
+	{
+		snprintf(message, size, "illegal instruction x%04X at x%04X", workerIllegalInstr, workerIllegalPC);
+		return false;
+	}
+	if (job.stop == FARM_STOP_LOOP)
+	{
+		snprintf(
+			message, size, "stuck in an infinite loop at x%04X-x%04X (repeats every %llu instructions)",
+			job.loopLow, job.loopHigh, (unsigned long long)job.loopPeriod
+		);
+		return false;
+	}
+	if (job.stop == BATCH_END_OF_KEYS)
+	{
+		snprintf(message, size, "asked for more input after %zu keys", workerKeys.size());
+		return false;
+	}
+	if (job.stop == BATCH_INSTRUCTION_LIMIT)
+	{
+		snprintf(message, size, "didn't HALT within %llu instructions", (unsigned long long)spec.maxInstructions);
+		return false;
+	}
+	if (spec.hasOutput && workerOutput != spec.output)
+	{
+		size_t at = 0;
+		while (at < workerOutput.size() && at < spec.output.size() && workerOutput[at] == spec.output[at])
+		{
+			at++;
+		}
+		snprintf(
+			message, size, "output differs at character %zu: expected \"%s\", got \"%s\"", at,
+			excerpt(spec.output, at).c_str(), excerpt(workerOutput, at).c_str()
+		);
+		return false;
+	}
+	for (const struct farmCheck& check : spec.checks)
+	{
+		uint16_t actual = check.isRegister ? reg[check.where] : memory[check.where];
+		if (actual == check.value)
+		{
+			continue;
+		}
+		if (check.isRegister)
+		{
+			snprintf(message, size, "%s is x%04X, expected x%04X", register_name(check.where), actual, check.value);
+		}
+		else
+		{
+			snprintf(message, size, "memory[x%04X] is x%04X, expected x%04X", check.where, actual, check.value);
+		}
+		return false;
+	}
+	message[0] = '\0';
+	return true;
+}
+
+static bool worker_run(const struct farmSpec& spec, struct farmJob& job, std::string* loadedProgram)
+{
+	if (spec.inlineInput)
+	{
+		workerKeys = spec.keys;
+	}
+	else if (spec.keys.empty())
+	{
+		workerKeys.clear();
+	}
+	else if (!read_file(spec.keys.c_str(), &workerKeys))
+	{
+		return false;
+	}
+	// EXPLAIN: Same program as the last job, undo what that one wrote instead of loading it again
+	if (*loadedProgram == spec.program)
+	{
+		machine_reset();
+	}
+	else
+	{
+		memset(memory, 0, sizeof(uint16_t) * MAX_SIZE);
+		if (!core_load(spec.program.c_str()))
+		{
+			loadedProgram->clear();
+			return false;
+		}
+		machine_baseline();
+		*loadedProgram = spec.program;
+	}
+
+	workerKeyIndex = 0;
+	workerKeysExhausted = false;
+	workerConsole = BATCH_CONSOLE_HASH_START;
+	workerOutput.clear();
+	workerIllegal = false;
+	uint64_t startCount = retiredCount;
+	while (isRunning && retiredCount - startCount < spec.maxInstructions)
+	{
+		core_run_block();
+	}
+	display_flush();
+	job.instructions = retiredCount - startCount;
+	job.stop = workerKeysExhausted ? BATCH_END_OF_KEYS : (isRunning ? BATCH_INSTRUCTION_LIMIT : BATCH_HALT);
+	if (hangReport.detected)
+	{
+		job.stop = FARM_STOP_LOOP;
+		job.loopLow = hangReport.pcLow;
+		job.loopHigh = hangReport.pcHigh;
+		job.loopPeriod = hangReport.period;
+	}
+	job.consoleHash = workerConsole;
+	job.stateHash = core_state_hash();
+	if (farmTests)
+	{
+		job.passed = worker_grade(spec, job, job.message, sizeof(job.message));
+	}
+	return true;
+}
+
+static void worker(int id)
+{
+	// EXPLAIN: The parent's handlers aren't ours, Ctrl+C just ends a worker
+	signal(SIGINT, SIG_DFL);
+	// EXPLAIN: The loader and HALT print to stdout, which is the parent's report. What the core has to say on stderr stays
+	int devNull = open("/dev/null", O_WRONLY);
+	if (devNull >= 0)
+	{
+		dup2(devNull, STDOUT_FILENO);
+		close(devNull);
+	}
+	host.console_write = &worker_console_write;
+	host.console_clear = &worker_console_clear;
+	host.input_poll = &worker_input_poll;
+	if (farmTests)
+	{
+		host.illegal_instruction = &worker_illegal_instruction;
+	}
+	if (farmHangCheck)
+	{
+		hang_enable(true);
+	}
+
+	struct farmSlot& slot = farm->slots[id];
+	std::string loadedProgram;
+	while (!farm->finished.load(std::memory_order_acquire))
+	{
+		uint32_t index;
+		if (!ring_pop(&index))
+		{
+			usleep(1000);
+			continue;
+		}
+		struct farmJob& job = farm->jobs[index];
+		slot.startedUs = now_us();
+		slot.job = (int)index;
+		job.state = JOB_RUNNING;
+
+		bool ok = worker_run(farmSpecs[index], job, &loadedProgram);
+
+		// EXPLAIN: If the parent timed the job out meanwhile the job is its, and we are about to be killed
+		int expected = (int)index;
+		if (slot.job.compare_exchange_strong(expected, -1))
+		{
+			job.microseconds = (uint64_t)(now_us() - slot.startedUs);
+			job_finish(job, ok ? JOB_DONE : JOB_BAD);
+		}
+	}
+}
+
+/* Parent side */
+
+static pid_t spawn_worker(int id)
+{
+	farm->slots[id].job = -1;
+	fflush(stdout);
+	fflush(stderr);
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		worker(id);
+		_exit(0);
+	}
+	farm->slots[id].pid = pid;
+	return pid;
+}
+
+static bool read_jobs(const char* path, uint64_t maxInstructions, int64_t timeoutUs)
+{
+	FILE* file = fopen(path, "r");
+	if (!file)
+	{
+		fprintf(stderr, "Failed to open %s\n", path);
+		return false;
+	}
+	char line[FARM_LINE_MAX];
+	while (fgets(line, sizeof(line), file))
+	{
+		char program[FARM_LINE_MAX] = "";
+		char keys[FARM_LINE_MAX] = "";
+		int fields = sscanf(line, "%4095s %4095s", program, keys);
+		if (fields >= 1 && program[0] != '#')
+		{
+			struct farmSpec spec = {};
+			spec.program = program;
+			spec.keys = keys;
+			spec.maxInstructions = maxInstructions;
+			spec.timeoutUs = timeoutUs;
+			farmSpecs.push_back(spec);
+		}
+	}
+	fclose(file);
+	return true;
+}
+
+/* x3000, #-1 or 12288 */
+static bool parse_word(const char* text, uint16_t* value)
+{
+	int base = 10;
+	if (text[0] == 'x' || text[0] == 'X')
+	{
+		base = 16;
+		text++;
+	}
+	else if (text[0] == '#')
+	{
+		text++;
+	}
+	char* end;
+	long number = strtol(text, &end, base);
+	if (*text == '\0' || *end != '\0' || number < -32768 || number > 0xFFFF)
+	{
+		return false;
+	}
+	*value = (uint16_t)number;
+	return true;
+}
+
+/* input= escapes, false on a malformed one */
+static bool unescape(const char* text, std::string* result)
+{
+	result->clear();
+	for (const char* p = text; *p; p++)
+	{
+		if (*p != '\\')
+		{
+			result->push_back(*p);
+			continue;
+		}
+		p++;
+		switch (*p)
+		{
+			case 'n': result->push_back('\n'); break;
+			case 'r': result->push_back('\r'); break;
+			case 't': result->push_back('\t'); break;
+			case '\\': result->push_back('\\'); break;
+			case 'x':
+			{
+				char hex[3] = {p[1], p[1] ? p[2] : '\0', '\0'};
+				char* end;
+				long value = strtol(hex, &end, 16);
+				if (hex[0] == '\0' || *end != '\0')
+				{
+					return false;
+				}
+				result->push_back((char)value);
+				p += 2;
+				break;
+			}
+			default:
+				return false;
+		}
+	}
+	return true;
+}
+
+/* One key=value of a test line */
+static bool parse_test_field(const char* field, struct farmSpec* spec)
+{
+	const char* equals = strchr(field, '=');
+	if (!equals)
+	{
+		return false;
+	}
+	std::string key(field, (size_t)(equals - field));
+	const char* value = equals + 1;
+
+	if (key == "keys")
+	{
+		spec->keys = value;
+		spec->inlineInput = false;
+		return true;
+	}
+	if (key == "input")
+	{
+		spec->inlineInput = true;
+		return unescape(value, &spec->keys);
+	}
+	if (key == "output")
+	{
+		spec->hasOutput = true;
+		if (!read_file(value, &spec->output))
+		{
+			fprintf(stderr, "Failed to read the expected output %s\n", value);
+			return false;
+		}
+		return true;
+	}
+	if (key == "max")
+	{
+		spec->maxInstructions = strtoull(value, nullptr, 10);
+		return true;
+	}
+	if (key == "timeout")
+	{
+		spec->timeoutUs = (int64_t)(atof(value) * 1e6);
+		return spec->timeoutUs > 0;
+	}
+
+	struct farmCheck check = {};
+	if (!parse_word(value, &check.value))
+	{
+		return false;
+	}
+	for (uint16_t r = 0; r < R_COUNT; r++)
+	{
+		if (key == register_name(r))
+		{
+			check.isRegister = true;
+			check.where = r;
+			spec->checks.push_back(check);
+			return true;
+		}
+	}
+	if ((key[0] == 'x' || key[0] == 'X') && parse_word(key.c_str(), &check.where))
+	{
+		spec->checks.push_back(check);
+		return true;
+	}
+	return false;
+}
+
+static bool read_tests(const char* path, uint64_t maxInstructions, int64_t timeoutUs)
+{
+	FILE* file = fopen(path, "r");
+	if (!file)
+	{
+		fprintf(stderr, "Failed to open %s\n", path);
+		return false;
+	}
+	char line[FARM_LINE_MAX];
+	int number = 0;
+	bool ok = true;
+	while (ok && fgets(line, sizeof(line), file))
+	{
+		number++;
+		std::vector<char*> fields;
+		for (char* field = strtok(line, " \t\r\n"); field; field = strtok(nullptr, " \t\r\n"))
+		{
+			fields.push_back(field);
+		}
+		if (fields.empty() || fields[0][0] == '#')
+		{
+			continue;
+		}
+		if (fields.size() < 2)
+		{
+			fprintf(stderr, "%s:%d: a test needs a name and an image\n", path, number);
+			ok = false;
+			break;
+		}
+		struct farmSpec spec = {};
+		spec.name = fields[0];
+		spec.program = fields[1];
+		spec.maxInstructions = maxInstructions;
+		spec.timeoutUs = timeoutUs;
+		for (size_t i = 2; i < fields.size(); i++)
+		{
+			if (!parse_test_field(fields[i], &spec))
+			{
+				fprintf(stderr, "%s:%d: can't make sense of %s\n", path, number, fields[i]);
+				ok = false;
+				break;
+			}
+		}
+		farmSpecs.push_back(spec);
+	}
+	fclose(file);
+	return ok;
+}
+
+/* A --self-test program, origin first like an .obj */
+struct farmSelfTest
+{
+	const char* name;
+	std::vector<uint16_t> image;
+};
+
+// EXPLAIN: The data sits in front of the code behind a BR, HALT only stops the machine at the end of its block
+static const struct farmSelfTest selfTests[] = {
+	{"kbsr_echo", {
+		0x3000,
+		0x0E02,         //       BRnzp START
+		0xFE00,         // KBSR  .FILL xFE00
+		0xFE02,         // KBDR  .FILL xFE02
+		0xA1FD,         // START LDI R0, KBSR
+		0x07FE,         //       BRzp START
+		0xA1FC,         //       LDI R0, KBDR
+		0xF021,         //       OUT
+		0x1236,         //       ADD R1, R0, #-10
+		0x0BFA,         //       BRnp START
+		0xF025          //       HALT
+	}},
+	{"getc_echo", {
+		0x3000,
+		0xF020,         // START GETC
+		0xF021,         //       OUT
+		0x1236,         //       ADD R1, R0, #-10
+		0x0BFC,         //       BRnp START
+		0xF025          //       HALT
+	}},
+	{"kbsr_getc_echo", {
+		0x3000,
+		0x0E02,         //       BRnzp START
+		0xFE00,         // KBSR  .FILL xFE00
+		0xFE02,         // KBDR  .FILL xFE02
+		0xA1FD,         // START LDI R0, KBSR
+		0x07FE,         //       BRzp START
+		0xA1FC,         //       LDI R0, KBDR
+		0xF021,         //       OUT
+		0x1236,         //       ADD R1, R0, #-10
+		0x0404,         //       BRz DONE
+		0xF020,         //       GETC
+		0xF021,         //       OUT
+		0x1236,         //       ADD R1, R0, #-10
+		0x0BF6,         //       BRnp START
+		0xF025          // DONE  HALT
+	}}
+};
+
+static std::vector<std::string> selfTestPaths;
+
+/* Writes the --self-test images and queues a test for each, false if an image can't be written */
+static bool self_test_specs(uint64_t maxInstructions, int64_t timeoutUs)
+{
+	const char* directory = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+	for (const struct farmSelfTest& test : selfTests)
+	{
+		std::string path = std::string(directory) + "/lc3farm-XXXXXX";
+		int fd = mkstemp(&path[0]);
+		if (fd < 0)
+		{
+			fprintf(stderr, "Failed to create an image in %s\n", directory);
+			return false;
+		}
+		selfTestPaths.push_back(path);
+		std::vector<uint8_t> bytes;
+		for (uint16_t word : test.image)
+		{
+			bytes.push_back((uint8_t)(word >> 8));
+			bytes.push_back((uint8_t)(word & 0xFF));
+		}
+		bool written = write(fd, bytes.data(), bytes.size()) == (ssize_t)bytes.size();
+		close(fd);
+		if (!written)
+		{
+			fprintf(stderr, "Failed to write %s\n", path.c_str());
+			return false;
+		}
+
+		struct farmSpec spec = {};
+		spec.name = test.name;
+		spec.program = path;
+		spec.keys = "abcd\n";
+		spec.inlineInput = true;
+		spec.hasOutput = true;
+		spec.output = "abcd\n";
+		spec.maxInstructions = maxInstructions;
+		spec.timeoutUs = timeoutUs;
+		spec.checks.push_back({true, R_R0, '\n'});
+		farmSpecs.push_back(spec);
+	}
+	return true;
+}
+
+static void self_test_cleanup()
+{
+	for (const std::string& path : selfTestPaths)
+	{
+		unlink(path.c_str());
+	}
+}
+
+static const char* crash_message(const struct farmJob& job, char* buffer, size_t size)
+{
+	if (WIFSIGNALED(job.exitStatus))
+	{
+		snprintf(buffer, size, "the worker died of signal %d (%d attempts)", WTERMSIG(job.exitStatus), job.attempts);
+	}
+	else
+	{
+		snprintf(buffer, size, "the worker exited with %d (%d attempts)", WEXITSTATUS(job.exitStatus), job.attempts);
+	}
+	return buffer;
+}
+
+/* Why a test didn't pass, nullptr if it did */
+static const char* test_message(const struct farmJob& job, char* buffer, size_t size)
+{
+	switch (job.state)
+	{
+		case JOB_DONE:
+			return job.passed ? nullptr : job.message;
+		case JOB_CRASHED:
+			return crash_message(job, buffer, size);
+		case JOB_TIMEOUT:
+			snprintf(buffer, size, "timed out after %.1f s", (double)job.microseconds / 1e6);
+			return buffer;
+		default:
+			return "couldn't read the image or the input";
+	}
+}
+
+static void xml_escaped(FILE* file, const char* text)
+{
+	for (const char* p = text; *p; p++)
+	{
+		switch (*p)
+		{
+			case '&': fputs("&amp;", file); break;
+			case '<': fputs("&lt;", file); break;
+			case '>': fputs("&gt;", file); break;
+			case '"': fputs("&quot;", file); break;
+			case '\'': fputs("&apos;", file); break;
+			default: fputc(*p, file); break;
+		}
+	}
+}
+
+static void json_escaped(FILE* file, const char* text)
+{
+	fputc('"', file);
+	for (const char* p = text; *p; p++)
+	{
+		if (*p == '"' || *p == '\\')
+		{
+			fprintf(file, "\\%c", *p);
+		}
+		else if ((uint8_t)*p < 0x20)
+		{
+			fprintf(file, "\\u%04x", (uint8_t)*p);
+		}
+		else
+		{
+			fputc(*p, file);
+		}
+	}
+	fputc('"', file);
+}
+
+static bool write_junit(const char* path, int failures, int errors, double seconds)
+{
+	FILE* file = fopen(path, "w");
+	if (!file)
+	{
+		fprintf(stderr, "Failed to open %s\n", path);
+		return false;
+	}
+	fprintf(file, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+	fprintf(
+		file, "<testsuite name=\"lc3farm\" tests=\"%d\" failures=\"%d\" errors=\"%d\" time=\"%.3f\">\n",
+		farm->jobCount, failures, errors, seconds
+	);
+	for (int i = 0; i < farm->jobCount; i++)
+	{
+		const struct farmSpec& spec = farmSpecs[(size_t)i];
+		const struct farmJob& job = farm->jobs[i];
+		fprintf(file, "  <testcase name=\"");
+		xml_escaped(file, spec.name.c_str());
+		fprintf(file, "\" classname=\"");
+		xml_escaped(file, spec.program.c_str());
+		fprintf(file, "\" time=\"%.6f\"", (double)job.microseconds / 1e6);
+
+		char buffer[FARM_MESSAGE_MAX];
+		const char* message = test_message(job, buffer, sizeof(buffer));
+		if (!message)
+		{
+			fprintf(file, "/>\n");
+			continue;
+		}
+		fprintf(file, ">\n    <%s message=\"", job.state == JOB_DONE ? "failure" : "error");
+		xml_escaped(file, message);
+		fprintf(file, "\"/>\n  </testcase>\n");
+	}
+	fprintf(file, "</testsuite>\n");
+	fclose(file);
+	return true;
+}
+
+static bool write_json(const char* path, int passed, int failures, int errors, double seconds)
+{
+	FILE* file = fopen(path, "w");
+	if (!file)
+	{
+		fprintf(stderr, "Failed to open %s\n", path);
+		return false;
+	}
+	fprintf(
+		file, "{\n  \"tests\": %d,\n  \"passed\": %d,\n  \"failures\": %d,\n  \"errors\": %d,\n  \"seconds\": %.3f,\n  \"results\": [\n",
+		farm->jobCount, passed, failures, errors, seconds
+	);
+	for (int i = 0; i < farm->jobCount; i++)
+	{
+		const struct farmSpec& spec = farmSpecs[(size_t)i];
+		const struct farmJob& job = farm->jobs[i];
+		char buffer[FARM_MESSAGE_MAX];
+		const char* message = test_message(job, buffer, sizeof(buffer));
+		const char* status = !message ? "pass" : (job.state == JOB_DONE ? "failure" : "error");
+
+		fprintf(file, "    {\"name\": ");
+		json_escaped(file, spec.name.c_str());
+		fprintf(file, ", \"image\": ");
+		json_escaped(file, spec.program.c_str());
+		fprintf(file, ", \"status\": \"%s\", \"instructions\": %llu, \"seconds\": %.6f", status, (unsigned long long)job.instructions, (double)job.microseconds / 1e6);
+		if (message)
+		{
+			fprintf(file, ", \"message\": ");
+			json_escaped(file, message);
+		}
+		fprintf(file, "}%s\n", i + 1 < farm->jobCount ? "," : "");
+	}
+	fprintf(file, "  ]\n}\n");
+	fclose(file);
+	return true;
+}
+
+/* lc3farm JOBS output */
+static int report_jobs(double seconds, int restarts)
+{
+	const char* stops[] = {"HALT", "end of keys", "instruction limit", "bad escape sequence", "infinite loop"};
+	int failed = 0;
+	uint64_t total = 0;
+	for (int i = 0; i < farm->jobCount; i++)
+	{
+		const struct farmSpec& spec = farmSpecs[(size_t)i];
+		const struct farmJob& job = farm->jobs[i];
+		printf("job %d: %s %s: ", i + 1, spec.program.c_str(), spec.keys.empty() ? "-" : spec.keys.c_str());
+		char buffer[FARM_MESSAGE_MAX];
+		switch (job.state)
+		{
+			case JOB_DONE:
+				printf(
+					"%llu instructions, stopped by %s, console %016llx, state %016llx, %.1f ms\n", (unsigned long long)job.instructions,
+					stops[job.stop], (unsigned long long)job.consoleHash, (unsigned long long)job.stateHash, (double)job.microseconds / 1000.0
+				);
+				total += job.instructions;
+				if (job.stop == FARM_STOP_LOOP)
+				{
+					printf("    the loop is x%04X-x%04X, it repeats every %llu instructions\n", job.loopLow, job.loopHigh, (unsigned long long)job.loopPeriod);
+					failed++;
+				}
+				break;
+			case JOB_CRASHED:
+				printf("CRASHED, %s\n", crash_message(job, buffer, sizeof(buffer)));
+				failed++;
+				break;
+			case JOB_TIMEOUT:
+				printf("TIMEOUT after %.1f s\n", (double)job.microseconds / 1e6);
+				failed++;
+				break;
+			default:
+				printf("FAILED, couldn't read the program or the keys\n");
+				failed++;
+				break;
+		}
+	}
+	fflush(stdout);
+	fprintf(
+		stderr, "\n%d jobs on %d workers in %.3f s, %llu instructions (%.1f MIPS), %d failed, %d worker restarts\n",
+		farm->jobCount, farm->workerCount, seconds, (unsigned long long)total, seconds > 0 ? (double)total / seconds / 1e6 : 0.0, failed, restarts
+	);
+	return failed ? ERROR_VALUE : 0;
+}
+
+/* lc3farm --tests output */
+static int report_tests(double seconds, int restarts, const char* junitPath, const char* jsonPath)
+{
+	int passed = 0;
+	int failures = 0;
+	int errors = 0;
+	for (int i = 0; i < farm->jobCount; i++)
+	{
+		const struct farmSpec& spec = farmSpecs[(size_t)i];
+		const struct farmJob& job = farm->jobs[i];
+		char buffer[FARM_MESSAGE_MAX];
+		const char* message = test_message(job, buffer, sizeof(buffer));
+		if (!message)
+		{
+			printf("test %d %s: PASS, %llu instructions, %.1f ms\n", i + 1, spec.name.c_str(), (unsigned long long)job.instructions, (double)job.microseconds / 1000.0);
+			passed++;
+		}
+		else
+		{
+			printf("test %d %s: %s, %s\n", i + 1, spec.name.c_str(), job.state == JOB_DONE ? "FAIL" : "ERROR", message);
+			(job.state == JOB_DONE ? failures : errors)++;
+		}
+	}
+	fflush(stdout);
+	fprintf(
+		stderr, "\n%d tests on %d workers in %.3f s (%.0f tests/s), %d passed, %d failed, %d errors, %d worker restarts\n",
+		farm->jobCount, farm->workerCount, seconds, seconds > 0 ? farm->jobCount / seconds : 0.0, passed, failures, errors, restarts
+	);
+
+	bool written = true;
+	if (junitPath)
+	{
+		written = write_junit(junitPath, failures, errors, seconds) && written;
+	}
+	if (jsonPath)
+	{
+		written = write_json(jsonPath, passed, failures, errors, seconds) && written;
+	}
+	if (!written)
+	{
+		return ERROR_LOADFILE;
+	}
+	return (failures || errors) ? ERROR_VALUE : 0;
+}
+
+int main(int argc, char* argv[])
+{
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int workerCount = cpus > 0 ? (int)cpus : 1;
+	uint64_t maxInstructions = 100000000;
+	double timeout = 60;
+	int retries = 1;
+	const char* jobsPath = nullptr;
+	const char* junitPath = nullptr;
+	const char* jsonPath = nullptr;
+	bool selfTest = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		bool hasValue = (i + 1 < argc);
+		if (strcmp(argv[i], "--workers") == 0 && hasValue)
+		{
+			workerCount = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--max") == 0 && hasValue)
+		{
+			maxInstructions = strtoull(argv[++i], nullptr, 10);
+		}
+		else if (strcmp(argv[i], "--timeout") == 0 && hasValue)
+		{
+			timeout = atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--retries") == 0 && hasValue)
+		{
+			retries = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--tests") == 0 && hasValue && jobsPath == nullptr)
+		{
+			farmTests = true;
+			jobsPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--self-test") == 0 && jobsPath == nullptr)
+		{
+			farmTests = true;
+			selfTest = true;
+		}
+		else if (strcmp(argv[i], "--hang-check") == 0)
+		{
+			farmHangCheck = true;
+		}
+		else if (strcmp(argv[i], "--native") == 0)
+		{
+			nativeEnabled = true;
+		}
+		else if (strcmp(argv[i], "--junit") == 0 && hasValue)
+		{
+			junitPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--json") == 0 && hasValue)
+		{
+			jsonPath = argv[++i];
+		}
+		else if (argv[i][0] != '-' && jobsPath == nullptr && !selfTest)
+		{
+			jobsPath = argv[i];
+		}
+		else
+		{
+			usage();
+			return ERROR_VALUE;
+		}
+	}
+	if ((jobsPath == nullptr && !selfTest) || workerCount < 1 || retries < 0 || timeout <= 0 || ((junitPath || jsonPath) && !farmTests))
+	{
+		usage();
+		return ERROR_VALUE;
+	}
+
+	int64_t timeoutUs = (int64_t)(timeout * 1e6);
+	bool loaded = selfTest ? self_test_specs(maxInstructions, timeoutUs)
+		: (farmTests ? read_tests(jobsPath, maxInstructions, timeoutUs) : read_jobs(jobsPath, maxInstructions, timeoutUs));
+	if (!loaded)
+	{
+		self_test_cleanup();
+		return ERROR_LOADFILE;
+	}
+	int jobCount = (int)farmSpecs.size();
+
+	// EXPLAIN: Every job is pushed once plus once per retry, the ring never has to wrap over a live entry
+	uint32_t capacity = (uint32_t)jobCount * (uint32_t)(retries + 1) + 1;
+	size_t bytes = sizeof(struct farmShared) + sizeof(struct farmJob) * (size_t)jobCount
+		+ sizeof(struct farmSlot) * (size_t)workerCount + sizeof(uint32_t) * capacity;
+	void* mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (mapping == MAP_FAILED)
+	{
+		fprintf(stderr, "Failed to map %zu bytes of shared memory\n", bytes);
+		return ERROR_VM_INIT_FAIL;
+	}
+	char* cursor = (char*)mapping;
+	farm = new (cursor) struct farmShared;
+	cursor += sizeof(struct farmShared);
+	farm->jobs = (struct farmJob*)cursor;
+	for (int i = 0; i < jobCount; i++)
+	{
+		new (&farm->jobs[i]) struct farmJob;
+	}
+	cursor += sizeof(struct farmJob) * (size_t)jobCount;
+	farm->slots = (struct farmSlot*)cursor;
+	for (int id = 0; id < workerCount; id++)
+	{
+		new (&farm->slots[id]) struct farmSlot;
+	}
+	cursor += sizeof(struct farmSlot) * (size_t)workerCount;
+	farm->ring = (uint32_t*)cursor;
+	farm->capacity = capacity;
+	farm->jobCount = jobCount;
+	farm->workerCount = workerCount;
+	farm->head = 0;
+	farm->tail = 0;
+	farm->done = 0;
+	farm->finished = false;
+
+	// EXPLAIN: Jobs of one program back to back, a worker then loads and decodes it once for the whole run of them
+	std::vector<uint32_t> order((size_t)jobCount);
+	for (int i = 0; i < jobCount; i++)
+	{
+		order[(size_t)i] = (uint32_t)i;
+	}
+	std::stable_sort(order.begin(), order.end(), [](uint32_t a, uint32_t b) { return farmSpecs[a].program < farmSpecs[b].program; });
+	for (uint32_t i : order)
+	{
+		farm->jobs[i].state = JOB_PENDING;
+		farm->jobs[i].attempts = 1;
+		ring_push(i);
+	}
+
+	auto begin = std::chrono::steady_clock::now();
+	for (int id = 0; id < workerCount; id++)
+	{
+		if (spawn_worker(id) < 0)
+		{
+			fprintf(stderr, "Failed to start worker %d\n", id);
+			return ERROR_VM_INIT_FAIL;
+		}
+	}
+
+	int restarts = 0;
+	while (farm->done.load(std::memory_order_acquire) < jobCount)
+	{
+		for (int id = 0; id < workerCount; id++)
+		{
+			struct farmSlot& slot = farm->slots[id];
+			int index = slot.job;
+			if (index >= 0 && now_us() - slot.startedUs > farmSpecs[(size_t)index].timeoutUs && slot.job.compare_exchange_strong(index, -1))
+			{
+				farm->jobs[index].microseconds = (uint64_t)(now_us() - slot.startedUs);
+				job_finish(farm->jobs[index], JOB_TIMEOUT);
+				kill(slot.pid, SIGKILL);
+			}
+		}
+
+		int status;
+		pid_t pid;
+		while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+		{
+			for (int id = 0; id < workerCount; id++)
+			{
+				struct farmSlot& slot = farm->slots[id];
+				if (slot.pid != pid)
+				{
+					continue;
+				}
+				int index = slot.job.exchange(-1);
+				if (index >= 0)
+				{
+					struct farmJob& job = farm->jobs[index];
+					job.exitStatus = status;
+					if (job.attempts <= retries)
+					{
+						job.attempts++;
+						job.state = JOB_PENDING;
+						ring_push((uint32_t)index);
+					}
+					else
+					{
+						job_finish(job, JOB_CRASHED);
+					}
+				}
+				restarts++;
+				if (spawn_worker(id) < 0)
+				{
+					fprintf(stderr, "Failed to restart worker %d\n", id);
+					return ERROR_VM_INIT_FAIL;
+				}
+			}
+		}
+		usleep(2000);
+	}
+
+	farm->finished = true;
+	for (int id = 0; id < workerCount; id++)
+	{
+		waitpid(farm->slots[id].pid, nullptr, 0);
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+	int result = farmTests ? report_tests(seconds, restarts, junitPath, jsonPath) : report_jobs(seconds, restarts);
+	self_test_cleanup();
+	return result;
+}
@@ -0,0 +1,449 @@
+/*
+	Coverage guided fuzzer for LC-3 programs: mutates keyboard input and keeps the inputs that reach
+	new block edges, see lc3vmwin_fuzz.hpp for what one execution does. POSIX only, the workers are processes.
+
+	lc3fuzz [options] program.obj DIR
+		--jobs N        worker processes (default 1), they share the coverage map and the corpus
+		--limit N       instructions per execution before it counts as a hang (default 1000000)
+		--keys STRING   the keys mutations pick from (default printable ASCII and newline)
+		--max-len N     longest input in keys (default 256)
+		--seconds N     stop after N seconds (default until Ctrl+C)
+		--execs N       stop each worker after N executions
+		--code A:B      the program's code, a PC outside it is a crash (hex as x3000 / 0x3000).
+		                Default every page the program loaded something into
+		--seed N        random seed (default the time)
+
+	DIR/queue           the corpus, one input per file, the keys as raw bytes. Files already there are the seeds,
+	                    the empty input is one when there are none
+	DIR/crashes         one input per fault kind and address: illegal-xADDR-..., badpc-xADDR-...
+	DIR/hangs           one input per address the hang was stopped at, hang-xADDR-...
+	Any input replays with lc3vm_headless --keys "$(cat FILE)" program.obj
+	Exits with an error when it found a crash or a hang
+*/
+
+#include "globals.hpp"
+#include "lc3vmwin_core.hpp"
+#include "lc3vmwin_fuzz.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <new>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+uint8_t DEBUG_MODE = DEBUG_OFF;
+
+/* Lives in memory shared by the parent and every worker */
+struct fuzzShared
+{
+	std::atomic<uint8_t> virgin[FUZZ_MAP_SIZE];
+	std::atomic<uint8_t> faultSeen[FUZZ_RESULT_COUNT][MAX_SIZE];
+	std::atomic<uint64_t> execs;
+	std::atomic<uint64_t> instructions;
+	std::atomic<uint64_t> crashes;
+	std::atomic<uint64_t> hangs;
+	std::atomic<uint64_t> queued;
+	std::atomic<uint64_t> edges;
+	std::atomic<bool> stop;
+};
+
+struct fuzzOptions
+{
+	int jobs;
+	uint64_t limit;
+	std::string keys;
+	size_t maxLength;
+	uint64_t seconds;
+	uint64_t execs;
+	uint64_t seed;
+	std::string dir;
+};
+
+static struct fuzzShared* shared = nullptr;
+
+static void usage()
+{
+	fprintf(stderr, "Usage: lc3fuzz [--jobs N] [--limit N] [--keys STRING] [--max-len N] [--seconds N] [--execs N] [--code A:B] [--seed N] program.obj DIR\n");
+}
+
+static uint16_t parse_address(const char* text)
+{
+	if (text[0] == 'x' || text[0] == 'X')
+	{
+		text++;
+	}
+	return (uint16_t)strtoul(text, nullptr, 16);
+}
+
+static void on_interrupt(int)
+{
+	shared->stop = true;
+}
+
+/* xorshift64*, one per worker */
+static uint64_t rngState = 1;
+
+static uint64_t rng_next()
+{
+	rngState ^= rngState >> 12;
+	rngState ^= rngState << 25;
+	rngState ^= rngState >> 27;
+	return rngState * UINT64_C(0x2545F4914F6CDD1D);
+}
+
+static size_t rng_below(size_t n)
+{
+	return n ? (size_t)(rng_next() % n) : 0;
+}
+
+static bool read_input(const std::filesystem::path& path, std::vector<uint8_t>* input)
+{
+	FILE* file = fopen(path.string().c_str(), "rb");
+	if (!file)
+	{
+		return false;
+	}
+	input->clear();
+	uint8_t chunk[4096];
+	size_t count;
+	while ((count = fread(chunk, 1, sizeof(chunk), file)) > 0)
+	{
+		input->insert(input->end(), chunk, chunk + count);
+	}
+	fclose(file);
+	return true;
+}
+
+static bool write_input(const std::filesystem::path& path, const std::vector<uint8_t>& input)
+{
+	// EXPLAIN: Other workers scan the queue, they must never see half a file
+	std::string temp = path.string() + ".tmp";
+	FILE* file = fopen(temp.c_str(), "wb");
+	if (!file)
+	{
+		printf("Failed to create %s\n", temp.c_str());
+		return false;
+	}
+	bool ok = fwrite(input.data(), 1, input.size(), file) == input.size();
+	ok = fclose(file) == 0 && ok;
+	return ok && rename(temp.c_str(), path.string().c_str()) == 0;
+}
+
+/* Adds the queue files this worker doesn't have yet, the seeds and whatever the other workers found */
+static void sync_queue(const struct fuzzOptions& options, std::set<std::string>* known, std::vector<std::vector<uint8_t>>* queue)
+{
+	std::error_code error;
+	for (const auto& entry : std::filesystem::directory_iterator(options.dir + "/queue", error))
+	{
+		std::string name = entry.path().filename().string();
+		if (entry.path().extension() == ".tmp" || known->count(name))
+		{
+			continue;
+		}
+		std::vector<uint8_t> input;
+		if (read_input(entry.path(), &input))
+		{
+			known->insert(name);
+			if (input.size() > options.maxLength)
+			{
+				input.resize(options.maxLength);
+			}
+			queue->push_back(std::move(input));
+		}
+	}
+}
+
+static void mutate(const struct fuzzOptions& options, const std::vector<std::vector<uint8_t>>& queue, std::vector<uint8_t>* input)
+{
+	const std::string& keys = options.keys;
+	int rounds = 1 << rng_below(4);
+	for (int round = 0; round < rounds; round++)
+	{
+		size_t size = input->size();
+		switch (rng_below(size ? 6 : 1))
+		{
+			case 0:
+				// Append a few keys
+				for (size_t n = 1 + rng_below(8); n > 0; n--)
+				{
+					input->push_back((uint8_t)keys[rng_below(keys.size())]);
+				}
+				break;
+			case 1:
+				(*input)[rng_below(size)] = (uint8_t)keys[rng_below(keys.size())];
+				break;
+			case 2:
+				input->insert(input->begin() + (long)rng_below(size + 1), (uint8_t)keys[rng_below(keys.size())]);
+				break;
+			case 3:
+			{
+				size_t at = rng_below(size);
+				size_t length = 1 + rng_below(size - at);
+				input->erase(input->begin() + (long)at, input->begin() + (long)(at + length));
+				break;
+			}
+			case 4:
+			{
+				// Repeat a chunk somewhere, programs that read keys in a loop like to see runs
+				size_t at = rng_below(size);
+				size_t length = 1 + rng_below(std::min<size_t>(size - at, 16));
+				std::vector<uint8_t> chunk(input->begin() + (long)at, input->begin() + (long)(at + length));
+				input->insert(input->begin() + (long)rng_below(size + 1), chunk.begin(), chunk.end());
+				break;
+			}
+			case 5:
+			{
+				// Splice: our head, another entry's tail
+				const std::vector<uint8_t>& other = queue[rng_below(queue.size())];
+				size_t cut = rng_below(size + 1);
+				size_t from = rng_below(other.size() + 1);
+				input->resize(cut);
+				input->insert(input->end(), other.begin() + (long)from, other.end());
+				break;
+			}
+		}
+	}
+	if (input->size() > options.maxLength)
+	{
+		input->resize(options.maxLength);
+	}
+}
+
+static void worker(int id, const struct fuzzOptions& options)
+{
+	rngState = options.seed + (uint64_t)id * UINT64_C(0x9E3779B97F4A7C15);
+	if (rngState == 0)
+	{
+		rngState = 1;
+	}
+
+	std::set<std::string> known;
+	std::vector<std::vector<uint8_t>> queue;
+	sync_queue(options, &known, &queue);
+	if (queue.empty())
+	{
+		queue.push_back({});
+	}
+
+	const char* faultNames[FUZZ_RESULT_COUNT] = {"ok", "illegal", "badpc", "hang"};
+	uint64_t execs = 0;
+	uint64_t instructions = 0;
+	uint64_t found = 0;
+	std::vector<uint8_t> input;
+	struct lc3FuzzResult result;
+
+	// EXPLAIN: The seeds run first unchanged so that their coverage counts as known
+	size_t calibrated = 0;
+	while (!shared->stop && (options.execs == 0 || execs < options.execs))
+	{
+		bool seed = calibrated < queue.size();
+		input = seed ? queue[calibrated++] : queue[rng_below(queue.size())];
+		if (!seed)
+		{
+			mutate(options, queue, &input);
+		}
+		fuzz_run(input.data(), input.size(), &result);
+		execs++;
+		instructions += result.instructions;
+
+		// EXPLAIN: Keys the guest never asked for don't belong in the saved input
+		input.resize(result.keysUsed);
+		if (result.kind != FUZZ_OK)
+		{
+			if (!shared->faultSeen[result.kind][result.pc].exchange(1))
+			{
+				char name[64];
+				snprintf(name, sizeof(name), "%s-x%04X-w%d-%llu", faultNames[result.kind], result.pc, id, (unsigned long long)found++);
+				write_input(options.dir + (result.kind == FUZZ_HANG ? "/hangs/" : "/crashes/") + name, input);
+				(result.kind == FUZZ_HANG ? shared->hangs : shared->crashes)++;
+			}
+		}
+		else if (result.newBuckets && !seed)
+		{
+			char name[64];
+			snprintf(name, sizeof(name), "w%d-%06llu-%dedges", id, (unsigned long long)found++, result.newEdges);
+			known.insert(name);
+			queue.push_back(input);
+			write_input(options.dir + "/queue/" + name, input);
+			shared->queued++;
+		}
+		shared->edges += (uint64_t)result.newEdges;
+
+		if ((execs & 63) == 0)
+		{
+			shared->execs += 64;
+			shared->instructions += instructions;
+			instructions = 0;
+		}
+		if ((execs & 1023) == 0)
+		{
+			sync_queue(options, &known, &queue);
+		}
+	}
+	shared->execs += execs & 63;
+	shared->instructions += instructions;
+}
+
+int main(int argc, char* argv[])
+{
+	struct fuzzOptions options = {1, 1000000, std::string(), 256, 0, 0, (uint64_t)time(nullptr), std::string()};
+	const char* programPath = nullptr;
+	const char* codeRange = nullptr;
+
+	for (int i = 1; i < argc; i++)
+	{
+		bool hasValue = (i + 1 < argc);
+		if (strcmp(argv[i], "--jobs") == 0 && hasValue)
+		{
+			options.jobs = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--limit") == 0 && hasValue)
+		{
+			options.limit = strtoull(argv[++i], nullptr, 10);
+		}
+		else if (strcmp(argv[i], "--keys") == 0 && hasValue)
+		{
+			options.keys = argv[++i];
+		}
+		else if (strcmp(argv[i], "--max-len") == 0 && hasValue)
+		{
+			options.maxLength = strtoull(argv[++i], nullptr, 10);
+		}
+		else if (strcmp(argv[i], "--seconds") == 0 && hasValue)
+		{
+			options.seconds = strtoull(argv[++i], nullptr, 10);
+		}
+		else if (strcmp(argv[i], "--execs") == 0 && hasValue)
+		{
+			options.execs = strtoull(argv[++i], nullptr, 10);
+		}
+		else if (strcmp(argv[i], "--code") == 0 && hasValue)
+		{
+			codeRange = argv[++i];
+		}
+		else if (strcmp(argv[i], "--seed") == 0 && hasValue)
+		{
+			options.seed = strtoull(argv[++i], nullptr, 10);
+		}
+		else if (argv[i][0] != '-' && programPath == nullptr)
+		{
+			programPath = argv[i];
+		}
+		else if (argv[i][0] != '-' && options.dir.empty())
+		{
+			options.dir = argv[i];
+		}
+		else
+		{
+			usage();
+			return ERROR_VALUE;
+		}
+	}
+
+	if (programPath == nullptr || options.dir.empty() || options.jobs < 1 || options.limit == 0 || options.maxLength == 0 || (codeRange && !strchr(codeRange, ':')))
+	{
+		usage();
+		return ERROR_VALUE;
+	}
+	if (options.keys.empty())
+	{
+		for (char c = ' '; c <= '~'; c++)
+		{
+			options.keys += c;
+		}
+		options.keys += '\n';
+	}
+
+	std::error_code error;
+	for (const char* sub : {"/queue", "/crashes", "/hangs"})
+	{
+		std::filesystem::create_directories(options.dir + sub, error);
+		if (error)
+		{
+			fprintf(stderr, "Failed to create %s%s\n", options.dir.c_str(), sub);
+			return ERROR_VALUE;
+		}
+	}
+
+	if (!core_load(programPath))
+	{
+		fprintf(stderr, "Failed to read %s\n", programPath);
+		return ERROR_LOADFILE;
+	}
+
+	void* memoryShared = mmap(nullptr, sizeof(struct fuzzShared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (memoryShared == MAP_FAILED)
+	{
+		fprintf(stderr, "Failed to map the shared coverage map\n");
+		return ERROR_VM_INIT_FAIL;
+	}
+	shared = new (memoryShared) struct fuzzShared;
+	for (std::atomic<uint8_t>& entry : shared->virgin)
+	{
+		entry = 0xFF;
+	}
+
+	// EXPLAIN: The workers inherit the loaded program, the start state and the decoded blocks
+	fuzz_init(shared->virgin, options.limit);
+	if (codeRange)
+	{
+		fuzz_set_code(parse_address(codeRange), parse_address(strchr(codeRange, ':') + 1));
+	}
+	signal(SIGINT, &on_interrupt);
+	signal(SIGTERM, &on_interrupt);
+
+	std::vector<pid_t> workers;
+	for (int id = 0; id < options.jobs; id++)
+	{
+		pid_t pid = fork();
+		if (pid == 0)
+		{
+			worker(id, options);
+			_exit(0);
+		}
+		if (pid < 0)
+		{
+			fprintf(stderr, "Failed to start worker %d\n", id);
+			shared->stop = true;
+			break;
+		}
+		workers.push_back(pid);
+	}
+
+	auto begin = std::chrono::steady_clock::now();
+	size_t running = workers.size();
+	while (running > 0)
+	{
+		sleep(1);
+		while (running > 0 && waitpid(-1, nullptr, WNOHANG) > 0)
+		{
+			running--;
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+		if (options.seconds && seconds >= (double)options.seconds)
+		{
+			shared->stop = true;
+		}
+		uint64_t execs = shared->execs;
+		fprintf(
+			stderr, "\r%.0f s: %llu execs (%.0f/s, %.1f MIPS), %llu edges, %llu queued, %llu crashes, %llu hangs   ",
+			seconds, (unsigned long long)execs, seconds > 0 ? (double)execs / seconds : 0.0,
+			seconds > 0 ? (double)shared->instructions / seconds / 1e6 : 0.0, (unsigned long long)shared->edges,
+			(unsigned long long)shared->queued, (unsigned long long)shared->crashes, (unsigned long long)shared->hangs
+		);
+	}
+	fprintf(stderr, "\n");
+
+	return shared->crashes || shared->hangs ? ERROR_VALUE : 0;
+}
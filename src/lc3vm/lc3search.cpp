@@ -0,0 +1,506 @@
+/*
+	2048 player: plays 2048.obj by searching the game tree on clones of the machine.
+	POSIX only, the search runs on forked worker processes that share one anonymous mapping.
+
+	lc3search [options] 2048.obj
+		--workers M      worker processes (default the number of CPUs)
+		--depth D        moves to look ahead, 1 to SEARCH_DEPTH_MAX (default 3)
+		--moves N        stop after N moves (default 1000), the game may end before
+		--board ADDR     the 16 board words, row by row, each a tile's exponent (default the BOARD symbol
+		                 if there is a .sym file, else x301A where 2048.obj in this repo keeps it)
+		--max N          instructions a move may take before the game counts as stuck (default 10000000)
+		--show           print the board after every move
+
+	Every time the game waits for a key the machine is at a node of the tree. The wait is found once at start-up,
+	the first poll after the game's ANSI question, and gets a breakpoint so every node stops right before it.
+	Trying a key there means machine_switch() to the node's clone, running until the breakpoint again and
+	machine_clone() of the result (lc3vmwin_machine.hpp), so the positions below a node share every page
+	they didn't write.
+	The game's random tiles come from its own state, so a clone sees exactly what the game will do.
+	Leaves are scored from the board in guest memory: free cells, merged tiles and the biggest tile in a corner.
+	A key that doesn't move anything is no move.
+
+	How it fits together:
+	- the VM is one machine per process, so the pool is M forked workers. Each keeps the root (the game as
+	  it is) as a clone and replays every move the parent picks onto it
+	- for each move the parent hands out the first two moves of every line (16 tasks) by bumping one counter
+	  in shared memory, the workers take the next task off it whenever they are done with one, so a worker
+	  whose subtrees end early takes over the rest. The counter carries the move number, a worker that is
+	  late can't take a task of the next move
+	- a worker searches its task depth first and writes the best leaf score into the task's slot
+	- the parent picks the first move with the best line, appends it to the moves and starts the next round
+*/
+
+#include "globals.hpp"
+#include "lc3vmwin_breakpoint.hpp"
+#include "lc3vmwin_core.hpp"
+#include "lc3vmwin_machine.hpp"
+#include "lc3vmwin_symbols.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+uint8_t DEBUG_MODE = DEBUG_OFF;
+
+#define SEARCH_DEPTH_MAX    8
+#define SEARCH_MOVES_MAX    100000
+#define SEARCH_PREFIX       2                   // moves of a task, 4^2 tasks per move
+#define SEARCH_TASKS_MAX    16
+#define SEARCH_CELLS        16
+#define SEARCH_NONE         INT64_MIN           // no legal line below
+#define SEARCH_DEAD         INT64_C(1000000)    // what a position without a legal move costs
+
+static const char searchKeys[4] = {'w', 'a', 's', 'd'};
+
+struct searchShared
+{
+	std::atomic<uint64_t> next;         // move number << 32 | next task
+	std::atomic<uint32_t> done;         // tasks of this move finished
+	std::atomic<bool> finished;
+	std::atomic<uint64_t> positions;    // search steps, over all workers
+	uint32_t taskCount;
+	uint32_t moveCount;
+	int64_t scores[SEARCH_TASKS_MAX];
+	uint8_t moves[SEARCH_MOVES_MAX];
+};
+
+static struct searchShared* search = nullptr;
+static uint16_t searchBoard = 0x301A;
+static uint64_t searchMaxPerMove = 10000000;
+static int searchDepth = 3;
+
+// EXPLAIN: A key for the game's next poll, only while it boots. A poll without one means the game waits there
+static bool searchHasKey = false;
+static uint8_t searchKey = 0;
+static bool searchPolled = false;
+static uint16_t searchPollAddress = 0;
+
+static void usage()
+{
+	fprintf(stderr, "Usage: lc3search [--workers M] [--depth D] [--moves N] [--board ADDR] [--max N] [--show] 2048.obj\n");
+}
+
+static void search_input_poll()
+{
+	if (searchHasKey)
+	{
+		core_key_press(searchKey);
+		searchHasKey = false;
+	}
+	else
+	{
+		// EXPLAIN: The PC is past the GETC or the load of KBSR that polled
+		searchPollAddress = (uint16_t)(reg[R_PC] - 1);
+		searchPolled = true;
+		isRunning = false;
+	}
+}
+
+/* Run to the breakpoint on the game's wait. false if it HALTed, polled anywhere else or took more than searchMaxPerMove */
+static bool search_run()
+{
+	searchPolled = false;
+	isRunning = true;
+	uint64_t start = retiredCount;
+	while (isRunning && !isStepIn && retiredCount - start < searchMaxPerMove)
+	{
+		core_run_block();
+	}
+	bool waiting = isStepIn && !searchPolled;
+	// EXPLAIN: Every node stops right on the breakpoint, the next step starts by running that very instruction
+	isStepIn = false;
+	breakpointResume = true;
+	return waiting;
+}
+
+/*
+	From the wait, give the game key and run to its next wait.
+	WHY not hand the key over in the poll and stop at the next one? GETC returns the last key when the poll has
+	none, the game would play that key once more before the block ends. The breakpoint stops before the GETC.
+*/
+static bool search_step(uint8_t key)
+{
+	core_key_press(key);
+	return search_run();
+}
+
+static void search_read_board(uint16_t cells[])
+{
+	for (int i = 0; i < SEARCH_CELLS; i++)
+	{
+		cells[i] = memory[(uint16_t)(searchBoard + i)];
+	}
+}
+
+/* The key did something: the game waits again and the board is different */
+static bool search_move(uint8_t key)
+{
+	uint16_t before[SEARCH_CELLS];
+	uint16_t after[SEARCH_CELLS];
+	search_read_board(before);
+	if (!search_step(key))
+	{
+		return false;
+	}
+	search_read_board(after);
+	return memcmp(before, after, sizeof(before)) != 0;
+}
+
+static int64_t search_score()
+{
+	uint16_t cells[SEARCH_CELLS];
+	search_read_board(cells);
+	int64_t score = 0;
+	int best = 0;
+	for (int i = 0; i < SEARCH_CELLS; i++)
+	{
+		int64_t e = cells[i];
+		// EXPLAIN: Squares reward merging, two tiles of exponent e score less than the one of e + 1 they make
+		score += e == 0 ? 512 : e * e * 4;
+		best = cells[i] > cells[best] ? i : best;
+	}
+	if (best == 0 || best == 3 || best == 12 || best == 15)
+	{
+		score += (int64_t)cells[best] * cells[best] * 16;
+	}
+	return score;
+}
+
+/* Best leaf below the machine as it is (waiting for a key), depth moves down */
+static int64_t search_node(int depth, std::vector<struct lc3Machine>& stack, uint64_t* positions)
+{
+	if (depth == 0)
+	{
+		return search_score();
+	}
+	struct lc3Machine& here = stack[(size_t)depth];
+	machine_clone(&here);
+	int64_t best = SEARCH_NONE;
+	for (int k = 0; k < 4; k++)
+	{
+		if (k > 0)
+		{
+			machine_switch(here);
+		}
+		++*positions;
+		if (search_move((uint8_t)searchKeys[k]))
+		{
+			int64_t score = search_node(depth - 1, stack, positions);
+			best = score > best ? score : best;
+		}
+	}
+	// EXPLAIN: Game over down there, worse than any line that goes on
+	return best == SEARCH_NONE ? search_score() - SEARCH_DEAD : best;
+}
+
+/* Task t: moves t / 4 and t % 4 from the root, or just t with a depth of 1 */
+static int64_t search_task(uint32_t task, const struct lc3Machine& root, std::vector<struct lc3Machine>& stack, uint64_t* positions)
+{
+	machine_switch(root);
+	int prefix = searchDepth < SEARCH_PREFIX ? searchDepth : SEARCH_PREFIX;
+	for (int i = prefix - 1; i >= 0; i--)
+	{
+		int k = (int)(task >> (2 * i)) & 3;
+		++*positions;
+		if (!search_move((uint8_t)searchKeys[k]))
+		{
+			return SEARCH_NONE;
+		}
+	}
+	return search_node(searchDepth - prefix, stack, positions);
+}
+
+static void worker(const struct lc3Machine& start)
+{
+	// EXPLAIN: The loader and HALT print to stdout, which is the parent's
+	int devNull = open("/dev/null", O_WRONLY);
+	if (devNull >= 0)
+	{
+		dup2(devNull, STDOUT_FILENO);
+		close(devNull);
+	}
+
+	struct lc3Machine root = start;
+	std::vector<struct lc3Machine> stack((size_t)searchDepth + 1);
+	uint32_t applied = 0;
+	uint32_t epoch = UINT32_MAX;
+	while (!search->finished.load(std::memory_order_acquire))
+	{
+		uint64_t next = search->next.load(std::memory_order_acquire);
+		if ((uint32_t)(next >> 32) == epoch)
+		{
+			usleep(50);
+			continue;
+		}
+		epoch = (uint32_t)(next >> 32);
+
+		// EXPLAIN: Catch up with the game, the moves the parent picked since the last round
+		uint32_t moveCount = search->moveCount;
+		if (applied < moveCount)
+		{
+			machine_switch(root);
+			for (; applied < moveCount; applied++)
+			{
+				search_step(search->moves[applied]);
+			}
+			machine_clone(&root);
+		}
+
+		uint64_t positions = 0;
+		while (true)
+		{
+			if ((uint32_t)(next >> 32) != epoch || (uint32_t)next >= search->taskCount)
+			{
+				break;
+			}
+			if (!search->next.compare_exchange_weak(next, next + 1, std::memory_order_acq_rel))
+			{
+				continue;
+			}
+			uint32_t task = (uint32_t)next;
+			search->scores[task] = search_task(task, root, stack, &positions);
+			search->done.fetch_add(1, std::memory_order_release);
+			next = search->next.load(std::memory_order_acquire);
+		}
+		search->positions.fetch_add(positions, std::memory_order_relaxed);
+	}
+}
+
+static void print_board()
+{
+	uint16_t cells[SEARCH_CELLS];
+	search_read_board(cells);
+	for (int row = 0; row < 4; row++)
+	{
+		for (int col = 0; col < 4; col++)
+		{
+			uint16_t e = cells[row * 4 + col];
+			if (e == 0)
+			{
+				printf("     .");
+			}
+			else
+			{
+				printf("%6u", e < 16 ? 1u << e : 0u);
+			}
+		}
+		printf("\n");
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int workerCount = cpus > 0 ? (int)cpus : 1;
+	uint32_t moveLimit = 1000;
+	bool show = false;
+	bool boardGiven = false;
+	const char* programPath = nullptr;
+
+	for (int i = 1; i < argc; i++)
+	{
+		bool hasValue = (i + 1 < argc);
+		if (strcmp(argv[i], "--workers") == 0 && hasValue)
+		{
+			workerCount = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--depth") == 0 && hasValue)
+		{
+			searchDepth = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--moves") == 0 && hasValue)
+		{
+			moveLimit = (uint32_t)strtoul(argv[++i], nullptr, 10);
+		}
+		else if (strcmp(argv[i], "--board") == 0 && hasValue)
+		{
+			const char* text = argv[++i];
+			searchBoard = (uint16_t)strtoul(text + (text[0] == 'x' || text[0] == 'X'), nullptr, 16);
+			boardGiven = true;
+		}
+		else if (strcmp(argv[i], "--max") == 0 && hasValue)
+		{
+			searchMaxPerMove = strtoull(argv[++i], nullptr, 10);
+		}
+		else if (strcmp(argv[i], "--show") == 0)
+		{
+			show = true;
+		}
+		else if (argv[i][0] != '-' && programPath == nullptr)
+		{
+			programPath = argv[i];
+		}
+		else
+		{
+			usage();
+			return ERROR_VALUE;
+		}
+	}
+	if (programPath == nullptr || workerCount < 1 || searchDepth < 1 || searchDepth > SEARCH_DEPTH_MAX || moveLimit > SEARCH_MOVES_MAX)
+	{
+		usage();
+		return ERROR_VALUE;
+	}
+
+	memset(memory, 0, sizeof(uint16_t) * MAX_SIZE);
+	if (!core_load(programPath))
+	{
+		fprintf(stderr, "Failed to read %s\n", programPath);
+		return ERROR_LOADFILE;
+	}
+	uint16_t symbol;
+	if (!boardGiven && symbols_lookup("BOARD", &symbol))
+	{
+		searchBoard = symbol;
+	}
+	host.input_poll = &search_input_poll;
+
+	/*
+		EXPLAIN: 2048 asks whether the terminal does ANSI first, the answer decides how it draws and not what it plays.
+		The first poll after the answer is where the game waits for moves. That run already went past it, so it
+		starts over from the boot with a breakpoint there
+	*/
+	struct lc3Machine boot;
+	machine_clone(&boot);
+	searchKey = 'y';
+	searchHasKey = true;
+	search_run();
+	std::string error;
+	if (!searchPolled || bp_add(searchPollAddress, "", error) < 0)
+	{
+		fprintf(stderr, "Failed to get %s to wait for a move\n", programPath);
+		return ERROR_VM_INIT_FAIL;
+	}
+	machine_switch(boot);
+	breakpointResume = false;
+	searchHasKey = true;
+	bool waiting = search_run();
+	// EXPLAIN: The answer is read where the moves are, the breakpoint came first
+	if (waiting && searchHasKey)
+	{
+		searchHasKey = false;
+		waiting = search_step('y');
+	}
+	if (!waiting)
+	{
+		fprintf(stderr, "Failed to get %s to wait for a move\n", programPath);
+		return ERROR_VM_INIT_FAIL;
+	}
+	struct lc3Machine root;
+	machine_clone(&root);
+
+	void* mapping = mmap(nullptr, sizeof(struct searchShared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (mapping == MAP_FAILED)
+	{
+		fprintf(stderr, "Failed to map %zu bytes of shared memory\n", sizeof(struct searchShared));
+		return ERROR_VM_INIT_FAIL;
+	}
+	search = new (mapping) struct searchShared;
+	search->next = 0;
+	search->done = 0;
+	search->finished = false;
+	search->positions = 0;
+	search->taskCount = 0;
+	search->moveCount = 0;
+
+	fflush(stdout);
+	std::vector<pid_t> workers;
+	for (int id = 0; id < workerCount; id++)
+	{
+		pid_t pid = fork();
+		if (pid == 0)
+		{
+			worker(root);
+			_exit(0);
+		}
+		if (pid < 0)
+		{
+			fprintf(stderr, "Failed to start worker %d\n", id);
+			search->finished = true;
+			break;
+		}
+		workers.push_back(pid);
+	}
+
+	uint32_t tasks = 1u << (2 * (searchDepth < SEARCH_PREFIX ? searchDepth : SEARCH_PREFIX));
+	int perFirst = (int)tasks / 4;
+	auto begin = std::chrono::steady_clock::now();
+	bool over = false;
+	while (!search->finished && search->moveCount < moveLimit)
+	{
+		for (uint32_t t = 0; t < tasks; t++)
+		{
+			search->scores[t] = SEARCH_NONE;
+		}
+		search->taskCount = tasks;
+		search->done = 0;
+		search->next.store((uint64_t)(search->moveCount + 1) << 32, std::memory_order_release);
+		while (search->done.load(std::memory_order_acquire) < tasks)
+		{
+			usleep(50);
+		}
+
+		int bestKey = -1;
+		int64_t bestScore = SEARCH_NONE;
+		for (int k = 0; k < 4; k++)
+		{
+			for (int t = k * perFirst; t < (k + 1) * perFirst; t++)
+			{
+				if (search->scores[t] != SEARCH_NONE && (bestKey < 0 || search->scores[t] > bestScore))
+				{
+					bestKey = k;
+					bestScore = search->scores[t];
+				}
+			}
+		}
+		if (bestKey < 0)
+		{
+			over = true;
+			break;
+		}
+
+		// EXPLAIN: The parent plays along on its own copy, for --show and the final board
+		search_step((uint8_t)searchKeys[bestKey]);
+		search->moves[search->moveCount] = (uint8_t)searchKeys[bestKey];
+		search->moveCount++;
+		if (show)
+		{
+			printf("move %u: %c\n", search->moveCount, searchKeys[bestKey]);
+			print_board();
+		}
+	}
+	search->finished = true;
+	for (pid_t pid : workers)
+	{
+		waitpid(pid, nullptr, 0);
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+	uint16_t cells[SEARCH_CELLS];
+	search_read_board(cells);
+	uint16_t top = 0;
+	for (int i = 0; i < SEARCH_CELLS; i++)
+	{
+		top = cells[i] > top ? cells[i] : top;
+	}
+	printf("\n");
+	print_board();
+	uint64_t positions = search->positions;
+	fprintf(
+		stderr, "\n%u moves (%s), biggest tile %u, %llu positions searched in %.3f s on %d workers (%.0f positions/s)\n",
+		search->moveCount, over ? "game over" : "move limit", top < 16 ? 1u << top : 0u, (unsigned long long)positions, seconds,
+		(int)workers.size(), seconds > 0 ? (double)positions / seconds : 0.0
+	);
+	return 0;
+}
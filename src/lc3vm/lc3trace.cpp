@@ -0,0 +1,364 @@
+/*
+	Command line tool for the trace files written by the trace recorder (lc3vmwin_trace.cpp)
+
+	lc3trace info FILE                   chunks, entries, bytes per instruction, dropped steps
+	lc3trace print FILE [options]        one line per instruction to stdout
+	lc3trace text FILE OUT [options]     the same, to OUT
+		--from ADDR --to ADDR    only instructions with ADDR <= PC <= ADDR (hex as x3000 / 0x3000)
+		--steps A:B              only steps A to B (inclusive, either side can be left out)
+		--limit N                stop after N lines
+
+	Queries, answered from the index TRACE.idx (built on first use, or by hand with "index"):
+	lc3trace index FILE
+	lc3trace lastwrite FILE ADDR [STEP]  the last instruction that wrote ADDR before STEP (default the end)
+	lc3trace first FILE ADDR             the first time the PC reached ADDR
+	lc3trace values FILE REG FROM TO     every value REG (R0-R7, COND) had after an instruction in FROM-TO
+*/
+
+#include "globals.hpp"
+#include "lc3vmwin_trace_reader.hpp"
+#include "lc3vmwin_trace_index.hpp"
+#include "lc3vmwin_disa_be.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+static std::string (*dis_table[16])(uint16_t, uint16_t) = {
+	&dis_br, &dis_add, &dis_ld, &dis_st, &dis_jsr, &dis_and, &dis_ldr, &dis_str,
+	&dis_rti, &dis_not, &dis_ldi, &dis_sti, &dis_jmp, &dis_rsv, &dis_lea, &dis_trap
+};
+
+struct traceFilter
+{
+	uint16_t from;
+	uint16_t to;
+	uint64_t firstStep;
+	uint64_t lastStep;
+	uint64_t limit;
+};
+
+static void usage()
+{
+	fprintf(stderr, "Usage: lc3trace info FILE\n");
+	fprintf(stderr, "       lc3trace print FILE [--from ADDR] [--to ADDR] [--steps A:B] [--limit N]\n");
+	fprintf(stderr, "       lc3trace text FILE OUT [--from ADDR] [--to ADDR] [--steps A:B] [--limit N]\n");
+	fprintf(stderr, "       lc3trace index FILE\n");
+	fprintf(stderr, "       lc3trace lastwrite FILE ADDR [STEP]\n");
+	fprintf(stderr, "       lc3trace first FILE ADDR\n");
+	fprintf(stderr, "       lc3trace values FILE REG FROM TO\n");
+}
+
+static uint16_t parse_address(const char* text)
+{
+	if (text[0] == 'x' || text[0] == 'X')
+	{
+		text++;
+	}
+	return (uint16_t)strtoul(text, nullptr, 16);
+}
+
+static bool parse_filter(int argc, char* argv[], int first, struct traceFilter* filter)
+{
+	*filter = {0x0000, 0xFFFF, 0, UINT64_MAX, UINT64_MAX};
+	for (int i = first; i < argc; i++)
+	{
+		if (i + 1 >= argc)
+		{
+			return false;
+		}
+		if (strcmp(argv[i], "--from") == 0)
+		{
+			filter->from = parse_address(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--to") == 0)
+		{
+			filter->to = parse_address(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--steps") == 0)
+		{
+			const char* range = argv[++i];
+			const char* colon = strchr(range, ':');
+			if (!colon)
+			{
+				return false;
+			}
+			if (colon != range)
+			{
+				filter->firstStep = strtoull(range, nullptr, 10);
+			}
+			if (colon[1] != '\0')
+			{
+				filter->lastStep = strtoull(colon + 1, nullptr, 10);
+			}
+		}
+		else if (strcmp(argv[i], "--limit") == 0)
+		{
+			filter->limit = strtoull(argv[++i], nullptr, 10);
+		}
+		else
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static void print_entry(FILE* out, const struct lc3TraceEntry& entry)
+{
+	std::string text = dis_table[entry.instr >> 12](entry.instr, entry.pc);
+	for (char& c : text)
+	{
+		if (c == '\t')
+		{
+			c = ' ';
+		}
+	}
+
+	fprintf(out, "%10llu  x%04X  %04X  %-28s", (unsigned long long)entry.step, entry.pc, entry.instr, text.c_str());
+	for (int r = R_R0; r <= R_R7; r++)
+	{
+		if (entry.regMask & (1 << r))
+		{
+			fprintf(out, " R%d=x%04X", r, entry.regs[r]);
+		}
+	}
+	uint16_t cond = entry.regs[R_COND];
+	fprintf(out, " %c", cond & FL_NEG ? 'N' : (cond & FL_ZRO ? 'Z' : 'P'));
+	for (size_t i = 0; i < entry.writeCount; i++)
+	{
+		fprintf(out, " [x%04X]=x%04X", entry.writeAddress[i], entry.writeValue[i]);
+	}
+	fprintf(out, "\n");
+}
+
+static int trace_info(const char* path)
+{
+	struct lc3TraceReader reader;
+	if (!trace_reader_open(&reader, path))
+	{
+		return ERROR_LOADFILE;
+	}
+
+	struct lc3TraceChunkInfo info;
+	uint64_t chunks = 0;
+	uint64_t entries = 0;
+	uint64_t payload = 0;
+	uint64_t firstStep = 0;
+	uint64_t nextStep = 0;
+	uint64_t gaps = 0;
+	uint64_t missing = 0;
+	while (trace_reader_skip_chunk(&reader, &info))
+	{
+		if (chunks == 0)
+		{
+			firstStep = info.firstStep;
+		}
+		else if (info.firstStep != nextStep)
+		{
+			gaps++;
+			missing += info.firstStep - nextStep;
+		}
+		nextStep = info.firstStep + info.entries;
+		chunks++;
+		entries += info.entries;
+		payload += info.bytes;
+	}
+	bool error = reader.error;
+	long size = ftell(reader.file);
+	trace_reader_close(&reader);
+
+	printf("chunks          %llu\n", (unsigned long long)chunks);
+	printf("entries         %llu (steps %llu to %llu)\n", (unsigned long long)entries, (unsigned long long)firstStep, (unsigned long long)(nextStep > 0 ? nextStep - 1 : 0));
+	printf("file bytes      %ld\n", size);
+	printf("bytes/instr     %.2f (payload only %.2f)\n", entries ? (double)size / (double)entries : 0.0, entries ? (double)payload / (double)entries : 0.0);
+	printf("gaps            %llu (%llu steps dropped)\n", (unsigned long long)gaps, (unsigned long long)missing);
+	return error ? ERROR_VALUE : 0;
+}
+
+static int trace_print(const char* path, FILE* out, const struct traceFilter& filter)
+{
+	struct lc3TraceReader reader;
+	if (!trace_reader_open(&reader, path))
+	{
+		return ERROR_LOADFILE;
+	}
+
+	// EXPLAIN: Chunks that end before the first step we want are skipped without decoding
+	struct lc3TraceChunkInfo info;
+	while (filter.firstStep > 0)
+	{
+		long offset = ftell(reader.file);
+		if (!trace_reader_skip_chunk(&reader, &info))
+		{
+			break;
+		}
+		if (info.firstStep + info.entries > filter.firstStep)
+		{
+			fseek(reader.file, offset, SEEK_SET);
+			break;
+		}
+	}
+
+	struct lc3TraceEntry entry;
+	uint64_t lines = 0;
+	uint64_t gaps = 0;
+	while (lines < filter.limit && trace_reader_next(&reader, &entry))
+	{
+		if (reader.gaps != gaps)
+		{
+			fprintf(out, "---- %llu steps missing ----\n", (unsigned long long)(reader.missingSteps));
+			gaps = reader.gaps;
+		}
+		if (entry.step > filter.lastStep)
+		{
+			break;
+		}
+		if (entry.step < filter.firstStep || entry.pc < filter.from || entry.pc > filter.to)
+		{
+			continue;
+		}
+		print_entry(out, entry);
+		lines++;
+	}
+
+	bool error = reader.error;
+	trace_reader_close(&reader);
+	return error ? ERROR_VALUE : 0;
+}
+
+static int parse_register(const char* text)
+{
+	if (strcmp(text, "COND") == 0 || strcmp(text, "cond") == 0)
+	{
+		return R_COND;
+	}
+	if ((text[0] == 'R' || text[0] == 'r') && text[1] >= '0' && text[1] <= '7' && text[2] == '\0')
+	{
+		return R_R0 + (text[1] - '0');
+	}
+	return -1;
+}
+
+static int trace_query(int argc, char* argv[])
+{
+	const char* command = argv[1];
+	const char* path = argv[2];
+
+	if (strcmp(command, "index") == 0)
+	{
+		return trace_index_build(path) ? 0 : ERROR_VALUE;
+	}
+
+	int registerIndex = -1;
+	if (strcmp(command, "values") == 0 && (argc != 6 || (registerIndex = parse_register(argv[3])) < 0))
+	{
+		usage();
+		return ERROR_VALUE;
+	}
+
+	struct lc3TraceIndex index;
+	if (!trace_index_open(&index, path))
+	{
+		return ERROR_LOADFILE;
+	}
+
+	// EXPLAIN: Timed without the index load (and build), that part is paid once per trace
+	auto begin = std::chrono::steady_clock::now();
+	struct lc3TraceEntry entry;
+	int result = 0;
+	if (strcmp(command, "lastwrite") == 0)
+	{
+		uint16_t address = parse_address(argv[3]);
+		uint64_t beforeStep = argc > 4 ? strtoull(argv[4], nullptr, 10) : TRACE_INDEX_NONE;
+		if (trace_index_last_write(&index, address, beforeStep, &entry))
+		{
+			print_entry(stdout, entry);
+		}
+		else
+		{
+			printf("x%04X was never written\n", address);
+			result = ERROR_VALUE;
+		}
+	}
+	else if (strcmp(command, "first") == 0)
+	{
+		uint16_t address = parse_address(argv[3]);
+		if (trace_index_first_exec(&index, address, &entry))
+		{
+			print_entry(stdout, entry);
+		}
+		else
+		{
+			printf("x%04X was never executed\n", address);
+			result = ERROR_VALUE;
+		}
+	}
+	else
+	{
+		std::vector<struct lc3TraceValue> values;
+		trace_index_register_values(&index, registerIndex, parse_address(argv[4]), parse_address(argv[5]), values);
+		for (const struct lc3TraceValue& value : values)
+		{
+			printf(
+				"x%04X  %10llu times  first at step %llu (x%04X)\n",
+				value.value, (unsigned long long)value.count, (unsigned long long)value.firstStep, value.firstPC
+			);
+		}
+		printf("%zu distinct values\n", values.size());
+	}
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+	fprintf(stderr, "answered in %.2f ms\n", ms);
+
+	trace_index_close(&index);
+	return result;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 3)
+	{
+		usage();
+		return ERROR_VALUE;
+	}
+
+	const char* command = argv[1];
+	const char* path = argv[2];
+	struct traceFilter filter;
+
+	if (strcmp(command, "info") == 0 && argc == 3)
+	{
+		return trace_info(path);
+	}
+	if (strcmp(command, "print") == 0 && parse_filter(argc, argv, 3, &filter))
+	{
+		return trace_print(path, stdout, filter);
+	}
+	if (strcmp(command, "text") == 0 && argc >= 4 && parse_filter(argc, argv, 4, &filter))
+	{
+		FILE* out = fopen(argv[3], "w");
+		if (!out)
+		{
+			fprintf(stderr, "Failed to create %s\n", argv[3]);
+			return ERROR_LOADFILE;
+		}
+		int result = trace_print(path, out, filter);
+		fclose(out);
+		return result;
+	}
+
+	if (strcmp(command, "index") == 0 || strcmp(command, "lastwrite") == 0 || strcmp(command, "first") == 0 || strcmp(command, "values") == 0)
+	{
+		if ((strcmp(command, "lastwrite") == 0 || strcmp(command, "first") == 0) && argc < 4)
+		{
+			usage();
+			return ERROR_VALUE;
+		}
+		return trace_query(argc, argv);
+	}
+
+	usage();
+	return ERROR_VALUE;
+}
@@ -0,0 +1,513 @@
+/*
+	Headless runner: the same core as lc3vmimgui.cpp without SDL or ImGui.
+	Runs a program as fast as it goes and dumps the instrumentation (ISA stats, profile) on exit.
+
+	lc3vm_headless [options] program.obj
+		--max N          stop after N instructions (default 100000000)
+		--keys STRING    keys for the program, one each time it polls KBSR or GETCs with none pending.
+		                 The run ends when they are used up and the program asks for another one
+		--stats FILE     turn on ISA stats and dump them as JSON to FILE
+		--profile FILE   write the profile as collapsed stacks to FILE
+		--trace FILE     record an execution trace to FILE (read it with lc3trace)
+		--trace-max-mb N stop recording once the trace file reaches N MB (default no limit)
+		--quiet          don't echo the program's console output
+		--load-state FILE  continue from a save state instead of the program's start. The program is still loaded
+		                 first for its symbols. Give the same --keys as the saved run, the keys it used are skipped
+		--save-state FILE  save the machine to FILE when the run ends
+		--checkpoint N   also save it to the --save-state file every N instructions, in the background
+		--record FILE    log the keys the program gets to FILE, with its start state in FILE.state
+		--replay FILE    run FILE.state with the keys in FILE instead of --keys, up to where the recording ended.
+		                 Exits with an error if the run doesn't end in the recorded state
+		--batch FILE     one run per line of FILE, the line is its --keys. Every run starts from the same machine
+		                 (the program's start, or --load-state) and gets its own --max. Prints one line per run
+		--simd           run the --batch lines 16 at a time in the lockstep SIMD engine (lc3vmwin_batch.hpp) instead
+		--simd-check     run them in both and compare, exits with an error if any run differs
+		--hang-check     stop as soon as the program is stuck in an infinite loop (lc3vmwin_hang.hpp), report the
+		                 loop and exit with an error. Not with --batch
+		--no-idioms      run the loops lc3vmwin_idiom.hpp recognises trip by trip, to compare
+		--native         let the program call the native services of the reserved opcode (lc3vmwin_native.hpp).
+		                 Not with --simd or --simd-check, the lockstep engine has none
+		--os FILE        load an LC-3 OS image after the program and run the TRAPs its vector table has in guest
+		                 code (lc3vmwin_trap.hpp). Not with --simd or --simd-check, the lanes only have native TRAPs
+		--native-traps LIST  comma separated hex vectors (e.g. 21,22,24) that stay native with --os. --stats shows
+		                 what each vector costs either way
+*/
+
+#include "globals.hpp"
+#include "lc3vmwin_batch.hpp"
+#include "lc3vmwin_core.hpp"
+#include "lc3vmwin_display.hpp"
+#include "lc3vmwin_hang.hpp"
+#include "lc3vmwin_idiom.hpp"
+#include "lc3vmwin_input.hpp"
+#include "lc3vmwin_machine.hpp"
+#include "lc3vmwin_native.hpp"
+#include "lc3vmwin_profiler_be.hpp"
+#include "lc3vmwin_savestate.hpp"
+#include "lc3vmwin_stats_be.hpp"
+#include "lc3vmwin_trace.hpp"
+#include "lc3vmwin_trap.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+uint8_t DEBUG_MODE = DEBUG_OFF;
+
+static std::string keys;
+static size_t keyIndex = 0;
+static bool keysExhausted = false;
+
+static void headless_console_write(const char* text, size_t length)
+{
+	fwrite(text, 1, length, stdout);
+}
+
+static void headless_input_poll()
+{
+	if (keyIndex < keys.size())
+	{
+		core_key_press((uint8_t)keys[keyIndex++]);
+	}
+	else
+	{
+		keysExhausted = true;
+		isRunning = false;
+	}
+}
+
+/* Console output of the current --batch run, hashed the way the SIMD engine hashes it */
+static uint64_t batchConsole = BATCH_CONSOLE_HASH_START;
+static bool batchEcho = true;
+
+static void headless_batch_console_write(const char* text, size_t length)
+{
+	for (size_t i = 0; i < length; i++)
+	{
+		batchConsole = batch_console_hash(batchConsole, (uint8_t)text[i]);
+	}
+	if (batchEcho)
+	{
+		fwrite(text, 1, length, stdout);
+	}
+}
+
+static void headless_batch_console_clear()
+{
+	batchConsole = batch_console_hash(batchConsole, BATCH_CONSOLE_CLEAR);
+}
+
+/* One --batch line in the core, from the baseline */
+static void headless_batch_scalar(const std::string& line, uint64_t maxInstructions, struct lc3BatchResult* result)
+{
+	machine_reset();
+	uint64_t startCount = retiredCount;
+	keys = line;
+	keyIndex = 0;
+	keysExhausted = false;
+	batchConsole = BATCH_CONSOLE_HASH_START;
+	while (isRunning && retiredCount - startCount < maxInstructions)
+	{
+		core_run_block();
+	}
+	display_flush();
+	result->instructions = retiredCount - startCount;
+	result->stop = keysExhausted ? BATCH_END_OF_KEYS : (isRunning ? BATCH_INSTRUCTION_LIMIT : BATCH_HALT);
+	result->stateHash = core_state_hash();
+	result->consoleHash = batchConsole;
+}
+
+/*
+	--batch: runs every line of path from the machine as it is now, in the core, the SIMD engine or both (and compares them).
+	false if path can't be read or the engines disagree
+*/
+static bool headless_batch(const char* path, uint64_t maxInstructions, bool simd, bool scalar)
+{
+	FILE* file = fopen(path, "r");
+	if (!file)
+	{
+		fprintf(stderr, "Failed to open %s\n", path);
+		return false;
+	}
+	std::vector<std::string> lines;
+	char line[4096];
+	while (fgets(line, sizeof(line), file))
+	{
+		line[strcspn(line, "\r\n")] = '\0';
+		lines.push_back(line);
+	}
+	fclose(file);
+
+	const char* stops[] = {"HALT", "end of keys", "instruction limit", "bad escape sequence"};
+	std::vector<struct lc3BatchResult> simdResults(lines.size());
+	std::vector<struct lc3BatchResult> scalarResults(lines.size());
+	uint64_t total = 0;
+	double simdSeconds = 0;
+	double scalarSeconds = 0;
+
+	if (simd)
+	{
+		auto begin = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < lines.size(); i += BATCH_LANES)
+		{
+			int count = (int)std::min<size_t>(BATCH_LANES, lines.size() - i);
+			batch_run(&lines[i], count, maxInstructions, &simdResults[i]);
+		}
+		simdSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+	}
+	if (scalar)
+	{
+		// EXPLAIN: Each run costs the pages it wrote to undo, not a reload, and keeps the blocks of the code it didn't write
+		machine_baseline();
+		auto begin = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < lines.size(); i++)
+		{
+			headless_batch_scalar(lines[i], maxInstructions, &scalarResults[i]);
+			fflush(stdout);
+		}
+		scalarSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+	}
+
+	int mismatches = 0;
+	for (size_t i = 0; i < lines.size(); i++)
+	{
+		const struct lc3BatchResult& result = simd ? simdResults[i] : scalarResults[i];
+		total += result.instructions;
+		fprintf(
+			stderr, "run %zu: %llu instructions, stopped by %s, state %016llx, console %016llx\n", i + 1,
+			(unsigned long long)result.instructions, stops[result.stop], (unsigned long long)result.stateHash, (unsigned long long)result.consoleHash
+		);
+		const struct lc3BatchResult& other = scalarResults[i];
+		if (simd && scalar && (result.instructions != other.instructions || result.stop != other.stop
+			|| result.stateHash != other.stateHash || result.consoleHash != other.consoleHash))
+		{
+			fprintf(
+				stderr, "run %zu: MISMATCH, the core ran %llu instructions, stopped by %s, state %016llx, console %016llx\n", i + 1,
+				(unsigned long long)other.instructions, stops[other.stop], (unsigned long long)other.stateHash, (unsigned long long)other.consoleHash
+			);
+			mismatches++;
+		}
+	}
+
+	fprintf(stderr, "\n%zu runs, %llu instructions", lines.size(), (unsigned long long)total);
+	if (simd)
+	{
+		fprintf(stderr, ", SIMD engine %.3f s (%.1f MIPS)", simdSeconds, simdSeconds > 0 ? (double)total / simdSeconds / 1e6 : 0.0);
+	}
+	if (scalar)
+	{
+		fprintf(stderr, ", core %.3f s (%.1f MIPS)", scalarSeconds, scalarSeconds > 0 ? (double)total / scalarSeconds / 1e6 : 0.0);
+	}
+	fprintf(stderr, "\n");
+	if (simd && scalar)
+	{
+		fprintf(stderr, "%d of %zu runs differ between the SIMD engine and the core\n", mismatches, lines.size());
+	}
+	return mismatches == 0;
+}
+
+static void usage()
+{
+	fprintf(stderr, "Usage: lc3vm_headless [--max N] [--keys STRING] [--stats FILE] [--profile FILE] [--trace FILE] [--trace-max-mb N] [--quiet] [--load-state FILE] [--save-state FILE] [--checkpoint N] [--record FILE] [--replay FILE] [--batch FILE [--simd | --simd-check]] [--hang-check] [--no-idioms] [--native] [--os FILE [--native-traps LIST]] program.obj\n");
+}
+
+int main(int argc, char* argv[])
+{
+	uint64_t maxInstructions = 100000000;
+	const char* statsPath = nullptr;
+	const char* profilePath = nullptr;
+	const char* tracePath = nullptr;
+	uint64_t traceMaxBytes = 0;
+	const char* programPath = nullptr;
+	const char* loadStatePath = nullptr;
+	const char* saveStatePath = nullptr;
+	uint64_t checkpointEvery = 0;
+	const char* recordPath = nullptr;
+	const char* replayPath = nullptr;
+	const char* batchPath = nullptr;
+	bool simd = false;
+	bool simdCheck = false;
+	bool quiet = false;
+	bool useKeys = false;
+	bool hangCheck = false;
+	const char* osPath = nullptr;
+	const char* nativeTraps = nullptr;
+
+	for (int i = 1; i < argc; i++)
+	{
+		bool hasValue = (i + 1 < argc);
+		if (strcmp(argv[i], "--max") == 0 && hasValue)
+		{
+			maxInstructions = strtoull(argv[++i], nullptr, 10);
+		}
+		else if (strcmp(argv[i], "--keys") == 0 && hasValue)
+		{
+			keys = argv[++i];
+			useKeys = true;
+		}
+		else if (strcmp(argv[i], "--stats") == 0 && hasValue)
+		{
+			statsPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--profile") == 0 && hasValue)
+		{
+			profilePath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--trace") == 0 && hasValue)
+		{
+			tracePath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--trace-max-mb") == 0 && hasValue)
+		{
+			traceMaxBytes = strtoull(argv[++i], nullptr, 10) * 1024 * 1024;
+		}
+		else if (strcmp(argv[i], "--load-state") == 0 && hasValue)
+		{
+			loadStatePath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--save-state") == 0 && hasValue)
+		{
+			saveStatePath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--checkpoint") == 0 && hasValue)
+		{
+			checkpointEvery = strtoull(argv[++i], nullptr, 10);
+		}
+		else if (strcmp(argv[i], "--record") == 0 && hasValue)
+		{
+			recordPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--replay") == 0 && hasValue)
+		{
+			replayPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--batch") == 0 && hasValue)
+		{
+			batchPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--simd") == 0)
+		{
+			simd = true;
+		}
+		else if (strcmp(argv[i], "--simd-check") == 0)
+		{
+			simdCheck = true;
+		}
+		else if (strcmp(argv[i], "--hang-check") == 0)
+		{
+			hangCheck = true;
+		}
+		else if (strcmp(argv[i], "--no-idioms") == 0)
+		{
+			idiomEnabled = false;
+		}
+		else if (strcmp(argv[i], "--native") == 0)
+		{
+			nativeEnabled = true;
+		}
+		else if (strcmp(argv[i], "--os") == 0 && hasValue)
+		{
+			osPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--native-traps") == 0 && hasValue)
+		{
+			nativeTraps = argv[++i];
+		}
+		else if (strcmp(argv[i], "--quiet") == 0)
+		{
+			quiet = true;
+		}
+		else if (argv[i][0] != '-' && programPath == nullptr)
+		{
+			programPath = argv[i];
+		}
+		else
+		{
+			usage();
+			return ERROR_VALUE;
+		}
+	}
+
+	if (programPath == nullptr || (checkpointEvery != 0 && saveStatePath == nullptr) || (replayPath && (recordPath || loadStatePath))
+		|| (batchPath && (replayPath || recordPath || saveStatePath || tracePath || hangCheck)) || ((simd || simdCheck) && (!batchPath || nativeEnabled || osPath)) || (nativeTraps && !osPath))
+	{
+		usage();
+		return ERROR_VALUE;
+	}
+
+	if (!core_load(programPath))
+	{
+		fprintf(stderr, "Failed to read %s\n", programPath);
+		return ERROR_LOADFILE;
+	}
+
+	if (osPath)
+	{
+		int vectors = trap_load_os(osPath);
+		if (vectors == 0)
+		{
+			return ERROR_LOADFILE;
+		}
+		// EXPLAIN: Strict hex, "21,x22" is rejected rather than half applied
+		for (const char* p = nativeTraps; p && *p; )
+		{
+			char* end;
+			unsigned long vector = strtoul(p, &end, 16);
+			if (end == p || vector >= TRAP_VECTORS || trapTable[vector].call == nullptr || (*end != ',' && *end != '\0'))
+			{
+				fprintf(stderr, "Failed to keep TRAP %.*s native, it isn't a hex vector with a native handler\n", (int)strcspn(p, ","), p);
+				return ERROR_VALUE;
+			}
+			trap_set_guest((int)vector, false);
+			p = *end ? end + 1 : end;
+		}
+		fprintf(stderr, "%s: %d TRAP vectors in guest code\n", osPath, vectors);
+	}
+
+	host.console_write = quiet ? nullptr : &headless_console_write;
+	host.input_poll = useKeys || batchPath ? &headless_input_poll : nullptr;
+
+	if (loadStatePath)
+	{
+		struct lc3SaveHost hostState;
+		if (!savestate_load(loadStatePath, &hostState))
+		{
+			return ERROR_LOADFILE;
+		}
+		keyIndex = hostState.inputPosition < keys.size() ? (size_t)hostState.inputPosition : keys.size();
+	}
+
+	if (statsPath)
+	{
+		stats_reset();
+		statsEnabled = true;
+	}
+	if (tracePath && !trace_start(tracePath, traceMaxBytes))
+	{
+		return ERROR_LOADFILE;
+	}
+
+	if (batchPath)
+	{
+		// EXPLAIN: The lanes run at the same time, their output would be a mess
+		batchEcho = !quiet && !simd && !simdCheck;
+		host.console_write = &headless_batch_console_write;
+		host.console_clear = &headless_batch_console_clear;
+		if (!headless_batch(batchPath, maxInstructions, simd || simdCheck, !simd) || (statsPath && !stats_dump_json(statsPath)) || (profilePath && !profiler_export(profilePath)))
+		{
+			return ERROR_VALUE;
+		}
+		return 0;
+	}
+
+	if (replayPath && !input_replay_start(replayPath, nullptr))
+	{
+		return ERROR_LOADFILE;
+	}
+	if (recordPath)
+	{
+		input_record_start(recordPath, {std::string(), keyIndex});
+	}
+
+	if (hangCheck)
+	{
+		hang_enable(true);
+	}
+
+	uint64_t nextCheckpoint = checkpointEvery ? retiredCount + checkpointEvery : UINT64_MAX;
+	auto begin = std::chrono::steady_clock::now();
+	// EXPLAIN: A replay is over at the end of the log, the program would only wait for keys from there
+	while (isRunning && retiredCount < maxInstructions)
+	{
+		if (replayPath)
+		{
+			input_replay_due();
+			if (!inputReplaying)
+			{
+				break;
+			}
+		}
+		core_run_block();
+		if (retiredCount >= nextCheckpoint)
+		{
+			savestate_save(saveStatePath, {std::string(), keyIndex}, true);
+			nextCheckpoint = retiredCount + checkpointEvery;
+		}
+	}
+	auto end = std::chrono::steady_clock::now();
+	double seconds = std::chrono::duration<double>(end - begin).count();
+
+	display_flush();
+	fflush(stdout);
+	if (tracePath)
+	{
+		struct lc3TraceStatus status;
+		trace_stop();
+		trace_status(&status);
+		fprintf(
+			stderr, "\ntrace: %llu instructions, %llu bytes, %llu chunks dropped%s\n",
+			(unsigned long long)status.entries, (unsigned long long)status.bytes, (unsigned long long)status.droppedChunks,
+			status.sizeLimitHit ? ", size limit hit" : ""
+		);
+	}
+
+	fprintf(
+		stderr, "\n%llu instructions in %.3f s (%.1f MIPS), stopped by %s\n",
+		(unsigned long long)retiredCount, seconds, seconds > 0 ? (double)retiredCount / seconds / 1e6 : 0.0,
+		keysExhausted ? "end of keys" : (replayPath && !inputReplaying ? "end of replay" : (hangReport.detected ? "infinite loop" : (isRunning ? "instruction limit" : "HALT")))
+	);
+	if (hangReport.detected)
+	{
+		fprintf(
+			stderr, "infinite loop: x%04X-x%04X repeats every %llu instructions without reading the keyboard\n",
+			hangReport.pcLow, hangReport.pcHigh, (unsigned long long)hangReport.period
+		);
+	}
+
+	if (recordPath && !input_record_stop())
+	{
+		return ERROR_VALUE;
+	}
+	if (replayPath)
+	{
+		input_replay_due();
+		input_replay_stop();
+		struct lc3InputStatus status;
+		input_status(&status);
+		const char* results[] = {"none", "running", "matched", "DIVERGED", "stopped before the end"};
+		fprintf(stderr, "replay: %zu of %zu keys, %s\n", status.replayed, status.events, results[status.result]);
+		if (status.result != INPUT_REPLAY_MATCHED)
+		{
+			return ERROR_VALUE;
+		}
+	}
+
+	if (saveStatePath)
+	{
+		// EXPLAIN: Running out of keys or being stopped in a loop isn't the guest's doing, the run continues from here
+		isRunning = isRunning || keysExhausted || hangReport.detected;
+		savestate_save(saveStatePath, {std::string(), keyIndex}, true);
+		if (!savestate_wait())
+		{
+			return ERROR_VALUE;
+		}
+		struct lc3SaveStatus status;
+		savestate_status(&status);
+		fprintf(stderr, "state: %llu bytes at instruction %llu\n", (unsigned long long)status.lastBytes, (unsigned long long)status.lastStep);
+	}
+
+	if (statsPath && !stats_dump_json(statsPath))
+	{
+		return ERROR_VALUE;
+	}
+	if (profilePath && !profiler_export(profilePath))
+	{
+		return ERROR_VALUE;
+	}
+
+	return hangReport.detected ? ERROR_VALUE : 0;
+}
@@ -1,10 +1,24 @@
 #include "globals.hpp"
+#include "lc3vmwin_core.hpp"
 #include "lc3vmwin_memory.hpp"
 #include "lc3vmwin_quit_confirm.hpp"
 #include "lc3vmwin_disa.hpp"
 #include "lc3vmwin_loader.hpp"
 #include "lc3vmwin_cache.hpp"
 #include "lc3vmwin_register.hpp"
+#include "lc3vmwin_breakpoint.hpp"
+#include "lc3vmwin_watch.hpp"
+#include "lc3vmwin_callstack.hpp"
+#include "lc3vmwin_profiler.hpp"
+#include "lc3vmwin_symbols.hpp"
+#include "lc3vmwin_heatmap.hpp"
+#include "lc3vmwin_stats.hpp"
+#include "lc3vmwin_trace.hpp"
+#include "lc3vmwin_journal.hpp"
+#include "lc3vmwin_rewind.hpp"
+#include "lc3vmwin_savestate.hpp"
+#include "lc3vmwin_input.hpp"
+#include "lc3vmwin_display.hpp"
 
 // FIXME: Just for testing memory editor, remove afterwards
 #include "memory_editor.hpp"
@@ -34,111 +48,45 @@ void sdl_imgui_frame();
 // interpreter run function
 void interpreter_run();
 void interpreter_run_test();
-void parse_escape(uint16_t memory[], uint16_t& index);
 void run();
 void shutdown();
-void cache_run(struct lc3Cache cache, int beginIndex);
+void debugger_signals();
+void debugger_resume();
 void cache_dump(int cacheIndex);
 
-uint16_t read_memory(uint16_t index);
-uint16_t read_uint16_t(uint16_t index);
-void write_memory(uint16_t index, uint16_t value);
-
-// lc-3 instruction functions
-void op_br(uint16_t instr);
-void op_add(uint16_t instr);
-void op_ld(uint16_t instr);
-void op_st(uint16_t instr);
-void op_jsr(uint16_t instr);
-void op_and(uint16_t instr);
-void op_ldr(uint16_t instr);
-void op_str(uint16_t instr);
-void op_rti(uint16_t instr);
-void op_not(uint16_t instr);
-void op_ldi(uint16_t instr);
-void op_sti(uint16_t instr);
-void op_jmp(uint16_t instr);
-void op_res(uint16_t instr);
-void op_lea(uint16_t instr);
-void op_trap(uint16_t instr);
-
-void update_flag(uint16_t value);
-
-// trap functions
-void trap_0x20();
-void trap_0x21();
-void trap_0x21_imgui();
-void trap_0x22();
-void trap_0x22_imgui();
-void trap_0x23();
-void trap_0x24();
-void trap_0x24_imgui();
-void trap_0x25();
+// lc3Host hooks, see lc3vmwin_core.hpp
+void gui_console_write(const char* text, size_t length);
+void gui_console_clear();
+bool gui_step_wait(const struct lc3Cache& cache, int index);
+void gui_block_created(int cacheIndex);
+void gui_watch_hit();
 
 /* ------- function declarations end --------*/
 
 /* Global variables BEGIN -------------------------------------*/
 uint8_t DEBUG_MODE = DEBUG_DIS;
 
-// LC-3 specific BEGIN ------------------------------------------
-enum
-{
-	R_R0 = 0, R_R1, R_R2, R_R3, R_R4, R_R5, R_R6, R_R7,
-	R_PC, 
-	R_COND, 
-	R_COUNT
-};
-
-// Condition codes are supposed to be in R[COND]'s bit-0/1/2, to be used in BR
-enum
-{
-	FL_POS = 1 << 0,	// P
-	FL_ZRO = 1 << 1,	// Z
-	FL_NEG = 1 << 2		// N
-};
-
-enum
-{
-    MR_KBSR = 0xFE00, /* keyboard status */
-    MR_KBDR = 0xFE02  /* keyboard data */
-};
-
-// LC-3 specific END --------------------------------------------
-
-uint16_t buffer[MAX_SIZE] = {0};
 uint8_t running = 1;
 
-void (*instr_call_table[])(uint16_t) = {
-	&op_br, &op_add, &op_ld, &op_st, &op_jsr, &op_and, &op_ldr, &op_str, 
-	&op_rti, &op_not, &op_ldi, &op_sti, &op_jmp, &op_res, &op_lea, &op_trap
-};
-
 /* Global variables owned by the VM */
 SDL_Window* window = nullptr;
 SDL_Renderer* renderer = nullptr;
 LC3VMMemoryWindow memoryWindow;
 LC3VMdisawindow disaWindow;
 LC3VMRegisterWindow regWindow;
+LC3VMProfilerWindow profWindow;
+LC3VMStatsWindow statsWindow;
 
 // FIXME: Just for testing memory editor, remove afterwards
 MemoryEditor me;
 
-bool keyPressed;
-uint8_t lastKeyPressed;
 struct termios original_tio;
 ImGuiTextBuffer consoleBuffer;
 
-// Registers
-uint16_t reg[R_COUNT] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
-// RAM
-uint16_t memory[MAX_SIZE] = {0};
-
 bool signalQuit;
 bool showQuitConfirm;
-bool isRunning;
 bool isDebug;
 bool isDisa;
-bool isStepIn;
 
 int main()
 {
@@ -158,20 +106,21 @@ int main()
 
 int init()
 {
-    keyPressed = false;
-    lastKeyPressed = 0;
-
-    reg[R_COND] = FL_ZRO;
-	reg[R_PC] = 0x3000;
-
-    FILE* fp = fopen("./2048.obj", "rb");
-    if (!fp)
+	// EXPLAIN: Also resets the machine with PC at the origin of the program
+    if (!core_load("./2048.obj"))
     {
         std::cerr << "Failed to read file" << std::endl;
         exit(ERROR_LOADFILE);
     }
-	uint16_t numInstr = load_memory(buffer, memory, fp);
-    fclose(fp);
+
+	host.console_write = &gui_console_write;
+	host.console_clear = &gui_console_clear;
+	host.step_wait = &gui_step_wait;
+	host.block_created = &gui_block_created;
+	host.watch_hit = &gui_watch_hit;
+
+	// EXPLAIN: Reverse-step/continue need the history from before the user thinks of them, so it's on from the start
+	journal_enable(true);
 
     /* --------------------------------Loading End----------------------------- */
     SDL_Init(SDL_INIT_EVERYTHING);
@@ -226,9 +175,16 @@ int init()
 
 	regWindow = LC3VMRegisterWindow(R_COUNT, reg, externalRegNames, externalRegSize, 4, regWinConfig);
 
+	// Profiler Window
+	WindowConfig profWinConfig {true, 20, {560, 400}, {560, 400}, {1400, 0}};
+	profWindow.Load_Config(profWinConfig);
+
+	// ISA Stats Window
+	WindowConfig statsWinConfig {true, 20, {560, 600}, {560, 600}, {1400, 420}};
+	statsWindow.Load_Config(statsWinConfig);
+
     signalQuit = false;
     showQuitConfirm = false;
-    isRunning = true;
     isDebug = false;
     isDisa = false;
     // Step in "debugging", should be default as the program loads and runs immediately so there is no time for the user to click the button, yuk!
@@ -270,13 +226,19 @@ void input()
             }
             case SDL_KEYUP:
             {
-                keyPressed = false;
+                // EXPLAIN: The rewind key never reaches the guest, see interpreter_run(). Neither does anything during a replay
+                if (sdlEvent.key.keysym.sym != SDLK_BACKSPACE && !inputReplaying)
+                {
+                    core_key_release();
+                }
                 break;
             }
             case SDL_KEYDOWN:
             {
-                keyPressed = true;
-                lastKeyPressed = sdlEvent.key.keysym.sym & 0x00FF;
+                if (sdlEvent.key.keysym.sym != SDLK_BACKSPACE && !inputReplaying)
+                {
+                    core_key_press((uint8_t)(sdlEvent.key.keysym.sym & 0x00FF));
+                }
                 // printf("Key pressed\n");
 
                 if (sdlEvent.key.keysym.sym == SDLK_ESCAPE)
@@ -332,6 +294,14 @@ void input()
 					// TODO: Implement toggle. Right now the window cannot be closed
 					regWindow.disabled = !regWindow.disabled;
 				}
+				else if (sdlEvent.key.keysym.sym == SDLK_4)
+				{
+					profWindow.disabled = !profWindow.disabled;
+				}
+				else if (sdlEvent.key.keysym.sym == SDLK_5)
+				{
+					statsWindow.disabled = !statsWindow.disabled;
+				}
 				// Test clear textBuffer
 				else if (sdlEvent.key.keysym.sym == SDLK_0)
                 {
@@ -347,6 +317,9 @@ void input()
 
 void sdl_imgui_frame()
 {
+    // EXPLAIN: The guest's output since the last frame, in one go
+    display_flush();
+
     /* ----------------------- RENDERING PART -------------------------- */
 
     SDL_SetRenderDrawColor(renderer, 21, 21, 21, 255);
@@ -380,6 +353,8 @@ void sdl_imgui_frame()
 
 	// TODO: make the code more robust here
 	regWindow.Draw();
+	profWindow.Draw();
+	statsWindow.Draw();
 
 	/*
 		Test the idea of an ImGui console
@@ -504,6 +479,11 @@ void run()
 
 void shutdown()
 {
+    // EXPLAIN: Flushes a trace that is still recording, the writer thread must not outlive main()
+    trace_stop();
+    // EXPLAIN: A recording still going is written out, quitting is how most of them end
+    input_record_stop();
+    savestate_wait();
     ImGui_ImplSDLRenderer2_Shutdown();
     ImGui_ImplSDL2_Shutdown();
     ImGui::DestroyContext();
@@ -520,46 +500,34 @@ void interpreter_run()
 	{
         input();
 
+		/*
+			EXPLAIN: Holding Backspace plays the game backwards one rendered frame at a time, and the guest doesn't run
+			meanwhile. Otherwise every rendered frame is a rewind sample, except while paused in the debugger.
+		*/
+		bool rewinding = rewindEnabled && SDL_GetKeyboardState(nullptr)[SDL_SCANCODE_BACKSPACE]
+			&& !ImGui::GetIO().WantCaptureKeyboard;
+
         Uint32 now = SDL_GetTicks();
 		// Cap rendering to 60 fps
 		if (now - startTime >= MSPF)
 		{
+			if (rewinding)
+			{
+				rewind_step_back();
+			}
+			else if (!isStepIn)
+			{
+				rewind_capture();
+			}
         	sdl_imgui_frame();
 			startTime = now;
 		}
 
-		uint16_t lc3Address = reg[R_PC];
-
-		/*
-			EXPLAIN: 
-			cache_find() checks a range of addresses instead of just checking the address of the first line of the code clock. Otherwise the code creates a new block for each step-in. Imagine we step-in into line 1 of the code block, we should still step into the same code block instead of creating a new block starting from this line.
-
-			This means we need to pass a parameter about which intruction in the cache code block to be executed.
-		*/
-
-		struct codeLocation loc = cache_find(lc3Address);
-		int cacheIndex = loc.cacheIndex;
-		int codeIndex = loc.codeIndex;
+		debugger_signals();
 
-		/*
-			EXPLAIN: if cache not found, create, insert and execute from first line, otherwise execute from line codeIndex
-		*/
-		if (cacheIndex == -1)
+		if (!rewinding)
 		{
-			struct lc3Cache newCache = cache_create_block(memory, lc3Address);
-			int newCacheIndex = cacheCount;
-			cache_add(newCache);
-
-			if (DEBUG_MODE == DEBUG_DIS)
-			{
-				cache_dump(newCacheIndex); 
-			}
-			// EXPLAIN: if it's a new code block, we ofc execute from line 0 (in this case loc.codeIndex should be -1)
-			cache_run(codeCache[newCacheIndex], 0);
-		}
-		else
-		{
-			cache_run(codeCache[cacheIndex], codeIndex);
+			core_run_block();
 		}
 	}
 }
@@ -592,632 +560,220 @@ void interpreter_run_test()
 	}
 }
 
-void cache_run(struct lc3Cache cache, int beginIndex)
+void debugger_resume()
 {
 	/*
-		cache_run is different from interpreter_run_test in the sense
-			-> that we don't use PC to find the next instruction but just run sequentially inside of the cache
-			-> We still need to update the PC for the next interpreter_run() call
+		EXPLAIN: Leave step-in mode and let the guest run at full speed.
+		If we stand on a breakpoint (or a run-to target) it must not stop us before the first instruction.
 	*/
+	isStepIn = false;
+	disaWindow.watchHitAddress = -1;
+	watchHit.triggered = false;
+	breakpointResume = (breakpointMap[reg[R_PC]] != 0);
+}
 
+void debugger_signals()
+{
 	/*
-		EXPLAIN: There are a few reasons that this function has two parameters ->
-			- cache, which is a struct lc3Cache that contains the code block
-			- beginIndex, the index of the code in the code block
-			(e.g. if beginIndex = 5 it means start running from the 6th line of code)
-
-			Reason 1: Sometimes we don't want to run from the first line of code of the code block, maybe it's because of a jump into the middle of the block
-
-			Reason 2: For step-in, right now the solution is to return the control to the caller if no step-in command has been given (there is a button in Draw() of lc3vmwin_disa.cpp does that, and right now I need to set isStepIn to true at the initialization phase of this program). So the problem is, imagine we just exeucted line 0, now we are sent back to the caller function (interpreter_run()), and we fall into the same code block ofc, then we call cache_run() again, how do we execute line 1 instead of executing line 0 over and over again? By telling cache_run() which line to run, of course.
+		EXPLAIN: Buttons of the disassembly window. Step-over, step-out and run-to-cursor never execute
+		instructions one frame at a time, they set up a stop condition and let the guest run until it is met.
 	*/
-	for (int i = beginIndex; i < cache.numInstr; i++)
+	if (disaWindow.breakSignal)
 	{
-		uint16_t instr = cache.codeBlock[i];	
-		uint16_t op = instr >> 12;
+		isStepIn = true;
+		stepOutDepth = -1;
+		bp_clear_temporary();
+		disaWindow.breakSignal = false;
+	}
 
-		if (isStepIn)
-		{
-			/* 
-				EXPLAIN: This is to mark the line that is about to run in the code block. Check the Draw() function in lc3vmwin_disa.cpp. Otherwise the disassembly window doesn't know which line should be marked with ">>""
-			*/
-			disaWindow.stepInLine = i;
+	if (disaWindow.continueSignal)
+	{
+		stepOutDepth = -1;
+		bp_clear_temporary();
+		debugger_resume();
+		disaWindow.continueSignal = false;
+	}
 
-			// EXPLAIN: Only execute if user sends a signal through the disa window
-			if (disaWindow.stepInSignal)
-			{
-				reg[R_PC] += 1;			
-        		instr_call_table[op](instr);
-				// EXPLAIN: Immediately disable stepInSignal for the next step. If we don't disable then the code continue running
-				disaWindow.stepInSignal = false;
-			}
-			// EXPLAIN: If no signal, then break and return. Since we haven't changed the PC, it should come back to this piece of code. NOTE that we CANNOT use an infinite loop to hold execution because the infinite loop would hold the whole program too!
-			else
-			{
-				break;
-			}
+	if (disaWindow.stepOverSignal)
+	{
+		// EXPLAIN: Only a JSR/JSRR has something to step over, for anything else this is a plain step-in
+		uint16_t pc = reg[R_PC];
+		if (get_opcode(memory[pc]) == OP_JSR)
+		{
+			// EXPLAIN: Stop at the return address at the current depth, a recursive call passing the same address doesn't count
+			bp_set_temporary((uint16_t)(pc + 1), callDepth);
+			debugger_resume();
 		}
 		else
-		// EXPLAIN: If not step-in, then just execute normally
 		{
- 			reg[R_PC] += 1;	
-        	instr_call_table[op](instr);
+			disaWindow.stepInSignal = true;
 		}
+		disaWindow.stepOverSignal = false;
 	}
 
-}
-
-void cache_dump(int cacheIndex)
-{
-	/*
-		EXPLAIN: Load the current code block into the disassembly window
-	*/
-	if (cacheIndex >= cacheCount)
-	{
-		printf("Wrong cache index at: %d\n", cacheIndex);
-	}
-	else
+	if (disaWindow.stepOutSignal)
 	{
-        disaWindow.Load(codeCache[cacheIndex].codeBlock, codeCache[cacheIndex].numInstr, codeCache[cacheIndex].lc3MemAddress);
+		// EXPLAIN: At the top level there is nothing to step out of
+		if (callDepth > 0)
+		{
+			stepOutDepth = callDepth;
+			debugger_resume();
+		}
+		disaWindow.stepOutSignal = false;
 	}
-}
 
-/* Op code functions */
-
-void op_br(uint16_t instr)
-{
-	/* 
-		15 14 13 12 | 11 10 9 | 8 7 6 5 4 3 2 1 0
-		0  0  0  0  | n  z  p |    PCOffset9
+	/*
+		EXPLAIN: Reverse execution lands between instructions like a step-in does, so it breaks first.
+		debugger_signals() runs between blocks, where retiredCount is exact.
 	*/
-	uint16_t pcoffset9 = sign_extended(instr & 0x01FF, 9);
-	// If at least one of the nzp bits and the matching bits in R_COND are both 1, then jump
-	if (reg[R_COND] & ((instr >> 9) & 0x0007))
+	if (disaWindow.reverseStepSignal || disaWindow.reverseContinueSignal)
 	{
-		reg[R_PC] += pcoffset9;
+		isStepIn = true;
+		stepOutDepth = -1;
+		bp_clear_temporary();
+		disaWindow.watchHitAddress = -1;
+		watchHit.triggered = false;
+		if (disaWindow.reverseStepSignal)
+		{
+			journal_reverse_step();
+		}
+		else
+		{
+			journal_reverse_continue();
+		}
+		disaWindow.reverseStepSignal = false;
+		disaWindow.reverseContinueSignal = false;
 	}
-}
-
-void op_add(uint16_t instr)
-{
-	/* 
-		15 14 13 12 | 11 10 9 | 8 7 6 | 5 | 4 3 | 2 1 0
-		0  0  0  1  |   DR    |  SR1  | 0 | 0 0 |  SR2 
-		----------------------or-----------------------
-		15 14 13 12 | 11 10 9 | 8 7 6 | 5 | 4 3 2 1 0
-		0  0  0  1  |   DR    |  SR   | 1 |    IMM
-	*/
 
-	uint8_t dr = (instr >> 9) & 0x0007;
-	uint8_t sr = (instr >> 6) & 0x0007;
-	uint8_t mode = (instr >> 5) & 0x0001;
-	if (mode)
+	// EXPLAIN: Between blocks the machine is between instructions, a snapshot taken here resumes exactly
+	if (disaWindow.saveStateSignal)
 	{
-		uint16_t imm = sign_extended(instr & 0x001F, 5);
-		reg[dr] = reg[sr] + imm;
+		savestate_save(disaWindow.statePathInput, {std::string(consoleBuffer.begin(), consoleBuffer.end()), 0}, disaWindow.stateWithCache);
+		disaWindow.stateError.clear();
+		disaWindow.saveStateSignal = false;
 	}
-	else 
+
+	if (disaWindow.loadStateSignal)
 	{
-		uint8_t sr2 = instr & 0x0007;
-		reg[dr] = reg[sr] + reg[sr2];
+		struct lc3SaveHost hostState;
+		if (savestate_load(disaWindow.statePathInput, &hostState))
+		{
+			consoleBuffer.clear();
+			consoleBuffer.append(hostState.console.c_str(), hostState.console.c_str() + hostState.console.size());
+			disaWindow.watchHitAddress = -1;
+			watchHit.triggered = false;
+			// EXPLAIN: The rewind frames lead up to the state we left, not to this one
+			rewind_reset();
+			disaWindow.stateError.clear();
+		}
+		else
+		{
+			disaWindow.stateError = std::string("could not load ") + disaWindow.statePathInput;
+		}
+		disaWindow.loadStateSignal = false;
 	}
-	update_flag(reg[dr]);
-}
-
-void op_ld(uint16_t instr)
-{
-	/* 
-		15 14 13 12 | 11 10 9 | 8 7 6 5 4 3 2 1 0
-		0  0  1  0  |   DR    |    PCOffset9
-	*/
-	uint16_t pcoffset9 = sign_extended(instr & 0x01FF, 9);
-	uint8_t dr = (instr >> 9) & 0x0007;
-	// Ignore privilege bit and other security measures
-	reg[dr] = read_memory(reg[R_PC] + pcoffset9);
-	update_flag(reg[dr]);
-}
-
-void op_st(uint16_t instr)
-{
-	/* 
-		15 14 13 12 | 11 10 9 | 8 7 6 5 4 3 2 1 0
-		0  0  1  1  |   SR    |    PCOffset9
-	*/
-	uint16_t pcoffset9 = sign_extended(instr & 0x01FF, 9);
-	uint8_t sr = (instr >> 9) & 0x0007;
-	write_memory(reg[R_PC] + pcoffset9, reg[sr]);
-}
 
-void op_jsr(uint16_t instr)
-{
-	/* 
-		15 14 13 12 | 11 | 10 9 8 7 6 5 4 3 2 1 0
-		0  1  0  0  | 1  |      PCOffset11
-		-----------------or----------------------
-		15 14 13 12 | 11 | 10 9 | 8 7 6 | 5 4 3 2 1 0
-		0  1  0  0  | 0  | 0  0 |   BR  | 0 0 0 0 0 0
-	*/
-	reg[R_R7] = reg[R_PC];
-	uint8_t mode = (instr >> 11) & 0x0001;
-	if (mode)
+	if (disaWindow.recordInputSignal)
 	{
-		uint16_t pcoffset11 = sign_extended(instr & 0x07FF, 11);
-		reg[R_PC] += pcoffset11;
+		input_record_start(disaWindow.inputLogPathInput, {std::string(consoleBuffer.begin(), consoleBuffer.end()), 0});
+		disaWindow.inputLogError.clear();
+		disaWindow.recordInputSignal = false;
 	}
-	else
+
+	if (disaWindow.replayInputSignal)
 	{
-		uint8_t br = (instr >> 6) & 0x0007;
-		reg[R_PC] = reg[br];
+		struct lc3SaveHost hostState;
+		if (input_replay_start(disaWindow.inputLogPathInput, &hostState))
+		{
+			consoleBuffer.clear();
+			consoleBuffer.append(hostState.console.c_str(), hostState.console.c_str() + hostState.console.size());
+			rewind_reset();
+			disaWindow.inputLogError.clear();
+		}
+		else
+		{
+			disaWindow.inputLogError = std::string("could not replay ") + disaWindow.inputLogPathInput;
+		}
+		disaWindow.replayInputSignal = false;
 	}
-}
 
-void op_and(uint16_t instr)
-{
-	/* 
-		15 14 13 12 | 11 10 9 | 8 7 6 | 5 | 4 3 | 2 1 0
-		0  1  0  1  |    DR   |  SR1  | 0 | 0 0 |  SR2
-		---------------------or------------------------
-		15 14 13 12 | 11 10 9 | 8 7 6 | 5 | 4 3 2 1 0
-		0  1  0  1  |    DR   |  SR1  | 1 |   imm5
-	*/
-	uint8_t mode = (instr >> 5) & 0x0001;
-	uint8_t dr = (instr >> 9) & 0x0007;
-	uint8_t sr = (instr >> 6) & 0x0007;
-	if (mode)
+	if (disaWindow.stopInputSignal)
 	{
-		uint16_t imm5 = sign_extended(instr & 0x001F, 5);
-		reg[dr] = reg[sr] & imm5;
+		if (inputRecording && !input_record_stop())
+		{
+			disaWindow.inputLogError = std::string("could not write ") + disaWindow.inputLogPathInput;
+		}
+		input_replay_stop();
+		disaWindow.stopInputSignal = false;
 	}
-	else
+
+	if (disaWindow.runToAddress >= 0)
 	{
-		uint8_t sr2 = instr & 0x0007;
-		reg[dr] = reg[sr] & reg[sr2];
+		bp_set_temporary((uint16_t)disaWindow.runToAddress, disaWindow.runToDepth);
+		debugger_resume();
+		disaWindow.runToAddress = -1;
+		disaWindow.runToDepth = -1;
 	}
-	update_flag(reg[dr]);
-}
-
-void op_ldr(uint16_t instr)
-{
-	/* 
-		15 14 13 12 | 11 10 9 | 8 7 6 | 5 4 3 2 1 0
-		0  1  1  0  |   DR    | BaseR |   offset6
-	*/
-	// Again ignore the security measures
-	uint8_t dr = (instr >> 9) & 0x0007;
-	uint8_t br = (instr >> 6) & 0x0007;
-	uint16_t offset6 = sign_extended(instr & 0x003F, 6);
-
-	reg[dr] = read_memory(reg[br] + offset6);
-	update_flag(reg[dr]);
-}
-
-void op_str(uint16_t instr)
-{
-	/* 
-		15 14 13 12 | 11 10 9 | 8 7 6 | 5 4 3 2 1 0
-		0  1  1  1  |   SR    | BaseR |   offset6
-	*/
-	// Again ignore the security measures
-	uint8_t sr = (instr >> 9) & 0x0007;
-	uint8_t br = (instr >> 6) & 0x0007;
-	uint16_t offset6 = sign_extended(instr & 0x003F, 6);
-
-	write_memory(reg[br] + offset6, reg[sr]);
-}
-
-void op_rti(uint16_t instr)
-{
-	/* 
-		15 14 13 12 | 11 10 9 8 7 6 5 4 3 2 1 0
-		1  0  0  0  | 0  0  0 0 0 0 0 0 0 0 0 0
-	*/
-	// Technically need to work under privilege mode
-	printf("Not supposed to be here!\n");
 }
 
-void op_not(uint16_t instr)
-{
-	/* 
-		15 14 13 12 | 11 10 9 | 8 7 6 | 5 | 4 3 2 1 0
-		1  0  0  1  |   DR    |   SR  | 1 | 1 1 1 1 1
-	*/
-	uint8_t dr = (instr >> 9) & 0x0007;
-	uint8_t sr = (instr >> 6) & 0x0007;
-
-	reg[dr] = (~reg[sr]);
-	update_flag(reg[dr]);
-}
-
-void op_ldi(uint16_t instr)
-{
-	/* 
-		15 14 13 12 | 11 10 9 | 8 7 6 5 4 3 2 1 0
-		1  0  1  0  |   DR    |    PCoffset9
-	*/
-	// Again we ignore the security measures
-	uint16_t pcoffset9 = sign_extended(instr & 0x01FF, 9);
-	uint8_t dr = (instr >> 9) & 0x0007;
-
-	reg[dr] = read_memory(read_memory(reg[R_PC] + pcoffset9));
-	update_flag(reg[dr]);
-}
-
-void op_sti(uint16_t instr)
-{
-	/* 
-		15 14 13 12 | 11 10 9 | 8 7 6 5 4 3 2 1 0
-		1  0  1  1  |   SR    |     PCoffset9
-	*/
-	// Again ignore the security measures
-	uint8_t sr = (instr >> 9) & 0x0007;
-	uint16_t pcoffset9 = sign_extended(instr & 0x01FF, 9);
-
-	write_memory(read_memory(reg[R_PC] + pcoffset9), reg[sr]);
-}
-
-void op_jmp(uint16_t instr)
-{
-	/*  JMP
-		15 14 13 12 | 11 10 9 | 8 7 6 | 5 4 3 2 1 0
-		1  1  0  0  | 0  0  0 | BaseR | 0 0 0 0 0 0
-		-------------------or----------------------
-		RET
-		15 14 13 12 | 11 10 9 | 8 7 6 | 5 4 3 2 1 0
-		1  1  0  0  | 0  0  0 | 1 1 1 | 0 0 0 0 0 0
-	*/
-	uint8_t br = (instr >> 6) & 0x0007;
-	// return address stored in R7 so a "jmp" to it equals RET
-	reg[R_PC] = reg[br];
-}
-
-void op_res(uint16_t instr)
-{
-	/*  RET
-		15 14 13 12 | 11 10 9 | 8 7 6 | 5 4 3 2 1 0
-		1  1  0  0  | 0  0  0 | 1 1 1 | 0 0 0 0 0 0
-	*/
-	// reg[R_PC] = reg[R_R7];
-	printf("Not supposed to be here\n");
-}
-
-void op_lea(uint16_t instr)
-{
-	/*
-		15 14 13 12 | 11 10 9 | 8 7 6 5 4 3 2 1 0
-		1  1  1  0  |    dr   |     PCoffset9
-	*/
-	uint16_t pcoffset9 = sign_extended(instr & 0x01FF, 9);
-	uint8_t dr = (instr >> 9) & 0x0007;
-
-	reg[dr] = reg[R_PC] + pcoffset9;
-	update_flag(reg[dr]);
-}
-
-void op_trap(uint16_t instr)
+void cache_dump(int cacheIndex)
 {
 	/*
-		15 14 13 12 | 11 10 9 8 | 7 6 5 4 3 2 1 0
-		1  1  1  1  | 0  0  0 0 |    trapvect8
+		EXPLAIN: Load the current code block into the disassembly window
 	*/
-	reg[R_R7] = reg[R_PC];
-
-	uint8_t trapvect8 = instr & 0x00FF;
-	switch (trapvect8)
-	{
-		case 0x20:
-			// GETC
-			// Read a single character from the keyboard. The character is not echoed onto the console.
-			// Its ASCII code is copied into R0. The high eight bits of R0 are cleared
-			trap_0x20();
-			break;
-		case 0x21:
-			// trap_0x21();
-			trap_0x21_imgui();
-			break;
-		case 0x22:
-			// trap_0x22();
-			trap_0x22_imgui();
-			break;
-		case 0x23:
-			trap_0x23();
-			break;
-		case 0x24:
-			// trap_0x24();
-			trap_0x24_imgui();
-			break;
-		case 0x25:
-			trap_0x25();
-			break;
-		default:
-			printf("Erroneous TRAP vector!\n");
-	}
-}
-
-void update_flag(uint16_t value)
-{
-	// Clear the last three bits (N/Z/P) and set P
-	reg[R_COND] &= 0xFFF8;
-	if (value >> 15)
-	{	
-		// Since value is uint16_t, cannot use if (value < 0), have to check the highest bit
-		reg[R_COND] |= FL_NEG;
-	}
-	else if (value == 0)
+	if (cacheIndex >= cacheCount)
 	{
-		reg[R_COND] |= FL_ZRO;
+		printf("Wrong cache index at: %d\n", cacheIndex);
 	}
 	else
 	{
-		reg[R_COND] |= FL_POS;
+        disaWindow.Load(codeCache[cacheIndex].codeBlock, codeCache[cacheIndex].numInstr, codeCache[cacheIndex].lc3MemAddress);
 	}
 }
 
-uint16_t read_memory(uint16_t index)
-{
-	// Two memory mapped registers
-	if (index == MR_KBSR)
-    {
-        if (keyPressed)
-        {
-            write_memory(MR_KBSR, 1 << 15);
-            memory[MR_KBDR] = lastKeyPressed;
-            /* 
-                WHY set keyPressed = false?
-                If I don't disable it here, the input is insanely lagged
-
-				*Edit*:
-				The above is wrong. It is still insanely lagged...
-            */
-		    // printf("\n");
-            keyPressed = false;
-        }
-        else
-        {
-            write_memory(MR_KBSR, 0);
-        }
-        return memory[MR_KBSR];
-    }
-	return memory[index];
-}
-
-uint16_t read_uint16_t(uint16_t index)
+void gui_console_write(const char* text, size_t length)
 {
-    return (uint16_t)(memory[index]) | ((uint16_t)(memory[index + 1]) << 8);
+	consoleBuffer.append(text, text + length);
 }
 
-void write_memory(uint16_t index, uint16_t value)
+void gui_console_clear()
 {
-    memory[index] = value;
+	consoleBuffer.clear();
 }
 
-// trap functions
-void trap_0x20()
+bool gui_step_wait(const struct lc3Cache& cache, int index)
 {
-	// Read a single character from the keyboard. The character is not echoed onto the console.
-	// Its ASCII code is copied into R0. The high eight bits of R0 are cleared
-    reg[R_R0] = lastKeyPressed & 0x00FF;
-}
-
-void trap_0x21()
-{
-	// Write a character in R0[7:0] to the console display.
-	putc((uint8_t)reg[R_R0], stdout);
-	// ui_debug_info(reg, 25);
-	fflush(stdout);
-}
-
-void trap_0x21_imgui()
-{
-	char ch = (uint8_t)reg[R_R0];
-	consoleBuffer.append(&ch, (&ch + 1));
-}
-
-
-void trap_0x22()
-{
-	// Write a string of ASCII characters to the console display. The characters are
-	// contained in consecutive memory locations, one character per memory location,
-	// starting with the address specified in R0. Writing terminates with the occurrence of
-	// x0000 in a memory location.
-
-	for (uint16_t i = reg[R_R0]; ;i++)
+	/* 
+		EXPLAIN: This is to mark the line that is about to run in the code block. Check the Draw() function in lc3vmwin_disa.cpp. Otherwise the disassembly window doesn't know which line should be marked with ">>""
+	*/
+	disaWindow.stepInLine = index;
+	// EXPLAIN: The window only gets new blocks from cache_dump(), so after a breakpoint or a jump into an old block it could be showing the wrong one
+	if (disaWindow.initialAddress != cache.lc3MemAddress || disaWindow.numInstructions != cache.numInstr)
 	{
-		char ch = read_memory(i);
-		if (ch == 0)
-		{
-			break;
-		}
-		else
-		{
-			putc(ch, stdout);
-		}
+		disaWindow.Load(cache.codeBlock, cache.numInstr, cache.lc3MemAddress);
 	}
-	// ui_debug_info(reg, 25);
-	fflush(stdout);
-}
-
-void trap_0x22_imgui()
-{
-	// Write a string of ASCII characters to the console display. The characters are
-	// contained in consecutive memory locations, one character per memory location,
-	// starting with the address specified in R0. Writing terminates with the occurrence of
-	// x0000 in a memory location.
 
-	uint16_t i = reg[R_R0];
-	char ch = read_memory(i);
-
-	while (ch != 0)
+	// EXPLAIN: Only execute if user sends a signal through the disa window
+	if (disaWindow.stepInSignal)
 	{
-		if (ch == 0x1B)
-		{
-			// EXPLAIN: For control sequences, the program needs to return instead of staying in the loop, otherwise somehow the next string (e.g. the +--------------+ one) gets fed into parse_escape()
-
-			// EXPLAIN: OK I know what's going on. ch is not updated in parse_escape(), so we need to explicitly return from this function, otherwise ch is still 0x1B and the next string triggers an error in parse_escape()
-			parse_escape(memory, i);
-			return;
-		}
-		else
-		{
-			consoleBuffer.append(&ch, (&ch + 1));
-			i++;
-			ch = read_memory(i);
-		}
+		// EXPLAIN: Immediately disable stepInSignal for the next step. If we don't disable then the code continue running
+		disaWindow.stepInSignal = false;
+		return true;
 	}
+	// EXPLAIN: If no signal, then cache_run() returns. Since we haven't changed the PC, it should come back to this piece of code. NOTE that we CANNOT use an infinite loop to hold execution because the infinite loop would hold the whole program too!
+	return false;
 }
 
-void parse_escape(uint16_t memory[], uint16_t& index)
+void gui_block_created(int cacheIndex)
 {
-    /*
-		EXPLAIN:
-        I want to be pragmatic and only deals with the control sequences in 2048
-        "\e[37m 2  \e[0m"
-        "\e[1;33m1024\e[0m"
-        "\e[2J\e[H\e[3J"
-
-        In the first and second case, we only need to retrieve the number in the middle (2 and 1024);
-
-        In the third case, we need to clean the buffer -> by clearing the buffer, the ImGui console is cleared
-    */
-
-	// EXPLAIN: We get away from implicitly casting a uint16_t to a char because of how LC-3 memory lays out strings: each character only takes the lower byte of a 2-byte memory chunk -> they are NOT char by char (check 2048.bin for details)
-
-    char ch = read_memory(index++);
-	// printf("ch is %d\n", (int)ch);
-
-	// EXPLAIN: Still not exactly sure why, but '\e' doesn't work (compiler compalins non-standard ISO excape character), so I have to use 0x1b
-
-    if (ch != 0x1b)
-    {
-        fprintf(stderr, "memory[%u] should be e\n", index);
-        exit(ERROR_VALUE);
-    }
-
-	ch = read_memory(index++);
-    if (ch != '[')
-    {
-        fprintf(stderr, "memory[%u] should be [ after \\e\n", index);
-        exit(ERROR_VALUE);
-    }
-
-    ch = read_memory(index++);
-    if (ch == '2')
-    {
-		/*
-			EXPLAIN: if it's 2, then there is actually no need to read the whole sequence because we take it that we are about to clear the screen (in this case clear the ImGui console buffer)
-		*/
-        consoleBuffer.clear();
-    }
-    else
-	
-	/* 
-		EXPLAIN: if ch != 2 then in 2048 it means it's either 3 or 1 depending on the control sequence (checkout "ansi board labels" section in 2048.asm)
-	*/
-
-    {
-        /* So we just need to take the number between m and \e */
-        while (ch != 'm')
-        {
-            ch = read_memory(index++);
-        }
-        /* Now we are pointing at the next char following 'm', read until we hit \ */
-		ch = read_memory(index++);
-        while (ch != 0x1b)
-        {
-            consoleBuffer.append(&ch, (&ch + 1));
-			ch = read_memory(index++);
-        }
-    }
-}
-
-void trap_0x23()
-{
-	// Print a prompt on the screen and read a single character from the keyboard. 
-	// The character is echoed onto the console monitor, and its ASCII code is copied into R0.
-	// The high eight bits of R0 are cleared.
-
-	// TODO: We need to figure out what to do with 0x23, right now we don't use it in 2048
-	// but eventually we need to implement an ImGui version of it
-	
-	// printf("> ");
-	// reg[R_R0] = (uint16_t)fgetc(stdin);
-	// reg[R_R0] &= 0x00FF;
-	// putc((uint8_t)reg[R_R0], stdout);
-	// // ui_debug_info(reg, 25);
-	// fflush(stdout);
-	// update_flag(reg[R_R0]);
-}
-
-void trap_0x24()
-{
-	/*
-		Write a string of ASCII characters to the console. 
-		The characters are contained in consecutive memory locations, 
-		two characters per memory location, starting with the address specified in R0. 
-
-		The ASCII code contained in bits [7:0] of a memory
-		location is written to the console first. 
-		
-		Then the ASCII code contained in bits [15:8] of that memory location is written to the console. 
-		
-		(A character string consisting of
-		an odd number of characters to be written will have x00 in bits [15:8] of the
-		memory location containing the last character to be written.) Writing terminates
-		with the occurrence of x0000 in a memory location.
-	*/
-	for (uint16_t i = reg[R_R0]; ;i++)
+	if (DEBUG_MODE == DEBUG_DIS)
 	{
-		uint16_t value = read_memory(i);
-		if (value == 0)
-		{
-			break;
-		}
-		else
-		{
-			putc((uint8_t)(value & 0x00FF), stdout);
-			putc(((uint8_t)(value >> 8)), stdout);
-		}
+		cache_dump(cacheIndex); 
 	}
-	fflush(stdout);
 }
 
-void trap_0x24_imgui()
+void gui_watch_hit()
 {
-	/*
-		Write a string of ASCII characters to the console. 
-		The characters are contained in consecutive memory locations, 
-		two characters per memory location, starting with the address specified in R0. 
-
-		The ASCII code contained in bits [7:0] of a memory
-		location is written to the console first. 
-		
-		Then the ASCII code contained in bits [15:8] of that memory location is written to the console. 
-		
-		(A character string consisting of
-		an odd number of characters to be written will have x00 in bits [15:8] of the
-		memory location containing the last character to be written.) Writing terminates
-		with the occurrence of x0000 in a memory location.
-	*/
-	for (uint16_t i = reg[R_R0]; ;i++)
-	{
-		uint16_t value = read_memory(i);
-		if (value == 0)
-		{
-			break;
-		}
-		else
-		{
-			char ch = (uint8_t)(value & 0x00FF);
-			consoleBuffer.append(&ch, (&ch + 1));
-			ch = (uint8_t)(value >> 8);
-			consoleBuffer.append(&ch, (&ch + 1));
-		}
-	}
+	disaWindow.watchHitAddress = watchHit.pc;
+	memoryWindow.Highlight_Word(watchHit.address);
 }
-
-
-void trap_0x25()
-{
-	// Halt execution and print a message on the console.
-	// TODO: Implement an ImGui version of it
-	printf("\nSystem HALT\n");
-	isRunning = false;
-}
\ No newline at end of file
@@ -0,0 +1,480 @@
+/*
+	Lockstep batch engine, see lc3vmwin_batch.hpp
+*/
+
+#include "lc3vmwin_batch.hpp"
+#include "lc3vmwin_core.hpp"
+#include "lc3vmwin_disa_be.hpp"
+
+#include <cstring>
+
+typedef uint16_t batchWords __attribute__((vector_size(BATCH_LANES * sizeof(uint16_t))));
+typedef int16_t batchMask __attribute__((vector_size(BATCH_LANES * sizeof(int16_t))));
+typedef uint32_t batchCounts __attribute__((vector_size(BATCH_LANES * sizeof(uint32_t))));
+typedef int32_t batchMask32 __attribute__((vector_size(BATCH_LANES * sizeof(int32_t))));
+
+#if defined(__x86_64__) && defined(__linux__)
+#define BATCH_TARGETS   __attribute__((target_clones("avx2", "default")))
+#else
+#define BATCH_TARGETS
+#endif
+// EXPLAIN: GCC warns that 32-byte vectors are returned differently with and without AVX, the helpers are always inlined
+#pragma GCC diagnostic ignored "-Wpsabi"
+// EXPLAIN: The helpers must end up inside the AVX2 clone, or they run the SSE2 code even at -O0
+#define BATCH_INLINE    inline __attribute__((always_inline))
+
+#define FNV_PRIME       UINT64_C(1099511628211)
+
+/* memory[address * BATCH_LANES + lane] */
+alignas(64) static uint16_t batchMemory[MAX_SIZE * BATCH_LANES];
+
+static batchWords laneReg[R_COUNT];
+static batchMask laneRunning;       // the lane's isRunning, it still runs to the end of the block once this is off
+static batchMask laneActive;        // not stopped yet
+static batchCounts laneCount;
+static bool laneKeyPressed[BATCH_LANES];
+static uint8_t laneLastKey[BATCH_LANES];
+static const std::string* laneKeys[BATCH_LANES];
+static size_t laneKeyIndex[BATCH_LANES];
+static bool laneKeysExhausted[BATCH_LANES];
+static bool laneBadEscape[BATCH_LANES];
+static uint64_t laneConsole[BATCH_LANES];
+
+uint64_t batch_console_hash(uint64_t hash, int value)
+{
+	return (hash ^ (uint64_t)value) * FNV_PRIME;
+}
+
+static BATCH_INLINE uint16_t& lane_word(uint16_t address, int lane)
+{
+	return batchMemory[(size_t)address * BATCH_LANES + (size_t)lane];
+}
+
+static BATCH_INLINE batchWords row_load(uint16_t address)
+{
+	batchWords row;
+	memcpy(&row, &batchMemory[(size_t)address * BATCH_LANES], sizeof(row));
+	return row;
+}
+
+static BATCH_INLINE void row_store(uint16_t address, const batchWords& row)
+{
+	memcpy(&batchMemory[(size_t)address * BATCH_LANES], &row, sizeof(row));
+}
+
+static BATCH_INLINE batchWords blend(const batchWords& old, const batchWords& value, const batchMask& mask)
+{
+	return (value & (batchWords)mask) | (old & ~(batchWords)mask);
+}
+
+static BATCH_INLINE bool any_lane(const batchMask& mask)
+{
+	uint64_t parts[sizeof(mask) / sizeof(uint64_t)];
+	memcpy(parts, &mask, sizeof(mask));
+	uint64_t any = 0;
+	for (uint64_t part : parts)
+	{
+		any |= part;
+	}
+	return any != 0;
+}
+
+static BATCH_INLINE batchWords splat(uint16_t value)
+{
+	batchWords zero = {};
+	return zero + value;
+}
+
+/* update_flag() for the lanes in mask */
+static BATCH_INLINE void set_cc(const batchWords& value, const batchMask& mask)
+{
+	batchWords negative = (batchWords)((batchMask)value < 0);
+	batchWords zero = (batchWords)(value == 0);
+	batchWords flag = (negative & (uint16_t)FL_NEG) | (zero & (uint16_t)FL_ZRO) | (~(negative | zero) & (uint16_t)FL_POS);
+	laneReg[R_COND] = blend(laneReg[R_COND], (laneReg[R_COND] & 0xFFF8) | flag, mask);
+}
+
+/* Per lane versions of what the core does with its globals */
+
+static void lane_poll(int lane)
+{
+	if (laneKeyIndex[lane] < laneKeys[lane]->size())
+	{
+		laneKeyPressed[lane] = true;
+		laneLastKey[lane] = (uint8_t)(*laneKeys[lane])[laneKeyIndex[lane]++];
+	}
+	else
+	{
+		laneKeysExhausted[lane] = true;
+		laneRunning[lane] = 0;
+	}
+}
+
+/* read_memory() */
+static uint16_t lane_read(int lane, uint16_t index)
+{
+	if (index == MR_DSR)
+	{
+		lane_word(MR_DSR, lane) = DSR_READY;
+	}
+	else if (index == MR_KBSR)
+	{
+		// EXPLAIN: IE is only a bit in memory here, it is kept like the core keeps it
+		if (laneKeyPressed[lane])
+		{
+			lane_word(MR_KBSR, lane) = (uint16_t)(KBSR_READY | (lane_word(MR_KBSR, lane) & KBSR_IE));
+			lane_word(MR_KBDR, lane) = laneLastKey[lane];
+			laneKeyPressed[lane] = false;
+		}
+		else
+		{
+			// EXPLAIN: As in read_device(), READY goes before the poll and a key it brings in shows up on the next read
+			lane_word(MR_KBSR, lane) &= KBSR_IE;
+			lane_poll(lane);
+		}
+	}
+	return lane_word(index, lane);
+}
+
+static void lane_console(int lane, char ch)
+{
+	laneConsole[lane] = batch_console_hash(laneConsole[lane], (uint8_t)ch);
+}
+
+/* parse_escape(), false where the core would exit */
+static bool lane_parse_escape(int lane, uint16_t index)
+{
+	char ch = (char)lane_read(lane, index++);
+	if (ch != 0x1b)
+	{
+		return false;
+	}
+	ch = (char)lane_read(lane, index++);
+	if (ch != '[')
+	{
+		return false;
+	}
+	ch = (char)lane_read(lane, index++);
+	if (ch == '2')
+	{
+		laneConsole[lane] = batch_console_hash(laneConsole[lane], BATCH_CONSOLE_CLEAR);
+		return true;
+	}
+	while (ch != 'm')
+	{
+		ch = (char)lane_read(lane, index++);
+	}
+	ch = (char)lane_read(lane, index++);
+	while (ch != 0x1b)
+	{
+		lane_console(lane, ch);
+		ch = (char)lane_read(lane, index++);
+	}
+	return true;
+}
+
+/* op_trap() after R7 is set, with the _host versions of the console traps */
+static void lane_trap(int lane, uint16_t instr)
+{
+	switch (instr & 0x00FF)
+	{
+		case 0x20:
+			if (!laneKeyPressed[lane])
+			{
+				lane_poll(lane);
+			}
+			laneReg[R_R0][lane] = laneLastKey[lane] & 0x00FF;
+			laneKeyPressed[lane] = false;
+			break;
+		case 0x23:
+			for (const char* p = TRAP_IN_PROMPT; *p != '\0'; p++)
+			{
+				lane_console(lane, *p);
+			}
+			if (!laneKeyPressed[lane])
+			{
+				lane_poll(lane);
+			}
+			laneReg[R_R0][lane] = laneLastKey[lane] & 0x00FF;
+			laneKeyPressed[lane] = false;
+			lane_console(lane, (char)(uint8_t)laneReg[R_R0][lane]);
+			lane_console(lane, '\n');
+			break;
+		case 0x21:
+			lane_console(lane, (char)(uint8_t)laneReg[R_R0][lane]);
+			break;
+		case 0x22:
+		{
+			uint16_t i = laneReg[R_R0][lane];
+			char ch = (char)lane_read(lane, i);
+			while (ch != 0)
+			{
+				if (ch == 0x1B)
+				{
+					if (!lane_parse_escape(lane, i))
+					{
+						laneBadEscape[lane] = true;
+						laneActive[lane] = 0;
+					}
+					break;
+				}
+				lane_console(lane, ch);
+				i++;
+				ch = (char)lane_read(lane, i);
+			}
+			break;
+		}
+		case 0x24:
+			for (uint16_t i = laneReg[R_R0][lane]; ; i++)
+			{
+				uint16_t value = lane_read(lane, i);
+				if (value == 0)
+				{
+					break;
+				}
+				lane_console(lane, (char)(uint8_t)(value & 0x00FF));
+				lane_console(lane, (char)(uint8_t)(value >> 8));
+			}
+			break;
+		case 0x25:
+			laneRunning[lane] = 0;
+			break;
+		default:
+			// EXPLAIN: Unknown vectors are only printed in the core
+			break;
+	}
+}
+
+/* One instruction for the lanes in group, they are all at pc */
+static BATCH_INLINE void batch_execute(uint16_t instr, uint16_t pc, const batchMask& group)
+{
+	uint16_t next = (uint16_t)(pc + 1);
+	uint16_t dr = (instr >> 9) & 0x0007;
+	uint16_t sr = (instr >> 6) & 0x0007;
+	uint16_t pcoffset9 = (uint16_t)(next + sign_extended(instr & 0x01FF, 9));
+	batchWords& pcs = laneReg[R_PC];
+	pcs = blend(pcs, splat(next), group);
+
+	switch (instr >> 12)
+	{
+		case OP_BR:
+		{
+			batchMask taken = group & ((laneReg[R_COND] & (uint16_t)((instr >> 9) & 0x0007)) != 0);
+			pcs = blend(pcs, splat(pcoffset9), taken);
+			break;
+		}
+		case OP_ADD:
+		case OP_AND:
+		{
+			batchWords operand = (instr & 0x0020) ? splat(sign_extended(instr & 0x001F, 5)) : laneReg[instr & 0x0007];
+			batchWords value = (instr >> 12) == OP_ADD ? laneReg[sr] + operand : laneReg[sr] & operand;
+			laneReg[dr] = blend(laneReg[dr], value, group);
+			set_cc(value, group);
+			break;
+		}
+		case OP_NOT:
+		{
+			batchWords value = ~laneReg[sr];
+			laneReg[dr] = blend(laneReg[dr], value, group);
+			set_cc(value, group);
+			break;
+		}
+		case OP_LEA:
+			laneReg[dr] = blend(laneReg[dr], splat(pcoffset9), group);
+			set_cc(splat(pcoffset9), group);
+			break;
+		case OP_LD:
+		case OP_LDI:
+		{
+			if (pcoffset9 == MR_KBSR || pcoffset9 == MR_DSR)
+			{
+				for (int lane = 0; lane < BATCH_LANES; lane++)
+				{
+					if (group[lane])
+					{
+						lane_read(lane, pcoffset9);
+					}
+				}
+			}
+			batchWords value = row_load(pcoffset9);
+			if ((instr >> 12) == OP_LDI)
+			{
+				for (int lane = 0; lane < BATCH_LANES; lane++)
+				{
+					if (group[lane])
+					{
+						value[lane] = lane_read(lane, value[lane]);
+					}
+				}
+			}
+			laneReg[dr] = blend(laneReg[dr], value, group);
+			set_cc(value, group);
+			break;
+		}
+		case OP_LDR:
+		{
+			batchWords address = laneReg[sr] + sign_extended(instr & 0x003F, 6);
+			batchWords value = laneReg[dr];
+			for (int lane = 0; lane < BATCH_LANES; lane++)
+			{
+				if (group[lane])
+				{
+					value[lane] = lane_read(lane, address[lane]);
+				}
+			}
+			laneReg[dr] = blend(laneReg[dr], value, group);
+			set_cc(value, group);
+			break;
+		}
+		case OP_ST:
+			row_store(pcoffset9, blend(row_load(pcoffset9), laneReg[dr], group));
+			break;
+		case OP_STI:
+		case OP_STR:
+		{
+			batchWords address = laneReg[sr] + sign_extended(instr & 0x003F, 6);
+			bool indirect = (instr >> 12) == OP_STI;
+			for (int lane = 0; lane < BATCH_LANES; lane++)
+			{
+				if (group[lane])
+				{
+					uint16_t target = indirect ? lane_read(lane, pcoffset9) : address[lane];
+					lane_word(target, lane) = laneReg[dr][lane];
+					if (target == MR_DDR)
+					{
+						lane_console(lane, (char)(uint8_t)laneReg[dr][lane]);
+					}
+				}
+			}
+			break;
+		}
+		case OP_JSR:
+		{
+			// EXPLAIN: R7 first, JSRR R7 jumps to the return address like op_jsr() does
+			laneReg[R_R7] = blend(laneReg[R_R7], splat(next), group);
+			batchWords target = (instr & 0x0800) ? splat((uint16_t)(next + sign_extended(instr & 0x07FF, 11))) : laneReg[sr];
+			pcs = blend(pcs, target, group);
+			break;
+		}
+		case OP_JMP:
+			pcs = blend(pcs, laneReg[sr], group);
+			break;
+		case OP_TRAP:
+			laneReg[R_R7] = blend(laneReg[R_R7], splat(next), group);
+			for (int lane = 0; lane < BATCH_LANES; lane++)
+			{
+				if (group[lane])
+				{
+					lane_trap(lane, instr);
+				}
+			}
+			break;
+		default:
+			// EXPLAIN: Neither does the reserved opcode in the core, RTI only without interrupts (see the header)
+			break;
+	}
+}
+
+BATCH_TARGETS
+static void batch_loop(uint32_t maxInstructions)
+{
+	while (any_lane(laneActive))
+	{
+		// EXPLAIN: The first active lane leads, while all lanes are together that is the whole group
+		int leader = 0;
+		while (!laneActive[leader])
+		{
+			leader++;
+		}
+		uint16_t pc = laneReg[R_PC][leader];
+		batchMask group = laneActive & (laneReg[R_PC] == pc);
+		if (any_lane(group ^ laneActive))
+		{
+			for (int lane = leader + 1; lane < BATCH_LANES; lane++)
+			{
+				if (laneActive[lane] && laneReg[R_PC][lane] < pc)
+				{
+					pc = laneReg[R_PC][lane];
+					leader = lane;
+				}
+			}
+			group = laneActive & (laneReg[R_PC] == pc);
+		}
+		batchWords code = row_load(pc);
+		uint16_t instr = code[leader];
+		// EXPLAIN: Lanes whose code at pc differs (they wrote it) wait for their own turn
+		group &= (code == instr);
+
+		batch_execute(instr, pc, group);
+		laneCount -= (batchCounts)__builtin_convertvector(group, batchMask32);
+
+		uint16_t op = instr >> 12;
+		if (is_branch((uint8_t)op))
+		{
+			// EXPLAIN: End of a block, where the headless loop looks at isRunning and the instruction count
+			batchMask over = __builtin_convertvector((batchMask32)(laneCount >= maxInstructions), batchMask);
+			laneActive &= ~(group & (~laneRunning | over));
+		}
+	}
+}
+
+void batch_run(const std::string* keys, int count, uint64_t maxInstructions, struct lc3BatchResult* results)
+{
+	for (uint32_t address = 0; address < MAX_SIZE; address++)
+	{
+		row_store((uint16_t)address, splat(memory[address]));
+	}
+	for (int i = 0; i < R_COUNT; i++)
+	{
+		laneReg[i] = splat(reg[i]);
+	}
+	laneCount = batchCounts{};
+	for (int lane = 0; lane < BATCH_LANES; lane++)
+	{
+		bool used = lane < count;
+		laneActive[lane] = (used && isRunning && maxInstructions > 0) ? -1 : 0;
+		laneRunning[lane] = isRunning ? -1 : 0;
+		laneKeyPressed[lane] = keyPressed;
+		laneLastKey[lane] = lastKeyPressed;
+		laneKeys[lane] = used ? &keys[lane] : nullptr;
+		laneKeyIndex[lane] = 0;
+		laneKeysExhausted[lane] = false;
+		laneBadEscape[lane] = false;
+		laneConsole[lane] = BATCH_CONSOLE_HASH_START;
+	}
+
+	batch_loop(maxInstructions > UINT32_MAX ? UINT32_MAX : (uint32_t)maxInstructions);
+
+	for (int lane = 0; lane < count; lane++)
+	{
+		struct lc3BatchResult& result = results[lane];
+		result.instructions = laneCount[lane];
+		if (laneBadEscape[lane])
+		{
+			result.stop = BATCH_BAD_ESCAPE;
+		}
+		else
+		{
+			result.stop = laneKeysExhausted[lane] ? BATCH_END_OF_KEYS : (laneRunning[lane] ? BATCH_INSTRUCTION_LIMIT : BATCH_HALT);
+		}
+
+		// EXPLAIN: core_state_hash() over this lane
+		uint64_t hash = BATCH_CONSOLE_HASH_START;
+		for (int i = 0; i < R_COUNT; i++)
+		{
+			hash = (hash ^ laneReg[i][lane]) * FNV_PRIME;
+		}
+		for (uint32_t address = 0; address < MAX_SIZE; address++)
+		{
+			hash = (hash ^ lane_word((uint16_t)address, lane)) * FNV_PRIME;
+		}
+		hash = (hash ^ (uint64_t)laneKeyPressed[lane]) * FNV_PRIME;
+		hash = (hash ^ laneLastKey[lane]) * FNV_PRIME;
+		// EXPLAIN: No interrupts or privilege in the lanes, they keep the PSR and stack pointers the core started them with
+		hash = (hash ^ psr) * FNV_PRIME;
+		hash = (hash ^ savedSSP) * FNV_PRIME;
+		hash = (hash ^ savedUSP) * FNV_PRIME;
+		result.stateHash = hash;
+		result.consoleHash = laneConsole[lane];
+	}
+}
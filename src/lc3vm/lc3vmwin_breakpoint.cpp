@@ -0,0 +1,596 @@
+/*
+	Breakpoint table and the condition compiler/evaluator
+*/
+
+#include "lc3vmwin_breakpoint.hpp"
+#include "lc3vmwin_callstack.hpp"
+#include "lc3vmwin_journal.hpp"
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+
+struct lc3Breakpoint breakpoints[BREAKPOINT_MAX];
+int breakpointCount = 0;
+uint8_t breakpointMap[MAX_SIZE] = {0};
+
+static bool temporaryActive = false;
+static uint16_t temporaryAddress = 0;
+static int temporaryDepth = -1;
+
+/* ------- condition compiler begin -------- */
+
+/*
+	EXPLAIN: A plain recursive descent parser that emits postfix bytecode as it goes.
+	depth tracks how many values the emitted code leaves on the stack, so a condition
+	that would overflow the evaluation stack is rejected here and bp_eval() never has to check.
+*/
+struct bpParser
+{
+	const char* p;
+	struct bpCondition* cond;
+	int depth;
+	std::string error;
+};
+
+static bool parse_or(struct bpParser& ps);
+
+static void skip_space(struct bpParser& ps)
+{
+	while (isspace((unsigned char)*ps.p))
+	{
+		ps.p++;
+	}
+}
+
+static bool accept(struct bpParser& ps, const char* token)
+{
+	skip_space(ps);
+	size_t len = strlen(token);
+	if (strncmp(ps.p, token, len) == 0)
+	{
+		ps.p += len;
+		return true;
+	}
+	return false;
+}
+
+static bool emit(struct bpParser& ps, uint8_t op, uint32_t operand)
+{
+	if (ps.cond->length >= BP_CODE_MAX)
+	{
+		ps.error = "condition too long";
+		return false;
+	}
+
+	switch (op)
+	{
+		case BP_PUSH_CONST:
+		case BP_PUSH_REG:
+		case BP_PUSH_HITS:
+			ps.depth++;
+			break;
+		case BP_LOAD:
+		case BP_NOT:
+		case BP_BITNOT:
+		case BP_NEG:
+			break;
+		default:
+			// Every binary operator pops two and pushes one
+			ps.depth--;
+			break;
+	}
+
+	if (ps.depth > BP_STACK_MAX)
+	{
+		ps.error = "condition nested too deeply";
+		return false;
+	}
+
+	ps.cond->code[ps.cond->length++] = {op, operand};
+	return true;
+}
+
+static bool parse_number(struct bpParser& ps, uint32_t* value)
+{
+	int base = 10;
+	const char* p = ps.p;
+
+	if ((p[0] == 'x' || p[0] == 'X') && isxdigit((unsigned char)p[1]))
+	{
+		base = 16;
+		p += 1;
+	}
+	else if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+	{
+		base = 16;
+		p += 2;
+	}
+	else if ((p[0] == 'b' || p[0] == 'B') && (p[1] == '0' || p[1] == '1'))
+	{
+		base = 2;
+		p += 1;
+	}
+	else if (p[0] == '#')
+	{
+		p += 1;
+	}
+
+	const char* begin = p;
+	uint64_t result = 0;
+	while (isalnum((unsigned char)*p))
+	{
+		int digit;
+		if (isdigit((unsigned char)*p))
+		{
+			digit = *p - '0';
+		}
+		else
+		{
+			digit = tolower((unsigned char)*p) - 'a' + 10;
+		}
+
+		if (digit >= base)
+		{
+			ps.error = std::string("bad digit in number near \"") + begin + "\"";
+			return false;
+		}
+		result = result * (uint64_t)base + (uint64_t)digit;
+		if (result > 0xFFFFFFFF)
+		{
+			ps.error = "number too large";
+			return false;
+		}
+		p++;
+	}
+
+	if (p == begin)
+	{
+		ps.error = "expected a number";
+		return false;
+	}
+
+	ps.p = p;
+	*value = (uint32_t)result;
+	return true;
+}
+
+static bool parse_primary(struct bpParser& ps)
+{
+	skip_space(ps);
+
+	if (accept(ps, "("))
+	{
+		if (!parse_or(ps))
+		{
+			return false;
+		}
+		if (!accept(ps, ")"))
+		{
+			ps.error = "expected )";
+			return false;
+		}
+		return true;
+	}
+
+	// Identifiers: registers, hits, mem[]
+	if (isalpha((unsigned char)*ps.p))
+	{
+		const char* begin = ps.p;
+		while (isalnum((unsigned char)*ps.p))
+		{
+			ps.p++;
+		}
+		std::string word(begin, ps.p);
+		for (char& c : word)
+		{
+			c = (char)toupper((unsigned char)c);
+		}
+
+		if (word.size() == 2 && word[0] == 'R' && word[1] >= '0' && word[1] <= '7')
+		{
+			return emit(ps, BP_PUSH_REG, (uint32_t)(R_R0 + (word[1] - '0')));
+		}
+		if (word == "PC")
+		{
+			return emit(ps, BP_PUSH_REG, R_PC);
+		}
+		if (word == "COND")
+		{
+			return emit(ps, BP_PUSH_REG, R_COND);
+		}
+		if (word == "HITS")
+		{
+			return emit(ps, BP_PUSH_HITS, 0);
+		}
+		if (word == "MEM")
+		{
+			if (!accept(ps, "["))
+			{
+				ps.error = "expected [ after mem";
+				return false;
+			}
+			if (!parse_or(ps))
+			{
+				return false;
+			}
+			if (!accept(ps, "]"))
+			{
+				ps.error = "expected ]";
+				return false;
+			}
+			return emit(ps, BP_LOAD, 0);
+		}
+
+		// EXPLAIN: x0F and b0101 also start with a letter, give them back to the number parser
+		ps.p = begin;
+		if (!(((begin[0] == 'x' || begin[0] == 'X') && isxdigit((unsigned char)begin[1])) ||
+			((begin[0] == 'b' || begin[0] == 'B') && (begin[1] == '0' || begin[1] == '1'))))
+		{
+			ps.error = "unknown name \"" + word + "\"";
+			return false;
+		}
+	}
+
+	uint32_t value = 0;
+	if (!parse_number(ps, &value))
+	{
+		return false;
+	}
+	return emit(ps, BP_PUSH_CONST, value);
+}
+
+static bool parse_unary(struct bpParser& ps)
+{
+	skip_space(ps);
+	if (*ps.p == '!' && ps.p[1] != '=')
+	{
+		ps.p++;
+		return parse_unary(ps) && emit(ps, BP_NOT, 0);
+	}
+	if (*ps.p == '~')
+	{
+		ps.p++;
+		return parse_unary(ps) && emit(ps, BP_BITNOT, 0);
+	}
+	if (*ps.p == '-')
+	{
+		ps.p++;
+		return parse_unary(ps) && emit(ps, BP_NEG, 0);
+	}
+	return parse_primary(ps);
+}
+
+static bool parse_sum(struct bpParser& ps)
+{
+	if (!parse_unary(ps))
+	{
+		return false;
+	}
+	while (true)
+	{
+		if (accept(ps, "+"))
+		{
+			if (!parse_unary(ps) || !emit(ps, BP_ADD, 0)) return false;
+		}
+		else if (accept(ps, "-"))
+		{
+			if (!parse_unary(ps) || !emit(ps, BP_SUB, 0)) return false;
+		}
+		else
+		{
+			return true;
+		}
+	}
+}
+
+static bool parse_bitand(struct bpParser& ps)
+{
+	if (!parse_sum(ps))
+	{
+		return false;
+	}
+	while (true)
+	{
+		skip_space(ps);
+		// EXPLAIN: a single & only, && belongs to parse_and()
+		if (ps.p[0] == '&' && ps.p[1] != '&')
+		{
+			ps.p++;
+			if (!parse_sum(ps) || !emit(ps, BP_AND, 0)) return false;
+		}
+		else
+		{
+			return true;
+		}
+	}
+}
+
+static bool parse_bitor(struct bpParser& ps)
+{
+	if (!parse_bitand(ps))
+	{
+		return false;
+	}
+	while (true)
+	{
+		skip_space(ps);
+		if (ps.p[0] == '|' && ps.p[1] != '|')
+		{
+			ps.p++;
+			if (!parse_bitand(ps) || !emit(ps, BP_OR, 0)) return false;
+		}
+		else if (ps.p[0] == '^')
+		{
+			ps.p++;
+			if (!parse_bitand(ps) || !emit(ps, BP_XOR, 0)) return false;
+		}
+		else
+		{
+			return true;
+		}
+	}
+}
+
+static bool parse_compare(struct bpParser& ps)
+{
+	if (!parse_bitor(ps))
+	{
+		return false;
+	}
+
+	// Longer tokens first so that <= is not read as <
+	static const struct { const char* token; uint8_t op; } compareOps[] = {
+		{"==", BP_EQ}, {"!=", BP_NE}, {"<=", BP_LE}, {">=", BP_GE}, {"<", BP_LT}, {">", BP_GT}
+	};
+	for (const auto& c : compareOps)
+	{
+		if (accept(ps, c.token))
+		{
+			return parse_bitor(ps) && emit(ps, c.op, 0);
+		}
+	}
+	return true;
+}
+
+static bool parse_and(struct bpParser& ps)
+{
+	if (!parse_compare(ps))
+	{
+		return false;
+	}
+	while (accept(ps, "&&"))
+	{
+		if (!parse_compare(ps) || !emit(ps, BP_LAND, 0)) return false;
+	}
+	return true;
+}
+
+static bool parse_or(struct bpParser& ps)
+{
+	if (!parse_and(ps))
+	{
+		return false;
+	}
+	while (accept(ps, "||"))
+	{
+		if (!parse_and(ps) || !emit(ps, BP_LOR, 0)) return false;
+	}
+	return true;
+}
+
+bool bp_compile(const char* text, struct bpCondition* cond, std::string& error)
+{
+	cond->length = 0;
+
+	struct bpParser ps = {text, cond, 0, ""};
+	skip_space(ps);
+	// EXPLAIN: an empty condition means "always stop"
+	if (*ps.p == '\0')
+	{
+		return true;
+	}
+
+	if (parse_or(ps))
+	{
+		skip_space(ps);
+		if (*ps.p == '\0')
+		{
+			return true;
+		}
+		ps.error = std::string("unexpected \"") + ps.p + "\"";
+	}
+
+	error = ps.error;
+	cond->length = 0;
+	return false;
+}
+
+/* ------- condition compiler end -------- */
+
+uint32_t bp_eval(const struct bpCondition* cond, const uint16_t reg[], const uint16_t memory[], uint32_t hits)
+{
+	if (cond->length == 0)
+	{
+		return 1;
+	}
+
+	// EXPLAIN: the stack lives on the host stack, bp_compile() guarantees it never goes past BP_STACK_MAX
+	uint32_t stack[BP_STACK_MAX];
+	int sp = 0;
+
+	for (int i = 0; i < cond->length; i++)
+	{
+		const struct bpInstr& in = cond->code[i];
+		switch (in.op)
+		{
+			case BP_PUSH_CONST: stack[sp++] = in.operand; break;
+			case BP_PUSH_REG:   stack[sp++] = reg[in.operand]; break;
+			case BP_PUSH_HITS:  stack[sp++] = hits; break;
+			// EXPLAIN: read memory[] directly, read_memory() has side effects on KBSR
+			case BP_LOAD:   stack[sp - 1] = memory[stack[sp - 1] & 0xFFFF]; break;
+			case BP_NOT:    stack[sp - 1] = !stack[sp - 1]; break;
+			case BP_BITNOT: stack[sp - 1] = (~stack[sp - 1]) & 0xFFFF; break;
+			case BP_NEG:    stack[sp - 1] = (0u - stack[sp - 1]) & 0xFFFF; break;
+			default:
+			{
+				uint32_t b = stack[--sp];
+				uint32_t a = stack[sp - 1];
+				uint32_t r = 0;
+				switch (in.op)
+				{
+					case BP_ADD:  r = (a + b) & 0xFFFF; break;
+					case BP_SUB:  r = (a - b) & 0xFFFF; break;
+					case BP_AND:  r = a & b; break;
+					case BP_OR:   r = a | b; break;
+					case BP_XOR:  r = a ^ b; break;
+					case BP_EQ:   r = a == b; break;
+					case BP_NE:   r = a != b; break;
+					case BP_LT:   r = a < b; break;
+					case BP_LE:   r = a <= b; break;
+					case BP_GT:   r = a > b; break;
+					case BP_GE:   r = a >= b; break;
+					case BP_LAND: r = a && b; break;
+					case BP_LOR:  r = a || b; break;
+				}
+				stack[sp - 1] = r;
+				break;
+			}
+		}
+	}
+
+	return stack[0];
+}
+
+int bp_add(uint16_t address, const char* conditionText, std::string& error)
+{
+	struct bpCondition cond;
+	if (!bp_compile(conditionText, &cond, error))
+	{
+		return -1;
+	}
+
+	/* EXPLAIN: one breakpoint per address, adding again just replaces the condition */
+	int index = (breakpointMap[address] & BP_MAP_INDEX) - 1;
+	if (index < 0)
+	{
+		if (breakpointCount >= BREAKPOINT_MAX)
+		{
+			error = "too many breakpoints";
+			return -1;
+		}
+		index = breakpointCount++;
+		breakpointMap[address] |= (uint8_t)(index + 1);
+	}
+
+	struct lc3Breakpoint& bp = breakpoints[index];
+	bp.address = address;
+	bp.enabled = true;
+	bp.hits = 0;
+	bp.condition = cond;
+	snprintf(bp.conditionText, BP_TEXT_MAX, "%s", conditionText);
+
+	return index;
+}
+
+void bp_remove(int index)
+{
+	if (index < 0 || index >= breakpointCount)
+	{
+		return;
+	}
+
+	breakpointMap[breakpoints[index].address] &= BP_MAP_TEMPORARY;
+	for (int i = index; i < breakpointCount - 1; i++)
+	{
+		breakpoints[i] = breakpoints[i + 1];
+		uint8_t& entry = breakpointMap[breakpoints[i].address];
+		entry = (uint8_t)((entry & BP_MAP_TEMPORARY) | (i + 1));
+	}
+	breakpointCount--;
+}
+
+void bp_clear()
+{
+	for (int i = 0; i < breakpointCount; i++)
+	{
+		breakpointMap[breakpoints[i].address] &= BP_MAP_TEMPORARY;
+	}
+	breakpointCount = 0;
+}
+
+void bp_set_temporary(uint16_t address, int depth)
+{
+	bp_clear_temporary();
+	temporaryActive = true;
+	temporaryAddress = address;
+	temporaryDepth = depth;
+	breakpointMap[address] |= BP_MAP_TEMPORARY;
+}
+
+void bp_clear_temporary()
+{
+	if (temporaryActive)
+	{
+		breakpointMap[temporaryAddress] &= BP_MAP_INDEX;
+		temporaryActive = false;
+	}
+}
+
+bool bp_check(uint16_t address, const uint16_t reg[], const uint16_t memory[])
+{
+	bool stop = false;
+	uint8_t entry = breakpointMap[address];
+
+	if ((entry & BP_MAP_TEMPORARY) && (temporaryDepth < 0 || temporaryDepth == callDepth))
+	{
+		bp_clear_temporary();
+		stop = true;
+	}
+
+	// EXPLAIN: Still count the hit on a user breakpoint at the same address, even if we stop anyway
+	int index = (entry & BP_MAP_INDEX) - 1;
+	if (index >= 0 && breakpoints[index].enabled)
+	{
+		struct lc3Breakpoint& bp = breakpoints[index];
+		bp.hits++;
+		if (journalEnabled)
+		{
+			journal_hit(address);
+		}
+		stop |= (bp_eval(&bp.condition, reg, memory, bp.hits) != 0);
+	}
+
+	return stop;
+}
+
+bool bp_matches(uint16_t address, const uint16_t reg[], const uint16_t memory[], uint32_t laterHits)
+{
+	int index = (breakpointMap[address] & BP_MAP_INDEX) - 1;
+	if (index < 0 || !breakpoints[index].enabled)
+	{
+		return false;
+	}
+	const struct lc3Breakpoint& bp = breakpoints[index];
+	// EXPLAIN: The hits before this step, plus this one. Hits from before bp_add() reset the count are not in bp.hits
+	uint32_t hits = bp.hits - (laterHits < bp.hits ? laterHits : bp.hits) + 1;
+	return bp_eval(&bp.condition, reg, memory, hits) != 0;
+}
+
+bool bp_uses_hits()
+{
+	for (int i = 0; i < breakpointCount; i++)
+	{
+		if (!breakpoints[i].enabled)
+		{
+			continue;
+		}
+		for (int j = 0; j < breakpoints[i].condition.length; j++)
+		{
+			if (breakpoints[i].condition.code[j].op == BP_PUSH_HITS)
+			{
+				return true;
+			}
+		}
+	}
+	return false;
+}
@@ -4,6 +4,8 @@
 
 #include "lc3disa.hpp"
 #include "lc3vmwin_cache.hpp"
+#include "lc3vmwin_idiom.hpp"
+#include "lc3vmwin_trap.hpp"
 #include <iostream>
 
 uint16_t cacheCount = 0;
@@ -29,7 +31,7 @@ struct lc3Cache cache_create_block(uint16_t memory[], uint16_t lc3Address)
 			Find the last lc3Address that is a jump/ret/trap. 
 			Code blocks always stop at such instructions.
 		*/
-		if (is_branch(get_opcode(memory[lc3Address])))
+		if (is_branch(get_opcode(memory[lc3Address])) || trap_ends_block(memory[lc3Address]))
 		{
 			break;
 		}
@@ -41,7 +43,9 @@ struct lc3Cache cache_create_block(uint16_t memory[], uint16_t lc3Address)
 		lc3Address += 1;
 	}
 
-	struct lc3Cache cache = {lc3MemAddress, numInstr, codeBlock};
+	int idiomHead = 0;
+	uint8_t idiom = idiom_match(codeBlock, numInstr, lc3MemAddress, &idiomHead);
+	struct lc3Cache cache = {lc3MemAddress, numInstr, codeBlock, idiom, idiomHead};
 
 	return cache;
 }
@@ -76,6 +80,33 @@ void cache_add(struct lc3Cache c)
 	}
 }
 
+int cache_invalidate(int begin, int end)
+{
+	/*
+		EXPLAIN:
+		Drops every block with an instruction in [begin, end] and closes the gap,
+		the rest keep their order. Returns how many were dropped.
+	*/
+	int kept = 0;
+	int dropped = 0;
+	for (int i = 0; i < cacheCount; i++)
+	{
+		int first = codeCache[i].lc3MemAddress;
+		int last = first + codeCache[i].numInstr - 1;
+		if (first <= end && last >= begin)
+		{
+			delete[] codeCache[i].codeBlock;
+			dropped++;
+		}
+		else
+		{
+			codeCache[kept++] = codeCache[i];
+		}
+	}
+	cacheCount = (uint16_t)kept;
+	return dropped;
+}
+
 
 // int cache_find(uint16_t address)
 // {
@@ -117,10 +148,10 @@ uint8_t get_opcode(uint16_t instr)
 	return (uint8_t)((instr >> 12) & 0x000F);
 }
 
-/* returns 1 if it's a br/jmp/ret/jsr, 0 otherwise (trap is allowed to stay) */
+/* returns 1 if it's a br/jmp/ret/jsr/rti, 0 otherwise (trap is allowed to stay) */
 int is_branch(uint8_t opcode)
 {
-	return ((opcode == 0x00) || (opcode == 0x04) || (opcode == 0x0c));
+	return ((opcode == 0x00) || (opcode == 0x04) || (opcode == 0x08) || (opcode == 0x0c));
 }
 
 void write_16bit(uint16_t* targetArray, uint16_t targetIndex, uint16_t value)
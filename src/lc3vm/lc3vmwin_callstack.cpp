@@ -0,0 +1,44 @@
+/*
+	Shadow call stack, fed by the interpreter at the end of each code block
+*/
+
+#include "lc3vmwin_callstack.hpp"
+
+struct lc3Frame callStack[CALLSTACK_MAX];
+int callDepth = 0;
+
+void callstack_reset()
+{
+	callDepth = 0;
+}
+
+void callstack_update(uint16_t instr, uint16_t address, uint16_t newPC)
+{
+	uint8_t op = (uint8_t)(instr >> 12);
+
+	// EXPLAIN: A TRAP only ends a block when its service routine runs in guest code, and then it's a call like JSR
+	if (op == OP_JSR || (op == OP_TRAP && newPC != (uint16_t)(address + 1)))
+	{
+		/* EXPLAIN: Deeper calls than CALLSTACK_MAX are simply not tracked, their RETs won't find a frame either */
+		if (callDepth < CALLSTACK_MAX)
+		{
+			callStack[callDepth++] = {address, newPC, (uint16_t)(address + 1)};
+		}
+	}
+	else if (op == OP_JMP && ((instr >> 6) & 0x0007) == R_R7)
+	{
+		/*
+			EXPLAIN: Search downwards for the frame we are returning to instead of blindly popping one.
+			Guest code is free to skip frames (e.g. an error path that restores an older R7), and a RET that
+			matches nothing (a JMP R7 used as a computed jump) leaves the stack alone.
+		*/
+		for (int i = callDepth - 1; i >= 0; i--)
+		{
+			if (callStack[i].returnAddress == newPC)
+			{
+				callDepth = i;
+				break;
+			}
+		}
+	}
+}
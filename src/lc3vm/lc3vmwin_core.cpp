@@ -0,0 +1,1163 @@
+/*
+	The LC-3 machine, shared by the GUI and the headless runner. See lc3vmwin_core.hpp
+*/
+
+#include "lc3vmwin_core.hpp"
+#include "lc3vmwin_loader.hpp"
+#include "lc3vmwin_disa_be.hpp"
+#include "lc3vmwin_breakpoint.hpp"
+#include "lc3vmwin_watch.hpp"
+#include "lc3vmwin_callstack.hpp"
+#include "lc3vmwin_profiler_be.hpp"
+#include "lc3vmwin_symbols.hpp"
+#include "lc3vmwin_heatmap.hpp"
+#include "lc3vmwin_stats_be.hpp"
+#include "lc3vmwin_trace.hpp"
+#include "lc3vmwin_journal.hpp"
+#include "lc3vmwin_machine.hpp"
+#include "lc3vmwin_input.hpp"
+#include "lc3vmwin_hang.hpp"
+#include "lc3vmwin_idiom.hpp"
+#include "lc3vmwin_native.hpp"
+#include "lc3vmwin_trap.hpp"
+#include "lc3vmwin_display.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+struct lc3Host host = {nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr};
+
+// EXPLAIN: load_memory() needs a scratch buffer as big as the address space
+uint16_t buffer[MAX_SIZE] = {0};
+
+void (*instr_call_table[])(uint16_t) = {
+	&op_br, &op_add, &op_ld, &op_st, &op_jsr, &op_and, &op_ldr, &op_str, 
+	&op_rti, &op_not, &op_ldi, &op_sti, &op_jmp, &op_res, &op_lea, &op_trap
+};
+
+// EXPLAIN: The plain instruction functions, instr_call_table[] is either a copy of this or the hooked wrappers below
+static void (*instr_base_table[16])(uint16_t) = {
+	&op_br, &op_add, &op_ld, &op_st, &op_jsr, &op_and, &op_ldr, &op_str, 
+	&op_rti, &op_not, &op_ldi, &op_sti, &op_jmp, &op_res, &op_lea, &op_trap
+};
+
+/*
+	EXPLAIN: Per-instruction hooks (undo journal, trace recorder). One wrapper per opcode so the real function is known
+	at compile time. They are only in instr_call_table[] while a hook is on, see core_hooks_update().
+*/
+template <int OP>
+static void instr_hooked(uint16_t instr)
+{
+	if (journalEnabled)
+	{
+		journal_before();
+	}
+	if (traceEnabled)
+	{
+		trace_before(instr);
+	}
+	instr_base_table[OP](instr);
+	if (traceEnabled)
+	{
+		trace_after();
+	}
+	if (journalEnabled)
+	{
+		journal_after();
+	}
+}
+
+static void (*instr_hooked_table[16])(uint16_t) = {
+	&instr_hooked<0>, &instr_hooked<1>, &instr_hooked<2>, &instr_hooked<3>,
+	&instr_hooked<4>, &instr_hooked<5>, &instr_hooked<6>, &instr_hooked<7>,
+	&instr_hooked<8>, &instr_hooked<9>, &instr_hooked<10>, &instr_hooked<11>,
+	&instr_hooked<12>, &instr_hooked<13>, &instr_hooked<14>, &instr_hooked<15>
+};
+
+bool keyPressed = false;
+uint8_t lastKeyPressed = 0;
+
+uint16_t psr = PSR_USER;
+uint16_t savedSSP = 0x3000;
+uint16_t savedUSP = 0;
+
+// Registers
+uint16_t reg[R_COUNT] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+// RAM
+uint16_t memory[MAX_SIZE] = {0};
+// One byte per 256-word page (PAGE_WATCH, PAGE_HEAT, PAGE_TRACE, PAGE_JOURNAL, PAGE_COW, PAGE_HANG, PAGE_DEVICE), non-zero sends read_memory()/write_memory() to the slow path
+uint8_t pageFlags[PAGE_COUNT] = {0};
+
+bool isRunning = true;
+bool isStepIn = false;
+bool breakpointResume = false;
+int stepOutDepth = -1;
+uint64_t retiredCount = 0;
+uint64_t retiredLimit = UINT64_MAX;
+uint64_t keyboardReads = 0;
+
+// EXPLAIN: First instruction of what cache_run()/core_step() is running, core_current_step() counts from it
+static uint16_t runBeginAddress = 0;
+// EXPLAIN: Set while host.input_poll runs, the input log marks a key pressed from there as polled
+static bool corePolling = false;
+
+static void core_input_poll()
+{
+	corePolling = true;
+	host.input_poll();
+	corePolling = false;
+}
+
+// EXPLAIN: Queued, whoever runs the core flushes it, see lc3vmwin_display.hpp
+static void console_write(const char* text, size_t length)
+{
+	display_write(text, length);
+}
+
+void core_reset(uint16_t pc)
+{
+	for (int i = 0; i < R_COUNT; i++)
+	{
+		reg[i] = 0;
+	}
+	reg[R_COND] = FL_ZRO;
+	reg[R_PC] = pc;
+
+	keyPressed = false;
+	lastKeyPressed = 0;
+	// EXPLAIN: Programs start in user mode at priority 0, the supervisor stack grows down from x2FFF like on the LC-3 simulators
+	psr = PSR_USER;
+	savedSSP = 0x3000;
+	savedUSP = 0;
+	isRunning = true;
+	isStepIn = false;
+	breakpointResume = false;
+	stepOutDepth = -1;
+	retiredCount = 0;
+	keyboardReads = 0;
+	pageFlags[MR_DDR >> PAGE_SHIFT] |= PAGE_DEVICE;
+	pageFlags[MR_MCR >> PAGE_SHIFT] |= PAGE_DEVICE;
+
+	// EXPLAIN: The blocks were built from the old memory contents
+	cache_clear();
+	trap_reset();
+	display_reset();
+	bp_clear_temporary();
+	callstack_reset();
+	profiler_reset(pc);
+	journal_reset();
+	// EXPLAIN: The loader writes memory[] directly
+	machine_forget_base();
+}
+
+bool core_load(const char* path)
+{
+	FILE* fp = fopen(path, "rb");
+	if (!fp)
+	{
+		return false;
+	}
+	uint16_t org = load_memory(buffer, memory, fp);
+	fclose(fp);
+
+	core_reset(org);
+
+	// EXPLAIN: Optional, without it the profiler and the call stack show raw addresses
+	std::string symPath = path;
+	size_t dot = symPath.rfind('.');
+	if (dot != std::string::npos)
+	{
+		symPath.erase(dot);
+	}
+	symPath += ".sym";
+	symbols_load(symPath.c_str());
+
+	return true;
+}
+
+void core_key_press(uint8_t key)
+{
+	if (journalEnabled)
+	{
+		journal_key(key, false);
+	}
+	if (inputRecording)
+	{
+		input_record_key(key, false, corePolling);
+	}
+	keyPressed = true;
+	lastKeyPressed = key;
+}
+
+void core_key_release()
+{
+	if (journalEnabled)
+	{
+		journal_key(0, true);
+	}
+	if (inputRecording)
+	{
+		input_record_key(0, true, corePolling);
+	}
+	keyPressed = false;
+}
+
+uint64_t core_current_step()
+{
+	// EXPLAIN: A block runs its instructions one after the other, and R_PC is already past the one that is running
+	return retiredCount + (uint16_t)(reg[R_PC] - 1 - runBeginAddress);
+}
+
+uint64_t core_state_hash()
+{
+	// EXPLAIN: FNV-1a over everything the guest can observe
+	uint64_t hash = 14695981039346656037ull;
+	for (int i = 0; i < R_COUNT; i++)
+	{
+		hash = (hash ^ reg[i]) * 1099511628211ull;
+	}
+	for (int i = 0; i < MAX_SIZE; i++)
+	{
+		hash = (hash ^ memory[i]) * 1099511628211ull;
+	}
+	hash = (hash ^ (uint64_t)keyPressed) * 1099511628211ull;
+	hash = (hash ^ lastKeyPressed) * 1099511628211ull;
+	hash = (hash ^ psr) * 1099511628211ull;
+	hash = (hash ^ savedSSP) * 1099511628211ull;
+	hash = (hash ^ savedUSP) * 1099511628211ull;
+	return hash;
+}
+
+uint16_t psr_read()
+{
+	return (uint16_t)(psr | (reg[R_COND] & 0x0007));
+}
+
+void core_interrupt(uint8_t vector, uint8_t priority)
+{
+	uint16_t oldPSR = psr_read();
+	if (psr & PSR_USER)
+	{
+		savedUSP = reg[R_R6];
+		reg[R_R6] = savedSSP;
+	}
+	// EXPLAIN: Through the bus, so the journal can undo the pushes and watchpoints see them
+	reg[R_R6] -= 1;
+	write_memory(reg[R_R6], oldPSR);
+	reg[R_R6] -= 1;
+	write_memory(reg[R_R6], reg[R_PC]);
+
+	psr = (uint16_t)((priority << PSR_PRIORITY_SHIFT) & PSR_PRIORITY);
+	// EXPLAIN: Z rather than no code at all, op_br() would not even take a BRnzp with none
+	reg[R_COND] = FL_ZRO;
+	reg[R_PC] = memory[INT_TABLE + vector];
+}
+
+void core_keyboard_interrupt()
+{
+	// EXPLAIN: The handler finds the key where a poll would, and reading KBDR is all it has to do
+	memory[MR_KBSR] = (uint16_t)(KBSR_READY | (memory[MR_KBSR] & KBSR_IE));
+	memory[MR_KBDR] = lastKeyPressed;
+	keyPressed = false;
+	keyboardReads++;
+	core_interrupt(INT_KEYBOARD, INT_KEYBOARD_LEVEL);
+}
+
+/*
+	Only called with KBSR_IE set. A guest that waits for its interrupt never reads KBSR, whatever loop it idles in,
+	so the host gets asked for a key at every block boundary instead
+*/
+static void core_interrupt_check()
+{
+	if (!keyPressed)
+	{
+		keyboardReads++;
+		if (host.input_poll)
+		{
+			core_input_poll();
+		}
+	}
+	if (keyPressed && ((psr & PSR_PRIORITY) >> PSR_PRIORITY_SHIFT) < INT_KEYBOARD_LEVEL)
+	{
+		core_keyboard_interrupt();
+		if (journalEnabled)
+		{
+			journal_interrupt();
+		}
+	}
+}
+
+void core_hooks_update()
+{
+	bool hooked = journalEnabled || traceEnabled;
+	for (int i = 0; i < 16; i++)
+	{
+		instr_call_table[i] = hooked ? instr_hooked_table[i] : instr_base_table[i];
+	}
+}
+
+void core_step()
+{
+	// EXPLAIN: Straight from memory[], the code cache only exists to speed up cache_run()
+	runBeginAddress = reg[R_PC];
+	uint16_t instr = memory[reg[R_PC]];
+	reg[R_PC] += 1;
+	instr_call_table[instr >> 12](instr);
+	retiredCount++;
+}
+
+void core_run_block()
+{
+	if (inputReplaying)
+	{
+		input_replay_due();
+	}
+	// EXPLAIN: One load per block while the guest has no interrupt enabled, blocks never look for one themselves
+	if (memory[MR_KBSR] & KBSR_IE)
+	{
+		core_interrupt_check();
+	}
+
+	uint16_t lc3Address = reg[R_PC];
+
+	/*
+		EXPLAIN: 
+		cache_find() checks a range of addresses instead of just checking the address of the first line of the code clock. Otherwise the code creates a new block for each step-in. Imagine we step-in into line 1 of the code block, we should still step into the same code block instead of creating a new block starting from this line.
+
+		This means we need to pass a parameter about which intruction in the cache code block to be executed.
+	*/
+
+	struct codeLocation loc = cache_find(lc3Address);
+	int cacheIndex = loc.cacheIndex;
+	int codeIndex = loc.codeIndex;
+
+	if (statsEnabled)
+	{
+		stats.dispatches++;
+		stats.blockMisses += (cacheIndex == -1);
+	}
+
+	/*
+		EXPLAIN: if cache not found, create, insert and execute from first line, otherwise execute from line codeIndex
+	*/
+	if (cacheIndex == -1)
+	{
+		struct lc3Cache newCache = cache_create_block(memory, lc3Address);
+		int newCacheIndex = cacheCount;
+		cache_add(newCache);
+
+		if (host.block_created)
+		{
+			host.block_created(newCacheIndex);
+		}
+		// EXPLAIN: if it's a new code block, we ofc execute from line 0 (in this case loc.codeIndex should be -1)
+		cache_run(codeCache[newCacheIndex], 0);
+	}
+	else
+	{
+		cache_run(codeCache[cacheIndex], codeIndex);
+	}
+}
+
+void cache_run(struct lc3Cache cache, int beginIndex)
+{
+	/*
+		cache_run is different from interpreter_run_test in the sense
+			-> that we don't use PC to find the next instruction but just run sequentially inside of the cache
+			-> We still need to update the PC for the next interpreter_run() call
+	*/
+
+	/*
+		EXPLAIN: There are a few reasons that this function has two parameters ->
+			- cache, which is a struct lc3Cache that contains the code block
+			- beginIndex, the index of the code in the code block
+			(e.g. if beginIndex = 5 it means start running from the 6th line of code)
+
+			Reason 1: Sometimes we don't want to run from the first line of code of the code block, maybe it's because of a jump into the middle of the block
+
+			Reason 2: For step-in, right now the solution is to return the control to the caller if no step-in command has been given (host.step_wait() says so, for the GUI it's the Step-in button in Draw() of lc3vmwin_disa.cpp). So the problem is, imagine we just exeucted line 0, now we are sent back to the caller function (interpreter_run()), and we fall into the same code block ofc, then we call cache_run() again, how do we execute line 1 instead of executing line 0 over and over again? By telling cache_run() which line to run, of course.
+	*/
+	// EXPLAIN: A loop idiom_match() recognised does every trip but the last natively, the loop below runs the last one
+	if (cache.idiom != IDIOM_NONE && beginIndex == cache.idiomHead)
+	{
+		uint64_t skipped = idiom_run(cache);
+		retiredCount += skipped;
+		if (profilerEnabled)
+		{
+			profiler_count((uint32_t)skipped);
+		}
+	}
+
+	// EXPLAIN: Stop right before the instruction retiredLimit names, the next call picks up from the middle of the block
+	int end = cache.numInstr;
+	if (retiredLimit - retiredCount < (uint64_t)(end - beginIndex))
+	{
+		end = beginIndex + (int)(retiredLimit - retiredCount);
+	}
+	runBeginAddress = (uint16_t)(cache.lc3MemAddress + beginIndex);
+
+	int i = beginIndex;
+	for (; i < end; i++)
+	{
+		uint16_t instr = cache.codeBlock[i];	
+		uint16_t op = instr >> 12;
+
+		if (isStepIn)
+		{
+			// EXPLAIN: Only execute if the front end says so (for the GUI, the user sends a signal through the disa window)
+			if (host.step_wait == nullptr || host.step_wait(cache, i))
+			{
+				reg[R_PC] += 1;			
+        		instr_call_table[op](instr);
+			}
+			// EXPLAIN: If not, then break and return. Since we haven't changed the PC, it should come back to this piece of code.
+			else
+			{
+				break;
+			}
+		}
+		else
+		// EXPLAIN: If not step-in, then just execute normally
+		{
+			/*
+				EXPLAIN: breakpointMap[] is 0 for every address without a breakpoint, so this is one byte load per instruction. The compiled condition only runs on addresses that have one.
+				On a hit we switch to step-in and return without executing, the isStepIn branch above takes over from this very line.
+			*/
+			uint16_t address = (uint16_t)(cache.lc3MemAddress + i);
+			if (breakpointMap[address])
+			{
+				if (breakpointResume)
+				{
+					breakpointResume = false;
+				}
+				else if (bp_check(address, reg, memory))
+				{
+					isStepIn = true;
+					break;
+				}
+			}
+ 			reg[R_PC] += 1;	
+        	instr_call_table[op](instr);
+		}
+	}
+
+	/*
+		EXPLAIN: We only get here with i == numInstr if the last instruction was executed. Code blocks always end with the
+		instructions that can call or return (see is_branch()), so the shadow call stack only needs a look once per block.
+	*/
+	// EXPLAIN: Whatever stopped the loop, everything from beginIndex to i has been executed, and by the current frame
+	retiredCount += (uint64_t)(i - beginIndex);
+	if (profilerEnabled)
+	{
+		profiler_count((uint32_t)(i - beginIndex));
+	}
+	if (heatmapEnabled)
+	{
+		heatmap_exec((uint16_t)(cache.lc3MemAddress + beginIndex), i - beginIndex);
+	}
+	if (statsEnabled)
+	{
+		stats_block(cache.codeBlock, cache.lc3MemAddress, beginIndex, i, i == cache.numInstr, reg[R_COND]);
+	}
+	// EXPLAIN: Nothing ran when step-in or a breakpoint held the block back, and an unchanged state is no repeat
+	if (hangEnabled && i > beginIndex)
+	{
+		hang_block((uint16_t)(cache.lc3MemAddress + beginIndex), i - beginIndex);
+	}
+
+	if (i == cache.numInstr)
+	{
+		uint16_t lastAddress = (uint16_t)(cache.lc3MemAddress + cache.numInstr - 1);
+		callstack_update(cache.codeBlock[cache.numInstr - 1], lastAddress, reg[R_PC]);
+		profiler_sync();
+		if (trapPending > 0)
+		{
+			trap_block_end();
+		}
+
+		if (callDepth < stepOutDepth)
+		{
+			stepOutDepth = -1;
+			isStepIn = true;
+		}
+	}
+}
+
+/* Op code functions */
+
+void op_br(uint16_t instr)
+{
+	/* 
+		15 14 13 12 | 11 10 9 | 8 7 6 5 4 3 2 1 0
+		0  0  0  0  | n  z  p |    PCOffset9
+	*/
+	uint16_t pcoffset9 = sign_extended(instr & 0x01FF, 9);
+	// If at least one of the nzp bits and the matching bits in R_COND are both 1, then jump
+	if (reg[R_COND] & ((instr >> 9) & 0x0007))
+	{
+		reg[R_PC] += pcoffset9;
+	}
+}
+
+void op_add(uint16_t instr)
+{
+	/* 
+		15 14 13 12 | 11 10 9 | 8 7 6 | 5 | 4 3 | 2 1 0
+		0  0  0  1  |   DR    |  SR1  | 0 | 0 0 |  SR2 
+		----------------------or-----------------------
+		15 14 13 12 | 11 10 9 | 8 7 6 | 5 | 4 3 2 1 0
+		0  0  0  1  |   DR    |  SR   | 1 |    IMM
+	*/
+
+	uint8_t dr = (instr >> 9) & 0x0007;
+	uint8_t sr = (instr >> 6) & 0x0007;
+	uint8_t mode = (instr >> 5) & 0x0001;
+	if (mode)
+	{
+		uint16_t imm = sign_extended(instr & 0x001F, 5);
+		reg[dr] = reg[sr] + imm;
+	}
+	else 
+	{
+		uint8_t sr2 = instr & 0x0007;
+		reg[dr] = reg[sr] + reg[sr2];
+	}
+	update_flag(reg[dr]);
+}
+
+void op_ld(uint16_t instr)
+{
+	/* 
+		15 14 13 12 | 11 10 9 | 8 7 6 5 4 3 2 1 0
+		0  0  1  0  |   DR    |    PCOffset9
+	*/
+	uint16_t pcoffset9 = sign_extended(instr & 0x01FF, 9);
+	uint8_t dr = (instr >> 9) & 0x0007;
+	// Ignore privilege bit and other security measures
+	reg[dr] = read_memory(reg[R_PC] + pcoffset9);
+	update_flag(reg[dr]);
+}
+
+void op_st(uint16_t instr)
+{
+	/* 
+		15 14 13 12 | 11 10 9 | 8 7 6 5 4 3 2 1 0
+		0  0  1  1  |   SR    |    PCOffset9
+	*/
+	uint16_t pcoffset9 = sign_extended(instr & 0x01FF, 9);
+	uint8_t sr = (instr >> 9) & 0x0007;
+	write_memory(reg[R_PC] + pcoffset9, reg[sr]);
+}
+
+void op_jsr(uint16_t instr)
+{
+	/* 
+		15 14 13 12 | 11 | 10 9 8 7 6 5 4 3 2 1 0
+		0  1  0  0  | 1  |      PCOffset11
+		-----------------or----------------------
+		15 14 13 12 | 11 | 10 9 | 8 7 6 | 5 4 3 2 1 0
+		0  1  0  0  | 0  | 0  0 |   BR  | 0 0 0 0 0 0
+	*/
+	reg[R_R7] = reg[R_PC];
+	uint8_t mode = (instr >> 11) & 0x0001;
+	if (mode)
+	{
+		uint16_t pcoffset11 = sign_extended(instr & 0x07FF, 11);
+		reg[R_PC] += pcoffset11;
+	}
+	else
+	{
+		uint8_t br = (instr >> 6) & 0x0007;
+		reg[R_PC] = reg[br];
+	}
+}
+
+void op_and(uint16_t instr)
+{
+	/* 
+		15 14 13 12 | 11 10 9 | 8 7 6 | 5 | 4 3 | 2 1 0
+		0  1  0  1  |    DR   |  SR1  | 0 | 0 0 |  SR2
+		---------------------or------------------------
+		15 14 13 12 | 11 10 9 | 8 7 6 | 5 | 4 3 2 1 0
+		0  1  0  1  |    DR   |  SR1  | 1 |   imm5
+	*/
+	uint8_t mode = (instr >> 5) & 0x0001;
+	uint8_t dr = (instr >> 9) & 0x0007;
+	uint8_t sr = (instr >> 6) & 0x0007;
+	if (mode)
+	{
+		uint16_t imm5 = sign_extended(instr & 0x001F, 5);
+		reg[dr] = reg[sr] & imm5;
+	}
+	else
+	{
+		uint8_t sr2 = instr & 0x0007;
+		reg[dr] = reg[sr] & reg[sr2];
+	}
+	update_flag(reg[dr]);
+}
+
+void op_ldr(uint16_t instr)
+{
+	/* 
+		15 14 13 12 | 11 10 9 | 8 7 6 | 5 4 3 2 1 0
+		0  1  1  0  |   DR    | BaseR |   offset6
+	*/
+	// Again ignore the security measures
+	uint8_t dr = (instr >> 9) & 0x0007;
+	uint8_t br = (instr >> 6) & 0x0007;
+	uint16_t offset6 = sign_extended(instr & 0x003F, 6);
+
+	reg[dr] = read_memory(reg[br] + offset6);
+	update_flag(reg[dr]);
+}
+
+void op_str(uint16_t instr)
+{
+	/* 
+		15 14 13 12 | 11 10 9 | 8 7 6 | 5 4 3 2 1 0
+		0  1  1  1  |   SR    | BaseR |   offset6
+	*/
+	// Again ignore the security measures
+	uint8_t sr = (instr >> 9) & 0x0007;
+	uint8_t br = (instr >> 6) & 0x0007;
+	uint16_t offset6 = sign_extended(instr & 0x003F, 6);
+
+	write_memory(reg[br] + offset6, reg[sr]);
+}
+
+void op_rti(uint16_t instr)
+{
+	/* 
+		15 14 13 12 | 11 10 9 8 7 6 5 4 3 2 1 0
+		1  0  0  0  | 0  0  0 0 0 0 0 0 0 0 0 0
+	*/
+	if (!(psr & PSR_USER))
+	{
+		reg[R_PC] = read_memory(reg[R_R6]);
+		uint16_t newPSR = read_memory((uint16_t)(reg[R_R6] + 1));
+		reg[R_R6] += 2;
+		psr = newPSR & (PSR_USER | PSR_PRIORITY);
+		reg[R_COND] = newPSR & 0x0007;
+		if (psr & PSR_USER)
+		{
+			savedSSP = reg[R_R6];
+			reg[R_R6] = savedUSP;
+		}
+		return;
+	}
+	// EXPLAIN: A program with no vector table (most of them) gets the old illegal instruction path
+	if (memory[INT_TABLE + INT_PRIVILEGE] != 0)
+	{
+		core_interrupt(INT_PRIVILEGE, (uint8_t)((psr & PSR_PRIORITY) >> PSR_PRIORITY_SHIFT));
+		return;
+	}
+	if (host.illegal_instruction)
+	{
+		host.illegal_instruction(instr);
+		return;
+	}
+	printf("Not supposed to be here!\n");
+}
+
+void op_not(uint16_t instr)
+{
+	/* 
+		15 14 13 12 | 11 10 9 | 8 7 6 | 5 | 4 3 2 1 0
+		1  0  0  1  |   DR    |   SR  | 1 | 1 1 1 1 1
+	*/
+	uint8_t dr = (instr >> 9) & 0x0007;
+	uint8_t sr = (instr >> 6) & 0x0007;
+
+	reg[dr] = (~reg[sr]);
+	update_flag(reg[dr]);
+}
+
+void op_ldi(uint16_t instr)
+{
+	/* 
+		15 14 13 12 | 11 10 9 | 8 7 6 5 4 3 2 1 0
+		1  0  1  0  |   DR    |    PCoffset9
+	*/
+	// Again we ignore the security measures
+	uint16_t pcoffset9 = sign_extended(instr & 0x01FF, 9);
+	uint8_t dr = (instr >> 9) & 0x0007;
+
+	reg[dr] = read_memory(read_memory(reg[R_PC] + pcoffset9));
+	update_flag(reg[dr]);
+}
+
+void op_sti(uint16_t instr)
+{
+	/* 
+		15 14 13 12 | 11 10 9 | 8 7 6 5 4 3 2 1 0
+		1  0  1  1  |   SR    |     PCoffset9
+	*/
+	// Again ignore the security measures
+	uint8_t sr = (instr >> 9) & 0x0007;
+	uint16_t pcoffset9 = sign_extended(instr & 0x01FF, 9);
+
+	write_memory(read_memory(reg[R_PC] + pcoffset9), reg[sr]);
+}
+
+void op_jmp(uint16_t instr)
+{
+	/*  JMP
+		15 14 13 12 | 11 10 9 | 8 7 6 | 5 4 3 2 1 0
+		1  1  0  0  | 0  0  0 | BaseR | 0 0 0 0 0 0
+		-------------------or----------------------
+		RET
+		15 14 13 12 | 11 10 9 | 8 7 6 | 5 4 3 2 1 0
+		1  1  0  0  | 0  0  0 | 1 1 1 | 0 0 0 0 0 0
+	*/
+	uint8_t br = (instr >> 6) & 0x0007;
+	// return address stored in R7 so a "jmp" to it equals RET
+	reg[R_PC] = reg[br];
+}
+
+void op_res(uint16_t instr)
+{
+	/*  RET
+		15 14 13 12 | 11 10 9 | 8 7 6 | 5 4 3 2 1 0
+		1  1  0  0  | 0  0  0 | 1 1 1 | 0 0 0 0 0 0
+	*/
+	// reg[R_PC] = reg[R_R7];
+	// EXPLAIN: Only an illegal instruction if it doesn't name a native service, or they are off (lc3vmwin_native.hpp)
+	if (nativeEnabled && native_call(instr))
+	{
+		return;
+	}
+	if (host.illegal_instruction)
+	{
+		host.illegal_instruction(instr);
+		return;
+	}
+	printf("Not supposed to be here\n");
+}
+
+void op_lea(uint16_t instr)
+{
+	/*
+		15 14 13 12 | 11 10 9 | 8 7 6 5 4 3 2 1 0
+		1  1  1  0  |    dr   |     PCoffset9
+	*/
+	uint16_t pcoffset9 = sign_extended(instr & 0x01FF, 9);
+	uint8_t dr = (instr >> 9) & 0x0007;
+
+	reg[dr] = reg[R_PC] + pcoffset9;
+	update_flag(reg[dr]);
+}
+
+void op_trap(uint16_t instr)
+{
+	/*
+		15 14 13 12 | 11 10 9 8 | 7 6 5 4 3 2 1 0
+		1  1  1  1  | 0  0  0 0 |    trapvect8
+	*/
+	reg[R_R7] = reg[R_PC];
+
+	// EXPLAIN: A native handler or the guest's service routine, per vector (lc3vmwin_trap.hpp). x20-x25 are native unless switched
+	if (trap_call(instr))
+	{
+		return;
+	}
+	if (host.illegal_instruction)
+	{
+		host.illegal_instruction(instr);
+		return;
+	}
+	printf("Erroneous TRAP vector!\n");
+}
+
+void update_flag(uint16_t value)
+{
+	// Clear the last three bits (N/Z/P) and set P
+	reg[R_COND] &= 0xFFF8;
+	if (value >> 15)
+	{	
+		// Since value is uint16_t, cannot use if (value < 0), have to check the highest bit
+		reg[R_COND] |= FL_NEG;
+	}
+	else if (value == 0)
+	{
+		reg[R_COND] |= FL_ZRO;
+	}
+	else
+	{
+		reg[R_COND] |= FL_POS;
+	}
+}
+
+uint16_t read_memory(uint16_t index)
+{
+	// EXPLAIN: The device registers the guest reads all sit on page xFE, one compare keeps them off the plain loads
+	if ((index >> PAGE_SHIFT) == (MR_KBSR >> PAGE_SHIFT))
+	{
+		read_device(index);
+	}
+	// EXPLAIN: No read flag is set unless a watchpoint or the heatmap covers the page, so plain loads cost one byte test
+	if (pageFlags[index >> PAGE_SHIFT] & PAGE_READ_FLAGS)
+	{
+		read_memory_slow(index);
+	}
+	return memory[index];
+}
+
+void read_device(uint16_t index)
+{
+	if (index == MR_DSR)
+	{
+		memory[MR_DSR] = DSR_READY;
+	}
+	else if (index == MR_KBSR)
+    {
+        keyboardReads++;
+        if (keyPressed)
+        {
+            // EXPLAIN: The keyboard updates its own registers, that's not a guest write so it skips write_memory()
+            memory[MR_KBSR] = (uint16_t)(KBSR_READY | (memory[MR_KBSR] & KBSR_IE));
+            memory[MR_KBDR] = lastKeyPressed;
+            /* 
+                WHY set keyPressed = false?
+                If I don't disable it here, the input is insanely lagged
+
+				*Edit*:
+				The above is wrong. It is still insanely lagged...
+            */
+		    // printf("\n");
+            keyPressed = false;
+        }
+        else
+        {
+            // EXPLAIN: READY was the last key's, this read has none. Cleared before the poll: a key it brings in shows up on the next read
+            memory[MR_KBSR] &= KBSR_IE;
+            if (host.input_poll)
+            {
+                core_input_poll();
+            }
+        }
+    }
+}
+
+void read_memory_slow(uint16_t index)
+{
+	uint8_t flags = pageFlags[index >> PAGE_SHIFT];
+	if (flags & PAGE_HEAT)
+	{
+		heatRead[index]++;
+	}
+	if ((flags & PAGE_WATCH) && watch_on_read(index, memory[index], (uint16_t)(reg[R_PC] - 1)))
+	{
+		watch_stop();
+	}
+}
+
+void write_memory_slow(uint16_t index, uint16_t value)
+{
+	uint8_t flags = pageFlags[index >> PAGE_SHIFT];
+	if (flags & PAGE_HEAT)
+	{
+		heatWrite[index]++;
+	}
+	if (flags & PAGE_TRACE)
+	{
+		trace_on_write(index, value);
+	}
+	if (flags & PAGE_JOURNAL)
+	{
+		journal_on_write(index, memory[index]);
+	}
+	if (flags & PAGE_COW)
+	{
+		machine_on_write(index);
+	}
+	if (flags & PAGE_HANG)
+	{
+		hang_on_write(index, memory[index], value);
+	}
+	if ((flags & PAGE_DEVICE) && index == MR_DDR)
+	{
+		char ch = (char)(value & 0xFF);
+		display_write(&ch, 1);
+	}
+	// EXPLAIN: Stops at the end of the block, like TRAP x25 does
+	if ((flags & PAGE_DEVICE) && index == MR_MCR && !(value & MCR_CLOCK_ENABLE))
+	{
+		isRunning = false;
+	}
+	if ((flags & PAGE_WATCH) && watch_on_write(index, memory[index], value, (uint16_t)(reg[R_PC] - 1)))
+	{
+		watch_stop();
+	}
+}
+
+uint16_t read_uint16_t(uint16_t index)
+{
+    return (uint16_t)(memory[index]) | ((uint16_t)(memory[index + 1]) << 8);
+}
+
+void write_memory(uint16_t index, uint16_t value)
+{
+	if (pageFlags[index >> PAGE_SHIFT])
+	{
+		write_memory_slow(index, value);
+	}
+    memory[index] = value;
+}
+
+void watch_stop()
+{
+	/*
+		EXPLAIN: The access has to complete (this is in the middle of an instruction), so we only switch to step-in here.
+		cache_run() checks isStepIn before the next instruction and stops there, with the instruction that hit marked in the disassembly window.
+	*/
+	isStepIn = true;
+	if (host.watch_hit)
+	{
+		host.watch_hit();
+	}
+}
+
+// trap functions
+void trap_0x20()
+{
+	// Read a single character from the keyboard. The character is not echoed onto the console.
+	// Its ASCII code is copied into R0. The high eight bits of R0 are cleared
+	keyboardReads++;
+	if (!keyPressed && host.input_poll)
+	{
+		core_input_poll();
+	}
+    reg[R_R0] = lastKeyPressed & 0x00FF;
+	// EXPLAIN: The key is consumed, same as reading KBSR does
+	keyPressed = false;
+}
+
+void trap_0x21()
+{
+	// Write a character in R0[7:0] to the console display.
+	putc((uint8_t)reg[R_R0], stdout);
+	// ui_debug_info(reg, 25);
+	fflush(stdout);
+}
+
+void trap_0x21_host()
+{
+	char ch = (uint8_t)reg[R_R0];
+	console_write(&ch, 1);
+}
+
+
+void trap_0x22()
+{
+	// Write a string of ASCII characters to the console display. The characters are
+	// contained in consecutive memory locations, one character per memory location,
+	// starting with the address specified in R0. Writing terminates with the occurrence of
+	// x0000 in a memory location.
+
+	for (uint16_t i = reg[R_R0]; ;i++)
+	{
+		char ch = read_memory(i);
+		if (ch == 0)
+		{
+			break;
+		}
+		else
+		{
+			putc(ch, stdout);
+		}
+	}
+	// ui_debug_info(reg, 25);
+	fflush(stdout);
+}
+
+void trap_0x22_host()
+{
+	// Write a string of ASCII characters to the console display. The characters are
+	// contained in consecutive memory locations, one character per memory location,
+	// starting with the address specified in R0. Writing terminates with the occurrence of
+	// x0000 in a memory location.
+
+	uint16_t i = reg[R_R0];
+	char ch = read_memory(i);
+
+	while (ch != 0)
+	{
+		if (ch == 0x1B)
+		{
+			// EXPLAIN: For control sequences, the program needs to return instead of staying in the loop, otherwise somehow the next string (e.g. the +--------------+ one) gets fed into parse_escape()
+
+			// EXPLAIN: OK I know what's going on. ch is not updated in parse_escape(), so we need to explicitly return from this function, otherwise ch is still 0x1B and the next string triggers an error in parse_escape()
+			parse_escape(memory, i);
+			return;
+		}
+		else
+		{
+			console_write(&ch, 1);
+			i++;
+			ch = read_memory(i);
+		}
+	}
+}
+
+void parse_escape(uint16_t memory[], uint16_t& index)
+{
+    /*
+		EXPLAIN:
+        I want to be pragmatic and only deals with the control sequences in 2048
+        "\e[37m 2  \e[0m"
+        "\e[1;33m1024\e[0m"
+        "\e[2J\e[H\e[3J"
+
+        In the first and second case, we only need to retrieve the number in the middle (2 and 1024);
+
+        In the third case, we need to clean the buffer -> by clearing the buffer, the ImGui console is cleared
+    */
+
+	// EXPLAIN: We get away from implicitly casting a uint16_t to a char because of how LC-3 memory lays out strings: each character only takes the lower byte of a 2-byte memory chunk -> they are NOT char by char (check 2048.bin for details)
+
+    char ch = read_memory(index++);
+	// printf("ch is %d\n", (int)ch);
+
+	// EXPLAIN: Still not exactly sure why, but '\e' doesn't work (compiler compalins non-standard ISO excape character), so I have to use 0x1b
+
+    if (ch != 0x1b)
+    {
+        fprintf(stderr, "memory[%u] should be e\n", index);
+        exit(ERROR_VALUE);
+    }
+
+	ch = read_memory(index++);
+    if (ch != '[')
+    {
+        fprintf(stderr, "memory[%u] should be [ after \\e\n", index);
+        exit(ERROR_VALUE);
+    }
+
+    ch = read_memory(index++);
+    if (ch == '2')
+    {
+		/*
+			EXPLAIN: if it's 2, then there is actually no need to read the whole sequence because we take it that we are about to clear the screen (in this case clear the ImGui console buffer)
+		*/
+        if (host.console_clear)
+        {
+            // EXPLAIN: What was queued before the clear goes out first and gets cleared with the rest
+            display_flush();
+            host.console_clear();
+        }
+    }
+    else
+	
+	/* 
+		EXPLAIN: if ch != 2 then in 2048 it means it's either 3 or 1 depending on the control sequence (checkout "ansi board labels" section in 2048.asm)
+	*/
+
+    {
+        /* So we just need to take the number between m and \e */
+        while (ch != 'm')
+        {
+            ch = read_memory(index++);
+        }
+        /* Now we are pointing at the next char following 'm', read until we hit \ */
+		ch = read_memory(index++);
+        while (ch != 0x1b)
+        {
+            console_write(&ch, 1);
+			ch = read_memory(index++);
+        }
+    }
+}
+
+void trap_0x23()
+{
+	// Print a prompt on the screen and read a single character from the keyboard. 
+	// The character is echoed onto the console monitor, and its ASCII code is copied into R0.
+	// The high eight bits of R0 are cleared.
+	console_write(TRAP_IN_PROMPT, sizeof(TRAP_IN_PROMPT) - 1);
+
+	// EXPLAIN: Then the key, the same way GETC gets it
+	trap_0x20();
+
+	char echo[2] = {(char)(uint8_t)reg[R_R0], '\n'};
+	console_write(echo, sizeof(echo));
+}
+
+void trap_0x24()
+{
+	/*
+		Write a string of ASCII characters to the console. 
+		The characters are contained in consecutive memory locations, 
+		two characters per memory location, starting with the address specified in R0. 
+
+		The ASCII code contained in bits [7:0] of a memory
+		location is written to the console first. 
+		
+		Then the ASCII code contained in bits [15:8] of that memory location is written to the console. 
+		
+		(A character string consisting of
+		an odd number of characters to be written will have x00 in bits [15:8] of the
+		memory location containing the last character to be written.) Writing terminates
+		with the occurrence of x0000 in a memory location.
+	*/
+	for (uint16_t i = reg[R_R0]; ;i++)
+	{
+		uint16_t value = read_memory(i);
+		if (value == 0)
+		{
+			break;
+		}
+		else
+		{
+			putc((uint8_t)(value & 0x00FF), stdout);
+			putc(((uint8_t)(value >> 8)), stdout);
+		}
+	}
+	fflush(stdout);
+}
+
+void trap_0x24_host()
+{
+	/*
+		Write a string of ASCII characters to the console. 
+		The characters are contained in consecutive memory locations, 
+		two characters per memory location, starting with the address specified in R0. 
+
+		The ASCII code contained in bits [7:0] of a memory
+		location is written to the console first. 
+		
+		Then the ASCII code contained in bits [15:8] of that memory location is written to the console. 
+		
+		(A character string consisting of
+		an odd number of characters to be written will have x00 in bits [15:8] of the
+		memory location containing the last character to be written.) Writing terminates
+		with the occurrence of x0000 in a memory location.
+	*/
+	for (uint16_t i = reg[R_R0]; ;i++)
+	{
+		uint16_t value = read_memory(i);
+		if (value == 0)
+		{
+			break;
+		}
+		else
+		{
+			char ch = (uint8_t)(value & 0x00FF);
+			console_write(&ch, 1);
+			ch = (uint8_t)(value >> 8);
+			console_write(&ch, 1);
+		}
+	}
+}
+
+
+void trap_0x25()
+{
+	// Halt execution and print a message on the console.
+	// TODO: Implement an ImGui version of it
+	// EXPLAIN: printf() doesn't go through the display ring, the guest's output has to be out first
+	display_flush();
+	printf("\nSystem HALT\n");
+	isRunning = false;
+}
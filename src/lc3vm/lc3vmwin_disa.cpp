@@ -1,4 +1,13 @@
 #include "lc3vmwin_disa.hpp"
+#include "lc3vmwin_symbols.hpp"
+#include "lc3vmwin_trace.hpp"
+#include "lc3vmwin_journal.hpp"
+#include "lc3vmwin_rewind.hpp"
+#include "lc3vmwin_savestate.hpp"
+#include "lc3vmwin_input.hpp"
+#include "lc3vmwin_core.hpp"
+#include <cstdio>
+#include <cstdlib>
 
 
 std::string (*disa_call_table[])(uint16_t, uint16_t) = {
@@ -21,6 +30,35 @@ LC3VMdisawindow::LC3VMdisawindow()
     initialized = false;
     stepInSignal = false;
     stepInLine = 0;
+    continueSignal = false;
+    breakSignal = false;
+
+    bpAddressInput[0] = '\0';
+    bpConditionInput[0] = '\0';
+
+    watchBeginInput[0] = '\0';
+    watchEndInput[0] = '\0';
+    watchRead = false;
+    watchWrite = true;
+    watchChange = false;
+    watchHitAddress = -1;
+    snprintf(tracePathInput, sizeof(tracePathInput), "%s", "./trace.lc3t");
+    traceMaxMB = 256;
+    snprintf(statePathInput, sizeof(statePathInput), "%s", "./state.lc3s");
+    stateWithCache = true;
+    snprintf(inputLogPathInput, sizeof(inputLogPathInput), "%s", "./input.lc3i");
+
+    stepOverSignal = false;
+    stepOutSignal = false;
+    reverseStepSignal = false;
+    reverseContinueSignal = false;
+    saveStateSignal = false;
+    loadStateSignal = false;
+    recordInputSignal = false;
+    replayInputSignal = false;
+    stopInputSignal = false;
+    runToAddress = -1;
+    runToDepth = -1;
 }
 
 LC3VMdisawindow::LC3VMdisawindow(uint16_t instrStream[], uint16_t numInstr, uint16_t address, const WindowConfig& config)
@@ -43,6 +81,37 @@ LC3VMdisawindow::LC3VMdisawindow(uint16_t instrStream[], uint16_t numInstr, uint
     assert(font != nullptr);
 
     initialized = false;
+    stepInSignal = false;
+    stepInLine = 0;
+    continueSignal = false;
+    breakSignal = false;
+
+    bpAddressInput[0] = '\0';
+    bpConditionInput[0] = '\0';
+
+    watchBeginInput[0] = '\0';
+    watchEndInput[0] = '\0';
+    watchRead = false;
+    watchWrite = true;
+    watchChange = false;
+    watchHitAddress = -1;
+    snprintf(tracePathInput, sizeof(tracePathInput), "%s", "./trace.lc3t");
+    traceMaxMB = 256;
+    snprintf(statePathInput, sizeof(statePathInput), "%s", "./state.lc3s");
+    stateWithCache = true;
+    snprintf(inputLogPathInput, sizeof(inputLogPathInput), "%s", "./input.lc3i");
+
+    stepOverSignal = false;
+    stepOutSignal = false;
+    reverseStepSignal = false;
+    reverseContinueSignal = false;
+    saveStateSignal = false;
+    loadStateSignal = false;
+    recordInputSignal = false;
+    replayInputSignal = false;
+    stopInputSignal = false;
+    runToAddress = -1;
+    runToDepth = -1;
 }
 
 void LC3VMdisawindow::Load_Config(const WindowConfig& config)
@@ -91,16 +160,53 @@ void LC3VMdisawindow::Draw(void)
             ImGui::Text(">>");
             ImGui::SameLine();
         }
+        // EXPLAIN: lines with a breakpoint get a red *, conditional ones a ?
+        int bpIndex = (breakpointMap[(uint16_t)(initialAddress + i)] & BP_MAP_INDEX) - 1;
+        if (bpIndex >= 0)
+        {
+            ImGui::PushStyleColor(ImGuiCol_Text, IM_COL32(255, 64, 64, 255));
+            ImGui::Text("%s", breakpoints[bpIndex].condition.length > 0 ? "?" : "*");
+            ImGui::PopStyleColor();
+            ImGui::SameLine();
+        }
         // EXPLAIN: Why + i, not + i*2? After all each instr is 2 bytes
         // The reason is, the VM uses 16-bit addressing so each "1" address has 2 bytes
         // This is different from the memory window, which uses the standard byte memory addressing
         // This is also why the address will never execeed 0xFFFF, while the memory window needs double the address space
-        ImGui::Text("%#06x\t", initialAddress + i); 
+        // EXPLAIN: The instruction that hit a watchpoint is drawn in red until the user continues
+        bool watchHitLine = (initialAddress + i == watchHitAddress);
+        if (watchHitLine)
+        {
+            ImGui::PushStyleColor(ImGuiCol_Text, IM_COL32(255, 64, 64, 255));
+        }
+        // EXPLAIN: Clicking the address runs to that line (run-to-cursor)
+        char addressText[16];
+        snprintf(addressText, sizeof(addressText), "%#06x\t", initialAddress + i);
+        ImGui::PushID(i);
+        if (ImGui::Selectable(addressText, false, ImGuiSelectableFlags_None, ImGui::CalcTextSize(addressText)))
+        {
+            runToAddress = (uint16_t)(initialAddress + i);
+        }
+        ImGui::PopID();
+        if (ImGui::IsItemHovered())
+        {
+            ImGui::SetTooltip("Run to here");
+        }
         ImGui::SameLine();
+        // EXPLAIN: Execution count of the line while the heatmap is on
+        if (heatmapEnabled)
+        {
+            ImGui::Text("%10u", heatExec[(uint16_t)(initialAddress + i)]);
+            ImGui::SameLine();
+        }
         ImGui::Text("%#06x\t", instr);
         ImGui::SameLine();
         std::string disaOutput = disa_call_table[instr >> 12](instr, initialAddress);
         ImGui::Text("%s", disaOutput.c_str());
+        if (watchHitLine)
+        {
+            ImGui::PopStyleColor();
+        }
     }
 
     /* Add a Continue button to let the code run */
@@ -108,6 +214,376 @@ void LC3VMdisawindow::Draw(void)
     {
         stepInSignal = !stepInSignal;
     }
+    ImGui::SameLine();
+    if (ImGui::Button("Step-over"))
+    {
+        stepOverSignal = true;
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Step-out"))
+    {
+        stepOutSignal = true;
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Continue"))
+    {
+        continueSignal = true;
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Break"))
+    {
+        breakSignal = true;
+    }
+
+    // EXPLAIN: Reverse execution, see lc3vmwin_journal.hpp. Both also break if the guest is running
+    ImGui::BeginDisabled(!journalEnabled);
+    if (ImGui::Button("Reverse-step"))
+    {
+        reverseStepSignal = true;
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Reverse-continue"))
+    {
+        reverseContinueSignal = true;
+    }
+    ImGui::EndDisabled();
+    ImGui::SameLine();
+    bool recordHistory = journalEnabled;
+    if (ImGui::Checkbox("Record history", &recordHistory))
+    {
+        journal_enable(recordHistory);
+    }
+    if (journalEnabled)
+    {
+        ImGui::Text(
+            "History: %llu instructions (%llu without replay)",
+            (unsigned long long)(retiredCount - journal_oldest()), (unsigned long long)(retiredCount - journal_oldest_undo())
+        );
+    }
+    if (rewindEnabled)
+    {
+        ImGui::Text("Rewind: %zu frames, %.1f KB (hold Backspace)", rewind_count(), (double)rewind_bytes() / 1024.0);
+    }
+
+    Draw_Callstack();
+    Draw_Breakpoints();
+    Draw_Watchpoints();
+    Draw_Trace();
+    Draw_Savestate();
+    Draw_Input_Log();
 
     ImGui::End();
-}
\ No newline at end of file
+}
+
+void LC3VMdisawindow::Draw_Breakpoints(void)
+{
+    /*
+        Conditions are compiled by bp_add() when the user hits Add (or Enter),
+        never while the program runs. See lc3vmwin_breakpoint.hpp for the syntax.
+    */
+    if (!ImGui::CollapsingHeader("Breakpoints", ImGuiTreeNodeFlags_DefaultOpen))
+    {
+        return;
+    }
+
+    ImGui::PushItemWidth(60);
+    ImGui::InputText("Address 0x", bpAddressInput, IM_ARRAYSIZE(bpAddressInput), ImGuiInputTextFlags_CharsHexadecimal);
+    ImGui::PopItemWidth();
+
+    ImGui::PushItemWidth(240);
+    bool addPressed = ImGui::InputText("Condition", bpConditionInput, IM_ARRAYSIZE(bpConditionInput), ImGuiInputTextFlags_EnterReturnsTrue);
+    ImGui::PopItemWidth();
+    ImGui::SameLine();
+    addPressed |= ImGui::Button("Add");
+
+    if (addPressed)
+    {
+        if (bpAddressInput[0] == '\0')
+        {
+            bpError = "enter an address first";
+        }
+        else
+        {
+            uint16_t address = (uint16_t)strtoul(bpAddressInput, nullptr, 16);
+            bpError.clear();
+            if (bp_add(address, bpConditionInput, bpError) >= 0)
+            {
+                bpConditionInput[0] = '\0';
+            }
+        }
+    }
+
+    if (!bpError.empty())
+    {
+        ImGui::PushStyleColor(ImGuiCol_Text, IM_COL32(255, 64, 64, 255));
+        ImGui::TextWrapped("%s", bpError.c_str());
+        ImGui::PopStyleColor();
+    }
+
+    for (int i = 0; i < breakpointCount; i++)
+    {
+        ImGui::PushID(i);
+        ImGui::Checkbox("##enabled", &breakpoints[i].enabled);
+        ImGui::SameLine();
+        ImGui::Text("%#06x  hits %u  %s", breakpoints[i].address, breakpoints[i].hits, breakpoints[i].conditionText);
+        ImGui::SameLine();
+        if (ImGui::SmallButton("X"))
+        {
+            bp_remove(i);
+            ImGui::PopID();
+            break;
+        }
+        ImGui::PopID();
+    }
+}
+
+void LC3VMdisawindow::Draw_Watchpoints(void)
+{
+    if (!ImGui::CollapsingHeader("Watchpoints", ImGuiTreeNodeFlags_DefaultOpen))
+    {
+        return;
+    }
+
+    if (watchHit.triggered)
+    {
+        ImGui::PushStyleColor(ImGuiCol_Text, IM_COL32(255, 64, 64, 255));
+        ImGui::Text(
+            "%s %#06x at PC %#06x: %#06x -> %#06x",
+            (watchHit.kind & WATCH_WRITE) ? "Write" : "Read",
+            watchHit.address, watchHit.pc, watchHit.oldValue, watchHit.newValue
+        );
+        ImGui::PopStyleColor();
+    }
+
+    ImGui::PushItemWidth(60);
+    ImGui::InputText("From 0x", watchBeginInput, IM_ARRAYSIZE(watchBeginInput), ImGuiInputTextFlags_CharsHexadecimal);
+    ImGui::SameLine();
+    ImGui::InputText("To 0x", watchEndInput, IM_ARRAYSIZE(watchEndInput), ImGuiInputTextFlags_CharsHexadecimal);
+    ImGui::PopItemWidth();
+
+    ImGui::Checkbox("Read", &watchRead);
+    ImGui::SameLine();
+    ImGui::Checkbox("Write", &watchWrite);
+    ImGui::SameLine();
+    ImGui::Checkbox("Change", &watchChange);
+    ImGui::SameLine();
+    if (ImGui::Button("Watch") && watchBeginInput[0] != '\0')
+    {
+        uint16_t begin = (uint16_t)strtoul(watchBeginInput, nullptr, 16);
+        // EXPLAIN: An empty "To" box watches a single word
+        uint16_t end = watchEndInput[0] == '\0' ? begin : (uint16_t)strtoul(watchEndInput, nullptr, 16);
+        uint8_t kind = (uint8_t)((watchRead ? WATCH_READ : 0) | (watchWrite ? WATCH_WRITE : 0) | (watchChange ? WATCH_CHANGE : 0));
+        if (kind != 0)
+        {
+            watch_add(begin, end, kind);
+        }
+    }
+
+    for (int i = 0; i < watchpointCount; i++)
+    {
+        struct lc3Watchpoint& w = watchpoints[i];
+        ImGui::PushID(i + BREAKPOINT_MAX);
+        ImGui::Text(
+            "%#06x-%#06x  %s%s%s  hits %u",
+            w.begin, w.end,
+            (w.kind & WATCH_READ) ? "R" : "", (w.kind & WATCH_WRITE) ? "W" : "", (w.kind & WATCH_CHANGE) ? "C" : "",
+            w.hits
+        );
+        ImGui::SameLine();
+        if (ImGui::SmallButton("X"))
+        {
+            watch_remove(i);
+            ImGui::PopID();
+            break;
+        }
+        ImGui::PopID();
+    }
+}
+
+void LC3VMdisawindow::Draw_Callstack(void)
+{
+    /*
+        Innermost frame first. Clicking a frame runs to its return address, i.e. finishes
+        every subroutine up to and including that one.
+    */
+    if (!ImGui::CollapsingHeader("Call stack", ImGuiTreeNodeFlags_DefaultOpen))
+    {
+        return;
+    }
+
+    char buffer[SYMBOL_NAME_MAX];
+    for (int i = callDepth - 1; i >= 0; i--)
+    {
+        const struct lc3Frame& frame = callStack[i];
+        char line[80];
+        snprintf(line, sizeof(line), "#%d %s  from %#06x", callDepth - 1 - i, symbols_label(frame.target, buffer), frame.callSite);
+
+        ImGui::PushID(i + BREAKPOINT_MAX + WATCHPOINT_MAX);
+        if (ImGui::Selectable(line))
+        {
+            runToAddress = frame.returnAddress;
+            runToDepth = i;
+        }
+        ImGui::PopID();
+    }
+    if (callDepth == 0)
+    {
+        ImGui::TextUnformatted("(top level)");
+    }
+}
+
+void LC3VMdisawindow::Draw_Trace(void)
+{
+    /*
+        Recording starts from the current state and can be toggled while the program runs.
+        Decode the file with the lc3trace tool.
+    */
+    if (!ImGui::CollapsingHeader("Trace"))
+    {
+        return;
+    }
+
+    struct lc3TraceStatus status;
+    trace_status(&status);
+
+    ImGui::PushItemWidth(240);
+    ImGui::InputText("File", tracePathInput, IM_ARRAYSIZE(tracePathInput));
+    ImGui::PopItemWidth();
+    ImGui::PushItemWidth(100);
+    ImGui::InputInt("Max MB (0 = no limit)", &traceMaxMB);
+    ImGui::PopItemWidth();
+    if (traceMaxMB < 0)
+    {
+        traceMaxMB = 0;
+    }
+
+    if (!status.recording)
+    {
+        if (ImGui::Button("Start recording"))
+        {
+            trace_start(tracePathInput, (uint64_t)traceMaxMB * 1024 * 1024);
+        }
+    }
+    else if (ImGui::Button("Stop recording"))
+    {
+        trace_stop();
+    }
+
+    ImGui::Text(
+        "%s  %llu instructions  %.1f MB  %llu chunks dropped%s",
+        status.recording ? "Recording" : "Stopped",
+        (unsigned long long)status.entries, (double)status.bytes / (1024.0 * 1024.0),
+        (unsigned long long)status.droppedChunks, status.sizeLimitHit ? "  (size limit hit)" : ""
+    );
+}
+
+void LC3VMdisawindow::Draw_Savestate(void)
+{
+    /*
+        Saving doesn't stop the guest, the file is written in the background.
+        Loading keeps the code blocks whose memory is the same in the file.
+    */
+    if (!ImGui::CollapsingHeader("Save state"))
+    {
+        return;
+    }
+
+    struct lc3SaveStatus status;
+    savestate_status(&status);
+
+    ImGui::PushItemWidth(240);
+    ImGui::InputText("State file", statePathInput, IM_ARRAYSIZE(statePathInput));
+    ImGui::PopItemWidth();
+    ImGui::Checkbox("Include code cache", &stateWithCache);
+
+    ImGui::BeginDisabled(status.busy);
+    if (ImGui::Button("Save"))
+    {
+        saveStateSignal = true;
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Load"))
+    {
+        loadStateSignal = true;
+    }
+    ImGui::EndDisabled();
+
+    if (status.busy)
+    {
+        ImGui::Text("Saving instruction %llu...", (unsigned long long)status.lastStep);
+    }
+    else if (status.lastBytes > 0)
+    {
+        ImGui::Text(
+            "Last save: instruction %llu, %.1f KB, snapshot %.2f ms",
+            (unsigned long long)status.lastStep, (double)status.lastBytes / 1024.0, status.lastSnapshotMs
+        );
+    }
+
+    if (!stateError.empty())
+    {
+        ImGui::PushStyleColor(ImGuiCol_Text, IM_COL32(255, 64, 64, 255));
+        ImGui::TextWrapped("%s", stateError.c_str());
+        ImGui::PopStyleColor();
+    }
+}
+
+void LC3VMdisawindow::Draw_Input_Log(void)
+{
+    /*
+        Records the keys the guest gets with the instruction they come in at, a replay gives them back at the same
+        instructions. The keyboard is ignored while replaying. See lc3vmwin_input.hpp
+    */
+    if (!ImGui::CollapsingHeader("Input log"))
+    {
+        return;
+    }
+
+    struct lc3InputStatus status;
+    input_status(&status);
+
+    ImGui::PushItemWidth(240);
+    ImGui::InputText("Log file", inputLogPathInput, IM_ARRAYSIZE(inputLogPathInput));
+    ImGui::PopItemWidth();
+
+    if (status.recording || status.replaying)
+    {
+        if (ImGui::Button(status.recording ? "Stop recording##input" : "Stop replay"))
+        {
+            stopInputSignal = true;
+        }
+    }
+    else
+    {
+        if (ImGui::Button("Record"))
+        {
+            recordInputSignal = true;
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Replay"))
+        {
+            replayInputSignal = true;
+        }
+    }
+
+    const char* results[] = {"", "", "matched", "diverged", "stopped"};
+    if (status.recording)
+    {
+        ImGui::Text("Recording: %zu keys since instruction %llu", status.events, (unsigned long long)status.startStep);
+    }
+    else if (status.replaying)
+    {
+        ImGui::Text("Replaying: %zu of %zu keys, ends at instruction %llu", status.replayed, status.events, (unsigned long long)status.endStep);
+    }
+    else if (status.result >= INPUT_REPLAY_MATCHED)
+    {
+        ImGui::Text("Last replay %s after %zu of %zu keys", results[status.result], status.replayed, status.events);
+    }
+
+    if (!inputLogError.empty())
+    {
+        ImGui::PushStyleColor(ImGuiCol_Text, IM_COL32(255, 64, 64, 255));
+        ImGui::TextWrapped("%s", inputLogError.c_str());
+        ImGui::PopStyleColor();
+    }
+}
@@ -335,6 +335,13 @@ std::string dis_rsv(uint16_t instr, uint16_t address)
 		15 14 13 12 11 10 9 8 7 6 5 4 3 2 1 0
 		1  1  0  1  x  x  x x x x x x x x x x
 	*/
+	// EXPLAIN: xD0nn calls native service nn when they are on (lc3vmwin_native.hpp)
+	if ((instr & 0x0F00) == 0)
+	{
+		std::stringstream ss;
+		ss << "NATIVE x" << std::uppercase << std::setfill('0') << std::setw(2) << std::hex << (instr & 0x00FF);
+		return ss.str();
+	}
 	return std::string("Reserved");
 }
 
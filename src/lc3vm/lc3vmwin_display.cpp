@@ -0,0 +1,77 @@
+/*
+	Display device and console output ring, see lc3vmwin_display.hpp
+*/
+
+#include "lc3vmwin_display.hpp"
+#include "lc3vmwin_core.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+static char displayRing[DISPLAY_RING_BYTES];
+// EXPLAIN: Absolute byte counts, the ring slot is count % DISPLAY_RING_BYTES. They wrap together at 2^32, head - tail stays right
+static std::atomic<uint32_t> displayHead(0);   // written by display_write() only
+static std::atomic<uint32_t> displayTail(0);   // written by display_flush() only
+// EXPLAIN: The producer's own copy of head and the room it knows of, so a byte costs one atomic store. The room only ever looks smaller than it is
+static uint32_t writeHead = 0;
+static uint32_t writeRoom = DISPLAY_RING_BYTES;
+
+void display_write(const char* text, size_t length)
+{
+	if (host.console_write == nullptr)
+	{
+		return;
+	}
+	while (length > 0)
+	{
+		if (writeRoom == 0)
+		{
+			writeRoom = DISPLAY_RING_BYTES - (writeHead - displayTail.load(std::memory_order_acquire));
+			if (writeRoom == 0)
+			{
+				display_flush();
+				continue;
+			}
+		}
+		// EXPLAIN: Up to the end of the ring, the rest goes to its start on the next trip
+		uint32_t at = writeHead % DISPLAY_RING_BYTES;
+		size_t count = length;
+		if (count > writeRoom)
+		{
+			count = writeRoom;
+		}
+		if (count > DISPLAY_RING_BYTES - at)
+		{
+			count = DISPLAY_RING_BYTES - at;
+		}
+		memcpy(&displayRing[at], text, count);
+		text += count;
+		length -= count;
+		writeHead += (uint32_t)count;
+		writeRoom -= (uint32_t)count;
+		displayHead.store(writeHead, std::memory_order_release);
+	}
+}
+
+void display_flush()
+{
+	uint32_t tail = displayTail.load(std::memory_order_relaxed);
+	uint32_t head = displayHead.load(std::memory_order_acquire);
+	while (tail != head)
+	{
+		uint32_t at = tail % DISPLAY_RING_BYTES;
+		uint32_t count = std::min<uint32_t>(head - tail, DISPLAY_RING_BYTES - at);
+		if (host.console_write)
+		{
+			host.console_write(&displayRing[at], count);
+		}
+		tail += count;
+	}
+	displayTail.store(tail, std::memory_order_release);
+}
+
+void display_reset()
+{
+	displayTail.store(displayHead.load(std::memory_order_acquire), std::memory_order_release);
+}
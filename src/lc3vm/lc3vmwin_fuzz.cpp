@@ -0,0 +1,176 @@
+/*
+	Fuzzing engine, see lc3vmwin_fuzz.hpp
+*/
+
+#include "lc3vmwin_fuzz.hpp"
+#include "lc3vmwin_core.hpp"
+#include "lc3vmwin_machine.hpp"
+
+#include <cstring>
+
+static uint64_t fuzzBaseCount = 0;
+static std::atomic<uint8_t>* fuzzVirgin = nullptr;
+static uint64_t fuzzLimit = 0;
+static bool fuzzCodePage[PAGE_COUNT];
+static uint16_t fuzzCodeFrom = 0x0000;
+static uint16_t fuzzCodeTo = 0xFFFF;
+
+/* This execution's hit counts, and the entries it touched so that clearing the map doesn't cost 64 KB */
+static uint8_t fuzzTrace[FUZZ_MAP_SIZE];
+static uint16_t fuzzTouched[FUZZ_MAP_SIZE];
+static int fuzzTouchedCount = 0;
+
+static const uint8_t* fuzzKeys = nullptr;
+static size_t fuzzLength = 0;
+static size_t fuzzKeyIndex = 0;
+static int fuzzFault = FUZZ_OK;
+static uint16_t fuzzFaultPC = 0;
+
+static void fuzz_input_poll()
+{
+	if (fuzzKeyIndex < fuzzLength)
+	{
+		core_key_press(fuzzKeys[fuzzKeyIndex++]);
+	}
+	else
+	{
+		isRunning = false;
+	}
+}
+
+static void fuzz_illegal_instruction(uint16_t instr)
+{
+	(void)instr;
+	fuzzFault = FUZZ_ILLEGAL;
+	fuzzFaultPC = (uint16_t)(reg[R_PC] - 1);
+	isRunning = false;
+}
+
+/* AFL's hit count classes, one bit each */
+static uint8_t fuzz_bucket(uint8_t count)
+{
+	if (count <= 3)
+	{
+		return (uint8_t)(1 << (count - 1));
+	}
+	if (count <= 7)
+	{
+		return 8;
+	}
+	if (count <= 15)
+	{
+		return 16;
+	}
+	if (count <= 31)
+	{
+		return 32;
+	}
+	return count <= 127 ? 64 : 128;
+}
+
+void fuzz_init(std::atomic<uint8_t>* virgin, uint64_t limit)
+{
+	fuzzVirgin = virgin;
+	fuzzLimit = limit;
+
+	// EXPLAIN: The program's code is wherever it loaded something, the keyboard registers don't count
+	for (int page = 0; page < PAGE_COUNT; page++)
+	{
+		fuzzCodePage[page] = false;
+		for (int i = 0; i < PAGE_WORDS && !fuzzCodePage[page]; i++)
+		{
+			fuzzCodePage[page] = memory[(page << PAGE_SHIFT) + i] != 0;
+		}
+	}
+	fuzzCodePage[MR_KBSR >> PAGE_SHIFT] = false;
+	fuzzCodeFrom = 0x0000;
+	fuzzCodeTo = 0xFFFF;
+
+	host.console_write = nullptr;
+	host.console_clear = nullptr;
+	host.input_poll = &fuzz_input_poll;
+	host.step_wait = nullptr;
+	host.illegal_instruction = &fuzz_illegal_instruction;
+	isStepIn = false;
+
+	machine_baseline();
+	fuzzBaseCount = retiredCount;
+}
+
+void fuzz_set_code(uint16_t from, uint16_t to)
+{
+	for (int page = 0; page < PAGE_COUNT; page++)
+	{
+		fuzzCodePage[page] = true;
+	}
+	fuzzCodeFrom = from;
+	fuzzCodeTo = to;
+}
+
+void fuzz_run(const uint8_t* keys, size_t length, struct lc3FuzzResult* result)
+{
+	machine_reset();
+	fuzzKeys = keys;
+	fuzzLength = length;
+	fuzzKeyIndex = 0;
+	fuzzFault = FUZZ_OK;
+	retiredLimit = fuzzBaseCount + fuzzLimit;
+
+	uint16_t previous = 0;
+	while (isRunning)
+	{
+		uint16_t pc = reg[R_PC];
+		if (retiredCount >= retiredLimit)
+		{
+			fuzzFault = FUZZ_HANG;
+			fuzzFaultPC = pc;
+			break;
+		}
+		if (!fuzzCodePage[pc >> PAGE_SHIFT] || pc < fuzzCodeFrom || pc > fuzzCodeTo)
+		{
+			fuzzFault = FUZZ_BAD_PC;
+			fuzzFaultPC = pc;
+			break;
+		}
+
+		// EXPLAIN: Shifting one side keeps A->B and B->A (and tight loops A->A) apart
+		uint16_t edge = (uint16_t)(pc ^ previous);
+		previous = (uint16_t)(pc >> 1);
+		if (fuzzTrace[edge] == 0)
+		{
+			fuzzTouched[fuzzTouchedCount++] = edge;
+		}
+		if (fuzzTrace[edge] != 0xFF)
+		{
+			fuzzTrace[edge]++;
+		}
+
+		core_run_block();
+	}
+	retiredLimit = UINT64_MAX;
+
+	result->kind = fuzzFault;
+	result->pc = fuzzFault == FUZZ_OK ? reg[R_PC] : fuzzFaultPC;
+	result->instructions = retiredCount - fuzzBaseCount;
+	result->keysUsed = fuzzKeyIndex;
+	result->newBuckets = 0;
+	result->newEdges = 0;
+	for (int i = 0; i < fuzzTouchedCount; i++)
+	{
+		uint16_t edge = fuzzTouched[i];
+		uint8_t bucket = fuzz_bucket(fuzzTrace[edge]);
+		fuzzTrace[edge] = 0;
+		// EXPLAIN: Plain loads first, almost every bucket was seen before and the atomic and would dirty the shared line
+		if ((fuzzVirgin[edge].load(std::memory_order_relaxed) & bucket) == 0)
+		{
+			continue;
+		}
+		uint8_t old = fuzzVirgin[edge].fetch_and((uint8_t)~bucket, std::memory_order_relaxed);
+		if (old & bucket)
+		{
+			result->newBuckets++;
+			result->newEdges += (old == 0xFF);
+		}
+	}
+	fuzzTouchedCount = 0;
+}
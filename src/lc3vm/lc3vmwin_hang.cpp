@@ -0,0 +1,125 @@
+/*
+	Infinite loop detector, see lc3vmwin_hang.hpp
+*/
+
+#include "lc3vmwin_hang.hpp"
+#include "lc3vmwin_core.hpp"
+
+bool hangEnabled = false;
+struct lc3HangReport hangReport = {};
+
+// EXPLAIN: Sum of mix(address, value) over memory, minus what it was at hang_reset()
+static uint64_t hangMemory = 0;
+
+static uint64_t hangSaved = 0;
+static uint64_t hangSavedKeyboard = 0;
+static uint64_t hangSavedRetired = 0;
+static uint64_t hangPower = 1;
+static uint64_t hangBlocks = 0;
+static uint16_t hangLow = 0xFFFF;
+static uint16_t hangHigh = 0;
+
+/* splitmix64's finalizer */
+static uint64_t hang_mix(uint64_t x)
+{
+	x ^= x >> 30;
+	x *= UINT64_C(0xBF58476D1CE4E5B9);
+	x ^= x >> 27;
+	x *= UINT64_C(0x94D049BB133111EB);
+	x ^= x >> 31;
+	return x;
+}
+
+static uint64_t hang_word(uint16_t index, uint16_t value)
+{
+	return hang_mix(((uint64_t)index << 16) | value);
+}
+
+static uint64_t hang_state()
+{
+	uint64_t hash = hangMemory;
+	hash = hang_mix(hash ^ ((uint64_t)reg[R_R0] | (uint64_t)reg[R_R1] << 16 | (uint64_t)reg[R_R2] << 32 | (uint64_t)reg[R_R3] << 48));
+	hash = hang_mix(hash ^ ((uint64_t)reg[R_R4] | (uint64_t)reg[R_R5] << 16 | (uint64_t)reg[R_R6] << 32 | (uint64_t)reg[R_R7] << 48));
+	hash = hang_mix(hash ^ ((uint64_t)reg[R_PC] | (uint64_t)reg[R_COND] << 16 | (uint64_t)keyPressed << 32 | (uint64_t)lastKeyPressed << 40));
+	// EXPLAIN: The keyboard writes these two behind the bus, so they are hashed as they are instead of through hangMemory
+	hash = hang_mix(hash ^ ((uint64_t)memory[MR_KBSR] | (uint64_t)memory[MR_KBDR] << 16));
+	hash = hang_mix(hash ^ ((uint64_t)psr | (uint64_t)savedSSP << 16 | (uint64_t)savedUSP << 32));
+	return hash;
+}
+
+/* Remember the state as it is now and compare the next blocks with it */
+static void hang_save()
+{
+	hangSaved = hang_state();
+	hangSavedKeyboard = keyboardReads;
+	hangSavedRetired = retiredCount;
+	hangBlocks = 0;
+	hangLow = 0xFFFF;
+	hangHigh = 0;
+}
+
+void hang_enable(bool enable)
+{
+	hangEnabled = enable;
+	for (int page = 0; page < PAGE_COUNT; page++)
+	{
+		if (enable)
+		{
+			pageFlags[page] |= PAGE_HANG;
+		}
+		else
+		{
+			pageFlags[page] &= (uint8_t)~PAGE_HANG;
+		}
+	}
+	hang_reset();
+}
+
+void hang_reset()
+{
+	hangReport = {};
+	hangMemory = 0;
+	hangPower = 1;
+	hang_save();
+}
+
+void hang_block(uint16_t address, int count)
+{
+	if (keyboardReads != hangSavedKeyboard)
+	{
+		hangPower = 1;
+		hang_save();
+		return;
+	}
+
+	uint16_t last = (uint16_t)(address + count - 1);
+	hangLow = address < hangLow ? address : hangLow;
+	hangHigh = last > hangHigh ? last : hangHigh;
+
+	if (hang_state() == hangSaved)
+	{
+		hangReport.detected = true;
+		hangReport.pcLow = hangLow;
+		hangReport.pcHigh = hangHigh;
+		hangReport.period = retiredCount - hangSavedRetired;
+		hangReport.at = retiredCount;
+		isRunning = false;
+		return;
+	}
+
+	// EXPLAIN: Brent: once as many blocks ran as the power, the one that is just now becomes the one to compare with
+	if (++hangBlocks == hangPower)
+	{
+		hangPower *= 2;
+		hang_save();
+	}
+}
+
+void hang_on_write(uint16_t index, uint16_t oldValue, uint16_t value)
+{
+	if (index == MR_KBSR || index == MR_KBDR || index == MR_DSR)
+	{
+		return;
+	}
+	hangMemory += hang_word(index, value) - hang_word(index, oldValue);
+}
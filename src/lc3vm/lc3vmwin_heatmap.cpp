@@ -0,0 +1,58 @@
+/*
+	Execution and memory access counters, see lc3vmwin_heatmap.hpp
+*/
+
+#include "lc3vmwin_heatmap.hpp"
+#include <cstring>
+
+uint32_t heatExec[MAX_SIZE];
+uint32_t heatRead[MAX_SIZE];
+uint32_t heatWrite[MAX_SIZE];
+bool heatmapEnabled = false;
+
+void heatmap_enable(bool enable)
+{
+	heatmapEnabled = enable;
+	for (int page = 0; page < PAGE_COUNT; page++)
+	{
+		if (enable)
+		{
+			pageFlags[page] |= PAGE_HEAT;
+		}
+		else
+		{
+			pageFlags[page] &= (uint8_t)~PAGE_HEAT;
+		}
+	}
+}
+
+void heatmap_clear()
+{
+	memset(heatExec, 0, sizeof(heatExec));
+	memset(heatRead, 0, sizeof(heatRead));
+	memset(heatWrite, 0, sizeof(heatWrite));
+}
+
+void heatmap_exec(uint16_t address, int count)
+{
+	// EXPLAIN: uint16_t wraps like the LC-3 PC does, a block running past xFFFF continues at x0000
+	for (int i = 0; i < count; i++)
+	{
+		heatExec[(uint16_t)(address + i)]++;
+	}
+}
+
+uint32_t heatmap_get(uint16_t address, int kind)
+{
+	switch (kind)
+	{
+		case HEAT_EXEC:
+			return heatExec[address];
+		case HEAT_READ:
+			return heatRead[address];
+		case HEAT_WRITE:
+			return heatWrite[address];
+		default:
+			return heatExec[address] + heatRead[address] + heatWrite[address];
+	}
+}
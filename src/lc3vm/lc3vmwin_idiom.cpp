@@ -0,0 +1,182 @@
+/*
+	Idiom recognition, see lc3vmwin_idiom.hpp
+*/
+
+#include "lc3vmwin_idiom.hpp"
+#include "lc3vmwin_breakpoint.hpp"
+#include "lc3vmwin_core.hpp"
+#include "lc3vmwin_disa_be.hpp"
+#include "lc3vmwin_heatmap.hpp"
+#include "lc3vmwin_input.hpp"
+#include "lc3vmwin_journal.hpp"
+#include "lc3vmwin_stats_be.hpp"
+#include "lc3vmwin_trace.hpp"
+
+bool idiomEnabled = true;
+
+/* ADD DR, SR, #imm5 with DR == SR, the step of a counter or a pointer */
+static bool idiom_is_step(uint16_t instr, int imm, uint8_t* r)
+{
+	if ((instr & 0xF020) != 0x1020)
+	{
+		return false;
+	}
+	uint8_t dr = (instr >> 9) & 0x0007;
+	uint8_t sr = (instr >> 6) & 0x0007;
+	*r = dr;
+	return dr == sr && (int16_t)sign_extended(instr & 0x001F, 5) == imm;
+}
+
+uint8_t idiom_match(const uint16_t block[], int numInstr, uint16_t lc3MemAddress, int* head)
+{
+	// EXPLAIN: BRp or BRnp back into the block. With a counter above 0 both loop exactly as long as it is above 0
+	uint16_t br = block[numInstr - 1];
+	uint16_t nzp = br & 0x0E00;
+	int target = (uint16_t)(lc3MemAddress + numInstr + sign_extended(br & 0x01FF, 9)) - lc3MemAddress;
+	int length = numInstr - target;
+	if ((br >> 12) != 0 || (nzp != 0x0200 && nzp != 0x0A00) || target < 0 || (length != 3 && length != 6))
+	{
+		return IDIOM_NONE;
+	}
+	const uint16_t* codeBlock = block + target;
+	uint8_t rc;
+	if (!idiom_is_step(codeBlock[length - 2], -1, &rc))
+	{
+		return IDIOM_NONE;
+	}
+	*head = target;
+
+	if (length == 3)
+	{
+		uint16_t add = codeBlock[0];
+		if ((add & 0xF038) != 0x1000)
+		{
+			return IDIOM_NONE;
+		}
+		uint8_t dr = (add >> 9) & 0x0007;
+		uint8_t sr1 = (add >> 6) & 0x0007;
+		uint8_t sr2 = add & 0x0007;
+		if (dr == rc || sr1 == rc || sr2 == rc)
+		{
+			return IDIOM_NONE;
+		}
+		if (dr == sr1 && dr == sr2)
+		{
+			return IDIOM_SHIFT;
+		}
+		if ((dr == sr1) != (dr == sr2))
+		{
+			return IDIOM_MULTIPLY;
+		}
+		return IDIOM_NONE;
+	}
+
+	uint16_t ldr = codeBlock[0];
+	uint16_t str = codeBlock[1];
+	if ((ldr >> 12) != 0x6 || (str >> 12) != 0x7 || ((ldr >> 9) & 0x0007) != ((str >> 9) & 0x0007))
+	{
+		return IDIOM_NONE;
+	}
+	uint8_t rt = (ldr >> 9) & 0x0007;
+	uint8_t rs = (ldr >> 6) & 0x0007;
+	uint8_t rd = (str >> 6) & 0x0007;
+	uint8_t first;
+	uint8_t second;
+	if (!idiom_is_step(codeBlock[2], 1, &first) || !idiom_is_step(codeBlock[3], 1, &second))
+	{
+		return IDIOM_NONE;
+	}
+	bool pointers = (first == rs && second == rd) || (first == rd && second == rs);
+	bool distinct = rt != rs && rt != rd && rt != rc && rs != rd && rs != rc && rd != rc;
+	return pointers && distinct ? IDIOM_COPY : IDIOM_NONE;
+}
+
+/* [first, first + count) stays below the device registers and off pages with any of flags */
+static bool idiom_range_plain(uint16_t first, uint16_t count, uint8_t flags)
+{
+	int last = first + count - 1;
+	if (last >= MR_KBSR)
+	{
+		return false;
+	}
+	for (int page = first >> PAGE_SHIFT; page <= (last >> PAGE_SHIFT); page++)
+	{
+		if (pageFlags[page] & flags)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+uint64_t idiom_run(const struct lc3Cache& cache)
+{
+	if (!idiomEnabled || isStepIn || journalEnabled || traceEnabled || statsEnabled || heatmapEnabled || inputReplaying)
+	{
+		return 0;
+	}
+	const uint16_t* code = cache.codeBlock + cache.idiomHead;
+	int length = cache.numInstr - cache.idiomHead;
+	uint8_t rc = (code[length - 2] >> 9) & 0x0007;
+	if ((int16_t)reg[rc] < 2)
+	{
+		return 0;
+	}
+	uint16_t trips = (uint16_t)(reg[rc] - 1);
+	uint64_t retired = (uint64_t)trips * (uint64_t)length;
+	if (retiredLimit - retiredCount < retired)
+	{
+		return 0;
+	}
+	for (int i = cache.idiomHead; i < cache.numInstr; i++)
+	{
+		if (breakpointMap[(uint16_t)(cache.lc3MemAddress + i)])
+		{
+			return 0;
+		}
+	}
+
+	switch (cache.idiom)
+	{
+		case IDIOM_SHIFT:
+		{
+			uint8_t rd = (code[0] >> 9) & 0x0007;
+			reg[rd] = trips >= 16 ? 0 : (uint16_t)(reg[rd] << trips);
+			break;
+		}
+		case IDIOM_MULTIPLY:
+		{
+			uint8_t ra = (code[0] >> 9) & 0x0007;
+			uint8_t sr1 = (code[0] >> 6) & 0x0007;
+			uint8_t rb = sr1 == ra ? code[0] & 0x0007 : sr1;
+			reg[ra] = (uint16_t)(reg[ra] + (uint32_t)reg[rb] * trips);
+			break;
+		}
+		case IDIOM_COPY:
+		{
+			uint8_t rt = (code[0] >> 9) & 0x0007;
+			uint8_t rs = (code[0] >> 6) & 0x0007;
+			uint8_t rd = (code[1] >> 6) & 0x0007;
+			uint16_t from = (uint16_t)(reg[rs] + sign_extended(code[0] & 0x003F, 6));
+			uint16_t to = (uint16_t)(reg[rd] + sign_extended(code[1] & 0x003F, 6));
+			// EXPLAIN: A watchpoint has to stop in the middle of the loop, the plain loop does that
+			if (!idiom_range_plain(from, trips, PAGE_READ_FLAGS) || !idiom_range_plain(to, trips, PAGE_WATCH))
+			{
+				return 0;
+			}
+			// EXPLAIN: Word by word like the loop, a destination just above the source repeats the first words
+			for (uint16_t k = 0; k < trips; k++)
+			{
+				reg[rt] = read_memory((uint16_t)(from + k));
+				write_memory((uint16_t)(to + k), reg[rt]);
+			}
+			reg[rs] = (uint16_t)(reg[rs] + trips);
+			reg[rd] = (uint16_t)(reg[rd] + trips);
+			break;
+		}
+		default:
+			return 0;
+	}
+	reg[rc] = 1;
+	return retired;
+}
@@ -0,0 +1,280 @@
+/*
+	Input log recorder and replayer, see lc3vmwin_input.hpp for the file format
+*/
+
+#include "lc3vmwin_input.hpp"
+#include "lc3vmwin_core.hpp"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+struct inputEvent
+{
+	uint64_t step;
+	uint8_t key;
+	bool released;
+	bool polled;
+};
+
+bool inputRecording = false;
+bool inputReplaying = false;
+
+static std::vector<struct inputEvent> inputEvents;
+static std::string inputPath;
+static uint64_t inputStartStep = 0;
+
+/* Replay state: inputEvents[replayCursor] is the next key, replayLimit the next one that comes between blocks */
+static size_t replayCursor = 0;
+static size_t replayLimit = 0;
+static uint64_t replayEnd = 0;
+static uint64_t replayHash = 0;
+static bool replayMissed = false;
+static int replayResult = INPUT_REPLAY_NONE;
+static void (*replaySavedPoll)() = nullptr;
+
+bool input_record_start(const char* path, const struct lc3SaveHost& hostState)
+{
+	if (inputReplaying)
+	{
+		return false;
+	}
+	inputPath = path;
+	inputEvents.clear();
+	inputStartStep = retiredCount;
+	// EXPLAIN: With the code cache, a program that modifies its code replays with the same stale blocks it ran with
+	savestate_save((inputPath + ".state").c_str(), hostState, true);
+	inputRecording = true;
+	return true;
+}
+
+void input_record_key(uint8_t key, bool released, bool polled)
+{
+	uint64_t step = polled ? core_current_step() : retiredCount;
+	inputEvents.push_back({step, key, released, polled});
+}
+
+bool input_record_stop()
+{
+	if (!inputRecording)
+	{
+		return false;
+	}
+	inputRecording = false;
+
+	if (!savestate_wait())
+	{
+		return false;
+	}
+	FILE* file = fopen(inputPath.c_str(), "w");
+	if (!file)
+	{
+		printf("Failed to create input log %s\n", inputPath.c_str());
+		return false;
+	}
+	fprintf(file, "LC3INPUT %d\n", INPUT_LOG_VERSION);
+	fprintf(file, "start %" PRIu64 "\n", inputStartStep);
+	for (const struct inputEvent& event : inputEvents)
+	{
+		if (event.released)
+		{
+			fprintf(file, "release %" PRIu64 "\n", event.step);
+		}
+		else
+		{
+			fprintf(file, "press %" PRIu64 " %u%s\n", event.step, event.key, event.polled ? " poll" : "");
+		}
+	}
+	fprintf(file, "end %" PRIu64 " %016" PRIx64 "\n", retiredCount, core_state_hash());
+	return fclose(file) == 0;
+}
+
+static bool input_read_log(const char* path)
+{
+	FILE* file = fopen(path, "r");
+	if (!file)
+	{
+		printf("Failed to open input log %s\n", path);
+		return false;
+	}
+
+	inputEvents.clear();
+	bool ok = false;
+	int version = 0;
+	char line[128];
+	if (fgets(line, sizeof(line), file) && sscanf(line, "LC3INPUT %d", &version) == 1 && version >= 1 && version <= INPUT_LOG_VERSION)
+	{
+		while (fgets(line, sizeof(line), file))
+		{
+			struct inputEvent event = {0, 0, false, false};
+			unsigned key;
+			char poll[8] = "";
+			if (sscanf(line, "start %" SCNu64, &inputStartStep) == 1)
+			{
+				continue;
+			}
+			if (sscanf(line, "press %" SCNu64 " %u %7s", &event.step, &key, poll) >= 2)
+			{
+				event.key = (uint8_t)key;
+				event.polled = strcmp(poll, "poll") == 0;
+				inputEvents.push_back(event);
+			}
+			else if (sscanf(line, "release %" SCNu64, &event.step) == 1)
+			{
+				event.released = true;
+				inputEvents.push_back(event);
+			}
+			else if (sscanf(line, "end %" SCNu64 " %" SCNx64, &replayEnd, &replayHash) == 2)
+			{
+				ok = true;
+				break;
+			}
+		}
+	}
+	fclose(file);
+
+	if (!ok)
+	{
+		printf("%s is not a valid input log\n", path);
+	}
+	return ok;
+}
+
+/* Stands in for host.input_poll during a replay */
+static void input_replay_poll()
+{
+	if (replayCursor < inputEvents.size())
+	{
+		const struct inputEvent& event = inputEvents[replayCursor];
+		if (event.polled && event.step == core_current_step())
+		{
+			replayCursor++;
+			core_key_press(event.key);
+		}
+	}
+}
+
+static void input_replay_end(int result)
+{
+	inputReplaying = false;
+	retiredLimit = UINT64_MAX;
+	host.input_poll = replaySavedPoll;
+	replayResult = result;
+}
+
+bool input_replay_start(const char* path, struct lc3SaveHost* hostState)
+{
+	if (inputRecording || inputReplaying || !input_read_log(path))
+	{
+		return false;
+	}
+	// EXPLAIN: The blocks have to be the ones the recording ran with, not whatever matches the state's memory
+	cache_clear();
+	if (!savestate_load((std::string(path) + ".state").c_str(), hostState))
+	{
+		return false;
+	}
+	if (retiredCount != inputStartStep)
+	{
+		printf("%s.state doesn't start where the input log does\n", path);
+		return false;
+	}
+
+	replayCursor = 0;
+	replayLimit = 0;
+	replayMissed = false;
+	replaySavedPoll = host.input_poll;
+	host.input_poll = &input_replay_poll;
+	inputReplaying = true;
+	replayResult = INPUT_REPLAY_RUNNING;
+	input_replay_due();
+	return true;
+}
+
+void input_replay_stop()
+{
+	if (inputReplaying)
+	{
+		input_replay_end(INPUT_REPLAY_STOPPED);
+	}
+}
+
+void input_replay_due()
+{
+	if (!inputReplaying)
+	{
+		return;
+	}
+
+	while (replayCursor < inputEvents.size())
+	{
+		const struct inputEvent& event = inputEvents[replayCursor];
+		// EXPLAIN: A polled key for the instruction about to run waits for its poll
+		if (event.step > retiredCount || (event.polled && event.step == retiredCount))
+		{
+			break;
+		}
+		// EXPLAIN: Its instruction already ran without taking it, or we are past where it should have come in
+		if (event.polled || event.step < retiredCount)
+		{
+			replayMissed = true;
+		}
+		else if (event.released)
+		{
+			core_key_release();
+		}
+		else
+		{
+			core_key_press(event.key);
+		}
+		replayCursor++;
+	}
+
+	if (retiredCount >= replayEnd)
+	{
+		bool matched = retiredCount == replayEnd && !replayMissed && replayCursor == inputEvents.size() && core_state_hash() == replayHash;
+		input_replay_end(matched ? INPUT_REPLAY_MATCHED : INPUT_REPLAY_DIVERGED);
+		return;
+	}
+
+	if (replayLimit < replayCursor)
+	{
+		replayLimit = replayCursor;
+	}
+	while (replayLimit < inputEvents.size() && inputEvents[replayLimit].polled)
+	{
+		replayLimit++;
+	}
+	retiredLimit = replayLimit < inputEvents.size() ? inputEvents[replayLimit].step : replayEnd;
+}
+
+void input_rewound()
+{
+	if (inputRecording)
+	{
+		// EXPLAIN: What is left happened before the current state, same rule as journal_forget_future()
+		while (!inputEvents.empty())
+		{
+			const struct inputEvent& last = inputEvents.back();
+			if (last.step < retiredCount || (last.step == retiredCount && !last.polled))
+			{
+				break;
+			}
+			inputEvents.pop_back();
+		}
+	}
+	input_replay_stop();
+}
+
+void input_status(struct lc3InputStatus* status)
+{
+	status->recording = inputRecording;
+	status->replaying = inputReplaying;
+	status->events = inputEvents.size();
+	status->replayed = replayCursor;
+	status->startStep = inputStartStep;
+	status->endStep = replayEnd;
+	status->result = replayResult;
+}
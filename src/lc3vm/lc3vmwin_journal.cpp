@@ -0,0 +1,558 @@
+/*
+	Undo journal and checkpoints for reverse execution
+*/
+
+#include "lc3vmwin_journal.hpp"
+#include "lc3vmwin_core.hpp"
+#include "lc3vmwin_display.hpp"
+#include "lc3vmwin_breakpoint.hpp"
+#include "lc3vmwin_machine.hpp"
+#include "lc3vmwin_input.hpp"
+
+#include <cstring>
+#include <vector>
+
+struct journalEntry
+{
+	uint16_t regs[R_COUNT];         // before the instruction, R_PC is its own address
+	uint64_t writeBegin;            // its first write in journalWrites
+	int16_t callDepth;
+	struct lc3Frame frame;          // callStack[callDepth] before, a JSR at the end of the block overwrites it
+	bool keyPressed;
+	uint8_t lastKeyPressed;
+	uint16_t kbsr;                  // the keyboard sets these itself, not through write_memory()
+	uint16_t kbdr;
+	uint16_t psr;
+	uint16_t savedSSP;
+	uint16_t savedUSP;
+};
+
+struct journalWrite
+{
+	uint16_t address;
+	uint16_t oldValue;
+};
+
+struct journalCheckpoint
+{
+	uint64_t step;
+	uint16_t regs[R_COUNT];
+	std::vector<uint16_t> memory;
+	bool keyPressed;
+	uint8_t lastKeyPressed;
+	uint16_t psr;
+	uint16_t savedSSP;
+	uint16_t savedUSP;
+	int callDepth;
+	struct lc3Frame callStack[CALLSTACK_MAX];
+};
+
+struct journalKey
+{
+	uint64_t step;                  // the instruction that sees the key
+	uint8_t key;
+	bool polled;                    // pressed while that instruction polled for it, i.e. after it started
+	bool released;                  // a key release, which only clears keyPressed
+	bool interrupt;                 // not a key, the keyboard interrupt was taken right before step
+};
+
+struct journalHit
+{
+	uint64_t step;                  // the instruction bp_check() counted the hit before
+	uint16_t address;
+};
+
+bool journalEnabled = false;
+
+static std::vector<struct journalEntry> journalRing;
+static std::vector<struct journalWrite> journalWrites;
+static std::vector<struct journalHit> journalHits;
+static struct journalCheckpoint journalCheckpoints[JOURNAL_CHECKPOINTS];
+static struct journalKey journalKeys[JOURNAL_KEYS_MAX];
+
+/* EXPLAIN: All of these are absolute counts, ring slots are count % size */
+static uint64_t journalStep = 0;        // the next instruction, == retiredCount between blocks
+static uint64_t journalTail = 0;        // oldest entry still in the ring
+static uint64_t journalWriteHead = 0;
+static uint64_t checkpointHead = 0;
+static uint64_t checkpointTail = 0;
+static uint64_t keyHead = 0;
+static uint64_t keyTail = 0;
+static uint64_t hitHead = 0;
+static uint64_t hitTail = 0;
+static uint64_t hitsKnownFrom = 0;      // steps before it had hits that were dropped from journalHits
+static bool journalExecuting = false;
+
+void journal_reset()
+{
+	journalStep = retiredCount;
+	journalTail = journalStep;
+	journalWriteHead = 0;
+	checkpointHead = 0;
+	checkpointTail = 0;
+	keyHead = 0;
+	keyTail = 0;
+	hitHead = 0;
+	hitTail = 0;
+	hitsKnownFrom = 0;
+	journalExecuting = false;
+}
+
+void journal_enable(bool enable)
+{
+	if (enable == journalEnabled)
+	{
+		return;
+	}
+
+	if (enable)
+	{
+		journalRing.resize(JOURNAL_ENTRIES);
+		journalWrites.resize(JOURNAL_WRITES);
+		journalHits.resize(JOURNAL_HITS_MAX);
+		for (int i = 0; i < JOURNAL_CHECKPOINTS; i++)
+		{
+			journalCheckpoints[i].memory.resize(MAX_SIZE);
+		}
+		journal_reset();
+	}
+	else
+	{
+		std::vector<struct journalEntry>().swap(journalRing);
+		std::vector<struct journalWrite>().swap(journalWrites);
+		std::vector<struct journalHit>().swap(journalHits);
+		for (int i = 0; i < JOURNAL_CHECKPOINTS; i++)
+		{
+			std::vector<uint16_t>().swap(journalCheckpoints[i].memory);
+		}
+	}
+
+	for (int page = 0; page < PAGE_COUNT; page++)
+	{
+		pageFlags[page] = enable ? (uint8_t)(pageFlags[page] | PAGE_JOURNAL) : (uint8_t)(pageFlags[page] & ~PAGE_JOURNAL);
+	}
+	journalEnabled = enable;
+	core_hooks_update();
+}
+
+static void journal_checkpoint(uint16_t pc)
+{
+	if (checkpointHead - checkpointTail == JOURNAL_CHECKPOINTS)
+	{
+		checkpointTail++;
+	}
+	struct journalCheckpoint& cp = journalCheckpoints[checkpointHead++ % JOURNAL_CHECKPOINTS];
+	cp.step = journalStep;
+	memcpy(cp.regs, reg, sizeof(cp.regs));
+	cp.regs[R_PC] = pc;
+	memcpy(cp.memory.data(), memory, MAX_SIZE * sizeof(uint16_t));
+	cp.keyPressed = keyPressed;
+	cp.lastKeyPressed = lastKeyPressed;
+	cp.psr = psr;
+	cp.savedSSP = savedSSP;
+	cp.savedUSP = savedUSP;
+	cp.callDepth = callDepth;
+	memcpy(cp.callStack, callStack, sizeof(cp.callStack));
+}
+
+void journal_before()
+{
+	// EXPLAIN: The core has already moved the PC past the instruction
+	uint16_t pc = (uint16_t)(reg[R_PC] - 1);
+
+	if (checkpointHead == checkpointTail ||
+		journalStep - journalCheckpoints[(checkpointHead - 1) % JOURNAL_CHECKPOINTS].step >= JOURNAL_CHECKPOINT_INTERVAL)
+	{
+		journal_checkpoint(pc);
+	}
+
+	if (journalStep - journalTail == JOURNAL_ENTRIES)
+	{
+		journalTail++;
+	}
+	struct journalEntry& entry = journalRing[journalStep % JOURNAL_ENTRIES];
+	memcpy(entry.regs, reg, sizeof(entry.regs));
+	entry.regs[R_PC] = pc;
+	entry.writeBegin = journalWriteHead;
+	entry.callDepth = (int16_t)callDepth;
+	entry.frame = callDepth < CALLSTACK_MAX ? callStack[callDepth] : lc3Frame{0, 0, 0};
+	entry.keyPressed = keyPressed;
+	entry.lastKeyPressed = lastKeyPressed;
+	entry.kbsr = memory[MR_KBSR];
+	entry.kbdr = memory[MR_KBDR];
+	entry.psr = psr;
+	entry.savedSSP = savedSSP;
+	entry.savedUSP = savedUSP;
+
+	journalStep++;
+	journalExecuting = true;
+}
+
+void journal_after()
+{
+	journalExecuting = false;
+}
+
+void journal_on_write(uint16_t address, uint16_t oldValue)
+{
+	// EXPLAIN: The oldest entries go first if their writes are about to be overwritten
+	while (journalTail < journalStep && journalWriteHead - journalRing[journalTail % JOURNAL_ENTRIES].writeBegin >= JOURNAL_WRITES)
+	{
+		journalTail++;
+	}
+	journalWrites[journalWriteHead++ % JOURNAL_WRITES] = {address, oldValue};
+}
+
+void journal_key(uint8_t key, bool released)
+{
+	// EXPLAIN: A key pressed while an instruction polls for one is seen by that instruction, otherwise by the next one
+	uint64_t step = journalExecuting ? journalStep - 1 : journalStep;
+	if (keyHead - keyTail == JOURNAL_KEYS_MAX)
+	{
+		keyTail++;
+	}
+	journalKeys[keyHead++ % JOURNAL_KEYS_MAX] = {step, key, journalExecuting, released, false};
+}
+
+void journal_interrupt()
+{
+	// EXPLAIN: Interrupts are only taken between blocks. Logged with the keys so a replay takes it in the same order
+	if (keyHead - keyTail == JOURNAL_KEYS_MAX)
+	{
+		keyTail++;
+	}
+	journalKeys[keyHead++ % JOURNAL_KEYS_MAX] = {journalStep, 0, false, false, true};
+}
+
+void journal_hit(uint16_t address)
+{
+	if (hitHead - hitTail == JOURNAL_HITS_MAX)
+	{
+		hitsKnownFrom = journalHits[hitTail++ % JOURNAL_HITS_MAX].step + 1;
+	}
+	journalHits[hitHead++ % JOURNAL_HITS_MAX] = {journalStep, address};
+}
+
+uint64_t journal_oldest_undo()
+{
+	return journalTail;
+}
+
+uint64_t journal_oldest()
+{
+	if (checkpointHead != checkpointTail && journalCheckpoints[checkpointTail % JOURNAL_CHECKPOINTS].step < journalTail)
+	{
+		return journalCheckpoints[checkpointTail % JOURNAL_CHECKPOINTS].step;
+	}
+	return journalTail;
+}
+
+static void journal_pop()
+{
+	journalStep--;
+	const struct journalEntry& entry = journalRing[journalStep % JOURNAL_ENTRIES];
+
+	while (journalWriteHead > entry.writeBegin)
+	{
+		journalWriteHead--;
+		const struct journalWrite& write = journalWrites[journalWriteHead % JOURNAL_WRITES];
+		memory[write.address] = write.oldValue;
+	}
+
+	memcpy(reg, entry.regs, sizeof(entry.regs));
+	keyPressed = entry.keyPressed;
+	lastKeyPressed = entry.lastKeyPressed;
+	memory[MR_KBSR] = entry.kbsr;
+	memory[MR_KBDR] = entry.kbdr;
+	psr = entry.psr;
+	savedSSP = entry.savedSSP;
+	savedUSP = entry.savedUSP;
+	callDepth = entry.callDepth;
+	if (callDepth < CALLSTACK_MAX)
+	{
+		callStack[callDepth] = entry.frame;
+	}
+	retiredCount = journalStep;
+	machine_forget_base();
+}
+
+/* Puts the machine in the state of checkpoint, everything recorded after it is gone */
+static void journal_restore(uint64_t checkpoint)
+{
+	struct journalCheckpoint& cp = journalCheckpoints[checkpoint % JOURNAL_CHECKPOINTS];
+	memcpy(reg, cp.regs, sizeof(cp.regs));
+	memcpy(memory, cp.memory.data(), MAX_SIZE * sizeof(uint16_t));
+	machine_forget_base();
+	keyPressed = cp.keyPressed;
+	lastKeyPressed = cp.lastKeyPressed;
+	psr = cp.psr;
+	savedSSP = cp.savedSSP;
+	savedUSP = cp.savedUSP;
+	callDepth = cp.callDepth;
+	memcpy(callStack, cp.callStack, sizeof(cp.callStack));
+
+	// EXPLAIN: Only reached when the target is older than the ring, so nothing in the ring is before the checkpoint
+	journalStep = cp.step;
+	journalTail = cp.step;
+	checkpointHead = checkpoint + 1;
+	retiredCount = journalStep;
+}
+
+static uint64_t replayKey = 0;
+
+/* Presses the recorded keys of instruction step that were pressed before it (polled == false) or while it polled, and takes its interrupt */
+static void journal_replay_keys(uint64_t step, bool polled)
+{
+	while (replayKey < keyHead && journalKeys[replayKey % JOURNAL_KEYS_MAX].step == step &&
+		journalKeys[replayKey % JOURNAL_KEYS_MAX].polled == polled)
+	{
+		const struct journalKey& event = journalKeys[replayKey % JOURNAL_KEYS_MAX];
+		if (event.interrupt)
+		{
+			core_keyboard_interrupt();
+		}
+		else if (event.released)
+		{
+			keyPressed = false;
+		}
+		else
+		{
+			keyPressed = true;
+			lastKeyPressed = event.key;
+		}
+		replayKey++;
+	}
+}
+
+/* Stands in for host.input_poll during a replay, journalStep is already past the instruction that polls */
+static void journal_replay_poll()
+{
+	journal_replay_keys(journalStep - 1, true);
+}
+
+/*
+	Runs forward to step with the recorded keys, calling visit() before every instruction.
+	The host hooks are off meanwhile: the console already shows this output and nothing may ask for new input.
+*/
+template <typename Visit>
+static void journal_replay(uint64_t step, Visit visit)
+{
+	// EXPLAIN: Output still queued belongs to the console, it mustn't be dropped with the hooks off
+	display_flush();
+	struct lc3Host saved = host;
+	host = {nullptr, nullptr, &journal_replay_poll, nullptr, nullptr, nullptr};
+
+	/*
+		EXPLAIN: The checkpoint we start from was taken when its instruction began, after whatever came in right
+		before it. Replaying those events again would press a key twice, no harm, but also take an interrupt twice
+	*/
+	replayKey = keyTail;
+	while (replayKey < keyHead && (journalKeys[replayKey % JOURNAL_KEYS_MAX].step < journalStep ||
+		(journalKeys[replayKey % JOURNAL_KEYS_MAX].step == journalStep && !journalKeys[replayKey % JOURNAL_KEYS_MAX].polled)))
+	{
+		replayKey++;
+	}
+
+	// EXPLAIN: Keys come in at the same point as they did the first time, before the instruction or from its poll
+	while (journalStep < step && isRunning)
+	{
+		visit();
+		journal_replay_keys(journalStep, false);
+		core_step();
+	}
+	// EXPLAIN: Keys pressed between blocks right at step are part of the state at step, same as in a journal entry
+	journal_replay_keys(journalStep, false);
+
+	host = saved;
+}
+
+/* Newest checkpoint at or before step, checkpointTail - 1 if there is none */
+static uint64_t journal_find_checkpoint(uint64_t step)
+{
+	uint64_t i = checkpointHead;
+	while (i > checkpointTail && journalCheckpoints[(i - 1) % JOURNAL_CHECKPOINTS].step > step)
+	{
+		i--;
+	}
+	return i - 1;
+}
+
+/* The keys of the future we just left must not be replayed into the new one */
+static void journal_forget_future()
+{
+	while (keyHead > keyTail)
+	{
+		const struct journalKey& last = journalKeys[(keyHead - 1) % JOURNAL_KEYS_MAX];
+		if (last.step < journalStep || (last.step == journalStep && !last.polled))
+		{
+			break;
+		}
+		keyHead--;
+	}
+
+	// EXPLAIN: Hits of the future are taken off the breakpoints too, the one at journalStep itself stays counted
+	while (hitHead > hitTail && journalHits[(hitHead - 1) % JOURNAL_HITS_MAX].step > journalStep)
+	{
+		int index = (breakpointMap[journalHits[--hitHead % JOURNAL_HITS_MAX].address] & BP_MAP_INDEX) - 1;
+		if (index >= 0 && breakpoints[index].hits > 0)
+		{
+			breakpoints[index].hits--;
+		}
+	}
+	input_rewound();
+}
+
+static bool journal_seek_step(uint64_t step)
+{
+	if (!journalEnabled || step > journalStep)
+	{
+		return false;
+	}
+
+	if (step >= journalTail)
+	{
+		while (journalStep > step)
+		{
+			journal_pop();
+		}
+		return true;
+	}
+
+	uint64_t checkpoint = journal_find_checkpoint(step);
+	if (checkpoint + 1 == checkpointTail)
+	{
+		return false;
+	}
+	journal_restore(checkpoint);
+	// EXPLAIN: The HALT flag is part of the future we are leaving
+	isRunning = true;
+	journal_replay(step, [] {});
+	return journalStep == step;
+}
+
+bool journal_seek(uint64_t step)
+{
+	bool reached = journal_seek_step(step);
+	journal_forget_future();
+	return reached;
+}
+
+bool journal_reverse_step()
+{
+	return journalStep > 0 && journal_seek(journalStep - 1);
+}
+
+/* journalHits[hitCursor] is the first hit at or after the step searched, laterHits[] counts them per breakpoint from there */
+static uint64_t hitCursor = 0;
+static uint32_t laterHits[BREAKPOINT_MAX];
+
+static void journal_count_hit(uint64_t slot, bool later)
+{
+	int index = (breakpointMap[journalHits[slot % JOURNAL_HITS_MAX].address] & BP_MAP_INDEX) - 1;
+	if (index >= 0)
+	{
+		laterHits[index] = later ? laterHits[index] + 1 : laterHits[index] - 1;
+	}
+}
+
+/* Same as bp_matches(), with hits as they were at journalStep */
+static bool journal_bp_matches()
+{
+	int index = (breakpointMap[reg[R_PC]] & BP_MAP_INDEX) - 1;
+	if (index < 0)
+	{
+		return false;
+	}
+
+	// EXPLAIN: The search goes back a step at a time and each replay forward, so the cursor only moves a little
+	while (hitCursor > hitTail && journalHits[(hitCursor - 1) % JOURNAL_HITS_MAX].step >= journalStep)
+	{
+		journal_count_hit(--hitCursor, true);
+	}
+	while (hitCursor < hitHead && journalHits[hitCursor % JOURNAL_HITS_MAX].step < journalStep)
+	{
+		journal_count_hit(hitCursor++, false);
+	}
+	return bp_matches(reg[R_PC], reg, memory, laterHits[index]);
+}
+
+static bool journal_reverse_search()
+{
+	if (!journalEnabled)
+	{
+		return false;
+	}
+	isRunning = true;
+
+	hitCursor = hitHead;
+	memset(laterHits, 0, sizeof(laterHits));
+	// EXPLAIN: Past the hits journalHits still has, a condition on hits can't be evaluated. The search ends there
+	uint64_t oldest = bp_uses_hits() ? hitsKnownFrom : 0;
+
+	// EXPLAIN: The ring first, popping one instruction at a time is all it takes
+	while (journalStep > journalTail && journalStep > oldest)
+	{
+		journal_pop();
+		if (journal_bp_matches())
+		{
+			return true;
+		}
+	}
+
+	/*
+		EXPLAIN: Then checkpoint by checkpoint, newest first. Each one is replayed up to where the previous search
+		started, remembering the last breakpoint on the way. The first checkpoint that has one is where we go.
+	*/
+	uint64_t limit = journalStep;
+	while (true)
+	{
+		uint64_t checkpoint = journal_find_checkpoint(limit == 0 ? 0 : limit - 1);
+		if (limit <= oldest || checkpoint + 1 == checkpointTail || journalCheckpoints[checkpoint % JOURNAL_CHECKPOINTS].step >= limit)
+		{
+			break;
+		}
+
+		journal_restore(checkpoint);
+		uint64_t found = UINT64_MAX;
+		journal_replay(limit, [&found, oldest] {
+			if (journalStep >= oldest && journal_bp_matches())
+			{
+				found = journalStep;
+			}
+		});
+
+		if (found != UINT64_MAX)
+		{
+			journal_seek_step(found);
+			return true;
+		}
+		limit = journalCheckpoints[checkpoint % JOURNAL_CHECKPOINTS].step;
+		if (limit < oldest)
+		{
+			limit = oldest;
+		}
+		journal_seek_step(limit);
+	}
+
+	return false;
+}
+
+bool journal_reverse_continue()
+{
+	bool found = journal_reverse_search();
+	journal_forget_future();
+
+	/*
+		EXPLAIN: Leave the breakpoint as if execution had stopped here going forward: this reach counted.
+		It isn't if the first run went through here in step mode, where bp_check() is not called
+	*/
+	uint16_t pc = reg[R_PC];
+	int index = (breakpointMap[pc] & BP_MAP_INDEX) - 1;
+	if (found && index >= 0 && (hitHead == hitTail || journalHits[(hitHead - 1) % JOURNAL_HITS_MAX].step != journalStep ||
+		journalHits[(hitHead - 1) % JOURNAL_HITS_MAX].address != pc))
+	{
+		breakpoints[index].hits++;
+		journal_hit(pc);
+	}
+	return found;
+}
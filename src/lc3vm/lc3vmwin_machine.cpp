@@ -0,0 +1,202 @@
+/*
+	Copy-on-write machine clones, see lc3vmwin_machine.hpp
+*/
+
+#include "lc3vmwin_machine.hpp"
+#include "lc3vmwin_core.hpp"
+#include "lc3vmwin_callstack.hpp"
+#include "lc3vmwin_journal.hpp"
+#include "lc3vmwin_hang.hpp"
+
+#include <cstring>
+
+#define DEVICE_PAGE     (MR_KBSR >> PAGE_SHIFT)
+
+/* EXPLAIN: What memory[] held at the last capture/switch, page by page, valid for every page that isn't dirty */
+static std::shared_ptr<const struct lc3Page> machineBase[PAGE_COUNT];
+static bool machineBaseValid = false;
+static bool machineDirty[PAGE_COUNT];
+static uint16_t machineDirtyList[PAGE_COUNT];
+static int machineDirtyCount = 0;
+static struct lc3MachineStats machineCounters = {0, 0, 0, 0, 0};
+static struct lc3Machine machineBaseline;
+static bool machineBaselineValid = false;
+
+static bool page_equal(const uint16_t* words, const std::shared_ptr<const struct lc3Page>& page)
+{
+	return page && memcmp(words, page->words, sizeof(page->words)) == 0;
+}
+
+/*
+	The blocks decoded from the words of page that are about to become words[] are stale. Only the changed span is
+	dropped, a program that keeps its variables next to its code doesn't lose the code's blocks on every switch
+*/
+static void machine_invalidate_changed(int page, const uint16_t* words)
+{
+	const uint16_t* current = &memory[page << PAGE_SHIFT];
+	int first = 0;
+	int last = PAGE_WORDS - 1;
+	while (first <= last && current[first] == words[first])
+	{
+		first++;
+	}
+	while (last > first && current[last] == words[last])
+	{
+		last--;
+	}
+	if (first <= last)
+	{
+		cache_invalidate((page << PAGE_SHIFT) + first, (page << PAGE_SHIFT) + last);
+	}
+}
+
+/* Brings machineBase[page] up to date with memory[], sharing it when the contents are the same anyway */
+static void machine_capture_page(int page)
+{
+	const uint16_t* words = &memory[page << PAGE_SHIFT];
+	if (page_equal(words, machineBase[page]))
+	{
+		return;
+	}
+
+	// EXPLAIN: Most of the 64K words are zero, all those pages are one page
+	static const std::shared_ptr<const struct lc3Page> zeroPage = std::make_shared<const struct lc3Page>();
+	if (page_equal(words, zeroPage))
+	{
+		machineBase[page] = zeroPage;
+		return;
+	}
+
+	std::shared_ptr<struct lc3Page> copy = std::make_shared<struct lc3Page>();
+	memcpy(copy->words, words, sizeof(copy->words));
+	machineBase[page] = std::move(copy);
+	machineCounters.pagesDuplicated++;
+}
+
+/* memory[] equals machineBase now, flag every page so that the first write to it is seen */
+static void machine_arm()
+{
+	for (int i = 0; i < machineDirtyCount; i++)
+	{
+		machineDirty[machineDirtyList[i]] = false;
+	}
+	machineDirtyCount = 0;
+	for (int page = 0; page < PAGE_COUNT; page++)
+	{
+		pageFlags[page] |= PAGE_COW;
+	}
+	machineBaseValid = true;
+}
+
+void machine_on_write(uint16_t index)
+{
+	int page = index >> PAGE_SHIFT;
+	pageFlags[page] &= (uint8_t)~PAGE_COW;
+	if (!machineDirty[page])
+	{
+		machineDirty[page] = true;
+		machineDirtyList[machineDirtyCount++] = (uint16_t)page;
+	}
+}
+
+void machine_forget_base()
+{
+	machineBaseValid = false;
+	hang_reset();
+}
+
+void machine_clone(struct lc3Machine* machine)
+{
+	if (!machineBaseValid)
+	{
+		for (int page = 0; page < PAGE_COUNT; page++)
+		{
+			machine_capture_page(page);
+		}
+	}
+	else
+	{
+		for (int i = 0; i < machineDirtyCount; i++)
+		{
+			machine_capture_page(machineDirtyList[i]);
+		}
+		if (!machineDirty[DEVICE_PAGE])
+		{
+			machine_capture_page(DEVICE_PAGE);
+		}
+	}
+	machine_arm();
+
+	memcpy(machine->regs, reg, sizeof(machine->regs));
+	machine->keyPressed = keyPressed;
+	machine->lastKeyPressed = lastKeyPressed;
+	machine->psr = psr;
+	machine->savedSSP = savedSSP;
+	machine->savedUSP = savedUSP;
+	machine->isRunning = isRunning;
+	machine->retiredCount = retiredCount;
+	machine->callDepth = callDepth;
+	for (int page = 0; page < PAGE_COUNT; page++)
+	{
+		machine->pages[page] = machineBase[page];
+	}
+	machineCounters.clones++;
+}
+
+void machine_switch(const struct lc3Machine& machine)
+{
+	for (int page = 0; page < PAGE_COUNT; page++)
+	{
+		const std::shared_ptr<const struct lc3Page>& target = machine.pages[page];
+		if (machineBaseValid && !machineDirty[page] && page != DEVICE_PAGE && machineBase[page] == target)
+		{
+			continue;
+		}
+
+		uint16_t* words = &memory[page << PAGE_SHIFT];
+		if (!page_equal(words, target))
+		{
+			machine_invalidate_changed(page, target->words);
+			memcpy(words, target->words, sizeof(target->words));
+			machineCounters.pagesRestored++;
+		}
+		machineBase[page] = target;
+	}
+	machine_arm();
+
+	memcpy(reg, machine.regs, sizeof(machine.regs));
+	keyPressed = machine.keyPressed;
+	lastKeyPressed = machine.lastKeyPressed;
+	psr = machine.psr;
+	savedSSP = machine.savedSSP;
+	savedUSP = machine.savedUSP;
+	isRunning = machine.isRunning;
+	retiredCount = machine.retiredCount;
+	callDepth = machine.callDepth;
+
+	journal_reset();
+	hang_reset();
+	machineCounters.switches++;
+}
+
+void machine_baseline()
+{
+	machine_clone(&machineBaseline);
+	machineBaselineValid = true;
+}
+
+bool machine_reset()
+{
+	if (!machineBaselineValid)
+	{
+		return false;
+	}
+	machine_switch(machineBaseline);
+	machineCounters.resets++;
+	return true;
+}
+
+void machine_stats(struct lc3MachineStats* stats)
+{
+	*stats = machineCounters;
+}
@@ -1,4 +1,5 @@
 #include "lc3vmwin_memory.hpp"
+#include "lc3vmwin_machine.hpp"
 #include <iomanip>
 #include <math.h> 
 
@@ -23,11 +24,15 @@ LC3VMMemoryWindow::LC3VMMemoryWindow()
     memoryEditedIndexLocked = false;
     quitSignal = false;
     addressInputMode = false;
+    memorySource = nullptr;
+    highlightWord = -1;
+    heatKind = HEAT_ALL;
 }
 
 LC3VMMemoryWindow::LC3VMMemoryWindow(uint16_t* memory, size_t memorySize, const WindowConfig& config)
 {
     assert(memory != nullptr);
+    memorySource = memory;
 
     buffer = std::vector<Glyph>(memorySize, {0, 255, 255, 255});
     bufferSize = memorySize;
@@ -73,6 +78,78 @@ LC3VMMemoryWindow::LC3VMMemoryWindow(uint16_t* memory, size_t memorySize, const
     memoryEditedIndexLocked = false;
     quitSignal = false;
     // char memoryEditedBackup = 0;
+    addressInputMode = false;
+    highlightWord = -1;
+    heatKind = HEAT_ALL;
+}
+
+void LC3VMMemoryWindow::Refresh()
+{
+    /*
+        buffer[] is a byte copy of the VM memory taken by the constructor, so without this the window
+        would keep showing the memory as it was at load time. Only the visible page (512 bytes) is copied.
+    */
+    if (memorySource == nullptr)
+    {
+        return;
+    }
+
+    for (size_t i = initialAddress; i < initialAddress + 32 * 16 && i + 1 < (size_t)bufferSize; i += 2)
+    {
+        uint16_t word = memorySource[i / 2];
+        buffer[i].ch = (unsigned char)(word >> 8);
+        buffer[i + 1].ch = (unsigned char)(word & 0x00FF);
+    }
+}
+
+void LC3VMMemoryWindow::Highlight_Word(uint16_t address)
+{
+    highlightWord = address;
+
+    /* Same alignment rule as the address input box: whole pages of 32 rows */
+    uint32_t byteIndex = (uint32_t)address * 2;
+    initialAddress = (byteIndex / 0x200) * 0x200;
+    if (initialAddress > (uint32_t)bufferSize - 0x200)
+    {
+        initialAddress = (uint32_t)bufferSize - 0x200;
+    }
+}
+
+ImU32 LC3VMMemoryWindow::Heat_Color(uint16_t address, uint32_t heatMax)
+{
+    uint32_t count = heatmap_get(address, heatKind);
+    if (count == 0 || heatMax == 0)
+    {
+        return 0;
+    }
+
+    /*
+        EXPLAIN: Log scale against the hottest word on the page, otherwise a single polling loop
+        running a million times washes out everything else. Cold words are dim yellow, hot ones bright red.
+    */
+    float t = (float)(log1p((double)count) / log1p((double)heatMax));
+    int green = (int)(200.0f * (1.0f - t));
+    int alpha = 48 + (int)(192.0f * t);
+    return IM_COL32(255, green, 0, alpha);
+}
+
+void LC3VMMemoryWindow::Draw_Heatmap_Controls()
+{
+    bool enabled = heatmapEnabled;
+    if (ImGui::Checkbox("Heatmap", &enabled))
+    {
+        heatmap_enable(enabled);
+    }
+    ImGui::SameLine();
+    ImGui::PushItemWidth(100);
+    const char* kinds[] = {"Execute", "Read", "Write", "All"};
+    ImGui::Combo("##heatKind", &heatKind, kinds, IM_ARRAYSIZE(kinds));
+    ImGui::PopItemWidth();
+    ImGui::SameLine();
+    if (ImGui::Button("Clear"))
+    {
+        heatmap_clear();
+    }
 }
 
 void LC3VMMemoryWindow::Draw()
@@ -94,6 +171,8 @@ void LC3VMMemoryWindow::Draw()
     ImGui::SetNextWindowPos(winPos);
     ImGui::SetNextWindowSizeConstraints(minWindowSize, initialWindowSize);
 
+    Refresh();
+
     ImGui::Begin(
         "Memory Watch Window",
         nullptr,
@@ -181,6 +260,17 @@ void LC3VMMemoryWindow::Draw()
     const char* text = " 00";
     ImVec2 textSize = ImGui::CalcTextSize(text);    // to get correct Selectable size for each glyph (note that the length also includes the prefix space)
 
+    // EXPLAIN: The heat colors are relative to the hottest word of the visible page
+    uint32_t heatMax = 0;
+    if (heatmapEnabled)
+    {
+        for (size_t i = initialAddress; i < initialAddress + 32 * 16; i += 2)
+        {
+            uint32_t count = heatmap_get((uint16_t)(i / 2), heatKind);
+            heatMax = count > heatMax ? count : heatMax;
+        }
+    }
+
     // static ImGuiListClipper clipper;
     // clipper.Begin(bufferSize / 16);
     // while (clipper.Step())
@@ -216,7 +306,29 @@ void LC3VMMemoryWindow::Draw()
 
         /* Memory display started */
 
-        if (ImGui::Selectable(byteHex.c_str(), selection[i], ImGuiSelectableFlags_AllowDoubleClick, textSize))
+        if (heatMax > 0)
+        {
+            ImU32 heat = Heat_Color((uint16_t)(i / 2), heatMax);
+            if (heat != 0)
+            {
+                ImVec2 cellPos = ImGui::GetCursorScreenPos();
+                ImGui::GetWindowDrawList()->AddRectFilled(cellPos, {cellPos.x + textSize.x, cellPos.y + textSize.y}, heat);
+            }
+        }
+
+        // EXPLAIN: Each glyph carries its own color, a highlighted word (2 bytes) overrides it
+        if ((int)(i / 2) == highlightWord)
+        {
+            ImGui::PushStyleColor(ImGuiCol_Text, IM_COL32(255, 64, 64, 255));
+        }
+        else
+        {
+            ImGui::PushStyleColor(ImGuiCol_Text, IM_COL32(buffer[i].r, buffer[i].g, buffer[i].b, 255));
+        }
+        bool selected = ImGui::Selectable(byteHex.c_str(), selection[i], ImGuiSelectableFlags_AllowDoubleClick, textSize);
+        ImGui::PopStyleColor();
+
+        if (selected)
         {
             selection[i] = !selection[i];
             /* Capture mouse double click */
@@ -349,7 +461,8 @@ void LC3VMMemoryWindow::Draw()
     }
 
     ImGui::PopItemWidth();
-    
+
+    Draw_Heatmap_Controls();
 
     /* If we are in Editor Mode, popup the editor window */
 
@@ -366,11 +479,26 @@ void LC3VMMemoryWindow::Draw()
     {
         // This part needs to be separated from the previous if(editorMode) block
         // I haven't figured out why yet
-        char buf = 0;
         char original = buffer[memoryEditedIndex].ch;
+        // EXPLAIN: Start from the original, if the editor window is collapsed Editor() never writes buf
+        char buf = original;
         Editor(mousePos, &buf, original);
         // dump the new value (or the original if the new value is not proper) back to the memory
         buffer[memoryEditedIndex].ch = buf;
+        // EXPLAIN: Write through to the VM as well, otherwise Refresh() puts the old byte back next frame
+        if (memorySource != nullptr)
+        {
+            uint16_t& word = memorySource[memoryEditedIndex / 2];
+            if (memoryEditedIndex % 2 == 0)
+            {
+                word = (uint16_t)((word & 0x00FF) | ((uint16_t)(unsigned char)buf << 8));
+            }
+            else
+            {
+                word = (uint16_t)((word & 0xFF00) | (unsigned char)buf);
+            }
+            machine_forget_base();
+        }
         // Release memoryEditedIndexLocked for next edit
         memoryEditedIndexLocked = false;
     }
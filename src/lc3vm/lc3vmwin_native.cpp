@@ -0,0 +1,116 @@
+/*
+	Native services through the reserved opcode, see lc3vmwin_native.hpp
+*/
+
+#include "lc3vmwin_native.hpp"
+#include "lc3vmwin_core.hpp"
+#include "lc3vmwin_display.hpp"
+
+bool nativeEnabled = false;
+
+static void native_memcpy()
+{
+	uint16_t to = reg[R_R0];
+	uint16_t from = reg[R_R1];
+	uint16_t count = reg[R_R2];
+	// EXPLAIN: Backwards when the destination is above the source inside the range, so nothing is read after it was overwritten
+	if ((uint16_t)(to - from) < count)
+	{
+		for (uint16_t k = count; k > 0; k--)
+		{
+			write_memory((uint16_t)(to + k - 1), read_memory((uint16_t)(from + k - 1)));
+		}
+		return;
+	}
+	for (uint16_t k = 0; k < count; k++)
+	{
+		write_memory((uint16_t)(to + k), read_memory((uint16_t)(from + k)));
+	}
+}
+
+static void native_memset()
+{
+	for (uint16_t k = 0; k < reg[R_R2]; k++)
+	{
+		write_memory((uint16_t)(reg[R_R0] + k), reg[R_R1]);
+	}
+}
+
+static void native_mul()
+{
+	uint32_t product = (uint32_t)reg[R_R0] * reg[R_R1];
+	reg[R_R0] = (uint16_t)product;
+	reg[R_R1] = (uint16_t)(product >> 16);
+	update_flag(reg[R_R0]);
+}
+
+static void native_div()
+{
+	uint16_t dividend = reg[R_R0];
+	uint16_t divisor = reg[R_R1];
+	reg[R_R0] = divisor == 0 ? 0xFFFF : (uint16_t)(dividend / divisor);
+	reg[R_R1] = divisor == 0 ? dividend : (uint16_t)(dividend % divisor);
+	update_flag(reg[R_R0]);
+}
+
+static void native_hash()
+{
+	uint32_t hash = 2166136261u;
+	for (uint16_t k = 0; k < reg[R_R1]; k++)
+	{
+		hash = (hash ^ read_memory((uint16_t)(reg[R_R0] + k))) * 16777619u;
+	}
+	reg[R_R0] = (uint16_t)(hash ^ (hash >> 16));
+	update_flag(reg[R_R0]);
+}
+
+static void native_putsn()
+{
+	char text[256];
+	uint16_t count = reg[R_R1];
+	for (uint16_t k = 0; k < count; )
+	{
+		// EXPLAIN: One display_write() per 256 characters instead of one per character
+		size_t length = 0;
+		for (; length < sizeof(text) && k < count; length++, k++)
+		{
+			text[length] = (char)read_memory((uint16_t)(reg[R_R0] + k));
+		}
+		display_write(text, length);
+	}
+}
+
+struct lc3NativeEntry nativeServices[NATIVE_SERVICE_MAX] = {
+	{nullptr, nullptr},
+	{"memcpy", &native_memcpy},
+	{"memset", &native_memset},
+	{"mul", &native_mul},
+	{"div", &native_div},
+	{"hash", &native_hash},
+	{"putsn", &native_putsn}
+};
+
+bool native_register(int id, const char* name, void (*call)())
+{
+	if (id < 0 || id >= NATIVE_SERVICE_MAX)
+	{
+		return false;
+	}
+	nativeServices[id] = {name, call};
+	return true;
+}
+
+bool native_call(uint16_t instr)
+{
+	if (instr & 0x0F00)
+	{
+		return false;
+	}
+	struct lc3NativeEntry& service = nativeServices[instr & 0x00FF];
+	if (service.call == nullptr)
+	{
+		return false;
+	}
+	service.call();
+	return true;
+}
@@ -0,0 +1,99 @@
+#include "lc3vmwin_profiler.hpp"
+#include "lc3vmwin_symbols.hpp"
+#include <cstdio>
+#include <cstring>
+
+LC3VMProfilerWindow::LC3VMProfilerWindow()
+{
+    initialWindowSize = {0, 0};
+    minWindowSize = {0, 0};
+    winPos = {0, 0};
+
+    disabled = false;
+    strcpy(exportPath, "profile.folded");
+    report.reserve(64);
+}
+
+void LC3VMProfilerWindow::Load_Config(const WindowConfig& config)
+{
+    initialWindowSize = config.initialWindowSize;
+    minWindowSize = config.minWindowSize;
+    winPos = config.winPos;
+}
+
+void LC3VMProfilerWindow::Draw()
+{
+    if (disabled)
+    {
+        return;
+    }
+
+    ImGui::SetNextWindowPos(winPos, ImGuiCond_FirstUseEver);
+    ImGui::SetNextWindowSize(initialWindowSize, ImGuiCond_FirstUseEver);
+
+    if (!ImGui::Begin("Profiler"))
+    {
+        ImGui::End();
+        return;
+    }
+
+    ImGui::Checkbox("Enabled", &profilerEnabled);
+    ImGui::SameLine();
+    if (ImGui::Button("Reset"))
+    {
+        profiler_reset(profNodes[0].function);
+    }
+
+    ImGui::PushItemWidth(200);
+    ImGui::InputText("##exportPath", exportPath, IM_ARRAYSIZE(exportPath));
+    ImGui::PopItemWidth();
+    ImGui::SameLine();
+    if (ImGui::Button("Export collapsed stacks"))
+    {
+        exportStatus = profiler_export(exportPath) ? std::string("written to ") + exportPath : std::string("failed to write ") + exportPath;
+    }
+    if (!exportStatus.empty())
+    {
+        ImGui::TextUnformatted(exportStatus.c_str());
+    }
+
+    // EXPLAIN: Folding the tree is cheap next to rendering, no need to cache the report between frames
+    profiler_report(report);
+    uint64_t total = profiler_total();
+    ImGui::Text("Instructions: %llu  Call paths: %d/%d", (unsigned long long)total, profNodeCount, PROFILER_NODE_MAX);
+
+    if (ImGui::BeginTable("profile", 6, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY))
+    {
+        ImGui::TableSetupColumn("Subroutine");
+        ImGui::TableSetupColumn("Calls");
+        ImGui::TableSetupColumn("Exclusive");
+        ImGui::TableSetupColumn("Excl %");
+        ImGui::TableSetupColumn("Inclusive");
+        ImGui::TableSetupColumn("Incl %");
+        ImGui::TableHeadersRow();
+
+        char buffer[SYMBOL_NAME_MAX];
+        for (const struct lc3ProfEntry& entry : report)
+        {
+            double exclusivePercent = total ? 100.0 * (double)entry.exclusive / (double)total : 0.0;
+            double inclusivePercent = total ? 100.0 * (double)entry.inclusive / (double)total : 0.0;
+
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(symbols_label(entry.function, buffer));
+            ImGui::TableNextColumn();
+            ImGui::Text("%u", entry.calls);
+            ImGui::TableNextColumn();
+            ImGui::Text("%llu", (unsigned long long)entry.exclusive);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f", exclusivePercent);
+            ImGui::TableNextColumn();
+            ImGui::Text("%llu", (unsigned long long)entry.inclusive);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f", inclusivePercent);
+        }
+        ImGui::EndTable();
+    }
+
+    ImGui::End();
+}
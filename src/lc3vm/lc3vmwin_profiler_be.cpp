@@ -0,0 +1,169 @@
+/*
+	Call tree profiler, see lc3vmwin_profiler_be.hpp
+*/
+
+#include "lc3vmwin_profiler_be.hpp"
+#include "lc3vmwin_symbols.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+
+struct lc3ProfNode profNodes[PROFILER_NODE_MAX];
+int profNodeCount = 0;
+bool profilerEnabled = true;
+
+/* EXPLAIN: profPath[d] is the node of callStack[d - 1], profPath[0] is the root */
+static int profPath[CALLSTACK_MAX + 1];
+static int profDepth = 0;
+
+static int profiler_child(int parent, uint16_t function)
+{
+	for (int child = profNodes[parent].firstChild; child != -1; child = profNodes[child].nextSibling)
+	{
+		if (profNodes[child].function == function)
+		{
+			return child;
+		}
+	}
+
+	// EXPLAIN: Out of nodes, keep charging the caller rather than losing the counts
+	if (profNodeCount >= PROFILER_NODE_MAX)
+	{
+		return parent;
+	}
+
+	int index = profNodeCount++;
+	profNodes[index] = {function, parent, -1, profNodes[parent].firstChild, 0, 0};
+	profNodes[parent].firstChild = index;
+	return index;
+}
+
+void profiler_reset(uint16_t entry)
+{
+	profNodes[0] = {entry, -1, -1, -1, 1, 0};
+	profNodeCount = 1;
+	profPath[0] = 0;
+	profDepth = 0;
+	profiler_sync();
+}
+
+void profiler_count(uint32_t count)
+{
+	profNodes[profPath[profDepth]].self += count;
+}
+
+void profiler_sync()
+{
+	// EXPLAIN: A RET can drop several frames at once, a JSR only ever adds one but resetting mid-call adds them all
+	while (profDepth < callDepth)
+	{
+		int node = profiler_child(profPath[profDepth], callStack[profDepth].target);
+		profNodes[node].calls++;
+		profPath[++profDepth] = node;
+	}
+	if (profDepth > callDepth)
+	{
+		profDepth = callDepth;
+	}
+}
+
+uint64_t profiler_total()
+{
+	uint64_t total = 0;
+	for (int i = 0; i < profNodeCount; i++)
+	{
+		total += profNodes[i].self;
+	}
+	return total;
+}
+
+/*
+	EXPLAIN: Returns the inclusive count of node. A subroutine that is already on the path
+	(recursion) doesn't get its inclusive count added a second time.
+*/
+static uint64_t profiler_fold(int node, std::unordered_map<uint16_t, struct lc3ProfEntry>& entries, std::unordered_map<uint16_t, int>& onPath)
+{
+	uint16_t function = profNodes[node].function;
+	struct lc3ProfEntry& entry = entries.emplace(function, lc3ProfEntry{function, 0, 0, 0}).first->second;
+	entry.calls += profNodes[node].calls;
+	entry.exclusive += profNodes[node].self;
+
+	int& depth = onPath[function];
+	depth++;
+
+	uint64_t inclusive = profNodes[node].self;
+	for (int child = profNodes[node].firstChild; child != -1; child = profNodes[child].nextSibling)
+	{
+		inclusive += profiler_fold(child, entries, onPath);
+	}
+
+	// EXPLAIN: unordered_map never moves its elements, entry and depth are still valid after the recursion
+	depth--;
+	if (depth == 0)
+	{
+		entry.inclusive += inclusive;
+	}
+	return inclusive;
+}
+
+void profiler_report(std::vector<struct lc3ProfEntry>& report)
+{
+	report.clear();
+	if (profNodeCount == 0)
+	{
+		return;
+	}
+
+	std::unordered_map<uint16_t, struct lc3ProfEntry> entries;
+	std::unordered_map<uint16_t, int> onPath;
+	profiler_fold(0, entries, onPath);
+
+	for (auto& it : entries)
+	{
+		report.push_back(it.second);
+	}
+	std::sort(report.begin(), report.end(), [](const lc3ProfEntry& a, const lc3ProfEntry& b) {
+		return a.inclusive > b.inclusive;
+	});
+}
+
+bool profiler_export(const char* path)
+{
+	FILE* fp = fopen(path, "w");
+	if (!fp)
+	{
+		printf("Failed to write profile to %s\n", path);
+		return false;
+	}
+
+	char buffer[SYMBOL_NAME_MAX];
+	for (int i = 0; i < profNodeCount; i++)
+	{
+		if (profNodes[i].self == 0)
+		{
+			continue;
+		}
+
+		// EXPLAIN: Walk up to the root then print the frames outermost first
+		std::vector<int> frames;
+		for (int node = i; node != -1; node = profNodes[node].parent)
+		{
+			frames.push_back(node);
+		}
+
+		std::string line;
+		for (auto it = frames.rbegin(); it != frames.rend(); ++it)
+		{
+			if (!line.empty())
+			{
+				line += ';';
+			}
+			line += symbols_label(profNodes[*it].function, buffer);
+		}
+		fprintf(fp, "%s %llu\n", line.c_str(), (unsigned long long)profNodes[i].self);
+	}
+
+	fclose(fp);
+	return true;
+}
@@ -0,0 +1,208 @@
+/*
+	Frame rewind buffer, XOR deltas of memory[] between rendered frames
+*/
+
+#include "lc3vmwin_rewind.hpp"
+#include "lc3vmwin_core.hpp"
+#include "lc3vmwin_callstack.hpp"
+#include "lc3vmwin_journal.hpp"
+#include "lc3vmwin_machine.hpp"
+#include "lc3vmwin_input.hpp"
+
+#include <cstring>
+#include <deque>
+#include <vector>
+
+struct rewindSample
+{
+	uint16_t regs[R_COUNT];
+	bool keyPressed;
+	uint8_t lastKeyPressed;
+	uint16_t psr;
+	uint16_t savedSSP;
+	uint16_t savedUSP;
+	uint64_t retiredCount;
+	int callDepth;
+	std::vector<uint8_t> delta;     // memory of this sample XOR the one before, empty for the oldest
+};
+
+bool rewindEnabled = true;
+
+static std::deque<struct rewindSample> rewindSamples;
+// EXPLAIN: memory[] as of the newest sample, the deltas are taken against it
+static std::vector<uint16_t> rewindBase;
+static size_t rewindBytes = 0;
+
+static void put_varint(std::vector<uint8_t>& out, uint32_t value)
+{
+	while (value >= 0x80)
+	{
+		out.push_back((uint8_t)(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back((uint8_t)value);
+}
+
+static uint32_t get_varint(const uint8_t*& p)
+{
+	uint32_t value = 0;
+	for (int shift = 0; ; shift += 7)
+	{
+		uint8_t byte = *p++;
+		value |= (uint32_t)(byte & 0x7F) << shift;
+		if (!(byte & 0x80))
+		{
+			return value;
+		}
+	}
+}
+
+/* XORs memory[] into rewindBase (leaving it equal to memory[]) and encodes the difference */
+static void rewind_encode(std::vector<uint8_t>& out)
+{
+	uint32_t skip = 0;
+	int i = 0;
+	while (i < MAX_SIZE)
+	{
+		// EXPLAIN: Most pages don't change from one frame to the next, memcmp() gets through them much faster than a loop
+		if ((i & (PAGE_WORDS - 1)) == 0 && memcmp(&memory[i], &rewindBase[(size_t)i], PAGE_WORDS * sizeof(uint16_t)) == 0)
+		{
+			skip += PAGE_WORDS;
+			i += PAGE_WORDS;
+			continue;
+		}
+		if (memory[i] == rewindBase[(size_t)i])
+		{
+			skip++;
+			i++;
+			continue;
+		}
+
+		int begin = i;
+		while (i < MAX_SIZE && memory[i] != rewindBase[(size_t)i])
+		{
+			i++;
+		}
+		put_varint(out, skip);
+		put_varint(out, (uint32_t)(i - begin));
+		for (int j = begin; j < i; j++)
+		{
+			uint16_t x = (uint16_t)(memory[j] ^ rewindBase[(size_t)j]);
+			out.push_back((uint8_t)x);
+			out.push_back((uint8_t)(x >> 8));
+			rewindBase[(size_t)j] = memory[j];
+		}
+		skip = 0;
+	}
+}
+
+/* Applies a delta to rewindBase, which then holds the memory of the sample before */
+static void rewind_decode(const std::vector<uint8_t>& delta)
+{
+	const uint8_t* p = delta.data();
+	const uint8_t* end = p + delta.size();
+	size_t address = 0;
+	while (p < end)
+	{
+		address += get_varint(p);
+		uint32_t count = get_varint(p);
+		for (uint32_t j = 0; j < count; j++, address++, p += 2)
+		{
+			rewindBase[address] ^= (uint16_t)(p[0] | (p[1] << 8));
+		}
+	}
+}
+
+void rewind_reset()
+{
+	rewindSamples.clear();
+	rewindBytes = 0;
+}
+
+static void rewind_drop_oldest()
+{
+	rewindBytes -= rewindSamples.front().delta.size();
+	rewindSamples.pop_front();
+	// EXPLAIN: Nothing goes back past the oldest sample, so its delta is dead weight
+	struct rewindSample& oldest = rewindSamples.front();
+	rewindBytes -= oldest.delta.size();
+	std::vector<uint8_t>().swap(oldest.delta);
+}
+
+void rewind_capture()
+{
+	if (!rewindEnabled)
+	{
+		return;
+	}
+	if (!rewindSamples.empty() && rewindSamples.back().retiredCount == retiredCount)
+	{
+		return;
+	}
+
+	struct rewindSample sample;
+	memcpy(sample.regs, reg, sizeof(sample.regs));
+	sample.keyPressed = keyPressed;
+	sample.lastKeyPressed = lastKeyPressed;
+	sample.psr = psr;
+	sample.savedSSP = savedSSP;
+	sample.savedUSP = savedUSP;
+	sample.retiredCount = retiredCount;
+	sample.callDepth = callDepth;
+
+	if (rewindSamples.empty())
+	{
+		rewindBase.assign(memory, memory + MAX_SIZE);
+	}
+	else
+	{
+		rewind_encode(sample.delta);
+		rewindBytes += sample.delta.size();
+	}
+	rewindSamples.push_back(std::move(sample));
+
+	while (rewindSamples.size() > REWIND_SAMPLES || (rewindBytes > REWIND_BYTES_MAX && rewindSamples.size() > 1))
+	{
+		rewind_drop_oldest();
+	}
+}
+
+bool rewind_step_back()
+{
+	if (rewindSamples.size() < 2)
+	{
+		return false;
+	}
+
+	rewind_decode(rewindSamples.back().delta);
+	rewindBytes -= rewindSamples.back().delta.size();
+	rewindSamples.pop_back();
+
+	const struct rewindSample& sample = rewindSamples.back();
+	memcpy(reg, sample.regs, sizeof(sample.regs));
+	memcpy(memory, rewindBase.data(), MAX_SIZE * sizeof(uint16_t));
+	machine_forget_base();
+	keyPressed = sample.keyPressed;
+	lastKeyPressed = sample.lastKeyPressed;
+	psr = sample.psr;
+	savedSSP = sample.savedSSP;
+	savedUSP = sample.savedUSP;
+	retiredCount = sample.retiredCount;
+	// EXPLAIN: Only the depth, a frame a later JSR overwrote stays overwritten. Not worth 1.5 KB per frame for a debugging aid
+	callDepth = sample.callDepth;
+
+	// EXPLAIN: The journal's history belongs to the future we just left
+	journal_reset();
+	input_rewound();
+	return true;
+}
+
+size_t rewind_count()
+{
+	return rewindSamples.size();
+}
+
+size_t rewind_bytes()
+{
+	return rewindBytes;
+}
@@ -0,0 +1,509 @@
+/*
+	Save states, see lc3vmwin_savestate.hpp for the file format
+*/
+
+#include "lc3vmwin_savestate.hpp"
+#include "lc3vmwin_core.hpp"
+#include "lc3vmwin_callstack.hpp"
+#include "lc3vmwin_idiom.hpp"
+#include "lc3vmwin_journal.hpp"
+#include "lc3vmwin_machine.hpp"
+#include "lc3vmwin_trace.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+struct saveSnapshot
+{
+	uint16_t regs[R_COUNT];
+	bool keyPressed;
+	uint8_t lastKeyPressed;
+	uint16_t psr;
+	uint16_t savedSSP;
+	uint16_t savedUSP;
+	bool isRunning;
+	uint64_t retiredCount;
+	int callDepth;
+	struct lc3Frame frames[CALLSTACK_MAX];
+	uint16_t memory[MAX_SIZE];
+	struct lc3SaveHost host;
+	bool hasCache;
+	std::vector<uint16_t> cacheWords;	// per block: address, instructions, the instruction words
+	std::string path;
+};
+
+/* EXPLAIN: Owned by the writer thread while saveBusy is set, nobody else touches it then */
+static struct saveSnapshot saveShot;
+static struct saveSnapshot loadShot;
+static std::thread saveThread;
+static std::atomic<bool> saveBusy(false);
+static std::atomic<bool> saveLastOk(true);
+static std::atomic<uint64_t> saveLastBytes(0);
+static double saveSnapshotMs = 0;
+static uint64_t saveLastStep = 0;
+
+static const uint64_t FNV_OFFSET = 14695981039346656037ull;
+static const uint64_t FNV_PRIME = 1099511628211ull;
+
+static uint64_t savestate_hash(const uint8_t* p, size_t size)
+{
+	uint64_t hash = FNV_OFFSET;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash = (hash ^ p[i]) * FNV_PRIME;
+	}
+	return hash;
+}
+
+static void put_le(std::vector<uint8_t>& out, uint64_t value, int bytes)
+{
+	size_t at = out.size();
+	out.resize(at + (size_t)bytes);
+	trace_put_le(&out[at], value, bytes);
+}
+
+static void put_varint(std::vector<uint8_t>& out, uint32_t value)
+{
+	uint8_t buffer[5];
+	size_t n = trace_put_varint(buffer, value);
+	out.insert(out.end(), buffer, buffer + n);
+}
+
+/* Starts a section, returns where its length goes for section_end() */
+static size_t section_begin(std::vector<uint8_t>& out, const char* tag)
+{
+	out.insert(out.end(), tag, tag + 4);
+	put_le(out, 0, 4);
+	return out.size() - 4;
+}
+
+static void section_end(std::vector<uint8_t>& out, size_t lengthAt)
+{
+	trace_put_le(&out[lengthAt], out.size() - lengthAt - 4, 4);
+}
+
+static void encode_memory(std::vector<uint8_t>& out, const uint16_t* words)
+{
+	/*
+		EXPLAIN:
+		Most of the 64K words are zero, so runs of zeros become a count and everything else is stored as is.
+		A lone zero between two other words stays a literal, a run break would cost as much.
+	*/
+	int i = 0;
+	while (i < MAX_SIZE)
+	{
+		int zeroBegin = i;
+		while (i < MAX_SIZE && words[i] == 0)
+		{
+			i++;
+		}
+		if (i == MAX_SIZE)
+		{
+			return;
+		}
+		int literalBegin = i;
+		while (i < MAX_SIZE && (words[i] != 0 || (i + 1 < MAX_SIZE && words[i + 1] != 0)))
+		{
+			i++;
+		}
+		put_varint(out, (uint32_t)(literalBegin - zeroBegin));
+		put_varint(out, (uint32_t)(i - literalBegin));
+		for (int j = literalBegin; j < i; j++)
+		{
+			put_le(out, words[j], 2);
+		}
+	}
+}
+
+static bool decode_memory(const uint8_t* p, const uint8_t* end, uint16_t* words)
+{
+	memset(words, 0, MAX_SIZE * sizeof(uint16_t));
+	uint32_t address = 0;
+	while (p < end)
+	{
+		uint32_t zeros, count;
+		size_t n = trace_get_varint(p, end, &zeros);
+		if (n == 0)
+		{
+			return false;
+		}
+		p += n;
+		n = trace_get_varint(p, end, &count);
+		if (n == 0)
+		{
+			return false;
+		}
+		p += n;
+		address += zeros;
+		if (address + count > MAX_SIZE || (size_t)(end - p) < (size_t)count * 2)
+		{
+			return false;
+		}
+		for (uint32_t j = 0; j < count; j++, p += 2)
+		{
+			words[address++] = (uint16_t)trace_get_le(p, 2);
+		}
+	}
+	return true;
+}
+
+static void encode_snapshot(const struct saveSnapshot& shot, std::vector<uint8_t>& out)
+{
+	out.insert(out.end(), "LC3STATE", "LC3STATE" + 8);
+	put_le(out, SAVESTATE_VERSION, 4);
+	put_le(out, 0, 4);
+
+	size_t at = section_begin(out, "REGS");
+	for (int i = 0; i < R_COUNT; i++)
+	{
+		put_le(out, shot.regs[i], 2);
+	}
+	put_le(out, shot.keyPressed, 1);
+	put_le(out, shot.lastKeyPressed, 1);
+	put_le(out, shot.isRunning, 1);
+	put_le(out, 0, 1);
+	put_le(out, shot.retiredCount, 8);
+	section_end(out, at);
+
+	at = section_begin(out, "PRIV");
+	put_le(out, shot.psr, 2);
+	put_le(out, shot.savedSSP, 2);
+	put_le(out, shot.savedUSP, 2);
+	section_end(out, at);
+
+	at = section_begin(out, "MEMZ");
+	encode_memory(out, shot.memory);
+	section_end(out, at);
+
+	at = section_begin(out, "CALL");
+	put_le(out, (uint32_t)shot.callDepth, 4);
+	for (int i = 0; i < shot.callDepth && i < CALLSTACK_MAX; i++)
+	{
+		put_le(out, shot.frames[i].callSite, 2);
+		put_le(out, shot.frames[i].target, 2);
+		put_le(out, shot.frames[i].returnAddress, 2);
+	}
+	section_end(out, at);
+
+	at = section_begin(out, "HOST");
+	put_le(out, shot.host.inputPosition, 8);
+	out.insert(out.end(), shot.host.console.begin(), shot.host.console.end());
+	section_end(out, at);
+
+	if (shot.hasCache)
+	{
+		at = section_begin(out, "CACH");
+		uint32_t blocks = 0;
+		size_t countAt = out.size();
+		put_le(out, 0, 4);
+		for (size_t i = 0; i < shot.cacheWords.size(); i += 2u + shot.cacheWords[i + 1])
+		{
+			for (size_t j = 0; j < 2u + shot.cacheWords[i + 1]; j++)
+			{
+				put_le(out, shot.cacheWords[i + j], 2);
+			}
+			blocks++;
+		}
+		trace_put_le(&out[countAt], blocks, 4);
+		section_end(out, at);
+	}
+
+	uint64_t hash = savestate_hash(out.data(), out.size());
+	at = section_begin(out, "END ");
+	put_le(out, hash, 8);
+	section_end(out, at);
+}
+
+static void savestate_writer_main()
+{
+	std::vector<uint8_t> out;
+	out.reserve(64 * 1024);
+	encode_snapshot(saveShot, out);
+
+	// EXPLAIN: Written aside and renamed, the checkpoint on disk is always a complete one
+	std::string tempPath = saveShot.path + ".tmp";
+	bool ok = false;
+	FILE* file = fopen(tempPath.c_str(), "wb");
+	if (file)
+	{
+		ok = fwrite(out.data(), 1, out.size(), file) == out.size();
+		ok = (fclose(file) == 0) && ok;
+		if (ok)
+		{
+			// EXPLAIN: POSIX rename() replaces the old file in one go, Windows wants it gone first
+			ok = rename(tempPath.c_str(), saveShot.path.c_str()) == 0;
+			if (!ok)
+			{
+				remove(saveShot.path.c_str());
+				ok = rename(tempPath.c_str(), saveShot.path.c_str()) == 0;
+			}
+		}
+	}
+	if (!ok)
+	{
+		printf("Failed to write save state %s\n", saveShot.path.c_str());
+	}
+
+	saveLastBytes = ok ? out.size() : 0;
+	saveLastOk = ok;
+	saveBusy = false;
+}
+
+bool savestate_wait()
+{
+	if (saveThread.joinable())
+	{
+		saveThread.join();
+	}
+	return saveLastOk;
+}
+
+void savestate_save(const char* path, const struct lc3SaveHost& hostState, bool withCache)
+{
+	savestate_wait();
+
+	auto begin = std::chrono::steady_clock::now();
+	memcpy(saveShot.regs, reg, sizeof(saveShot.regs));
+	memcpy(saveShot.memory, memory, sizeof(saveShot.memory));
+	saveShot.keyPressed = keyPressed;
+	saveShot.lastKeyPressed = lastKeyPressed;
+	saveShot.psr = psr;
+	saveShot.savedSSP = savedSSP;
+	saveShot.savedUSP = savedUSP;
+	saveShot.isRunning = isRunning;
+	saveShot.retiredCount = retiredCount;
+	saveShot.callDepth = callDepth;
+	memcpy(saveShot.frames, callStack, sizeof(saveShot.frames));
+	saveShot.host = hostState;
+	saveShot.hasCache = withCache;
+	saveShot.cacheWords.clear();
+	if (withCache)
+	{
+		for (int i = 0; i < cacheCount; i++)
+		{
+			saveShot.cacheWords.push_back(codeCache[i].lc3MemAddress);
+			saveShot.cacheWords.push_back((uint16_t)codeCache[i].numInstr);
+			saveShot.cacheWords.insert(saveShot.cacheWords.end(), codeCache[i].codeBlock, codeCache[i].codeBlock + codeCache[i].numInstr);
+		}
+	}
+	saveShot.path = path;
+	saveSnapshotMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+	saveLastStep = retiredCount;
+
+	saveBusy = true;
+	saveThread = std::thread(savestate_writer_main);
+}
+
+void savestate_status(struct lc3SaveStatus* status)
+{
+	status->busy = saveBusy;
+	status->lastOk = saveLastOk;
+	status->lastBytes = saveLastBytes;
+	status->lastSnapshotMs = saveSnapshotMs;
+	status->lastStep = saveLastStep;
+}
+
+/* Parses a whole file into loadShot, false if anything about it is off */
+static bool savestate_parse(const std::vector<uint8_t>& file)
+{
+	if (file.size() < SAVESTATE_HEADER_BYTES || memcmp(file.data(), "LC3STATE", 8) != 0)
+	{
+		return false;
+	}
+	uint32_t version = (uint32_t)trace_get_le(&file[8], 4);
+	if (version == 0 || version > SAVESTATE_VERSION)
+	{
+		printf("Save state version %u is not supported\n", version);
+		return false;
+	}
+
+	bool hasRegs = false;
+	bool hasMemory = false;
+	bool hasEnd = false;
+	loadShot.psr = PSR_USER;
+	loadShot.savedSSP = 0x3000;
+	loadShot.savedUSP = 0;
+	loadShot.callDepth = 0;
+	loadShot.host.inputPosition = 0;
+	loadShot.host.console.clear();
+	loadShot.hasCache = false;
+	loadShot.cacheWords.clear();
+
+	size_t at = SAVESTATE_HEADER_BYTES;
+	while (!hasEnd && at + 8 <= file.size())
+	{
+		const uint8_t* tag = &file[at];
+		size_t length = (size_t)trace_get_le(&file[at + 4], 4);
+		const uint8_t* p = &file[at + 8];
+		if (length > file.size() - at - 8)
+		{
+			return false;
+		}
+		const uint8_t* end = p + length;
+
+		if (memcmp(tag, "REGS", 4) == 0 && length >= 2 * R_COUNT + 12)
+		{
+			for (int i = 0; i < R_COUNT; i++, p += 2)
+			{
+				loadShot.regs[i] = (uint16_t)trace_get_le(p, 2);
+			}
+			loadShot.keyPressed = p[0] != 0;
+			loadShot.lastKeyPressed = p[1];
+			loadShot.isRunning = p[2] != 0;
+			loadShot.retiredCount = trace_get_le(p + 4, 8);
+			hasRegs = true;
+		}
+		else if (memcmp(tag, "PRIV", 4) == 0 && length >= 6)
+		{
+			loadShot.psr = (uint16_t)trace_get_le(p, 2);
+			loadShot.savedSSP = (uint16_t)trace_get_le(p + 2, 2);
+			loadShot.savedUSP = (uint16_t)trace_get_le(p + 4, 2);
+		}
+		else if (memcmp(tag, "MEMZ", 4) == 0)
+		{
+			if (!decode_memory(p, end, loadShot.memory))
+			{
+				return false;
+			}
+			hasMemory = true;
+		}
+		else if (memcmp(tag, "CALL", 4) == 0 && length >= 4)
+		{
+			loadShot.callDepth = (int)trace_get_le(p, 4);
+			int frames = loadShot.callDepth < CALLSTACK_MAX ? loadShot.callDepth : CALLSTACK_MAX;
+			if (loadShot.callDepth < 0 || length < 4 + (size_t)frames * 6)
+			{
+				return false;
+			}
+			for (int i = 0; i < frames; i++)
+			{
+				const uint8_t* frame = p + 4 + i * 6;
+				loadShot.frames[i] = {(uint16_t)trace_get_le(frame, 2), (uint16_t)trace_get_le(frame + 2, 2), (uint16_t)trace_get_le(frame + 4, 2)};
+			}
+		}
+		else if (memcmp(tag, "HOST", 4) == 0 && length >= 8)
+		{
+			loadShot.host.inputPosition = trace_get_le(p, 8);
+			loadShot.host.console.assign((const char*)p + 8, (const char*)end);
+		}
+		else if (memcmp(tag, "CACH", 4) == 0 && length >= 4)
+		{
+			uint32_t blocks = (uint32_t)trace_get_le(p, 4);
+			p += 4;
+			for (uint32_t i = 0; i < blocks; i++)
+			{
+				if (end - p < 4)
+				{
+					return false;
+				}
+				uint16_t address = (uint16_t)trace_get_le(p, 2);
+				uint16_t numInstr = (uint16_t)trace_get_le(p + 2, 2);
+				p += 4;
+				if (numInstr == 0 || numInstr > CODE_BLOCK_SIZE || end - p < 2 * numInstr)
+				{
+					return false;
+				}
+				loadShot.cacheWords.push_back(address);
+				loadShot.cacheWords.push_back(numInstr);
+				for (int j = 0; j < numInstr; j++, p += 2)
+				{
+					loadShot.cacheWords.push_back((uint16_t)trace_get_le(p, 2));
+				}
+			}
+			loadShot.hasCache = true;
+		}
+		else if (memcmp(tag, "END ", 4) == 0 && length >= 8)
+		{
+			if (trace_get_le(p, 8) != savestate_hash(file.data(), at))
+			{
+				return false;
+			}
+			hasEnd = true;
+		}
+		at += 8 + length;
+	}
+
+	return hasRegs && hasMemory && hasEnd;
+}
+
+bool savestate_load(const char* path, struct lc3SaveHost* hostState)
+{
+	// EXPLAIN: Loading the file a save is still writing would find the old one, or none
+	savestate_wait();
+
+	FILE* file = fopen(path, "rb");
+	if (!file)
+	{
+		printf("Failed to open save state %s\n", path);
+		return false;
+	}
+	std::vector<uint8_t> data;
+	uint8_t buffer[64 * 1024];
+	size_t n;
+	while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+	{
+		data.insert(data.end(), buffer, buffer + n);
+	}
+	fclose(file);
+
+	if (!savestate_parse(data))
+	{
+		printf("%s is not a valid save state\n", path);
+		return false;
+	}
+
+	/*
+		EXPLAIN:
+		A block is a copy of the instructions it was built from, it only stays valid if its pages didn't change.
+		Reloading a checkpoint of the same program usually changes a few data pages and no code at all.
+	*/
+	for (int page = 0; page < PAGE_COUNT; page++)
+	{
+		int first = page << PAGE_SHIFT;
+		if (memcmp(&memory[first], &loadShot.memory[first], PAGE_WORDS * sizeof(uint16_t)) != 0)
+		{
+			cache_invalidate(first, first + PAGE_WORDS - 1);
+		}
+	}
+	memcpy(memory, loadShot.memory, sizeof(loadShot.memory));
+	machine_forget_base();
+
+	for (size_t i = 0; i < loadShot.cacheWords.size(); i += 2u + loadShot.cacheWords[i + 1])
+	{
+		uint16_t address = loadShot.cacheWords[i];
+		uint16_t numInstr = loadShot.cacheWords[i + 1];
+		if (cacheCount >= CACHE_SIZE_MAX - 1 || cache_find(address).cacheIndex != -1)
+		{
+			continue;
+		}
+		uint16_t* codeBlock = new uint16_t[CODE_BLOCK_SIZE];
+		memcpy(codeBlock, &loadShot.cacheWords[i + 2], numInstr * sizeof(uint16_t));
+		// EXPLAIN: The file keeps only the instructions, the idiom is matched again as cache_create_block() would
+		int idiomHead = 0;
+		uint8_t idiom = idiom_match(codeBlock, numInstr, address, &idiomHead);
+		cache_add({address, numInstr, codeBlock, idiom, idiomHead});
+	}
+
+	memcpy(reg, loadShot.regs, sizeof(loadShot.regs));
+	keyPressed = loadShot.keyPressed;
+	lastKeyPressed = loadShot.lastKeyPressed;
+	psr = loadShot.psr;
+	savedSSP = loadShot.savedSSP;
+	savedUSP = loadShot.savedUSP;
+	isRunning = loadShot.isRunning;
+	retiredCount = loadShot.retiredCount;
+	callDepth = loadShot.callDepth;
+	memcpy(callStack, loadShot.frames, sizeof(loadShot.frames));
+
+	if (hostState)
+	{
+		*hostState = loadShot.host;
+	}
+
+	journal_reset();
+	return true;
+}
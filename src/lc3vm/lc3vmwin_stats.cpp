@@ -0,0 +1,166 @@
+#include "lc3vmwin_stats.hpp"
+#include "lc3vmwin_trap.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+LC3VMStatsWindow::LC3VMStatsWindow()
+{
+    initialWindowSize = {0, 0};
+    minWindowSize = {0, 0};
+    winPos = {0, 0};
+
+    disabled = false;
+    strcpy(dumpPath, "stats.json");
+    branchSites.reserve(256);
+}
+
+void LC3VMStatsWindow::Load_Config(const WindowConfig& config)
+{
+    initialWindowSize = config.initialWindowSize;
+    minWindowSize = config.minWindowSize;
+    winPos = config.winPos;
+}
+
+void LC3VMStatsWindow::Draw()
+{
+    if (disabled)
+    {
+        return;
+    }
+
+    ImGui::SetNextWindowPos(winPos, ImGuiCond_FirstUseEver);
+    ImGui::SetNextWindowSize(initialWindowSize, ImGuiCond_FirstUseEver);
+
+    if (!ImGui::Begin("ISA Stats"))
+    {
+        ImGui::End();
+        return;
+    }
+
+    ImGui::Checkbox("Enabled", &statsEnabled);
+    ImGui::SameLine();
+    if (ImGui::Button("Reset"))
+    {
+        stats_reset();
+    }
+    ImGui::PushItemWidth(200);
+    ImGui::InputText("##dumpPath", dumpPath, IM_ARRAYSIZE(dumpPath));
+    ImGui::PopItemWidth();
+    ImGui::SameLine();
+    if (ImGui::Button("Dump JSON"))
+    {
+        dumpStatus = stats_dump_json(dumpPath) ? std::string("written to ") + dumpPath : std::string("failed to write ") + dumpPath;
+    }
+    if (!dumpStatus.empty())
+    {
+        ImGui::TextUnformatted(dumpStatus.c_str());
+    }
+
+    double total = (double)stats.instructions;
+    double perThousand = total > 0 ? 1000.0 / total : 0.0;
+    ImGui::Text("Instructions: %llu", (unsigned long long)stats.instructions);
+    ImGui::Text(
+        "Dispatcher lookups: %.1f / 1k  Block misses: %.2f / 1k",
+        (double)stats.dispatches * perThousand, (double)stats.blockMisses * perThousand
+    );
+
+    if (ImGui::CollapsingHeader("Opcodes", ImGuiTreeNodeFlags_DefaultOpen))
+    {
+        if (ImGui::BeginTable("opcodes", 3, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+        {
+            ImGui::TableSetupColumn("Variant");
+            ImGui::TableSetupColumn("Count");
+            ImGui::TableSetupColumn("%");
+            ImGui::TableHeadersRow();
+            for (int i = 0; i < STAT_VARIANT_COUNT; i++)
+            {
+                if (stats.variants[i] == 0)
+                {
+                    continue;
+                }
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(stats_variant_name(i));
+                ImGui::TableNextColumn();
+                ImGui::Text("%llu", (unsigned long long)stats.variants[i]);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.2f", total > 0 ? 100.0 * (double)stats.variants[i] / total : 0.0);
+            }
+            ImGui::EndTable();
+        }
+    }
+
+    if (ImGui::CollapsingHeader("Traps", ImGuiTreeNodeFlags_DefaultOpen))
+    {
+        for (int i = 0; i < 256; i++)
+        {
+            if (stats.traps[i] != 0)
+            {
+                // EXPLAIN: A native trap costs host time, one in guest code the instructions of its service routine
+                if (trapTable[i].guest)
+                {
+                    ImGui::Text("x%02X %-6s %llu  guest, %llu instructions", i, stats_trap_name((uint8_t)i), (unsigned long long)stats.traps[i], (unsigned long long)stats.trapInstructions[i]);
+                }
+                else
+                {
+                    ImGui::Text("x%02X %-6s %llu  native, %.3f ms", i, stats_trap_name((uint8_t)i), (unsigned long long)stats.traps[i], (double)stats.trapNanoseconds[i] / 1e6);
+                }
+            }
+        }
+    }
+
+    Draw_Branches();
+
+    if (ImGui::CollapsingHeader("Block lengths"))
+    {
+        // EXPLAIN: Only the first 64 lengths, real code blocks of 2048 are a lot shorter than that anyway
+        float lengths[64];
+        for (int i = 0; i < 64; i++)
+        {
+            lengths[i] = (float)stats.blockLengths[i];
+        }
+        ImGui::PlotHistogram("##lengths", lengths, 64, 0, "instructions per cache_run() (0-63)", 0.0f, FLT_MAX, {480, 120});
+    }
+
+    ImGui::End();
+}
+
+void LC3VMStatsWindow::Draw_Branches()
+{
+    if (!ImGui::CollapsingHeader("Branches", ImGuiTreeNodeFlags_DefaultOpen))
+    {
+        return;
+    }
+
+    uint64_t branches = stats.branchesTaken + stats.branchesNotTaken;
+    ImGui::Text(
+        "Taken %llu  Not taken %llu  (%.1f%% taken)",
+        (unsigned long long)stats.branchesTaken, (unsigned long long)stats.branchesNotTaken,
+        branches ? 100.0 * (double)stats.branchesTaken / (double)branches : 0.0
+    );
+
+    // EXPLAIN: Only the busiest sites, sorting all 64K addresses each frame would be a waste
+    branchSites.clear();
+    for (int i = 0; i < MAX_SIZE; i++)
+    {
+        if (statBranchTaken[i] != 0 || statBranchNotTaken[i] != 0)
+        {
+            branchSites.push_back((uint16_t)i);
+        }
+    }
+    size_t shown = std::min(branchSites.size(), (size_t)STATS_BRANCH_SITES_SHOWN);
+    std::partial_sort(branchSites.begin(), branchSites.begin() + (long)shown, branchSites.end(), [](uint16_t a, uint16_t b) {
+        return (uint64_t)statBranchTaken[a] + statBranchNotTaken[a] > (uint64_t)statBranchTaken[b] + statBranchNotTaken[b];
+    });
+
+    for (size_t i = 0; i < shown; i++)
+    {
+        uint16_t site = branchSites[i];
+        uint64_t count = (uint64_t)statBranchTaken[site] + statBranchNotTaken[site];
+        ImGui::Text(
+            "%#06x  %10llu  %5.1f%% taken",
+            site, (unsigned long long)count, 100.0 * (double)statBranchTaken[site] / (double)count
+        );
+    }
+}
@@ -0,0 +1,186 @@
+/*
+	Dynamic ISA statistics, see lc3vmwin_stats_be.hpp
+*/
+
+#include "lc3vmwin_stats_be.hpp"
+#include "lc3vmwin_trap.hpp"
+#include <cstdio>
+#include <cstring>
+
+struct lc3Stats stats;
+uint32_t statBranchTaken[MAX_SIZE];
+uint32_t statBranchNotTaken[MAX_SIZE];
+bool statsEnabled = false;
+
+static const char* statVariantNames[STAT_VARIANT_COUNT] = {
+	"BR", "ADD_REG", "ADD_IMM", "LD", "ST", "JSR", "JSRR", "AND_REG", "AND_IMM", "LDR",
+	"STR", "RTI", "NOT", "LDI", "STI", "JMP", "RET", "RSV", "LEA", "TRAP"
+};
+
+/* EXPLAIN: Variant of each opcode when its mode bit is clear / set. For JMP the "mode" is BaseR == R7 */
+static const uint8_t statVariantTable[16][2] = {
+	{STAT_BR, STAT_BR},
+	{STAT_ADD_REG, STAT_ADD_IMM},
+	{STAT_LD, STAT_LD},
+	{STAT_ST, STAT_ST},
+	{STAT_JSRR, STAT_JSR},
+	{STAT_AND_REG, STAT_AND_IMM},
+	{STAT_LDR, STAT_LDR},
+	{STAT_STR, STAT_STR},
+	{STAT_RTI, STAT_RTI},
+	{STAT_NOT, STAT_NOT},
+	{STAT_LDI, STAT_LDI},
+	{STAT_STI, STAT_STI},
+	{STAT_JMP, STAT_RET},
+	{STAT_RSV, STAT_RSV},
+	{STAT_LEA, STAT_LEA},
+	{STAT_TRAP, STAT_TRAP}
+};
+
+void stats_reset()
+{
+	memset(&stats, 0, sizeof(stats));
+	memset(statBranchTaken, 0, sizeof(statBranchTaken));
+	memset(statBranchNotTaken, 0, sizeof(statBranchNotTaken));
+}
+
+int stats_variant(uint16_t instr)
+{
+	uint8_t op = (uint8_t)(instr >> 12);
+	int mode;
+	switch (op)
+	{
+		case OP_ADD:
+		case OP_AND:
+			mode = (instr >> 5) & 0x0001;
+			break;
+		case OP_JSR:
+			mode = (instr >> 11) & 0x0001;
+			break;
+		case OP_JMP:
+			mode = ((instr >> 6) & 0x0007) == R_R7;
+			break;
+		default:
+			mode = 0;
+			break;
+	}
+	return statVariantTable[op][mode];
+}
+
+const char* stats_variant_name(int variant)
+{
+	return statVariantNames[variant];
+}
+
+const char* stats_trap_name(uint8_t vector)
+{
+	return trapTable[vector].name ? trapTable[vector].name : "?";
+}
+
+void stats_block(const uint16_t code[], uint16_t address, int begin, int end, bool complete, uint16_t cond)
+{
+	int length = end - begin;
+	stats.instructions += (uint64_t)length;
+	stats.blockLengths[length < CODE_BLOCK_SIZE ? length : CODE_BLOCK_SIZE]++;
+
+	for (int i = begin; i < end; i++)
+	{
+		uint16_t instr = code[i];
+		stats.variants[stats_variant(instr)]++;
+		if ((instr >> 12) == OP_TRAP)
+		{
+			stats.traps[instr & 0x00FF]++;
+		}
+	}
+
+	// EXPLAIN: BR always ends a block and doesn't touch R_COND, so the flags after the block decide it
+	if (complete && end > 0 && (code[end - 1] >> 12) == OP_BR)
+	{
+		uint16_t instr = code[end - 1];
+		uint16_t site = (uint16_t)(address + end - 1);
+		if (cond & ((instr >> 9) & 0x0007))
+		{
+			stats.branchesTaken++;
+			statBranchTaken[site]++;
+		}
+		else
+		{
+			stats.branchesNotTaken++;
+			statBranchNotTaken[site]++;
+		}
+	}
+}
+
+bool stats_dump_json(const char* path)
+{
+	FILE* fp = fopen(path, "w");
+	if (!fp)
+	{
+		printf("Failed to write stats to %s\n", path);
+		return false;
+	}
+
+	double perThousand = stats.instructions ? 1000.0 / (double)stats.instructions : 0.0;
+
+	fprintf(fp, "{\n");
+	fprintf(fp, "  \"instructions\": %llu,\n", (unsigned long long)stats.instructions);
+	fprintf(fp, "  \"dispatches\": %llu,\n", (unsigned long long)stats.dispatches);
+	fprintf(fp, "  \"block_misses\": %llu,\n", (unsigned long long)stats.blockMisses);
+	fprintf(fp, "  \"dispatches_per_1k\": %.2f,\n", (double)stats.dispatches * perThousand);
+	fprintf(fp, "  \"block_misses_per_1k\": %.2f,\n", (double)stats.blockMisses * perThousand);
+
+	fprintf(fp, "  \"opcodes\": {");
+	for (int i = 0; i < STAT_VARIANT_COUNT; i++)
+	{
+		fprintf(fp, "%s\n    \"%s\": %llu", i ? "," : "", statVariantNames[i], (unsigned long long)stats.variants[i]);
+	}
+	fprintf(fp, "\n  },\n");
+
+	fprintf(fp, "  \"traps\": {");
+	bool first = true;
+	for (int i = 0; i < 256; i++)
+	{
+		if (stats.traps[i] == 0)
+		{
+			continue;
+		}
+		fprintf(fp, "%s\n    \"x%02X\": {\"name\": \"%s\", \"count\": %llu, \"guest\": %s, \"host_ns\": %llu, \"guest_instructions\": %llu}", first ? "" : ",", i,
+			stats_trap_name((uint8_t)i), (unsigned long long)stats.traps[i], trapTable[i].guest ? "true" : "false",
+			(unsigned long long)stats.trapNanoseconds[i], (unsigned long long)stats.trapInstructions[i]);
+		first = false;
+	}
+	fprintf(fp, "\n  },\n");
+
+	fprintf(fp, "  \"branches\": {\n");
+	fprintf(fp, "    \"taken\": %llu,\n", (unsigned long long)stats.branchesTaken);
+	fprintf(fp, "    \"not_taken\": %llu,\n", (unsigned long long)stats.branchesNotTaken);
+	fprintf(fp, "    \"sites\": [");
+	first = true;
+	for (int i = 0; i < MAX_SIZE; i++)
+	{
+		if (statBranchTaken[i] == 0 && statBranchNotTaken[i] == 0)
+		{
+			continue;
+		}
+		fprintf(fp, "%s\n      {\"address\": \"x%04X\", \"taken\": %u, \"not_taken\": %u}", first ? "" : ",", i, statBranchTaken[i], statBranchNotTaken[i]);
+		first = false;
+	}
+	fprintf(fp, "\n    ]\n  },\n");
+
+	fprintf(fp, "  \"block_lengths\": {");
+	first = true;
+	for (int i = 0; i <= CODE_BLOCK_SIZE; i++)
+	{
+		if (stats.blockLengths[i] == 0)
+		{
+			continue;
+		}
+		fprintf(fp, "%s\n    \"%d\": %llu", first ? "" : ",", i, (unsigned long long)stats.blockLengths[i]);
+		first = false;
+	}
+	fprintf(fp, "\n  }\n");
+	fprintf(fp, "}\n");
+
+	fclose(fp);
+	return true;
+}
@@ -0,0 +1,108 @@
+/*
+	Symbol table loaded from the assembler's .sym file
+*/
+
+#include "lc3vmwin_symbols.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+
+static std::unordered_map<uint16_t, std::string> symbolTable;
+
+/* EXPLAIN: Accepts 3040, x3040 and 0x3040, returns false for anything that isn't entirely a hex number */
+static bool symbols_parse_address(const char* text, uint16_t* address)
+{
+	if (text[0] == 'x' || text[0] == 'X')
+	{
+		text++;
+	}
+	else if (text[0] == '0' && (text[1] == 'x' || text[1] == 'X'))
+	{
+		text += 2;
+	}
+
+	char* end = nullptr;
+	unsigned long value = strtoul(text, &end, 16);
+	if (end == text || *end != '\0' || value > 0xFFFF)
+	{
+		return false;
+	}
+	*address = (uint16_t)value;
+	return true;
+}
+
+int symbols_load(const char* path)
+{
+	// EXPLAIN: The labels of the previous image go even if this one has no .sym
+	symbolTable.clear();
+
+	FILE* fp = fopen(path, "r");
+	if (!fp)
+	{
+		return 0;
+	}
+
+	char line[256];
+	while (fgets(line, sizeof(line), fp))
+	{
+		char* p = line;
+		if (p[0] == '/' && p[1] == '/')
+		{
+			p += 2;
+		}
+
+		char name[SYMBOL_NAME_MAX];
+		char addressText[16];
+		uint16_t address;
+		if (sscanf(p, "%31s %15s", name, addressText) == 2 && symbols_parse_address(addressText, &address))
+		{
+			// EXPLAIN: Two labels on the same address, the first one (usually the subroutine name) wins
+			symbolTable.emplace(address, name);
+		}
+	}
+
+	fclose(fp);
+	return (int)symbolTable.size();
+}
+
+void symbols_clear()
+{
+	symbolTable.clear();
+}
+
+const char* symbols_find(uint16_t address)
+{
+	auto it = symbolTable.find(address);
+	if (it == symbolTable.end())
+	{
+		return nullptr;
+	}
+	return it->second.c_str();
+}
+
+bool symbols_lookup(const char* name, uint16_t* address)
+{
+	// EXPLAIN: The table is keyed by address for the disassembly, looking up a name is rare enough to just walk it
+	for (const auto& entry : symbolTable)
+	{
+		if (entry.second == name)
+		{
+			*address = entry.first;
+			return true;
+		}
+	}
+	return false;
+}
+
+const char* symbols_label(uint16_t address, char buffer[])
+{
+	const char* name = symbols_find(address);
+	if (name)
+	{
+		return name;
+	}
+	snprintf(buffer, SYMBOL_NAME_MAX, "x%04X", address);
+	return buffer;
+}
@@ -0,0 +1,349 @@
+/*
+	Execution trace recorder, see lc3vmwin_trace.hpp for the file format
+*/
+
+#include "lc3vmwin_trace.hpp"
+#include "lc3vmwin_core.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+bool traceEnabled = false;
+
+struct traceChunk
+{
+	std::vector<uint8_t> data;
+	size_t used;
+	uint32_t entries;
+	uint64_t firstStep;
+	uint16_t regs[R_COUNT];
+};
+
+static struct traceChunk traceRing[TRACE_RING_CHUNKS];
+static int traceFill = 0;
+
+/* EXPLAIN: Chunks in [traceWritten, traceSealed) belong to the writer thread, traceFill to the interpreter */
+static std::mutex traceMutex;
+static std::condition_variable traceReady;
+static uint64_t traceSealed = 0;
+static uint64_t traceWritten = 0;
+static bool traceStopping = false;
+static std::thread traceWriter;
+static FILE* traceFile = nullptr;
+static uint64_t traceMaxBytes = 0;
+static std::atomic<uint64_t> traceBytes(0);
+static std::atomic<uint64_t> traceDropped(0);
+static std::atomic<bool> traceLimitHit(false);
+
+/* Encoder state, reset for every chunk so that chunks decode on their own */
+static uint64_t traceStep = 0;
+static uint64_t traceStartStep = 0;
+static uint16_t traceExpectedPC = 0;
+static uint16_t tracePrevWrite = 0;
+static uint32_t traceGeneration = 0;
+static uint32_t traceInstrSeen[MAX_SIZE];
+static uint16_t traceInstrLast[MAX_SIZE];
+
+/* The instruction being executed */
+static uint16_t tracePC;
+static uint16_t traceInstr;
+static uint16_t traceRegsBefore[R_COUNT];
+static std::vector<uint16_t> traceWriteAddress;
+static std::vector<uint16_t> traceWriteValue;
+
+static void trace_writer_main()
+{
+	uint8_t header[TRACE_CHUNK_HEADER_BYTES];
+
+	while (true)
+	{
+		int index;
+		{
+			std::unique_lock<std::mutex> lock(traceMutex);
+			traceReady.wait(lock, [] { return traceWritten < traceSealed || traceStopping; });
+			if (traceWritten == traceSealed)
+			{
+				return;
+			}
+			index = (int)(traceWritten % TRACE_RING_CHUNKS);
+		}
+
+		struct traceChunk& chunk = traceRing[index];
+		uint64_t size = TRACE_CHUNK_HEADER_BYTES + chunk.used;
+		if (traceMaxBytes != 0 && traceBytes + size > traceMaxBytes)
+		{
+			traceLimitHit = true;
+			traceDropped++;
+		}
+		else
+		{
+			trace_put_le(header, TRACE_CHUNK_MAGIC, 4);
+			trace_put_le(header + 4, chunk.used, 4);
+			trace_put_le(header + 8, chunk.entries, 4);
+			trace_put_le(header + 12, 0, 4);
+			trace_put_le(header + 16, chunk.firstStep, 8);
+			for (int r = 0; r < R_COUNT; r++)
+			{
+				trace_put_le(header + 24 + 2 * r, chunk.regs[r], 2);
+			}
+			fwrite(header, 1, sizeof(header), traceFile);
+			fwrite(chunk.data.data(), 1, chunk.used, traceFile);
+			traceBytes += size;
+		}
+
+		std::lock_guard<std::mutex> lock(traceMutex);
+		traceWritten++;
+	}
+}
+
+static void trace_chunk_begin()
+{
+	struct traceChunk& chunk = traceRing[traceFill];
+	chunk.used = 0;
+	chunk.entries = 0;
+	chunk.firstStep = traceStep;
+	memcpy(chunk.regs, traceRegsBefore, sizeof(chunk.regs));
+	chunk.regs[R_PC] = tracePC;
+
+	traceExpectedPC = tracePC;
+	tracePrevWrite = 0;
+	traceGeneration++;
+}
+
+/* EXPLAIN: Hand the chunk to the writer, or drop it if the writer is a whole ring behind. Never waits unless wait is set */
+static void trace_chunk_seal(bool wait)
+{
+	std::unique_lock<std::mutex> lock(traceMutex);
+	if (wait)
+	{
+		traceReady.wait(lock, [] { return traceSealed - traceWritten < TRACE_RING_CHUNKS - 1; });
+	}
+	if (traceSealed - traceWritten < TRACE_RING_CHUNKS - 1)
+	{
+		traceSealed++;
+		traceFill = (int)(traceSealed % TRACE_RING_CHUNKS);
+		traceReady.notify_one();
+	}
+	else
+	{
+		traceDropped++;
+	}
+}
+
+static void trace_detach()
+{
+	for (int page = 0; page < PAGE_COUNT; page++)
+	{
+		pageFlags[page] &= (uint8_t)~PAGE_TRACE;
+	}
+	traceEnabled = false;
+	core_hooks_update();
+}
+
+void trace_before(uint16_t instr)
+{
+	// EXPLAIN: cache_run() has already moved the PC past the instruction
+	tracePC = (uint16_t)(reg[R_PC] - 1);
+	traceInstr = instr;
+}
+
+void trace_after()
+{
+	struct traceChunk* chunk = &traceRing[traceFill];
+	size_t writeCount = traceWriteAddress.size();
+	size_t entryBytes = TRACE_ENTRY_BYTES(writeCount);
+	if (chunk->used + entryBytes > TRACE_CHUNK_BYTES && chunk->entries > 0)
+	{
+		trace_chunk_seal(false);
+		// EXPLAIN: The writer gave up on the size limit, everything recorded so far is on disk in one piece
+		if (traceLimitHit)
+		{
+			trace_detach();
+			return;
+		}
+		chunk = &traceRing[traceFill];
+		trace_chunk_begin();
+	}
+	// EXPLAIN: Only a bulk write gets here, the chunk is empty and the next entry seals it. The slot keeps the room
+	if (entryBytes > chunk->data.size())
+	{
+		chunk->data.resize(entryBytes);
+	}
+
+	uint8_t* start = chunk->data.data() + chunk->used;
+	uint8_t* p = start + 1;
+	uint8_t flags = 0;
+
+	if (tracePC != traceExpectedPC)
+	{
+		flags |= TRACE_PC_JUMP;
+		p += trace_put_varint(p, trace_zigzag((uint16_t)(tracePC - traceExpectedPC)));
+	}
+	traceExpectedPC = (uint16_t)(tracePC + 1);
+
+	if (traceInstrSeen[tracePC] != traceGeneration || traceInstrLast[tracePC] != traceInstr)
+	{
+		flags |= TRACE_INSTR;
+		trace_put_le(p, traceInstr, 2);
+		p += 2;
+		traceInstrSeen[tracePC] = traceGeneration;
+		traceInstrLast[tracePC] = traceInstr;
+	}
+
+	uint8_t mask = 0;
+	for (int r = R_R0; r <= R_R7; r++)
+	{
+		if (reg[r] != traceRegsBefore[r])
+		{
+			mask |= (uint8_t)(1 << r);
+		}
+	}
+	if (mask)
+	{
+		flags |= TRACE_REGS;
+		*p++ = mask;
+		for (int r = R_R0; r <= R_R7; r++)
+		{
+			if (mask & (1 << r))
+			{
+				p += trace_put_varint(p, trace_zigzag((uint16_t)(reg[r] - traceRegsBefore[r])));
+			}
+		}
+	}
+
+	if (reg[R_COND] != traceRegsBefore[R_COND])
+	{
+		flags |= TRACE_COND;
+		*p++ = (uint8_t)reg[R_COND];
+	}
+
+	if (writeCount > 0)
+	{
+		flags |= TRACE_WRITES;
+		p += trace_put_varint(p, (uint32_t)writeCount);
+		for (size_t i = 0; i < writeCount; i++)
+		{
+			p += trace_put_varint(p, trace_zigzag((uint16_t)(traceWriteAddress[i] - tracePrevWrite)));
+			p += trace_put_varint(p, traceWriteValue[i]);
+			tracePrevWrite = traceWriteAddress[i];
+		}
+	}
+
+	*start = flags;
+	chunk->used += (size_t)(p - start);
+	chunk->entries++;
+	traceStep++;
+
+	/*
+		EXPLAIN: The next entry is taken against the state right after this instruction, not right before the next one.
+		Whatever happens in between (an interrupt entry pushes and jumps) is then part of the next entry's deltas
+	*/
+	memcpy(traceRegsBefore, reg, sizeof(traceRegsBefore));
+	traceWriteAddress.clear();
+	traceWriteValue.clear();
+}
+
+void trace_on_write(uint16_t address, uint16_t value)
+{
+	traceWriteAddress.push_back(address);
+	traceWriteValue.push_back(value);
+}
+
+bool trace_start(const char* path, uint64_t maxBytes)
+{
+	if (traceEnabled || traceWriter.joinable())
+	{
+		trace_stop();
+	}
+
+	traceFile = fopen(path, "wb");
+	if (!traceFile)
+	{
+		printf("Failed to create trace file %s\n", path);
+		return false;
+	}
+
+	uint8_t header[TRACE_FILE_HEADER_BYTES];
+	memcpy(header, "LC3TRACE", 8);
+	trace_put_le(header + 8, TRACE_VERSION, 4);
+	trace_put_le(header + 12, 0, 4);
+	fwrite(header, 1, sizeof(header), traceFile);
+
+	for (int i = 0; i < TRACE_RING_CHUNKS; i++)
+	{
+		traceRing[i].data.resize(TRACE_CHUNK_BYTES);
+	}
+	traceSealed = 0;
+	traceWritten = 0;
+	traceStopping = false;
+	traceMaxBytes = maxBytes;
+	traceBytes = TRACE_FILE_HEADER_BYTES;
+	traceDropped = 0;
+	traceLimitHit = false;
+	traceFill = 0;
+
+	// EXPLAIN: The first chunk starts at the current state, as if the instruction at PC were about to run
+	traceStep = retiredCount;
+	traceStartStep = traceStep;
+	memcpy(traceRegsBefore, reg, sizeof(traceRegsBefore));
+	traceWriteAddress.clear();
+	traceWriteValue.clear();
+	tracePC = reg[R_PC];
+	trace_chunk_begin();
+
+	traceWriter = std::thread(trace_writer_main);
+
+	for (int page = 0; page < PAGE_COUNT; page++)
+	{
+		pageFlags[page] |= PAGE_TRACE;
+	}
+	traceEnabled = true;
+	core_hooks_update();
+	return true;
+}
+
+void trace_stop()
+{
+	if (traceEnabled)
+	{
+		trace_detach();
+	}
+	if (!traceWriter.joinable())
+	{
+		return;
+	}
+
+	// EXPLAIN: The last chunk is partly filled, it's worth waiting for the writer to make room for it
+	if (traceRing[traceFill].entries > 0 && !traceLimitHit)
+	{
+		trace_chunk_seal(true);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(traceMutex);
+		traceStopping = true;
+	}
+	traceReady.notify_all();
+	traceWriter.join();
+
+	fclose(traceFile);
+	traceFile = nullptr;
+	for (int i = 0; i < TRACE_RING_CHUNKS; i++)
+	{
+		std::vector<uint8_t>().swap(traceRing[i].data);
+	}
+}
+
+void trace_status(struct lc3TraceStatus* status)
+{
+	status->recording = traceEnabled;
+	status->entries = traceStep - traceStartStep;
+	status->bytes = traceBytes;
+	status->droppedChunks = traceDropped;
+	status->sizeLimitHit = traceLimitHit;
+}
@@ -0,0 +1,393 @@
+/*
+	Query index over a trace file, see lc3vmwin_trace_index.hpp for the layout
+*/
+
+#include "lc3vmwin_trace_index.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+#define TRACE_INDEX_MAGIC   "LC3TIDX1"
+#define TRACE_INDEX_HEADER_BYTES    32
+#define TRACE_INDEX_CHUNK_BYTES     (24 + TRACE_INDEX_PAGE_BYTES)
+
+static std::string trace_index_path(const char* tracePath)
+{
+	return std::string(tracePath) + ".idx";
+}
+
+static uint64_t trace_file_size(const char* path)
+{
+	FILE* file = fopen(path, "rb");
+	if (!file)
+	{
+		return 0;
+	}
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fclose(file);
+	return size > 0 ? (uint64_t)size : 0;
+}
+
+static void write_u64(FILE* file, uint64_t value)
+{
+	uint8_t bytes[8];
+	trace_put_le(bytes, value, 8);
+	fwrite(bytes, 1, 8, file);
+}
+
+static void write_u64_array(FILE* file, const uint64_t* values, size_t count)
+{
+	// EXPLAIN: Converted in blocks, one fwrite per value would dominate the build time
+	uint8_t bytes[8 * 1024];
+	for (size_t i = 0; i < count; i += 1024)
+	{
+		size_t n = std::min((size_t)1024, count - i);
+		for (size_t j = 0; j < n; j++)
+		{
+			trace_put_le(bytes + 8 * j, values[i + j], 8);
+		}
+		fwrite(bytes, 1, 8 * n, file);
+	}
+}
+
+static bool read_u64_array(FILE* file, uint64_t* values, size_t count)
+{
+	uint8_t bytes[8 * 1024];
+	for (size_t i = 0; i < count; i += 1024)
+	{
+		size_t n = std::min((size_t)1024, count - i);
+		if (fread(bytes, 1, 8 * n, file) != 8 * n)
+		{
+			return false;
+		}
+		for (size_t j = 0; j < n; j++)
+		{
+			values[i + j] = trace_get_le(bytes + 8 * j, 8);
+		}
+	}
+	return true;
+}
+
+bool trace_index_build(const char* tracePath)
+{
+	struct lc3TraceReader reader;
+	if (!trace_reader_open(&reader, tracePath))
+	{
+		return false;
+	}
+
+	/*
+		EXPLAIN: Pass 1 counts the writes of every address, so the lists can be laid out back to back.
+		It also collects everything else in the index, which is small.
+	*/
+	std::vector<struct lc3TraceIndexChunk> chunks;
+	std::vector<uint64_t> firstExec(MAX_SIZE, TRACE_INDEX_NONE);
+	std::vector<uint64_t> writeCounts(MAX_SIZE, 0);
+	struct lc3TraceEntry entry;
+	while (trace_reader_next(&reader, &entry))
+	{
+		if (chunks.empty() || chunks.back().info.offset != reader.chunk.offset)
+		{
+			struct lc3TraceIndexChunk chunk;
+			chunk.info = reader.chunk;
+			memset(chunk.pages, 0, sizeof(chunk.pages));
+			chunks.push_back(chunk);
+		}
+		int page = entry.pc >> PAGE_SHIFT;
+		chunks.back().pages[page >> 3] |= (uint8_t)(1 << (page & 7));
+		if (firstExec[entry.pc] == TRACE_INDEX_NONE)
+		{
+			firstExec[entry.pc] = entry.step;
+		}
+		for (size_t i = 0; i < entry.writeCount; i++)
+		{
+			writeCounts[entry.writeAddress[i]]++;
+		}
+	}
+	if (reader.error)
+	{
+		trace_reader_close(&reader);
+		return false;
+	}
+
+	std::vector<uint64_t> writeOffsets(MAX_SIZE + 1, 0);
+	for (size_t address = 0; address < MAX_SIZE; address++)
+	{
+		writeOffsets[address + 1] = writeOffsets[address] + writeCounts[address];
+	}
+
+	std::string indexPath = trace_index_path(tracePath);
+	FILE* file = fopen(indexPath.c_str(), "wb");
+	if (!file)
+	{
+		printf("Failed to create index file %s\n", indexPath.c_str());
+		trace_reader_close(&reader);
+		return false;
+	}
+
+	fwrite(TRACE_INDEX_MAGIC, 1, 8, file);
+	write_u64(file, trace_file_size(tracePath));
+	write_u64(file, chunks.size());
+	write_u64(file, writeOffsets[MAX_SIZE]);
+	for (const struct lc3TraceIndexChunk& chunk : chunks)
+	{
+		uint8_t bytes[TRACE_INDEX_CHUNK_BYTES];
+		trace_put_le(bytes, chunk.info.offset, 8);
+		trace_put_le(bytes + 8, chunk.info.firstStep, 8);
+		trace_put_le(bytes + 16, chunk.info.entries, 4);
+		trace_put_le(bytes + 20, chunk.info.bytes, 4);
+		memcpy(bytes + 24, chunk.pages, TRACE_INDEX_PAGE_BYTES);
+		fwrite(bytes, 1, sizeof(bytes), file);
+	}
+	write_u64_array(file, firstExec.data(), firstExec.size());
+	write_u64_array(file, writeOffsets.data(), writeOffsets.size());
+
+	/*
+		EXPLAIN: Pass 2 fills the lists. They can be far bigger than memory on a long trace, so the addresses are
+		cut into ranges holding at most TRACE_INDEX_BUILD_WRITES steps and the trace is decoded once per range.
+		Every range is then written out in one go, in address order, which is exactly the file order.
+	*/
+	size_t begin = 0;
+	while (begin < MAX_SIZE)
+	{
+		size_t end = begin + 1;
+		while (end < MAX_SIZE && writeOffsets[end + 1] - writeOffsets[begin] <= TRACE_INDEX_BUILD_WRITES)
+		{
+			end++;
+		}
+
+		uint64_t base = writeOffsets[begin];
+		std::vector<uint64_t> steps(writeOffsets[end] - base);
+		std::vector<uint64_t> cursor(writeOffsets.begin() + (long)begin, writeOffsets.begin() + (long)end);
+		if (!steps.empty())
+		{
+			trace_reader_seek(&reader, TRACE_FILE_HEADER_BYTES);
+			while (trace_reader_next(&reader, &entry))
+			{
+				for (size_t i = 0; i < entry.writeCount; i++)
+				{
+					size_t address = entry.writeAddress[i];
+					if (address >= begin && address < end)
+					{
+						steps[cursor[address - begin]++ - base] = entry.step;
+					}
+				}
+			}
+			write_u64_array(file, steps.data(), steps.size());
+		}
+		begin = end;
+	}
+
+	bool error = reader.error || ferror(file);
+	fclose(file);
+	trace_reader_close(&reader);
+	if (error)
+	{
+		printf("Failed to write index file %s\n", indexPath.c_str());
+		remove(indexPath.c_str());
+	}
+	return !error;
+}
+
+static bool trace_index_load(struct lc3TraceIndex* index, const char* tracePath)
+{
+	std::string indexPath = trace_index_path(tracePath);
+	index->file = fopen(indexPath.c_str(), "rb");
+	if (!index->file)
+	{
+		return false;
+	}
+
+	uint8_t header[TRACE_INDEX_HEADER_BYTES];
+	if (fread(header, 1, sizeof(header), index->file) != sizeof(header) || memcmp(header, TRACE_INDEX_MAGIC, 8) != 0)
+	{
+		return false;
+	}
+	// EXPLAIN: The trace file only ever grows or gets replaced, its size is enough to tell the index is stale
+	if (trace_get_le(header + 8, 8) != trace_file_size(tracePath))
+	{
+		return false;
+	}
+
+	uint64_t chunkCount = trace_get_le(header + 16, 8);
+	index->chunks.resize(chunkCount);
+	for (struct lc3TraceIndexChunk& chunk : index->chunks)
+	{
+		uint8_t bytes[TRACE_INDEX_CHUNK_BYTES];
+		if (fread(bytes, 1, sizeof(bytes), index->file) != sizeof(bytes))
+		{
+			return false;
+		}
+		chunk.info.offset = trace_get_le(bytes, 8);
+		chunk.info.firstStep = trace_get_le(bytes + 8, 8);
+		chunk.info.entries = (uint32_t)trace_get_le(bytes + 16, 4);
+		chunk.info.bytes = (uint32_t)trace_get_le(bytes + 20, 4);
+		memcpy(chunk.pages, bytes + 24, TRACE_INDEX_PAGE_BYTES);
+	}
+
+	index->firstExec.resize(MAX_SIZE);
+	index->writeOffsets.resize(MAX_SIZE + 1);
+	if (!read_u64_array(index->file, index->firstExec.data(), index->firstExec.size()) ||
+		!read_u64_array(index->file, index->writeOffsets.data(), index->writeOffsets.size()))
+	{
+		return false;
+	}
+	index->writeStepsOffset = (uint64_t)ftell(index->file);
+	return true;
+}
+
+bool trace_index_open(struct lc3TraceIndex* index, const char* tracePath)
+{
+	index->file = nullptr;
+	if (!trace_index_load(index, tracePath))
+	{
+		if (index->file)
+		{
+			fclose(index->file);
+			index->file = nullptr;
+		}
+		if (!trace_index_build(tracePath) || !trace_index_load(index, tracePath))
+		{
+			printf("Failed to index %s\n", tracePath);
+			trace_index_close(index);
+			return false;
+		}
+	}
+
+	if (!trace_reader_open(&index->reader, tracePath))
+	{
+		trace_index_close(index);
+		return false;
+	}
+	return true;
+}
+
+void trace_index_close(struct lc3TraceIndex* index)
+{
+	trace_reader_close(&index->reader);
+	if (index->file)
+	{
+		fclose(index->file);
+		index->file = nullptr;
+	}
+}
+
+/* Decodes a chunk and calls visit() on every entry, stops early when visit() returns false */
+template <typename Visit>
+static void trace_index_decode(struct lc3TraceIndex* index, const struct lc3TraceIndexChunk& chunk, Visit visit)
+{
+	struct lc3TraceEntry entry;
+	if (!trace_reader_seek(&index->reader, chunk.info.offset))
+	{
+		return;
+	}
+	for (uint32_t i = 0; i < chunk.info.entries && trace_reader_next(&index->reader, &entry); i++)
+	{
+		if (!visit(entry))
+		{
+			return;
+		}
+	}
+}
+
+bool trace_index_entry(struct lc3TraceIndex* index, uint64_t step, struct lc3TraceEntry* entry)
+{
+	// EXPLAIN: The last chunk starting at or before step, chunks are in step order
+	auto it = std::upper_bound(
+		index->chunks.begin(), index->chunks.end(), step,
+		[](uint64_t value, const struct lc3TraceIndexChunk& chunk) { return value < chunk.info.firstStep; }
+	);
+	if (it == index->chunks.begin())
+	{
+		return false;
+	}
+	--it;
+	if (step >= it->info.firstStep + it->info.entries)
+	{
+		return false;
+	}
+
+	bool found = false;
+	trace_index_decode(index, *it, [&](const struct lc3TraceEntry& e) {
+		if (e.step == step)
+		{
+			*entry = e;
+			found = true;
+		}
+		return e.step < step;
+	});
+	return found;
+}
+
+bool trace_index_last_write(struct lc3TraceIndex* index, uint16_t address, uint64_t beforeStep, struct lc3TraceEntry* entry)
+{
+	uint64_t begin = index->writeOffsets[address];
+	uint64_t end = index->writeOffsets[address + 1];
+
+	// EXPLAIN: Binary search straight in the file, a list can be millions of steps long and we only need ~20 of them
+	uint64_t found = TRACE_INDEX_NONE;
+	while (begin < end)
+	{
+		uint64_t middle = begin + (end - begin) / 2;
+		uint8_t bytes[8];
+		if (fseek(index->file, (long)(index->writeStepsOffset + 8 * middle), SEEK_SET) != 0 || fread(bytes, 1, 8, index->file) != 8)
+		{
+			return false;
+		}
+		uint64_t step = trace_get_le(bytes, 8);
+		if (step < beforeStep)
+		{
+			found = step;
+			begin = middle + 1;
+		}
+		else
+		{
+			end = middle;
+		}
+	}
+
+	return found != TRACE_INDEX_NONE && trace_index_entry(index, found, entry);
+}
+
+bool trace_index_first_exec(struct lc3TraceIndex* index, uint16_t pc, struct lc3TraceEntry* entry)
+{
+	uint64_t step = index->firstExec[pc];
+	return step != TRACE_INDEX_NONE && trace_index_entry(index, step, entry);
+}
+
+void trace_index_register_values(
+	struct lc3TraceIndex* index, int registerIndex, uint16_t from, uint16_t to, std::vector<struct lc3TraceValue>& values
+)
+{
+	values.clear();
+	std::vector<int> slot(MAX_SIZE, -1);
+
+	for (const struct lc3TraceIndexChunk& chunk : index->chunks)
+	{
+		bool touched = false;
+		for (int page = from >> PAGE_SHIFT; page <= (to >> PAGE_SHIFT) && !touched; page++)
+		{
+			touched = chunk.pages[page >> 3] & (1 << (page & 7));
+		}
+		if (!touched)
+		{
+			continue;
+		}
+
+		trace_index_decode(index, chunk, [&](const struct lc3TraceEntry& e) {
+			if (e.pc >= from && e.pc <= to)
+			{
+				uint16_t value = e.regs[registerIndex];
+				if (slot[value] < 0)
+				{
+					slot[value] = (int)values.size();
+					values.push_back({value, 0, e.step, e.pc});
+				}
+				values[(size_t)slot[value]].count++;
+			}
+			return true;
+		});
+	}
+}
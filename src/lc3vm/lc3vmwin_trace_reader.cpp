@@ -0,0 +1,256 @@
+/*
+	Trace file decoder, the mirror image of the encoder in lc3vmwin_trace.cpp
+*/
+
+#include "lc3vmwin_trace_reader.hpp"
+
+#include <cstring>
+
+bool trace_reader_open(struct lc3TraceReader* reader, const char* path)
+{
+	reader->file = fopen(path, "rb");
+	if (!reader->file)
+	{
+		printf("Failed to open trace file %s\n", path);
+		return false;
+	}
+
+	uint8_t header[TRACE_FILE_HEADER_BYTES];
+	if (fread(header, 1, sizeof(header), reader->file) != sizeof(header) || memcmp(header, "LC3TRACE", 8) != 0)
+	{
+		printf("%s is not a trace file\n", path);
+		fclose(reader->file);
+		reader->file = nullptr;
+		return false;
+	}
+	if (trace_get_le(header + 8, 4) != TRACE_VERSION)
+	{
+		printf("%s is trace version %u, expected %d\n", path, (unsigned)trace_get_le(header + 8, 4), TRACE_VERSION);
+		fclose(reader->file);
+		reader->file = nullptr;
+		return false;
+	}
+
+	reader->chunk = {0, 0, 0, 0};
+	reader->chunkLoaded = false;
+	reader->chunkEntry = 0;
+	reader->position = 0;
+	reader->instrLast.assign(MAX_SIZE, 0);
+	reader->instrSeen.assign(MAX_SIZE, 0);
+	reader->generation = 0;
+	reader->nextStep = 0;
+	reader->stepKnown = false;
+	reader->gaps = 0;
+	reader->missingSteps = 0;
+	reader->error = false;
+	return true;
+}
+
+void trace_reader_close(struct lc3TraceReader* reader)
+{
+	if (reader->file)
+	{
+		fclose(reader->file);
+		reader->file = nullptr;
+	}
+}
+
+/* Reads a chunk header at the current file position, the payload is left in the file */
+static bool trace_reader_chunk_header(struct lc3TraceReader* reader, struct lc3TraceChunkInfo* info, uint16_t regs[])
+{
+	uint8_t header[TRACE_CHUNK_HEADER_BYTES];
+	long offset = ftell(reader->file);
+	size_t count = fread(header, 1, sizeof(header), reader->file);
+	if (count == 0)
+	{
+		return false;
+	}
+	if (count != sizeof(header) || trace_get_le(header, 4) != TRACE_CHUNK_MAGIC)
+	{
+		printf("Corrupt chunk header at offset %ld\n", offset);
+		reader->error = true;
+		return false;
+	}
+
+	info->offset = (uint64_t)offset;
+	info->bytes = (uint32_t)trace_get_le(header + 4, 4);
+	info->entries = (uint32_t)trace_get_le(header + 8, 4);
+	info->firstStep = trace_get_le(header + 16, 8);
+	for (int r = 0; r < R_COUNT; r++)
+	{
+		regs[r] = (uint16_t)trace_get_le(header + 24 + 2 * r, 2);
+	}
+	return true;
+}
+
+static bool trace_reader_load_chunk(struct lc3TraceReader* reader)
+{
+	if (!trace_reader_chunk_header(reader, &reader->chunk, reader->regs))
+	{
+		return false;
+	}
+
+	reader->data.resize(reader->chunk.bytes);
+	if (fread(reader->data.data(), 1, reader->chunk.bytes, reader->file) != reader->chunk.bytes)
+	{
+		printf("Truncated chunk at offset %llu\n", (unsigned long long)reader->chunk.offset);
+		reader->error = true;
+		return false;
+	}
+
+	if (reader->stepKnown && reader->chunk.firstStep != reader->nextStep)
+	{
+		reader->gaps++;
+		reader->missingSteps += reader->chunk.firstStep - reader->nextStep;
+	}
+	reader->nextStep = reader->chunk.firstStep;
+	reader->stepKnown = true;
+
+	reader->chunkLoaded = true;
+	reader->chunkEntry = 0;
+	reader->position = 0;
+	reader->expectedPC = reader->regs[R_PC];
+	reader->prevWrite = 0;
+	reader->generation++;
+	return true;
+}
+
+bool trace_reader_next(struct lc3TraceReader* reader, struct lc3TraceEntry* entry)
+{
+	while (!reader->chunkLoaded || reader->chunkEntry == reader->chunk.entries)
+	{
+		reader->chunkLoaded = false;
+		if (!trace_reader_load_chunk(reader))
+		{
+			return false;
+		}
+	}
+
+	const uint8_t* p = reader->data.data() + reader->position;
+	const uint8_t* end = reader->data.data() + reader->data.size();
+	uint32_t value = 0;
+	size_t n;
+
+	// EXPLAIN: One macro for every bounds check, a corrupt payload must never read past the chunk
+#define TRACE_NEED(count) if ((size_t)(end - p) < (size_t)(count)) { goto corrupt; }
+#define TRACE_VARINT() n = trace_get_varint(p, end, &value); if (n == 0) { goto corrupt; } p += n;
+
+	{
+		TRACE_NEED(1);
+		uint8_t flags = *p++;
+
+		uint16_t pc = reader->expectedPC;
+		if (flags & TRACE_PC_JUMP)
+		{
+			TRACE_VARINT();
+			pc = (uint16_t)(pc + trace_unzigzag(value));
+		}
+		reader->expectedPC = (uint16_t)(pc + 1);
+
+		if (flags & TRACE_INSTR)
+		{
+			TRACE_NEED(2);
+			reader->instrLast[pc] = (uint16_t)trace_get_le(p, 2);
+			reader->instrSeen[pc] = reader->generation;
+			p += 2;
+		}
+		else if (reader->instrSeen[pc] != reader->generation)
+		{
+			goto corrupt;
+		}
+
+		entry->step = reader->nextStep++;
+		entry->pc = pc;
+		entry->instr = reader->instrLast[pc];
+		entry->regMask = 0;
+		if (flags & TRACE_REGS)
+		{
+			TRACE_NEED(1);
+			entry->regMask = *p++;
+			for (int r = R_R0; r <= R_R7; r++)
+			{
+				if (entry->regMask & (1 << r))
+				{
+					TRACE_VARINT();
+					reader->regs[r] = (uint16_t)(reader->regs[r] + trace_unzigzag(value));
+				}
+			}
+		}
+		if (flags & TRACE_COND)
+		{
+			TRACE_NEED(1);
+			reader->regs[R_COND] = *p++;
+		}
+
+		entry->writeCount = 0;
+		if (flags & TRACE_WRITES)
+		{
+			TRACE_VARINT();
+			// EXPLAIN: A write takes at least 2 bytes, a count the chunk can't hold is corrupt, not a huge allocation
+			if (value > (size_t)(end - p) / 2)
+			{
+				goto corrupt;
+			}
+			entry->writeCount = value;
+			entry->writeAddress.resize(value);
+			entry->writeValue.resize(value);
+			for (size_t i = 0; i < entry->writeCount; i++)
+			{
+				TRACE_VARINT();
+				reader->prevWrite = (uint16_t)(reader->prevWrite + trace_unzigzag(value));
+				entry->writeAddress[i] = reader->prevWrite;
+				TRACE_VARINT();
+				entry->writeValue[i] = (uint16_t)value;
+			}
+		}
+
+		// EXPLAIN: The PC after a jump is only known once the next entry is decoded, so R_PC holds this entry's own PC
+		reader->regs[R_PC] = pc;
+		memcpy(entry->regs, reader->regs, sizeof(entry->regs));
+	}
+
+#undef TRACE_NEED
+#undef TRACE_VARINT
+
+	reader->position = (size_t)(p - reader->data.data());
+	reader->chunkEntry++;
+	return true;
+
+corrupt:
+	printf("Corrupt entry %u in chunk at offset %llu\n", reader->chunkEntry, (unsigned long long)reader->chunk.offset);
+	reader->error = true;
+	reader->chunkLoaded = false;
+	return false;
+}
+
+bool trace_reader_skip_chunk(struct lc3TraceReader* reader, struct lc3TraceChunkInfo* info)
+{
+	uint16_t regs[R_COUNT];
+	if (!trace_reader_chunk_header(reader, info, regs))
+	{
+		return false;
+	}
+	if (fseek(reader->file, (long)info->bytes, SEEK_CUR) != 0)
+	{
+		reader->error = true;
+		return false;
+	}
+	reader->chunkLoaded = false;
+	return true;
+}
+
+bool trace_reader_seek(struct lc3TraceReader* reader, uint64_t offset)
+{
+	if (fseek(reader->file, (long)offset, SEEK_SET) != 0)
+	{
+		return false;
+	}
+	reader->chunkLoaded = false;
+	// EXPLAIN: A seek is not a gap, the chunk sets nextStep from its own header
+	reader->stepKnown = false;
+	if (!trace_reader_load_chunk(reader))
+	{
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,142 @@
+/*
+	TRAP dispatch, native or through the trap vector table, see lc3vmwin_trap.hpp
+*/
+
+#include "lc3vmwin_trap.hpp"
+#include "lc3vmwin_core.hpp"
+#include "lc3vmwin_loader.hpp"
+#include "lc3vmwin_machine.hpp"
+#include "lc3vmwin_stats_be.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+struct trapFrame
+{
+	uint8_t vector;
+	uint16_t returnAddress;
+	uint64_t firstStep;             // the routine's first instruction
+};
+
+struct lc3TrapEntry trapTable[TRAP_VECTORS] = {};
+int trapPending = 0;
+
+static struct trapFrame trapStack[TRAP_NESTING];
+
+// EXPLAIN: A function so the built-in handlers are in the table before anything can call trap_register()
+static bool trap_builtin()
+{
+	trapTable[0x20] = {"GETC", &trap_0x20, false};
+	trapTable[0x21] = {"OUT", &trap_0x21_host, false};
+	trapTable[0x22] = {"PUTS", &trap_0x22_host, false};
+	trapTable[0x23] = {"IN", &trap_0x23, false};
+	trapTable[0x24] = {"PUTSP", &trap_0x24_host, false};
+	trapTable[0x25] = {"HALT", &trap_0x25, false};
+	return true;
+}
+
+static bool trapBuiltin = trap_builtin();
+
+bool trap_register(int vector, const char* name, void (*call)())
+{
+	if (vector < 0 || vector >= TRAP_VECTORS)
+	{
+		return false;
+	}
+	trap_set_guest(vector, false);
+	trapTable[vector].name = name;
+	trapTable[vector].call = call;
+	return true;
+}
+
+void trap_set_guest(int vector, bool guest)
+{
+	if (trapTable[vector].guest != guest)
+	{
+		trapTable[vector].guest = guest;
+		// EXPLAIN: Blocks were built with the old mode, a guest TRAP ends its block and a native one doesn't
+		cache_clear();
+	}
+}
+
+int trap_load_os(const char* path)
+{
+	FILE* fp = fopen(path, "rb");
+	if (!fp)
+	{
+		printf("Failed to open OS image %s\n", path);
+		return 0;
+	}
+	std::vector<uint16_t> scratch(MAX_SIZE);
+	uint16_t org = load_memory(scratch.data(), memory, fp);
+	fclose(fp);
+	// EXPLAIN: The loader writes memory[] directly
+	cache_clear();
+	machine_forget_base();
+
+	if (org >= TRAP_VECTORS)
+	{
+		printf("Failed to find a trap vector table in %s, it starts at x%04X\n", path, org);
+		return 0;
+	}
+	int count = 0;
+	for (int vector = org; vector < TRAP_VECTORS; vector++)
+	{
+		if (memory[vector] != 0)
+		{
+			trapTable[vector].guest = true;
+			count++;
+		}
+	}
+	return count;
+}
+
+bool trap_call(uint16_t instr)
+{
+	uint8_t vector = (uint8_t)(instr & 0x00FF);
+	const struct lc3TrapEntry& entry = trapTable[vector];
+	if (entry.guest)
+	{
+		if (statsEnabled && trapPending < TRAP_NESTING)
+		{
+			trapStack[trapPending++] = {vector, reg[R_PC], core_current_step() + 1};
+		}
+		reg[R_PC] = memory[vector];
+		return true;
+	}
+	if (entry.call == nullptr)
+	{
+		return false;
+	}
+	if (!statsEnabled)
+	{
+		entry.call();
+		return true;
+	}
+	auto begin = std::chrono::steady_clock::now();
+	entry.call();
+	stats.trapNanoseconds[vector] += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+	return true;
+}
+
+bool trap_ends_block(uint16_t instr)
+{
+	return (instr >> 12) == OP_TRAP && trapTable[instr & 0x00FF].guest;
+}
+
+void trap_block_end()
+{
+	// EXPLAIN: RET ends a block, so this is the only place a routine can have returned. One that never does (HALT) just stays
+	const struct trapFrame& frame = trapStack[trapPending - 1];
+	if (reg[R_PC] == frame.returnAddress)
+	{
+		stats.trapInstructions[frame.vector] += retiredCount - frame.firstStep;
+		trapPending--;
+	}
+}
+
+void trap_reset()
+{
+	trapPending = 0;
+}
@@ -0,0 +1,109 @@
+/*
+	Watchpoint table and the page flagging that keeps unwatched accesses on the fast path
+*/
+
+#include "lc3vmwin_watch.hpp"
+
+struct lc3Watchpoint watchpoints[WATCHPOINT_MAX];
+int watchpointCount = 0;
+struct lc3WatchHit watchHit = {false, 0, 0, 0, 0, 0};
+
+/*
+	EXPLAIN: Recompute PAGE_WATCH from scratch. Watchpoints are added and removed by hand
+	from the UI so there is no point in keeping per-page reference counts.
+*/
+static void watch_update_pages()
+{
+	for (int page = 0; page < PAGE_COUNT; page++)
+	{
+		pageFlags[page] &= (uint8_t)~PAGE_WATCH;
+	}
+
+	for (int i = 0; i < watchpointCount; i++)
+	{
+		if (!watchpoints[i].enabled)
+		{
+			continue;
+		}
+		for (int page = watchpoints[i].begin >> PAGE_SHIFT; page <= (watchpoints[i].end >> PAGE_SHIFT); page++)
+		{
+			pageFlags[page] |= PAGE_WATCH;
+		}
+	}
+}
+
+int watch_add(uint16_t begin, uint16_t end, uint8_t kind)
+{
+	if (watchpointCount >= WATCHPOINT_MAX)
+	{
+		return -1;
+	}
+
+	if (end < begin)
+	{
+		uint16_t temp = begin;
+		begin = end;
+		end = temp;
+	}
+
+	int index = watchpointCount++;
+	watchpoints[index] = {begin, end, kind, true, 0};
+	watch_update_pages();
+
+	return index;
+}
+
+void watch_remove(int index)
+{
+	if (index < 0 || index >= watchpointCount)
+	{
+		return;
+	}
+
+	for (int i = index; i < watchpointCount - 1; i++)
+	{
+		watchpoints[i] = watchpoints[i + 1];
+	}
+	watchpointCount--;
+	watch_update_pages();
+}
+
+void watch_clear()
+{
+	watchpointCount = 0;
+	watch_update_pages();
+}
+
+/*
+	EXPLAIN: A page can be flagged by a watchpoint that only covers part of it,
+	so we still have to check the exact ranges here.
+*/
+static bool watch_match(uint16_t address, uint8_t kind, uint16_t pc, uint16_t oldValue, uint16_t newValue)
+{
+	for (int i = 0; i < watchpointCount; i++)
+	{
+		struct lc3Watchpoint& w = watchpoints[i];
+		if (w.enabled && (w.kind & kind) && address >= w.begin && address <= w.end)
+		{
+			w.hits++;
+			watchHit = {true, kind, address, pc, oldValue, newValue};
+			return true;
+		}
+	}
+	return false;
+}
+
+bool watch_on_read(uint16_t address, uint16_t value, uint16_t pc)
+{
+	return watch_match(address, WATCH_READ, pc, value, value);
+}
+
+bool watch_on_write(uint16_t address, uint16_t oldValue, uint16_t newValue, uint16_t pc)
+{
+	uint8_t kind = WATCH_WRITE;
+	if (oldValue != newValue)
+	{
+		kind |= WATCH_CHANGE;
+	}
+	return watch_match(address, kind, pc, oldValue, newValue);
+}